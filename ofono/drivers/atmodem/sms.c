@@ -77,6 +77,14 @@ struct sms_data {
 	guint timeout_source;
 	GAtChat *chat;
 	unsigned int vendor;
+	GArray *cmgl_list;
+};
+
+struct cmgl_entry {
+	int index;
+	int pdu_len;
+	int tpdu_len;
+	unsigned char pdu[176];
 };
 
 struct cpms_request {
@@ -654,13 +662,12 @@ static void at_cmgl_notify(GAtResult *result, gpointer user_data)
 	struct ofono_sms *sms = user_data;
 	struct sms_data *data = ofono_sms_get_data(sms);
 	GAtResultIter iter;
+	struct cmgl_entry entry;
 	const char *hexpdu;
-	unsigned char pdu[176] = {0};
 	long pdu_len;
 	int tpdu_len;
 	int index;
 	int status;
-	char buf[16];
 
 	DBG("");
 
@@ -688,16 +695,21 @@ static void at_cmgl_notify(GAtResult *result, gpointer user_data)
 		DBG("Found an old SMS PDU: %s, with len: %d",
 				hexpdu, tpdu_len);
 
-		if (strlen(hexpdu) > sizeof(pdu) * 2)
+		if (strlen(hexpdu) > sizeof(entry.pdu) * 2)
 			continue;
 
-		decode_hex_own_buf(hexpdu, -1, &pdu_len, 0, pdu);
-		ofono_sms_deliver_notify(sms, pdu, pdu_len, tpdu_len);
+		memset(entry.pdu, 0, sizeof(entry.pdu));
+		decode_hex_own_buf(hexpdu, -1, &pdu_len, 0, entry.pdu);
+		entry.index = index;
+		entry.pdu_len = pdu_len;
+		entry.tpdu_len = tpdu_len;
 
-		/* We don't buffer SMS on the SIM/ME, send along a CMGD */
-		snprintf(buf, sizeof(buf), "AT+CMGD=%d", index);
-		g_at_chat_send(data->chat, buf, none_prefix,
-				at_cmgd_cb, NULL, NULL);
+		/* Handed to the core in one go by at_cmgl_flush */
+		if (data->cmgl_list == NULL)
+			data->cmgl_list = g_array_new(FALSE, FALSE,
+						sizeof(struct cmgl_entry));
+
+		g_array_append_val(data->cmgl_list, entry);
 	}
 	return;
 
@@ -705,6 +717,48 @@ err:
 	ofono_error("Unable to parse CMGL response");
 }
 
+static void at_cmgl_flush(struct ofono_sms *sms)
+{
+	struct sms_data *data = ofono_sms_get_data(sms);
+	GArray *list = data->cmgl_list;
+	struct ofono_sms_pdu *pdus;
+	char buf[16];
+	guint i;
+
+	if (list == NULL)
+		return;
+
+	data->cmgl_list = NULL;
+	pdus = g_new(struct ofono_sms_pdu, list->len);
+
+	for (i = 0; i < list->len; i++) {
+		struct cmgl_entry *entry =
+			&g_array_index(list, struct cmgl_entry, i);
+
+		pdus[i].pdu = entry->pdu;
+		pdus[i].len = entry->pdu_len;
+		pdus[i].tpdu_len = entry->tpdu_len;
+	}
+
+	/*
+	 * We don't buffer SMS on the SIM/ME. Once the core has backed
+	 * up whatever it needs, delete the whole listing.
+	 */
+	if (!ofono_sms_deliver_notify_batch(sms, pdus, list->len))
+		goto out;
+
+	for (i = 0; i < list->len; i++) {
+		snprintf(buf, sizeof(buf), "AT+CMGD=%d",
+				g_array_index(list, struct cmgl_entry, i).index);
+		g_at_chat_send(data->chat, buf, none_prefix,
+				at_cmgd_cb, NULL, NULL);
+	}
+
+out:
+	g_free(pdus);
+	g_array_free(list, TRUE);
+}
+
 static void at_cmgl_cb(gboolean ok, GAtResult *result, gpointer user_data)
 {
 	struct ofono_sms *sms = user_data;
@@ -712,6 +766,7 @@ static void at_cmgl_cb(gboolean ok, GAtResult *result, gpointer user_data)
 	if (!ok)
 		DBG("Initial listing SMS storage failed!");
 
+	at_cmgl_flush(sms);
 	at_cmgl_done(sms);
 }
 
@@ -1320,6 +1375,9 @@ static void at_sms_remove(struct ofono_sms *sms)
 
 	g_free(data->cnma_ack_pdu);
 
+	if (data->cmgl_list)
+		g_array_free(data->cmgl_list, TRUE);
+
 	if (data->timeout_source > 0)
 		g_source_remove(data->timeout_source);
 
@@ -43,6 +43,7 @@ static const char *simple_types = "syqut";
 struct mbim_message {
 	int ref_count;
 	uint8_t header[HEADER_SIZE];
+	void *buf;		/* header and body in one block, if built */
 	struct iovec *frags;
 	uint32_t n_frags;
 	uint8_t uuid[16];
@@ -140,6 +141,11 @@ static inline const void *_iter_get_data(struct mbim_message_iter *iter,
 {
 	pos = iter->base_offset + pos;
 
+	if (pos < iter->cur_iov_offset) {
+		iter->cur_iov = 0;
+		iter->cur_iov_offset = 0;
+	}
+
 	while (pos >= iter->cur_iov_offset + iter->iov[iter->cur_iov].iov_len) {
 		iter->cur_iov_offset += iter->iov[iter->cur_iov].iov_len;
 		iter->cur_iov += 1;
@@ -148,16 +154,47 @@ static inline const void *_iter_get_data(struct mbim_message_iter *iter,
 	return iter->iov[iter->cur_iov].iov_base + pos - iter->cur_iov_offset;
 }
 
+/*
+ * Returns a pointer to len bytes at pos.  The data is normally used in
+ * place, it is only gathered into buf if it straddles a fragment boundary
+ */
+static const void *_iter_get_value(struct mbim_message_iter *iter,
+					size_t pos, size_t len, void *buf)
+{
+	const uint8_t *data = _iter_get_data(iter, pos);
+	size_t avail = iter->cur_iov_offset + iter->iov[iter->cur_iov].iov_len -
+						(iter->base_offset + pos);
+	uint8_t *dest = buf;
+	uint32_t i;
+
+	if (avail >= len)
+		return data;
+
+	memcpy(dest, data, avail);
+	dest += avail;
+	len -= avail;
+
+	for (i = iter->cur_iov + 1; len && i < iter->n_iov; i++) {
+		size_t tocopy = len;
+
+		if (tocopy > iter->iov[i].iov_len)
+			tocopy = iter->iov[i].iov_len;
+
+		memcpy(dest, iter->iov[i].iov_base, tocopy);
+		dest += tocopy;
+		len -= tocopy;
+	}
+
+	return buf;
+}
+
 static bool _iter_copy_string(struct mbim_message_iter *iter,
 					uint32_t offset, uint32_t len,
 					char **out)
 {
-	uint8_t buf[len];
-	uint8_t *dest = buf;
-	uint32_t remaining = len;
-	uint32_t iov_start = 0;
-	uint32_t i = 0;
-	uint32_t tocopy;
+	const void *data;
+	uint8_t *buf = NULL;
+	uint32_t i;
 
 	if (!len) {
 		*out = NULL;
@@ -167,33 +204,27 @@ static bool _iter_copy_string(struct mbim_message_iter *iter,
 	if (offset + len > iter->len)
 		return false;
 
-	offset += iter->base_offset;
-
-	while (offset >= iov_start + iter->iov[i].iov_len)
-		iov_start += iter->iov[i++].iov_len;
-
-	tocopy = iter->iov[i].iov_len - (offset - iov_start);
-
-	if (tocopy > remaining)
-		tocopy = remaining;
-
-	memcpy(dest, iter->iov[i].iov_base + offset - iov_start, tocopy);
-	remaining -= tocopy;
-	dest += tocopy;
-	i += 1;
+	/*
+	 * Strings are in UTF16-LE.  On Little-endian CPUs they can be
+	 * converted straight from the message unless split into fragments
+	 */
+	if (L_CPU_TO_LE16(0x8000) == 0x8000) {
+		data = _iter_get_data(iter, offset);
 
-	while (remaining) {
-		tocopy = remaining;
+		if (iter->cur_iov_offset + iter->iov[iter->cur_iov].iov_len >=
+				iter->base_offset + offset + len) {
+			*out = l_utf8_from_utf16(data, len);
+			return true;
+		}
+	}
 
-		if (remaining > iter->iov[i].iov_len)
-			tocopy = iter->iov[i].iov_len;
+	buf = l_malloc(len);
+	data = _iter_get_value(iter, offset, len, buf);
 
-		memcpy(dest, iter->iov[i].iov_base, tocopy);
-		remaining -= tocopy;
-		dest += tocopy;
-	}
+	if (data != buf)
+		memcpy(buf, data, len);
 
-	/* Strings are in UTF16-LE, so convert to UTF16-CPU first if needed */
+	/* Convert to UTF16-CPU first if needed */
 	if (L_CPU_TO_LE16(0x8000) != 0x8000) {
 		uint16_t *le = (uint16_t *) buf;
 
@@ -202,6 +233,7 @@ static bool _iter_copy_string(struct mbim_message_iter *iter,
 	}
 
 	*out = l_utf8_from_utf16(buf, len);
+	l_free(buf);
 	return true;
 }
 
@@ -242,6 +274,7 @@ static bool _iter_next_entry_basic(struct mbim_message_iter *iter,
 	uint32_t uint32_val;
 	uint64_t uint64_val;
 	uint32_t offset, length;
+	uint8_t buf[8];
 	const void *data;
 	size_t pos;
 
@@ -266,7 +299,7 @@ static bool _iter_next_entry_basic(struct mbim_message_iter *iter,
 	case 'q':
 		if (pos + 2 > iter->len)
 			return false;
-		data = _iter_get_data(iter, pos);
+		data = _iter_get_value(iter, pos, 2, buf);
 		uint16_val = l_get_le16(data);
 		*(uint16_t *) out = uint16_val;
 		iter->pos = pos + 2;
@@ -274,7 +307,7 @@ static bool _iter_next_entry_basic(struct mbim_message_iter *iter,
 	case 'u':
 		if (pos + 4 > iter->len)
 			return false;
-		data = _iter_get_data(iter, pos);
+		data = _iter_get_value(iter, pos, 4, buf);
 		uint32_val = l_get_le32(data);
 		*(uint32_t *) out = uint32_val;
 		iter->pos = pos + 4;
@@ -282,7 +315,7 @@ static bool _iter_next_entry_basic(struct mbim_message_iter *iter,
 	case 't':
 		if (pos + 8 > iter->len)
 			return false;
-		data = _iter_get_data(iter, pos);
+		data = _iter_get_value(iter, pos, 8, buf);
 		uint64_val = l_get_le64(data);
 		*(uint64_t *) out = uint64_val;
 		iter->pos = pos + 8;
@@ -295,10 +328,9 @@ static bool _iter_next_entry_basic(struct mbim_message_iter *iter,
 		if (pos + 8 > iter->len)
 			return false;
 
-		data = _iter_get_data(iter, pos);
+		data = _iter_get_value(iter, pos, 8, buf);
 		offset = l_get_le32(data);
-		data = _iter_get_data(iter, pos + 4);
-		length = l_get_le32(data);
+		length = l_get_le32(data + 4);
 
 		if (!_iter_copy_string(iter, offset, length, out))
 			return false;
@@ -641,6 +673,12 @@ void *_mbim_message_to_bytearray(struct mbim_message *message, size_t *out_len)
 
 	hdr = (struct mbim_message_header *) message->header;
 	len = L_LE32_TO_CPU(hdr->len);
+
+	if (message->buf) {
+		binary = l_memdup(_mbim_message_get_buffer(message, NULL), len);
+		goto done;
+	}
+
 	binary = l_malloc(len);
 
 	memcpy(binary, message->header, HEADER_SIZE);
@@ -652,6 +690,7 @@ void *_mbim_message_to_bytearray(struct mbim_message *message, size_t *out_len)
 		pos += message->frags[i].iov_len;
 	}
 
+done:
 	if (out_len)
 		*out_len = len;
 
@@ -692,8 +731,11 @@ void mbim_message_unref(struct mbim_message *msg)
 	if (__sync_sub_and_fetch(&msg->ref_count, 1))
 		return;
 
-	for (i = 0; i < msg->n_frags; i++)
-		l_free(msg->frags[i].iov_base);
+	if (msg->buf)
+		l_free(msg->buf);
+	else
+		for (i = 0; i < msg->n_frags; i++)
+			l_free(msg->frags[i].iov_base);
 
 	l_free(msg->frags);
 	l_free(msg);
@@ -959,8 +1001,14 @@ static inline size_t grow_buf(void **buf, size_t *buf_size, size_t *pos,
 	size_t size = align_len(*pos, alignment);
 
 	if (size + len > *buf_size) {
-		*buf = l_realloc(*buf, size + len);
-		*buf_size = size + len;
+		/* Grow geometrically, messages are built a field at a time */
+		size_t new_size = *buf_size * 2;
+
+		if (new_size < size + len)
+			new_size = size + len;
+
+		*buf = l_realloc(*buf, new_size);
+		*buf_size = new_size;
 	}
 
 	if (size - *pos > 0)
@@ -1019,9 +1067,14 @@ struct mbim_message_builder *mbim_message_builder_new(struct mbim_message *msg)
 	ret = l_new(struct mbim_message_builder, 1);
 	ret->message = mbim_message_ref(msg);
 
-	/* Reserve space in the static buffer for UUID, CID, Status, etc */
+	/*
+	 * Reserve space in the static buffer for the message header as
+	 * well as UUID, CID, Status, etc.  The finalized message is then
+	 * written out straight from this buffer.
+	 */
 	container = &ret->stack[ret->index];
-	container->base_offset = _mbim_information_buffer_offset(type);
+	container->base_offset = HEADER_SIZE +
+					_mbim_information_buffer_offset(type);
 	container->container_type = CONTAINER_TYPE_STRUCT;
 	GROW_SBUF(container, container->base_offset, 0);
 
@@ -1413,6 +1466,9 @@ struct mbim_message *mbim_message_builder_finalize(
 {
 	struct container *root;
 	struct mbim_message_header *hdr;
+	struct mbim_message *message;
+	uint8_t *info;
+	size_t start;
 
 	if (unlikely(!builder))
 		return NULL;
@@ -1420,46 +1476,53 @@ struct mbim_message *mbim_message_builder_finalize(
 	if (builder->index != 0)
 		return NULL;
 
-	hdr = (struct mbim_message_header *) builder->message->header;
+	message = builder->message;
+	hdr = (struct mbim_message_header *) message->header;
 
 	root = &builder->stack[0];
 	GROW_DBUF(root, 0, 4);
 	container_update_offsets(root);
 
-	memcpy(root->sbuf, builder->message->uuid, 16);
-	l_put_le32(builder->message->cid, root->sbuf + 16);
+	/* Place the data buffer right behind the static buffer */
+	if (root->dbuf_pos) {
+		start = GROW_SBUF(root, root->dbuf_pos, 1);
+		memcpy(root->sbuf + start, root->dbuf, root->dbuf_pos);
+	}
+
+	l_free(root->dbuf);
+	root->dbuf = NULL;
+
+	info = root->sbuf + HEADER_SIZE;
+	memcpy(info, message->uuid, 16);
+	l_put_le32(message->cid, info + 16);
 
 	switch (L_LE32_TO_CPU(hdr->type)) {
 	case MBIM_COMMAND_DONE:
-		l_put_le32(builder->message->status, root->sbuf + 20);
+		l_put_le32(message->status, info + 20);
 		break;
 	case MBIM_COMMAND_MSG:
-		l_put_le32(builder->message->command_type, root->sbuf + 20);
+		l_put_le32(message->command_type, info + 20);
 		break;
 	default:
 		break;
 	}
 
-	builder->message->info_buf_len = root->dbuf_pos + root->sbuf_pos -
-						root->base_offset;
-	l_put_le32(builder->message->info_buf_len,
-					root->sbuf + root->base_offset - 4);
+	message->info_buf_len = root->sbuf_pos - root->base_offset;
+	l_put_le32(message->info_buf_len, root->sbuf + root->base_offset - 4);
 
-	builder->message->n_frags = 2;
-	builder->message->frags = l_new(struct iovec, 2);
-	builder->message->frags[0].iov_base = root->sbuf;
-	builder->message->frags[0].iov_len = root->sbuf_pos;
-	builder->message->frags[1].iov_base = root->dbuf;
-	builder->message->frags[1].iov_len = root->dbuf_pos;
+	message->buf = root->sbuf;
+	message->n_frags = 1;
+	message->frags = l_new(struct iovec, 1);
+	message->frags[0].iov_base = root->sbuf + HEADER_SIZE;
+	message->frags[0].iov_len = root->sbuf_pos - HEADER_SIZE;
 
 	root->sbuf = NULL;
-	root->dbuf = NULL;
 
-	hdr->len = L_CPU_TO_LE32(HEADER_SIZE + root->dbuf_pos + root->sbuf_pos);
+	hdr->len = L_CPU_TO_LE32(root->sbuf_pos);
 
-	builder->message->sealed = true;
+	message->sealed = true;
 
-	return builder->message;
+	return message;
 }
 
 static bool append_arguments(struct mbim_message *message,
@@ -1731,8 +1794,24 @@ struct iovec *_mbim_message_get_body(struct mbim_message *message,
 		*out_len = message->info_buf_len;
 
 	if (out_n_iov)
-		*out_n_iov = message->info_buf_len ? message->n_frags :
-							message->n_frags - 1;
+		*out_n_iov = message->n_frags;
 
 	return message->frags;
 }
+
+void *_mbim_message_get_buffer(struct mbim_message *message, size_t *out_len)
+{
+	struct mbim_message_header *hdr =
+				(struct mbim_message_header *) message->header;
+
+	if (!message->buf)
+		return NULL;
+
+	/* The header may have changed since, e.g. the TID */
+	memcpy(message->buf, message->header, HEADER_SIZE);
+
+	if (out_len)
+		*out_len = L_LE32_TO_CPU(hdr->len);
+
+	return message->buf;
+}
@@ -57,3 +57,4 @@ void *_mbim_message_to_bytearray(struct mbim_message *message, size_t *out_len);
 void *_mbim_message_get_header(struct mbim_message *message, size_t *out_len);
 struct iovec *_mbim_message_get_body(struct mbim_message *message,
 					size_t *out_n_iov, size_t *out_len);
+void *_mbim_message_get_buffer(struct mbim_message *message, size_t *out_len);
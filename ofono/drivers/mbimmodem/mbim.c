@@ -185,15 +185,15 @@ static struct mbim_message *message_assembly_add(
 
 	if (unlikely(type != MBIM_COMMAND_DONE &&
 				type != MBIM_INDICATE_STATUS_MSG))
-		return NULL;
+		goto drop;
 
 	node = l_queue_find(assembly->transactions,
 				message_assembly_node_match_tid,
 				L_UINT_TO_PTR(tid));
 
 	if (!node) {
-		if (cur_frag != 0)
-			return NULL;
+		if (cur_frag != 0 || n_frags == 0)
+			goto drop;
 
 		if (n_frags == 1) {
 			struct iovec *iov = l_new(struct iovec, 1);
@@ -201,7 +201,13 @@ static struct mbim_message *message_assembly_add(
 			iov[0].iov_base = frag;
 			iov[0].iov_len = frag_len;
 
-			return _mbim_message_build(header, iov, 1);
+			message = _mbim_message_build(header, iov, 1);
+			if (!message) {
+				l_free(iov);
+				goto drop;
+			}
+
+			return message;
 		}
 
 		node = l_new(struct message_assembly_node, 1);
@@ -219,10 +225,10 @@ static struct mbim_message *message_assembly_add(
 	}
 
 	if (node->n_iov != n_frags)
-		return NULL;
+		goto drop;
 
 	if (node->cur_iov + 1 != cur_frag)
-		return NULL;
+		goto drop;
 
 	node->cur_iov = cur_frag;
 	node->iov[node->cur_iov].iov_base = frag;
@@ -240,6 +246,10 @@ static struct mbim_message *message_assembly_add(
 		l_free(node);
 
 	return message;
+
+drop:
+	l_free(frag);
+	return NULL;
 }
 
 struct mbim_device {
@@ -439,6 +449,62 @@ static int receive_header(struct mbim_device *device, int fd)
 	return true;
 }
 
+/*
+ * Writes out a message built in place.  Fragments are written straight
+ * from the message buffer: the fragment header temporarily overwrites
+ * the tail of the previous fragment, which has already been sent.
+ */
+static bool write_fragments(struct mbim_device *device, int fd,
+						uint8_t *buf, size_t len)
+{
+	const struct mbim_message_header *msg_hdr = (void *) buf;
+	__le32 type = msg_hdr->type;
+	__le32 tid = msg_hdr->tid;
+	size_t frag_size = device->max_segment_size - HEADER_SIZE;
+	size_t body_len = len - HEADER_SIZE;
+	uint32_t n_frags = body_len ? (body_len + frag_size - 1) / frag_size : 1;
+	uint8_t saved[HEADER_SIZE];
+	uint32_t i;
+
+	for (i = 0; i < n_frags; i++) {
+		size_t offset = i * frag_size;
+		size_t frag_len = body_len - offset;
+		uint8_t *frag = buf + offset;
+		struct mbim_message_header *hdr = (void *) frag;
+		struct mbim_fragment_header *frag_hdr = (void *) frag +
+					sizeof(struct mbim_message_header);
+		ssize_t written;
+
+		if (frag_len > frag_size)
+			frag_len = frag_size;
+
+		if (i > 0)
+			memcpy(saved, frag, HEADER_SIZE);
+
+		hdr->type = type;
+		hdr->len = L_CPU_TO_LE32(HEADER_SIZE + frag_len);
+		hdr->tid = tid;
+		frag_hdr->num_frags = L_CPU_TO_LE32(n_frags);
+		frag_hdr->cur_frag = L_CPU_TO_LE32(i);
+
+		written = TEMP_FAILURE_RETRY(write(fd, frag,
+						HEADER_SIZE + frag_len));
+
+		if (written >= 0)
+			l_util_hexdump(false, frag, written,
+					device->debug_handler,
+					device->debug_data);
+
+		if (i > 0)
+			memcpy(frag, saved, HEADER_SIZE);
+
+		if (written < 0)
+			return false;
+	}
+
+	return true;
+}
+
 static bool command_write_handler(struct l_io *io, void *user_data)
 {
 	struct mbim_device *device = user_data;
@@ -449,6 +515,8 @@ static bool command_write_handler(struct l_io *io, void *user_data)
 	size_t info_buf_len;
 	size_t n_iov;
 	struct iovec *body;
+	void *buf;
+	size_t len;
 	int fd;
 	ssize_t written;
 
@@ -463,36 +531,46 @@ static bool command_write_handler(struct l_io *io, void *user_data)
 	message = pending->message;
 	_mbim_message_set_tid(message, pending->tid);
 
+	fd = l_io_get_fd(io);
+
+	/*
+	 * cdc-wdm* doesn't seem to support scatter-gather writes
+	 * properly.  Messages we built are already laid out as a single
+	 * buffer, so write those out without copying.
+	 */
+	buf = _mbim_message_get_buffer(message, &len);
+	if (buf) {
+		if (!write_fragments(device, fd, buf, len))
+			return false;
+
+		goto sent;
+	}
+
 	header = _mbim_message_get_header(message, &header_size);
 	body = _mbim_message_get_body(message, &n_iov, &info_buf_len);
 
-	fd = l_io_get_fd(io);
-
 	if (info_buf_len + header_size < device->max_segment_size) {
-		/*
-		 * cdc-wdm* doesn't seem to support scatter-gather writes
-		 * properly.  So copy into a temporary buffer instead
-		 */
-		uint8_t buf[device->max_segment_size];
+		/* Otherwise copy into a temporary buffer instead */
+		uint8_t tmp[device->max_segment_size];
 		size_t pos;
 		unsigned int i;
 
-		memcpy(buf, header, header_size);
+		memcpy(tmp, header, header_size);
 		pos = header_size;
 
 		for (i = 0; i < n_iov; i++) {
-			memcpy(buf + pos, body[i].iov_base, body[i].iov_len);
+			memcpy(tmp + pos, body[i].iov_base, body[i].iov_len);
 			pos += body[i].iov_len;
 		}
 
-		written = TEMP_FAILURE_RETRY(write(fd, buf, pos));
+		written = TEMP_FAILURE_RETRY(write(fd, tmp, pos));
 
 		l_info("n_iov: %zu, %zu", n_iov + 1, (size_t) written);
 
 		if (written < 0)
 			return false;
 
-		l_util_hexdump(false, buf, written, device->debug_handler,
+		l_util_hexdump(false, tmp, written, device->debug_handler,
 				device->debug_data);
 	} else {
 		/* TODO: Handle fragmented writes */
@@ -500,6 +578,7 @@ static bool command_write_handler(struct l_io *io, void *user_data)
 				"fragment me");
 	}
 
+sent:
 	l_queue_push_tail(device->sent_commands, pending);
 
 	if (l_queue_isempty(device->pending_commands))
@@ -637,6 +716,20 @@ static bool command_read_handler(struct l_io *io, void *user_data)
 	else
 		header_size = sizeof(struct mbim_message_header);
 
+	/*
+	 * Each segment gets a buffer of its own size, which the assembled
+	 * message then keeps using in place
+	 */
+	if (!device->segment) {
+		if (L_LE32_TO_CPU(hdr->len) < header_size ||
+				L_LE32_TO_CPU(hdr->len) >
+						device->max_segment_size)
+			return false;
+
+		device->segment = l_malloc(L_LE32_TO_CPU(hdr->len) -
+								header_size);
+	}
+
 	/* Put the rest of the header into the first chunk */
 	if (device->header_offset < header_size) {
 		iov[n_iov].iov_base = device->header + device->header_offset;
@@ -693,7 +786,7 @@ static bool command_read_handler(struct l_io *io, void *user_data)
 	message = message_assembly_add(device->assembly, device->header,
 					device->segment,
 					L_LE32_TO_CPU(hdr->len) - header_size);
-	device->segment = l_malloc(device->max_segment_size - HEADER_SIZE);
+	device->segment = NULL;
 
 	if (!message)
 		return true;
@@ -907,8 +1000,6 @@ struct mbim_device *mbim_device_new(int fd, uint32_t max_segment_size)
 	device->next_tid = 1;
 	device->next_notification = 1;
 
-	device->segment = l_malloc(max_segment_size - HEADER_SIZE);
-
 	device->io = l_io_new(fd);
 	l_io_set_disconnect_handler(device->io, disconnect_handler,
 								device, NULL);
@@ -551,6 +551,9 @@ static int qmi_sms_probe(struct ofono_sms *sms,
 
 	ofono_sms_set_data(sms, data);
 
+	/* Each raw send is a separate WMS transaction */
+	ofono_sms_set_submit_window(sms, 4);
+
 	qmi_service_create(device, QMI_SERVICE_WMS, create_wms_cb, sms, NULL);
 
 	return 0;
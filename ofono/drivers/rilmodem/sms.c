@@ -485,6 +485,9 @@ static int ril_sms_probe(struct ofono_sms *sms, unsigned int vendor,
 
 	ofono_sms_set_data(sms, data);
 
+	/* RIL queues the requests, several can be in progress at once */
+	ofono_sms_set_submit_window(sms, 4);
+
 	g_idle_add(ril_delayed_register, sms);
 
 	return 0;
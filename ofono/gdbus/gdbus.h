@@ -218,6 +218,15 @@ struct GDBusSecurityTable {
 void g_dbus_set_flags(int flags);
 int g_dbus_get_flags(void);
 
+/*
+ * Called before anything is sent on the connection and before an
+ * interface is unregistered, so that messages held back by the user
+ * can go out first and keep their order.
+ */
+typedef void (* GDBusFlushFunction) (DBusConnection *connection);
+
+void g_dbus_set_flush_function(GDBusFlushFunction function);
+
 gboolean g_dbus_register_interface(DBusConnection *connection,
 					const char *path, const char *name,
 					const GDBusMethodTable *methods,
@@ -303,6 +312,19 @@ void g_dbus_emit_property_changed(DBusConnection *connection,
 gboolean g_dbus_get_properties(DBusConnection *connection, const char *path,
 				const char *interface, DBusMessageIter *iter);
 
+typedef void (* GDBusObjectFunction) (DBusConnection *connection,
+					const char *path, void *user_data);
+typedef void (* GDBusInterfaceFunction) (DBusConnection *connection,
+					const char *path, const char *interface,
+					void *user_data);
+
+void g_dbus_foreach_object(DBusConnection *connection, const char *path,
+			GDBusObjectFunction function, void *user_data);
+void g_dbus_foreach_interface(DBusConnection *connection, const char *path,
+			GDBusInterfaceFunction function, void *user_data);
+DBusMessage *g_dbus_call_method(DBusConnection *connection,
+							DBusMessage *message);
+
 gboolean g_dbus_attach_object_manager(DBusConnection *connection);
 gboolean g_dbus_detach_object_manager(DBusConnection *connection);
 
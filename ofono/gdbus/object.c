@@ -87,6 +87,7 @@ struct property_data {
 static int global_flags = 0;
 static struct generic_data *root;
 static GSList *pending = NULL;
+static GDBusFlushFunction flush_function = NULL;
 
 static gboolean process_changes(gpointer user_data);
 static void process_properties_from_interface(struct generic_data *data,
@@ -1379,6 +1380,10 @@ gboolean g_dbus_unregister_interface(DBusConnection *connection,
 	if (data == NULL)
 		return FALSE;
 
+	/* Whatever is held back for the interface goes out while it exists */
+	if (flush_function != NULL)
+		flush_function(connection);
+
 	if (remove_interface(data, name) == FALSE)
 		return FALSE;
 
@@ -1479,6 +1484,9 @@ static void g_dbus_flush(DBusConnection *connection)
 
 		process_changes(data);
 	}
+
+	if (flush_function != NULL)
+		flush_function(connection);
 }
 
 gboolean g_dbus_send_message(DBusConnection *connection, DBusMessage *message)
@@ -1785,6 +1793,103 @@ gboolean g_dbus_get_properties(DBusConnection *connection, const char *path,
 	return TRUE;
 }
 
+static void foreach_object(struct generic_data *data,
+			GDBusObjectFunction function, void *user_data)
+{
+	GSList *list;
+
+	function(data->conn, data->path, user_data);
+
+	for (list = data->objects; list; list = list->next)
+		foreach_object(list->data, function, user_data);
+}
+
+void g_dbus_foreach_object(DBusConnection *connection, const char *path,
+			GDBusObjectFunction function, void *user_data)
+{
+	struct generic_data *data;
+
+	if (path == NULL || function == NULL)
+		return;
+
+	if (!dbus_connection_get_object_path_data(connection, path,
+					(void **) &data) || data == NULL)
+		return;
+
+	foreach_object(data, function, user_data);
+}
+
+void g_dbus_foreach_interface(DBusConnection *connection, const char *path,
+			GDBusInterfaceFunction function, void *user_data)
+{
+	struct generic_data *data;
+	GSList *list;
+
+	if (path == NULL || function == NULL)
+		return;
+
+	if (!dbus_connection_get_object_path_data(connection, path,
+					(void **) &data) || data == NULL)
+		return;
+
+	for (list = data->interfaces; list; list = list->next) {
+		struct interface_data *iface = list->data;
+
+		function(connection, path, iface->name, user_data);
+	}
+}
+
+/*
+ * Runs a method handler in place and returns its reply. Only methods
+ * which reply right away and don't require any privileges qualify,
+ * NULL is returned for everything else.
+ */
+DBusMessage *g_dbus_call_method(DBusConnection *connection,
+							DBusMessage *message)
+{
+	struct generic_data *data;
+	struct interface_data *iface;
+	const GDBusMethodTable *method;
+	const char *path = dbus_message_get_path(message);
+
+	if (path == NULL)
+		return NULL;
+
+	if (!dbus_connection_get_object_path_data(connection, path,
+					(void **) &data) || data == NULL)
+		return NULL;
+
+	iface = find_interface(data->interfaces,
+					dbus_message_get_interface(message));
+	if (iface == NULL)
+		return NULL;
+
+	for (method = iface->methods; method &&
+			method->name && method->function; method++) {
+
+		if (dbus_message_is_method_call(message, iface->name,
+							method->name) == FALSE)
+			continue;
+
+		if (check_experimental(method->flags,
+					G_DBUS_METHOD_FLAG_EXPERIMENTAL))
+			return NULL;
+
+		if (g_dbus_args_have_signature(method->in_args,
+							message) == FALSE)
+			continue;
+
+		if ((method->flags & G_DBUS_METHOD_FLAG_ASYNC) ||
+							method->privilege)
+			return NULL;
+
+		return method->function(connection, message,
+							iface->user_data);
+	}
+
+	return NULL;
+}
+
 gboolean g_dbus_attach_object_manager(DBusConnection *connection)
 {
 	struct generic_data *data;
@@ -1821,3 +1926,8 @@ int g_dbus_get_flags(void)
 {
 	return global_flags;
 }
+
+void g_dbus_set_flush_function(GDBusFlushFunction function)
+{
+	flush_function = function;
+}
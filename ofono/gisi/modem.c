@@ -44,7 +44,9 @@
 
 struct _GIsiServiceMux {
 	GIsiModem *modem;
-	GSList *pending;
+	GSList *pending;		/* REQ, IND and NTF handlers */
+	GSList *pings;			/* Version queries */
+	GHashTable *resps;		/* Pending RESPs by UTID */
 	GIsiVersion version;
 	uint8_t resource;
 	uint8_t last_utid;
@@ -60,7 +62,10 @@ struct _GIsiModem {
 	unsigned index;
 	uint8_t device;
 	GHashTable *services;
-	gboolean subs_source;
+	guint subs_source;
+	uint32_t subs[256 / 32];	/* Subscribed resources */
+	uint32_t subs_sent[256 / 32];	/* As last reported to the modem */
+	gboolean fake;			/* AF_UNIX instead of PhoNet */
 	int req_fd;
 	int ind_fd;
 	guint req_watch;
@@ -99,6 +104,7 @@ static GIsiServiceMux *service_get(GIsiModem *modem, uint8_t resource)
 	g_hash_table_insert(modem->services, GINT_TO_POINTER(key), mux);
 
 	mux->modem = modem;
+	mux->resps = g_hash_table_new(g_direct_hash, g_direct_equal);
 	mux->resource = resource;
 	mux->version.major = -1;
 	mux->version.minor = -1;
@@ -108,12 +114,94 @@ static GIsiServiceMux *service_get(GIsiModem *modem, uint8_t resource)
 	return mux;
 }
 
-static gint utid_equal(gconstpointer a, gconstpointer b)
+static gboolean service_utid_busy(GIsiServiceMux *mux, uint8_t utid)
 {
-	const GIsiPending *pa = a;
-	const GIsiPending *pb = b;
+	GSList *l;
+
+	if (g_hash_table_lookup(mux->resps, GUINT_TO_POINTER(utid)))
+		return TRUE;
+
+	for (l = mux->pings; l != NULL; l = l->next) {
+		GIsiPending *ping = l->data;
+
+		if (ping->utid == utid)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void pending_unlink(GIsiPending *op)
+{
+	GIsiServiceMux *mux = op->service;
+	gpointer key = GUINT_TO_POINTER(op->utid);
+
+	switch (op->type) {
+	case GISI_MESSAGE_TYPE_RESP:
+		if (g_hash_table_lookup(mux->resps, key) == op)
+			g_hash_table_remove(mux->resps, key);
+		break;
+	case GISI_MESSAGE_TYPE_COMMON:
+		mux->pings = g_slist_remove(mux->pings, op);
+		break;
+	default:
+		mux->pending = g_slist_remove(mux->pending, op);
+		break;
+	}
+}
+
+static ssize_t modem_sendmsg(GIsiModem *modem, int fd,
+				struct sockaddr_pn *dst,
+				const struct iovec *__restrict iov,
+				size_t iovlen)
+{
+	struct iovec _iov[1 + iovlen];
+	struct msghdr msg = {
+		.msg_name = (void *)dst,
+		.msg_namelen = sizeof(struct sockaddr_pn),
+		.msg_iov = (struct iovec *)iov,
+		.msg_iovlen = iovlen,
+		.msg_control = NULL,
+		.msg_controllen = 0,
+		.msg_flags = 0,
+	};
+	ssize_t ret;
+	size_t i;
+
+	if (!modem->fake)
+		return sendmsg(fd, &msg, MSG_NOSIGNAL);
+
+	/*
+	 * The fake backend is a connected AF_UNIX socket, the PhoNet
+	 * address goes in front of the payload.
+	 */
+	_iov[0].iov_base = dst;
+	_iov[0].iov_len = sizeof(struct sockaddr_pn);
+
+	for (i = 0; i < iovlen; i++)
+		_iov[1 + i] = iov[i];
 
-	return pa->utid - pb->utid;
+	msg.msg_name = NULL;
+	msg.msg_namelen = 0;
+	msg.msg_iov = _iov;
+	msg.msg_iovlen = 1 + iovlen;
+
+	ret = sendmsg(fd, &msg, MSG_NOSIGNAL);
+	if (ret < (ssize_t)sizeof(struct sockaddr_pn))
+		return ret;
+
+	return ret - sizeof(struct sockaddr_pn);
+}
+
+static ssize_t modem_sendto(GIsiModem *modem, int fd, struct sockaddr_pn *dst,
+				const void *__restrict buf, size_t len)
+{
+	const struct iovec iov = {
+		.iov_base = (void *)buf,
+		.iov_len = len,
+	};
+
+	return modem_sendmsg(modem, fd, dst, &iov, 1);
 }
 
 static const char *pend_type_to_str(enum GIsiMessageType type)
@@ -154,7 +242,7 @@ static void pending_remove_and_dispatch(GIsiPending *op, GIsiMessage *msg)
 {
 	GIsiModem *modem;
 
-	op->service->pending = g_slist_remove(op->service->pending, op);
+	pending_unlink(op);
 
 	if (op->notify == NULL || msg == NULL)
 		goto destroy;
@@ -184,45 +272,56 @@ static void service_dispatch(GIsiServiceMux *mux, GIsiMessage *msg,
 {
 	uint8_t msgid = g_isi_msg_id(msg);
 	uint8_t utid = g_isi_msg_utid(msg);
+	GIsiPending *pend;
+	GSList *l;
 
-	GSList *l = mux->pending;
+	/*
+	 * RESPs are dispatched on unique transaction ID, explicitly
+	 * ignoring the msgid.  A RESP also completes a transaction,
+	 * so it needs to be removed after being notified of.
+	 */
+	if (!is_indication) {
+		pend = g_hash_table_lookup(mux->resps, GUINT_TO_POINTER(utid));
+		if (pend != NULL) {
+			pending_remove_and_dispatch(pend, msg);
+			return;
+		}
+	}
 
-	while (l != NULL) {
-		GSList *next = l->next;
-		GIsiPending *pend = l->data;
+	/*
+	 * Version query responses are dispatched in a similar fashion
+	 * as RESPs, but based on the pending type and the message ID.
+	 * Some of these may be synthesized, but nevertheless need to
+	 * be removed.
+	 */
+	if (msgid == COMMON_MESSAGE) {
+		l = mux->pings;
 
-		/*
-		 * REQs, NTFs and INDs are dispatched on message ID.  While
-		 * INDs have the unique transaction ID set to zero, NTFs
-		 * typically mirror the UTID of the request that set up the
-		 * session, and REQs can naturally have any transaction ID.
-		 *
-		 * RESPs are dispatched on unique transaction ID, explicitly
-		 * ignoring the msgid.  A RESP also completes a transaction,
-		 * so it needs to be removed after being notified of.
-		 *
-		 * Version query responses are dispatched in a similar fashion
-		 * as RESPs, but based on the pending type and the message ID.
-		 * Some of these may be synthesized, but nevertheless need to
-		 * be removed.
-		 */
-		if (pend->type < GISI_MESSAGE_TYPE_RESP
-				&& pend->msgid == msgid) {
+		while (l != NULL) {
+			GSList *next = l->next;
 
-			pending_dispatch(pend, msg);
+			pend = l->data;
+			if (pend->msgid == COMM_ISI_VERSION_GET_REQ)
+				pending_remove_and_dispatch(pend, msg);
 
-		} else if (pend->type == GISI_MESSAGE_TYPE_RESP &&
-				!is_indication && pend->utid == utid) {
+			l = next;
+		}
+	}
 
-			pending_remove_and_dispatch(pend, msg);
-			break;
+	/*
+	 * REQs, NTFs and INDs are dispatched on message ID.  While
+	 * INDs have the unique transaction ID set to zero, NTFs
+	 * typically mirror the UTID of the request that set up the
+	 * session, and REQs can naturally have any transaction ID.
+	 */
+	l = mux->pending;
 
-		} else if (pend->type == GISI_MESSAGE_TYPE_COMMON &&
-				msgid == COMMON_MESSAGE &&
-				pend->msgid == COMM_ISI_VERSION_GET_REQ) {
+	while (l != NULL) {
+		GSList *next = l->next;
 
-			pending_remove_and_dispatch(pend, msg);
-		}
+		pend = l->data;
+		if (pend->msgid == msgid)
+			pending_dispatch(pend, msg);
 
 		l = next;
 	}
@@ -289,7 +388,8 @@ static gboolean isi_callback(GIOChannel *channel, GIOCondition cond,
 	}
 
 	fd = g_io_channel_unix_get_fd(channel);
-	len = g_isi_phonet_peek_length(channel);
+	len = modem->fake ? g_isi_fake_peek_length(channel) :
+				g_isi_phonet_peek_length(channel);
 
 	if (len > 0) {
 		struct sockaddr_pn addr;
@@ -299,7 +399,11 @@ static gboolean isi_callback(GIOChannel *channel, GIOCondition cond,
 		GIsiMessage msg;
 		unsigned key;
 
-		len = g_isi_phonet_read(channel, buf, len, &addr);
+		if (modem->fake)
+			len = g_isi_fake_read(channel, buf, len, &addr);
+		else
+			len = g_isi_phonet_read(channel, buf, len, &addr);
+
 		if (len < 2)
 			return TRUE;
 
@@ -337,9 +441,6 @@ static gboolean isi_callback(GIOChannel *channel, GIOCondition cond,
 
 static gboolean modem_subs_update(gpointer data)
 {
-	GHashTableIter iter;
-	gpointer keyptr, value;
-
 	GIsiModem *modem = data;
 	gboolean legacy = modem->flags & GISI_MODEM_FLAG_USE_LEGACY_SUBSCRIBE;
 	struct sockaddr_pn commgr = {
@@ -355,23 +456,29 @@ static gboolean modem_subs_update(gpointer data)
 		0,	/* Filler */
 	};
 	uint8_t count = 0;
+	unsigned int i;
 	size_t len;
 
 	modem->subs_source = 0;
 
-	g_hash_table_iter_init(&iter, modem->services);
+	/*
+	 * The subscriptions may have changed back and forth since the
+	 * update was scheduled, in which case there is nothing to send.
+	 */
+	if (!memcmp(modem->subs, modem->subs_sent, sizeof(modem->subs)))
+		return FALSE;
 
-	while (g_hash_table_iter_next(&iter, &keyptr, &value)) {
-		GIsiServiceMux *mux = value;
+	memcpy(modem->subs_sent, modem->subs, sizeof(modem->subs));
 
-		if (mux->subscriptions == 0)
+	for (i = 0; i < 256; i++) {
+		if (!(modem->subs[i / 32] & (1u << (i % 32))))
 			continue;
 
 		if (legacy)
-			msg[3 + count] = mux->resource;
+			msg[3 + count] = i;
 		else
 			/* Resource field is 32bit and Little-endian */
-			msg[4 + count * 4 + 3] = mux->resource;
+			msg[4 + count * 4 + 3] = i;
 
 		count++;
 	}
@@ -379,12 +486,20 @@ static gboolean modem_subs_update(gpointer data)
 	len = legacy ? 3 + count : 4 + count * 4;
 	msg[2] = count;
 
-	sendto(modem->ind_fd, msg, len, MSG_NOSIGNAL, (void *) &commgr,
-		sizeof(commgr));
+	modem_sendto(modem, modem->ind_fd, &commgr, msg, len);
 
 	return FALSE;
 }
 
+static void modem_subs_set(GIsiModem *modem, uint8_t resource,
+				gboolean subscribed)
+{
+	if (subscribed)
+		modem->subs[resource / 32] |= 1u << (resource % 32);
+	else
+		modem->subs[resource / 32] &= ~(1u << (resource % 32));
+}
+
 static void modem_subs_update_when_idle(GIsiModem *modem)
 {
 	if (modem->subs_source > 0)
@@ -408,7 +523,8 @@ static void service_name_register(GIsiServiceMux *mux)
 	};
 	uint16_t object = 0;
 
-	if (ioctl(mux->modem->req_fd, SIOCPNGETOBJECT, &object) < 0) {
+	if (!mux->modem->fake &&
+		ioctl(mux->modem->req_fd, SIOCPNGETOBJECT, &object) < 0) {
 		ISIDBG(mux->modem, "ioctl(SIOCPNGETOBJECT): %s",
 			strerror(errno));
 		return;
@@ -418,8 +534,8 @@ static void service_name_register(GIsiServiceMux *mux)
 	msg[8] = object >> 8;
 	msg[9] = object & 0xFF;
 
-	sendto(mux->modem->req_fd, msg, sizeof(msg), MSG_NOSIGNAL,
-		(void *) &namesrv, sizeof(namesrv));
+	modem_sendto(mux->modem, mux->modem->req_fd, &namesrv, msg,
+			sizeof(msg));
 }
 
 static void service_name_deregister(GIsiServiceMux *mux)
@@ -434,8 +550,8 @@ static void service_name_deregister(GIsiServiceMux *mux)
 		0, 0, 0, mux->resource,
 	};
 
-	sendto(mux->modem->req_fd, msg, sizeof(msg), MSG_NOSIGNAL,
-		(void *) &namesrv, sizeof(namesrv));
+	modem_sendto(mux->modem, mux->modem->req_fd, &namesrv, msg,
+			sizeof(msg));
 }
 
 static void pending_destroy(gpointer value, gpointer user)
@@ -459,17 +575,57 @@ static void service_finalize(gpointer value)
 	GIsiServiceMux *mux = value;
 	GIsiModem *modem = mux->modem;
 
-	if (mux->subscriptions > 0)
+	GHashTableIter iter;
+	gpointer op;
+
+	if (mux->subscriptions > 0) {
+		modem_subs_set(modem, mux->resource, FALSE);
 		modem_subs_update_when_idle(modem);
+	}
 
 	if (mux->registrations > 0)
 		service_name_deregister(mux);
 
 	g_slist_foreach(mux->pending, pending_destroy, NULL);
 	g_slist_free(mux->pending);
+	g_slist_foreach(mux->pings, pending_destroy, NULL);
+	g_slist_free(mux->pings);
+
+	g_hash_table_iter_init(&iter, mux->resps);
+	while (g_hash_table_iter_next(&iter, NULL, &op)) {
+		g_hash_table_iter_steal(&iter);
+		pending_destroy(op, NULL);
+	}
+
+	g_hash_table_destroy(mux->resps);
 	g_free(mux);
 }
 
+static GIsiModem *modem_new(GIOChannel *reqs, GIOChannel *inds)
+{
+	GIsiModem *modem;
+
+	modem = g_try_new0(GIsiModem, 1);
+	if (modem == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	modem->req_fd = g_io_channel_unix_get_fd(reqs);
+	modem->req_watch = g_io_add_watch(reqs,
+					G_IO_IN|G_IO_ERR|G_IO_HUP|G_IO_NVAL,
+					isi_callback, modem);
+	modem->ind_fd = g_io_channel_unix_get_fd(inds);
+	modem->ind_watch = g_io_add_watch(inds,
+					G_IO_IN|G_IO_ERR|G_IO_HUP|G_IO_NVAL,
+					isi_callback, modem);
+
+	modem->services = g_hash_table_new_full(g_direct_hash, NULL,
+						NULL, service_finalize);
+
+	return modem;
+}
+
 GIsiModem *g_isi_modem_create(unsigned index)
 {
 	GIsiModem *modem;
@@ -481,35 +637,51 @@ GIsiModem *g_isi_modem_create(unsigned index)
 		return NULL;
 	}
 
-	modem = g_try_new0(GIsiModem, 1);
-	if (modem == NULL) {
-		errno = ENOMEM;
-		return NULL;
-	}
-
 	inds = g_isi_phonet_new(index);
 	reqs = g_isi_phonet_new(index);
 
 	if (inds == NULL || reqs == NULL) {
-		g_free(modem);
+		if (inds != NULL)
+			g_io_channel_unref(inds);
+
+		if (reqs != NULL)
+			g_io_channel_unref(reqs);
+
 		return NULL;
 	}
 
-	modem->req_fd = g_io_channel_unix_get_fd(reqs);
-	modem->req_watch = g_io_add_watch(reqs,
-					G_IO_IN|G_IO_ERR|G_IO_HUP|G_IO_NVAL,
-					isi_callback, modem);
-	modem->ind_fd = g_io_channel_unix_get_fd(inds);
-	modem->ind_watch = g_io_add_watch(inds,
-					G_IO_IN|G_IO_ERR|G_IO_HUP|G_IO_NVAL,
-					isi_callback, modem);
+	modem = modem_new(reqs, inds);
 
 	g_io_channel_unref(reqs);
 	g_io_channel_unref(inds);
 
-	modem->index = index;
-	modem->services = g_hash_table_new_full(g_direct_hash, NULL,
-						NULL, service_finalize);
+	if (modem != NULL)
+		modem->index = index;
+
+	return modem;
+}
+
+GIsiModem *g_isi_modem_create_fake(int req_fd, int ind_fd)
+{
+	GIsiModem *modem;
+	GIOChannel *inds;
+	GIOChannel *reqs;
+
+	if (req_fd < 0 || ind_fd < 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	reqs = g_isi_fake_new(req_fd);
+	inds = g_isi_fake_new(ind_fd);
+
+	modem = modem_new(reqs, inds);
+
+	g_io_channel_unref(reqs);
+	g_io_channel_unref(inds);
+
+	if (modem != NULL)
+		modem->fake = TRUE;
 
 	return modem;
 }
@@ -591,8 +763,10 @@ static void service_subs_incr(GIsiServiceMux *mux)
 
 	mux->subscriptions++;
 
-	if (mux->subscriptions == 1)
+	if (mux->subscriptions == 1) {
+		modem_subs_set(modem, mux->resource, TRUE);
 		modem_subs_update_when_idle(modem);
+	}
 }
 
 static void service_subs_decr(GIsiServiceMux *mux)
@@ -604,8 +778,10 @@ static void service_subs_decr(GIsiServiceMux *mux)
 
 	mux->subscriptions--;
 
-	if (mux->subscriptions == 0)
+	if (mux->subscriptions == 0) {
+		modem_subs_set(modem, mux->resource, FALSE);
 		modem_subs_update_when_idle(modem);
+	}
 }
 
 static void service_regs_incr(GIsiServiceMux *mux)
@@ -742,15 +918,6 @@ GIsiPending *g_isi_request_vsendto(GIsiModem *modem, struct sockaddr_pn *dst,
 					GDestroyNotify destroy)
 {
 	struct iovec _iov[1 + iovlen];
-	struct msghdr msg = {
-		.msg_name = (void *)dst,
-		.msg_namelen = sizeof(struct sockaddr_pn),
-		.msg_iov = _iov,
-		.msg_iovlen = 1 + iovlen,
-		.msg_control = NULL,
-		.msg_controllen = 0,
-		.msg_flags = 0,
-	};
 	ssize_t ret;
 	size_t i, len;
 
@@ -781,7 +948,7 @@ GIsiPending *g_isi_request_vsendto(GIsiModem *modem, struct sockaddr_pn *dst,
 	resp->destroy = destroy;
 	resp->data = data;
 
-	if (g_slist_find_custom(mux->pending, resp, utid_equal)) {
+	if (service_utid_busy(mux, resp->utid)) {
 		/*
 		 * FIXME: perhaps retry with randomized access after
 		 * initial miss. Although if the rate at which
@@ -805,7 +972,7 @@ GIsiPending *g_isi_request_vsendto(GIsiModem *modem, struct sockaddr_pn *dst,
 	if (modem->trace != NULL)
 		vtrace(dst, _iov, 1 + iovlen, len, modem->trace);
 
-	ret = sendmsg(modem->req_fd, &msg, MSG_NOSIGNAL);
+	ret = modem_sendmsg(modem, modem->req_fd, dst, _iov, 1 + iovlen);
 	if (ret == -1)
 		goto error;
 
@@ -814,7 +981,7 @@ GIsiPending *g_isi_request_vsendto(GIsiModem *modem, struct sockaddr_pn *dst,
 		goto error;
 	}
 
-	mux->pending = g_slist_prepend(mux->pending, resp);
+	g_hash_table_insert(mux->resps, GUINT_TO_POINTER(resp->utid), resp);
 
 	if (timeout > 0)
 		resp->timeout = g_timeout_add_seconds(timeout, resp_timeout,
@@ -853,8 +1020,7 @@ void g_isi_pending_remove(GIsiPending *op)
 		return;
 	}
 
-	op->service->pending = g_slist_remove(op->service->pending, op);
-
+	pending_unlink(op);
 	pending_destroy(op, NULL);
 }
 
@@ -889,6 +1055,8 @@ void g_isi_remove_pending_by_owner(GIsiModem *modem, uint8_t resource,
 					gpointer owner)
 {
 	GIsiServiceMux *mux;
+	GHashTableIter iter;
+	gpointer value;
 	GSList *l;
 	GSList *next;
 	GIsiPending *op;
@@ -911,6 +1079,30 @@ void g_isi_remove_pending_by_owner(GIsiModem *modem, uint8_t resource,
 		owned = l;
 	}
 
+	for (l = mux->pings; l != NULL; l = next) {
+		next = l->next;
+		op = l->data;
+
+		if (op->owner != owner)
+			continue;
+
+		mux->pings = g_slist_remove_link(mux->pings, l);
+
+		l->next = owned;
+		owned = l;
+	}
+
+	g_hash_table_iter_init(&iter, mux->resps);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		op = value;
+
+		if (op->owner != owner)
+			continue;
+
+		g_hash_table_iter_steal(&iter);
+		owned = g_slist_prepend(owned, op);
+	}
+
 	for (l = owned; l != NULL; l = l->next) {
 		op = l->data;
 
@@ -1096,15 +1288,6 @@ int g_isi_modem_vsendto(GIsiModem *modem, struct sockaddr_pn *dst,
 				const struct iovec *__restrict iov,
 				size_t iovlen)
 {
-	struct msghdr msg = {
-		.msg_name = (void *)dst,
-		.msg_namelen = sizeof(struct sockaddr_pn),
-		.msg_iov = (struct iovec *)iov,
-		.msg_iovlen = iovlen,
-		.msg_control = NULL,
-		.msg_controllen = 0,
-		.msg_flags = 0,
-	};
 	ssize_t ret;
 	size_t i, len;
 	GIsiServiceMux *mux;
@@ -1122,7 +1305,7 @@ int g_isi_modem_vsendto(GIsiModem *modem, struct sockaddr_pn *dst,
 	if (modem->trace != NULL)
 		vtrace(dst, iov, iovlen, len, modem->trace);
 
-	ret = sendmsg(modem->req_fd, &msg, MSG_NOSIGNAL);
+	ret = modem_sendmsg(modem, modem->req_fd, dst, iov, iovlen);
 	if (ret == -1)
 		return -errno;
 
@@ -1164,11 +1347,10 @@ static int version_get_send(GIsiModem *modem, GIsiPending *ping)
 	};
 	ssize_t ret;
 
-	if (g_slist_find_custom(mux->pending, ping, utid_equal))
+	if (service_utid_busy(mux, ping->utid))
 		return -EBUSY;
 
-	ret = sendto(modem->req_fd, msg, sizeof(msg), MSG_NOSIGNAL,
-			(void *)&dst, sizeof(dst));
+	ret = modem_sendto(modem, modem->req_fd, &dst, msg, sizeof(msg));
 
 	if (ret == -1)
 		return -errno;
@@ -1246,7 +1428,7 @@ GIsiPending *g_isi_resource_ping(GIsiModem *modem, uint8_t resource,
 
 	ping->timeout = g_timeout_add_seconds(COMMON_TIMEOUT, resp_timeout,
 						ping);
-	mux->pending = g_slist_prepend(mux->pending, ping);
+	mux->pings = g_slist_prepend(mux->pings, ping);
 	mux->version_pending = TRUE;
 
 	ISIDBG(modem, "Ping sent %s (%p) [res=0x%02X]",
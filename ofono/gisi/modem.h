@@ -46,6 +46,15 @@ typedef void (*GIsiDebugFunc)(const char *fmt, ...);
 
 GIsiModem *g_isi_modem_create(unsigned index);
 GIsiModem *g_isi_modem_create_by_name(const char *name);
+
+/*
+ * Creates a modem talking to a fake PhoNet peer over connected AF_UNIX
+ * SOCK_SEQPACKET sockets, e.g. for load testing without the hardware.
+ * Each datagram is prefixed with struct sockaddr_pn, which carries the
+ * destination address on the way out and the source address on the way
+ * in. The modem takes ownership of the file descriptors.
+ */
+GIsiModem *g_isi_modem_create_fake(int req_fd, int ind_fd);
 void g_isi_modem_destroy(GIsiModem *modem);
 
 unsigned g_isi_modem_index(GIsiModem *modem);
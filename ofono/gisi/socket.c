@@ -27,6 +27,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <net/if.h>
 #include <fcntl.h>
@@ -91,3 +92,50 @@ ssize_t g_isi_phonet_read(GIOChannel *channel, void *restrict buf, size_t len,
 
 	return ret;
 }
+
+/*
+ * Fake backend: PhoNet datagrams are carried over a connected AF_UNIX
+ * SOCK_SEQPACKET socket, each one prefixed with the PhoNet address.
+ */
+GIOChannel *g_isi_fake_new(int fd)
+{
+	GIOChannel *channel;
+
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	channel = g_io_channel_unix_new(fd);
+	g_io_channel_set_close_on_unref(channel, TRUE);
+	g_io_channel_set_encoding(channel, NULL, NULL);
+	g_io_channel_set_buffered(channel, FALSE);
+	return channel;
+}
+
+size_t g_isi_fake_peek_length(GIOChannel *channel)
+{
+	size_t len = g_isi_phonet_peek_length(channel);
+
+	if (len < sizeof(struct sockaddr_pn))
+		return 0;
+
+	return len - sizeof(struct sockaddr_pn);
+}
+
+ssize_t g_isi_fake_read(GIOChannel *channel, void *restrict buf, size_t len,
+				struct sockaddr_pn *addr)
+{
+	struct iovec iov[2] = {
+		{ .iov_base = addr, .iov_len = sizeof(struct sockaddr_pn) },
+		{ .iov_base = buf, .iov_len = len },
+	};
+	struct msghdr msg = {
+		.msg_iov = iov,
+		.msg_iovlen = 2,
+	};
+	ssize_t ret;
+
+	ret = recvmsg(g_io_channel_unix_get_fd(channel), &msg, MSG_DONTWAIT);
+	if (ret < (ssize_t)sizeof(struct sockaddr_pn))
+		return -1;
+
+	return ret - sizeof(struct sockaddr_pn);
+}
@@ -23,3 +23,8 @@ GIOChannel *g_isi_phonet_new(unsigned int ifindex);
 size_t g_isi_phonet_peek_length(GIOChannel *io);
 ssize_t g_isi_phonet_read(GIOChannel *io, void *restrict buf, size_t len,
 				struct sockaddr_pn *addr);
+
+GIOChannel *g_isi_fake_new(int fd);
+size_t g_isi_fake_peek_length(GIOChannel *io);
+ssize_t g_isi_fake_read(GIOChannel *io, void *restrict buf, size_t len,
+				struct sockaddr_pn *addr);
@@ -41,8 +41,13 @@
 #include <ofono/log.h>
 #include "ringbuffer.h"
 #include "gril.h"
+#include "grilreader.h"
 #include "grilutil.h"
 
+/* Small request buffers are recycled instead of being freed */
+#define RIL_BUF_POOL_MAX	16
+#define RIL_BUF_POOL_BUF_SIZE	256
+
 #define RIL_TRACE(ril, fmt, arg...) do {	\
 	if (ril->trace == TRUE)			\
 		ofono_debug(fmt, ## arg);	\
@@ -57,6 +62,8 @@ struct ril_request {
 	GRilResponseFunc callback;
 	gpointer user_data;
 	GDestroyNotify notify;
+	GList *link;		/* Node in command_queue or out_queue */
+	gboolean sent;		/* TRUE if link belongs to out_queue */
 };
 
 struct ril_notify_node {
@@ -80,13 +87,14 @@ struct ril_s {
 	guint next_notify_id;			/* Next notify id */
 	guint next_gid;				/* Next group id */
 	GRilIO *io;				/* GRil IO */
-	GQueue *command_queue;			/* Command queue */
+	GQueue *command_queue;			/* Commands not sent yet */
 	GQueue *out_queue;			/* Commands sent/been sent */
+	GHashTable *req_table;			/* Serial -> ril_request */
 	guint req_bytes_written;		/* bytes written from req */
 	GHashTable *notify_list;		/* List of notification reg */
 	GRilDisconnectFunc user_disconnect;	/* user disconnect func */
 	gpointer user_disconnect_data;		/* user disconnect data */
-	guint read_so_far;			/* Number of bytes processed */
+	GRilReader *reader;			/* Parcel assembler */
 	gboolean suspended;			/* Are we suspended? */
 	gboolean debug;
 	gboolean trace;
@@ -98,6 +106,8 @@ struct ril_s {
 	int slot;
 	GRilMsgIdToStrFunc req_to_string;
 	GRilMsgIdToStrFunc unsol_to_string;
+	gchar *buf_pool[RIL_BUF_POOL_MAX];	/* Free request buffers */
+	guint buf_pool_len;
 };
 
 struct _GRil {
@@ -232,6 +242,26 @@ static gboolean ril_unregister_all(struct ril_s *ril,
 	return TRUE;
 }
 
+static gchar *ril_buf_alloc(struct ril_s *ril, guint len)
+{
+	if (len > RIL_BUF_POOL_BUF_SIZE)
+		return g_try_malloc(len);
+
+	if (ril->buf_pool_len > 0)
+		return ril->buf_pool[--ril->buf_pool_len];
+
+	return g_try_malloc(RIL_BUF_POOL_BUF_SIZE);
+}
+
+static void ril_buf_free(struct ril_s *ril, gchar *buf, guint len)
+{
+	if (buf && len <= RIL_BUF_POOL_BUF_SIZE &&
+				ril->buf_pool_len < RIL_BUF_POOL_MAX)
+		ril->buf_pool[ril->buf_pool_len++] = buf;
+	else
+		g_free(buf);
+}
+
 /*
  * This function creates a RIL request.  For a good reference on
  * the layout of RIL requests, responses, and unsolicited requests
@@ -265,7 +295,7 @@ static struct ril_request *ril_request_create(struct ril_s *ril,
 	/* Full request size: header size plus buffer length */
 	r->data_len = data_len + sizeof(header);
 
-	r->data = g_try_new(char, r->data_len);
+	r->data = ril_buf_alloc(ril, r->data_len);
 	if (r->data == NULL) {
 		ofono_error("ril_request: can't allocate new request.");
 		g_free(r);
@@ -293,12 +323,12 @@ static struct ril_request *ril_request_create(struct ril_s *ril,
 	return r;
 }
 
-static void ril_request_destroy(struct ril_request *req)
+static void ril_request_destroy(struct ril_s *ril, struct ril_request *req)
 {
 	if (req->notify)
 		req->notify(req->user_data);
 
-	g_free(req->data);
+	ril_buf_free(ril, req->data, req->data_len);
 	g_free(req);
 }
 
@@ -316,6 +346,11 @@ static void ril_cleanup(struct ril_s *p)
 		p->out_queue = NULL;
 	}
 
+	if (p->req_table) {
+		g_hash_table_destroy(p->req_table);
+		p->req_table = NULL;
+	}
+
 	/* Cleanup registered notifications */
 	if (p->notify_list) {
 		g_hash_table_destroy(p->notify_list);
@@ -326,6 +361,18 @@ static void ril_cleanup(struct ril_s *p)
 		g_source_remove(p->timeout_source);
 		p->timeout_source = 0;
 	}
+
+	/* Drop partially received parcel */
+	g_ril_reader_reset(p->reader);
+}
+
+static void ril_free(struct ril_s *p)
+{
+	while (p->buf_pool_len > 0)
+		g_free(p->buf_pool[--p->buf_pool_len]);
+
+	g_ril_reader_free(p->reader);
+	g_free(p);
 }
 
 void g_ril_set_disconnect_function(GRil *ril, GRilDisconnectFunc disconnect,
@@ -349,62 +396,51 @@ static void io_disconnect(gpointer user_data)
 		ril->user_disconnect(ril->user_disconnect_data);
 }
 
+static void ril_request_unlink(struct ril_s *p, struct ril_request *req)
+{
+	g_hash_table_remove(p->req_table, GINT_TO_POINTER(req->id));
+	g_queue_delete_link(req->sent ? p->out_queue : p->command_queue,
+								req->link);
+	req->link = NULL;
+}
+
 static void handle_response(struct ril_s *p, struct ril_msg *message)
 {
-	guint count = g_queue_get_length(p->command_queue);
 	struct ril_request *req;
-	gboolean found = FALSE;
-	guint i, len;
-	gint id;
-
-	for (i = 0; i < count; i++) {
-		req = g_queue_peek_nth(p->command_queue, i);
-
-		if (req->id == message->serial_no) {
-			found = TRUE;
-			message->req = req->req;
-
-			if (message->error != RIL_E_SUCCESS)
-				RIL_TRACE(p, "[%d,%04d]< %s failed %s",
-					p->slot, message->serial_no,
-					request_id_to_string(p, message->req),
-					ril_error_to_string(message->error));
 
-			req = g_queue_pop_nth(p->command_queue, i);
-			if (req->callback)
-				req->callback(message, req->user_data);
+	req = g_hash_table_lookup(p->req_table,
+				GINT_TO_POINTER(message->serial_no));
 
-			/* gril may have been destroyed in the request callback */
-			if (p->destroyed) {
-				ril_request_destroy(req);
-				return;
-			}
+	if (req == NULL) {
+		ofono_error("No matching request for reply: %s serial_no: %d!",
+			request_id_to_string(p, message->req),
+			message->serial_no);
+		return;
+	}
 
-			len = g_queue_get_length(p->out_queue);
+	message->req = req->req;
 
-			for (i = 0; i < len; i++) {
-				id = GPOINTER_TO_INT(g_queue_peek_nth(
-							p->out_queue, i));
-				if (id == req->id) {
-					g_queue_pop_nth(p->out_queue, i);
-					break;
-				}
-			}
+	if (message->error != RIL_E_SUCCESS)
+		RIL_TRACE(p, "[%d,%04d]< %s failed %s",
+			p->slot, message->serial_no,
+			request_id_to_string(p, message->req),
+			ril_error_to_string(message->error));
 
-			ril_request_destroy(req);
+	ril_request_unlink(p, req);
 
-			if (g_queue_peek_head(p->command_queue))
-				ril_wakeup_writer(p);
+	if (req->callback)
+		req->callback(message, req->user_data);
 
-			break;
-		}
+	/* gril may have been destroyed in the request callback */
+	if (p->destroyed) {
+		ril_request_destroy(p, req);
+		return;
 	}
 
-	if (found == FALSE)
-		ofono_error("No matching request for reply: %s serial_no: %d!",
-			request_id_to_string(p, message->req),
-			message->serial_no);
+	ril_request_destroy(p, req);
 
+	if (g_queue_peek_head(p->command_queue))
+		ril_wakeup_writer(p);
 }
 
 static gboolean node_check_destroyed(struct ril_notify_node *node,
@@ -534,108 +570,76 @@ error:
 	g_free(message);
 }
 
-static struct ril_msg *read_fixed_record(struct ril_s *p,
-						const guchar *bytes, gsize *len)
+static void new_parcel(struct ril_s *p, guchar *buf, gsize len)
 {
 	struct ril_msg *message;
-	unsigned message_len, plen;
-
-	/* First four bytes are length in TCP byte order (Big Endian) */
-	plen = ntohl(*((uint32_t *) (void *) bytes));
-	bytes += 4;
 
 	/*
-	 * TODO: Verify that 8k is the max message size from rild.
-	 *
-	 * This condition shouldn't happen.  If it does
-	 * there are three options:
-	 *
-	 * 1) Exit; ofono will restart via DBus (this is what we do now)
-	 * 2) Consume the bytes & continue
-	 * 3) force a disconnect
+	 * A RIL Unsolicited Event has two UINT32 header fields, a RIL
+	 * Solicited Response has three, see dispatch()
 	 */
-	if (plen > GRIL_BUFFER_SIZE - 4) {
-		ofono_error("ERROR RIL parcel bigger than buffer (%u), exiting",
-				plen);
-		exit(1);
+	if (len < 8 || (len < 12 && *(int32_t *) (void *) buf == 0)) {
+		ofono_error("Invalid RIL parcel of %u bytes, ignoring",
+				(unsigned int) len);
+		g_free(buf);
+		return;
 	}
 
-	/*
-	 * If we don't have the whole fixed record in the ringbuffer
-	 * then return NULL & leave ringbuffer as is.
-	 */
-
-	message_len = *len - 4;
-	if (message_len < plen)
-		return NULL;
-
-	message = g_malloc(sizeof(struct ril_msg));
-
-	/* allocate ril_msg->buffer */
-	message->buf_len = plen;
-	message->buf = g_malloc(plen);
-
-	/* Copy bytes into message buffer */
-	memmove(message->buf, (const void *) bytes, plen);
+	message = g_new0(struct ril_msg, 1);
+	message->buf = (gchar *) buf;
+	message->buf_len = len;
 
-	/* Indicate to caller size of record we extracted */
-	*len = plen + 4;
-	return message;
+	dispatch(p, message);
 }
 
 static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 {
-	struct ril_msg *message;
 	struct ril_s *p = user_data;
-	unsigned int len = ring_buffer_len(rbuf);
-	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
-	guchar *buf = ring_buffer_read_ptr(rbuf, p->read_so_far);
+	GRilReaderStatus status;
+	unsigned int len;
+	gsize consumed;
+	guchar *buf;
+	gsize buf_len;
 
 	p->in_read_handler = TRUE;
 
-	while (p->suspended == FALSE && (p->read_so_far < len)) {
-		gsize rbytes = MIN(len - p->read_so_far, wrap - p->read_so_far);
+	/*
+	 * Parcels are not required to be contiguous in the ring buffer
+	 * (or even fit into it), the reader reassembles them from as
+	 * many chunks as necessary.
+	 */
+	while (p->suspended == FALSE && p->destroyed == FALSE) {
+		len = ring_buffer_len_no_wrap(rbuf);
+		if (len == 0)
+			break;
 
-		if (rbytes < 4) {
-			DBG("Not enough bytes for header length: len: %d", len);
-			return;
-		}
+		status = g_ril_reader_feed(p->reader,
+					ring_buffer_read_ptr(rbuf, 0),
+					len, &consumed);
 
-		/*
-		 * This function attempts to read the next full length
-		 * fixed message from the stream.  if not all bytes are
-		 * available, it returns NULL.  otherwise it allocates
-		 * and returns a ril_message with the copied bytes, and
-		 * drains those bytes from the ring_buffer
-		 */
-		message = read_fixed_record(p, buf, &rbytes);
+		ring_buffer_drain(rbuf, consumed);
 
-		/* wait for the rest of the record... */
-		if (message == NULL)
+		switch (status) {
+		case G_RIL_READER_PARCEL:
+			buf = g_ril_reader_steal_parcel(p->reader, &buf_len);
+			new_parcel(p, buf, buf_len);
+			break;
+		case G_RIL_READER_DROPPED:
+			ofono_error("RIL parcel of %u bytes exceeds %u, dropped",
+				(unsigned int)
+				g_ril_reader_dropped_size(p->reader),
+				(unsigned int)
+				g_ril_reader_get_max_size(p->reader));
+			break;
+		case G_RIL_READER_NEED_MORE:
 			break;
-
-		buf += rbytes;
-		p->read_so_far += rbytes;
-
-		/* TODO: need to better understand how wrap works! */
-		if (p->read_so_far == wrap) {
-			buf = ring_buffer_read_ptr(rbuf, p->read_so_far);
-			wrap = len;
 		}
-
-		dispatch(p, message);
-
-		ring_buffer_drain(rbuf, p->read_so_far);
-
-		len -= p->read_so_far;
-		wrap -= p->read_so_far;
-		p->read_so_far = 0;
 	}
 
 	p->in_read_handler = FALSE;
 
 	if (p->destroyed)
-		g_free(p);
+		ril_free(p);
 }
 
 /*
@@ -648,67 +652,23 @@ static gboolean can_write_data(gpointer data)
 	struct ril_s *ril = data;
 	struct ril_request *req;
 	gsize bytes_written, towrite, len;
-	guint qlen, oqlen;
-	gint id;
-	gboolean written = TRUE;
-	guint i, j;
 
-	qlen = g_queue_get_length(ril->command_queue);
-	if (qlen < 1)
-		return FALSE;
-
-	/* if the whole request was not written */
 	if (ril->req_bytes_written != 0) {
-
-		for (i = 0; i < qlen; i++) {
-			req = g_queue_peek_nth(ril->command_queue, i);
-			if (req) {
-				id = GPOINTER_TO_INT(g_queue_peek_head(
-							ril->out_queue));
-				if (req->id == id)
-					goto out;
-			} else {
-				return FALSE;
-			}
-		}
-	}
-	/* if no requests already sent */
-	oqlen = g_queue_get_length(ril->out_queue);
-	if (oqlen < 1) {
-		req = g_queue_peek_head(ril->command_queue);
+		/* The whole request was not written, it's the last one sent */
+		req = g_queue_peek_head(ril->out_queue);
 		if (req == NULL)
 			return FALSE;
 
-		g_queue_push_head(ril->out_queue, GINT_TO_POINTER(req->id));
-
 		goto out;
 	}
 
-	for (i = 0; i < qlen; i++) {
-		req = g_queue_peek_nth(ril->command_queue, i);
-		if (req == NULL)
-			return FALSE;
-
-		for (j = 0; j < oqlen; j++) {
-			id = GPOINTER_TO_INT(
-					g_queue_peek_nth(ril->out_queue, j));
-			if (req->id == id) {
-				written = TRUE;
-				break;
-			} else {
-				written = FALSE;
-			}
-		}
-
-		if (written == FALSE)
-			break;
-	}
-
-	/* watcher fired though requests already written */
-	if (written == TRUE)
+	req = g_queue_pop_head(ril->command_queue);
+	if (req == NULL)
 		return FALSE;
 
-	g_queue_push_head(ril->out_queue, GINT_TO_POINTER(req->id));
+	g_queue_push_head(ril->out_queue, req);
+	req->link = g_queue_peek_head_link(ril->out_queue);
+	req->sent = TRUE;
 
 out:
 	len = req->data_len;
@@ -780,7 +740,7 @@ static void ril_unref(struct ril_s *ril)
 	if (ril->in_read_handler)
 		ril->destroyed = TRUE;
 	else
-		g_free(ril);
+		ril_free(ril);
 }
 
 static gboolean node_compare_by_group(struct ril_notify_node *node,
@@ -814,6 +774,7 @@ static struct ril_s *create_ril(const char *sock_path, unsigned int uid,
 	ril->next_gid = 0;
 	ril->req_bytes_written = 0;
 	ril->trace = FALSE;
+	ril->reader = g_ril_reader_new(GRIL_MAX_PARCEL_SIZE);
 
 	/* sock_path is allowed to be NULL for unit tests */
 	if (sock_path == NULL)
@@ -888,6 +849,8 @@ static struct ril_s *create_ril(const char *sock_path, unsigned int uid,
 		goto error;
 	}
 
+	ril->req_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+
 	ril->notify_list = g_hash_table_new_full(g_int_hash, g_int_equal,
 							g_free,
 							ril_notify_destroy);
@@ -925,39 +888,30 @@ static struct ril_notify *ril_notify_create(struct ril_s *ril,
 
 static void ril_cancel_group(struct ril_s *ril, guint group)
 {
-	int n = 0;
-	guint len, i;
+	GList *l, *next;
 	struct ril_request *req;
-	gboolean sent;
 
 	if (ril->command_queue == NULL)
 		return;
 
-	while ((req = g_queue_peek_nth(ril->command_queue, n)) != NULL) {
-		if (req->id == 0 || req->gid != group) {
-			n += 1;
-			continue;
-		}
+	/* Requests already sent stay around until the response arrives */
+	for (l = ril->out_queue->head; l; l = l->next) {
+		req = l->data;
 
-		req->callback = NULL;
-		sent = FALSE;
-
-		len = g_queue_get_length(ril->out_queue);
-		for (i = 0; i < len; i++) {
-			if (GPOINTER_TO_INT(
-					g_queue_peek_nth(ril->out_queue, i))
-					== req->id) {
-				n += 1;
-				sent = TRUE;
-				break;
-			}
-		 }
+		if (req->gid == group)
+			req->callback = NULL;
+	}
+
+	for (l = ril->command_queue->head; l; l = next) {
+		next = l->next;
+		req = l->data;
 
-		if (sent)
+		if (req->id == 0 || req->gid != group)
 			continue;
 
-		g_queue_remove(ril->command_queue, req);
-		ril_request_destroy(req);
+		req->callback = NULL;
+		ril_request_unlink(ril, req);
+		ril_request_destroy(ril, req);
 	}
 }
 
@@ -1151,6 +1105,8 @@ gint g_ril_send(GRil *ril, const gint reqid, struct parcel *rilp,
 	p->next_cmd_id++;
 
 	g_queue_push_tail(p->command_queue, r);
+	r->link = g_queue_peek_tail_link(p->command_queue);
+	g_hash_table_insert(p->req_table, GINT_TO_POINTER(r->id), r);
 
 	ril_wakeup_writer(p);
 
@@ -1269,6 +1225,15 @@ gboolean g_ril_unregister_all(GRil *ril)
 					GUINT_TO_POINTER(ril->group));
 }
 
+gboolean g_ril_set_max_parcel_size(GRil *ril, gsize max_size)
+{
+	if (ril == NULL || ril->parent == NULL)
+		return FALSE;
+
+	g_ril_reader_set_max_size(ril->parent->reader, max_size);
+	return TRUE;
+}
+
 enum ofono_ril_vendor g_ril_vendor(GRil *ril)
 {
 	if (ril == NULL)
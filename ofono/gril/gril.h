@@ -28,6 +28,7 @@ extern "C" {
 #endif
 
 #include "grilio.h"
+#include "grilreader.h"
 #include "grilutil.h"
 #include "parcel.h"
 #include "ril_constants.h"
@@ -142,6 +143,13 @@ gboolean g_ril_set_vendor_print_msg_id_funcs(GRil *ril,
 					GRilMsgIdToStrFunc req_to_string,
 					GRilMsgIdToStrFunc unsol_to_string);
 
+/*!
+ * Sets the maximum size of a parcel accepted from rild, the default is
+ * GRIL_MAX_PARCEL_SIZE.  Larger parcels are drained from the socket and
+ * dropped, the connection stays up.
+ */
+gboolean g_ril_set_max_parcel_size(GRil *ril, gsize max_size);
+
 
 /*!
  * Queue an RIL request for execution.  The request contents are given
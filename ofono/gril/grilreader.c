@@ -0,0 +1,228 @@
+/*
+ *
+ *  RIL library with GLib integration
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "grilreader.h"
+
+/* The length header is 4 bytes in TCP byte order (Big Endian) */
+#define RIL_PARCEL_HEADER_SIZE 4
+
+struct _GRilReader {
+	guchar header[RIL_PARCEL_HEADER_SIZE];	/* Length header */
+	gsize header_len;			/* Header bytes received */
+	gsize parcel_len;			/* Current parcel length */
+	gsize received;				/* Payload bytes received */
+	guchar *parcel;				/* Payload being assembled */
+	gboolean skipping;			/* Draining oversized parcel */
+	guchar *complete;			/* Last complete parcel */
+	gsize complete_len;			/* and its length */
+	gsize dropped;				/* Size of last dropped parcel */
+	gsize max_size;				/* Max accepted parcel size */
+};
+
+GRilReader *g_ril_reader_new(gsize max_size)
+{
+	GRilReader *reader = g_new0(GRilReader, 1);
+
+	reader->max_size = max_size;
+
+	return reader;
+}
+
+void g_ril_reader_reset(GRilReader *reader)
+{
+	if (reader == NULL)
+		return;
+
+	g_free(reader->parcel);
+	reader->parcel = NULL;
+
+	g_free(reader->complete);
+	reader->complete = NULL;
+	reader->complete_len = 0;
+
+	reader->header_len = 0;
+	reader->parcel_len = 0;
+	reader->received = 0;
+	reader->skipping = FALSE;
+	reader->dropped = 0;
+}
+
+void g_ril_reader_free(GRilReader *reader)
+{
+	if (reader == NULL)
+		return;
+
+	g_ril_reader_reset(reader);
+	g_free(reader);
+}
+
+void g_ril_reader_set_max_size(GRilReader *reader, gsize max_size)
+{
+	if (reader == NULL)
+		return;
+
+	/* Takes effect starting with the next parcel */
+	reader->max_size = max_size;
+}
+
+gsize g_ril_reader_get_max_size(GRilReader *reader)
+{
+	if (reader == NULL)
+		return 0;
+
+	return reader->max_size;
+}
+
+static void reader_start_parcel(GRilReader *reader)
+{
+	const guchar *h = reader->header;
+
+	reader->parcel_len = ((gsize) h[0] << 24) | ((gsize) h[1] << 16) |
+				((gsize) h[2] << 8) | h[3];
+	reader->received = 0;
+	reader->parcel = NULL;
+	reader->skipping = FALSE;
+
+	if (reader->parcel_len > reader->max_size) {
+		reader->skipping = TRUE;
+		return;
+	}
+
+	if (reader->parcel_len == 0)
+		return;
+
+	reader->parcel = g_try_malloc(reader->parcel_len);
+
+	/* Treat allocation failure the same way as an oversized parcel */
+	if (reader->parcel == NULL)
+		reader->skipping = TRUE;
+}
+
+static GRilReaderStatus reader_finish_parcel(GRilReader *reader)
+{
+	GRilReaderStatus status;
+
+	if (reader->skipping) {
+		reader->dropped = reader->parcel_len;
+		status = G_RIL_READER_DROPPED;
+	} else {
+		g_free(reader->complete);
+		reader->complete = reader->parcel;
+		reader->complete_len = reader->parcel_len;
+		status = G_RIL_READER_PARCEL;
+	}
+
+	reader->parcel = NULL;
+	reader->skipping = FALSE;
+	reader->header_len = 0;
+	reader->parcel_len = 0;
+	reader->received = 0;
+
+	return status;
+}
+
+GRilReaderStatus g_ril_reader_feed(GRilReader *reader, const guchar *data,
+					gsize len, gsize *consumed)
+{
+	GRilReaderStatus status = G_RIL_READER_NEED_MORE;
+	gsize used = 0;
+	gsize n;
+
+	if (reader == NULL)
+		goto out;
+
+	while (status == G_RIL_READER_NEED_MORE) {
+		if (reader->header_len < RIL_PARCEL_HEADER_SIZE) {
+			if (used == len)
+				break;
+
+			n = MIN(RIL_PARCEL_HEADER_SIZE - reader->header_len,
+					len - used);
+			memcpy(reader->header + reader->header_len,
+					data + used, n);
+			reader->header_len += n;
+			used += n;
+
+			if (reader->header_len < RIL_PARCEL_HEADER_SIZE)
+				break;
+
+			reader_start_parcel(reader);
+		}
+
+		n = MIN(reader->parcel_len - reader->received, len - used);
+
+		if (n > 0 && !reader->skipping)
+			memcpy(reader->parcel + reader->received,
+					data + used, n);
+
+		reader->received += n;
+		used += n;
+
+		if (reader->received < reader->parcel_len)
+			break;
+
+		status = reader_finish_parcel(reader);
+	}
+
+out:
+	if (consumed)
+		*consumed = used;
+
+	return status;
+}
+
+guchar *g_ril_reader_steal_parcel(GRilReader *reader, gsize *len)
+{
+	guchar *parcel;
+
+	if (reader == NULL) {
+		if (len)
+			*len = 0;
+
+		return NULL;
+	}
+
+	parcel = reader->complete;
+
+	if (len)
+		*len = reader->complete_len;
+
+	reader->complete = NULL;
+	reader->complete_len = 0;
+
+	return parcel;
+}
+
+gsize g_ril_reader_dropped_size(GRilReader *reader)
+{
+	if (reader == NULL)
+		return 0;
+
+	return reader->dropped;
+}
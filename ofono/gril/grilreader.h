@@ -0,0 +1,82 @@
+/*
+ *
+ *  RIL library with GLib integration
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __GRILREADER_H
+#define __GRILREADER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+
+/* Default upper limit for the size of a single parcel received from rild */
+#define GRIL_MAX_PARCEL_SIZE (1024 * 1024)
+
+struct _GRilReader;
+
+typedef struct _GRilReader GRilReader;
+
+typedef enum {
+	G_RIL_READER_NEED_MORE,		/* Parcel is incomplete */
+	G_RIL_READER_PARCEL,		/* Complete parcel is available */
+	G_RIL_READER_DROPPED		/* Oversized parcel has been drained */
+} GRilReaderStatus;
+
+GRilReader *g_ril_reader_new(gsize max_size);
+void g_ril_reader_free(GRilReader *reader);
+void g_ril_reader_reset(GRilReader *reader);
+
+void g_ril_reader_set_max_size(GRilReader *reader, gsize max_size);
+gsize g_ril_reader_get_max_size(GRilReader *reader);
+
+/*!
+ * Feeds len bytes of the rild stream into the reader.  The data may be
+ * split at an arbitrary offset, including the middle of the length
+ * header.  Consumption stops right after the end of a parcel, so that
+ * the caller can process it before feeding the rest of the data.  The
+ * number of bytes actually consumed is returned in consumed.
+ *
+ * If G_RIL_READER_PARCEL is returned, the parcel payload (without the
+ * length header) can be taken with g_ril_reader_steal_parcel.
+ *
+ * Parcels exceeding the maximum size are not buffered, their payload is
+ * silently consumed and G_RIL_READER_DROPPED is returned once the last
+ * byte has been drained.  The size of such a parcel can be queried with
+ * g_ril_reader_dropped_size.
+ */
+GRilReaderStatus g_ril_reader_feed(GRilReader *reader, const guchar *data,
+					gsize len, gsize *consumed);
+
+/*!
+ * Returns the last complete parcel and passes its ownership to the
+ * caller, who must release it with g_free.  The returned pointer is NULL
+ * for empty parcels.
+ */
+guchar *g_ril_reader_steal_parcel(GRilReader *reader, gsize *len);
+
+gsize g_ril_reader_dropped_size(GRilReader *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __GRILREADER_H */
@@ -46,6 +46,13 @@
 
 typedef uint16_t char16_t;
 
+/* Extracts n-th UTF-16 code unit from a 64-bit word (host byte order) */
+#if BYTE_ORDER == BIG_ENDIAN
+#define UTF16_LANE(w, n) ((char) ((w) >> (16 * (3 - (n)))))
+#else
+#define UTF16_LANE(w, n) ((char) ((w) >> (16 * (n))))
+#endif
+
 void parcel_init(struct parcel *p)
 {
 	p->data = g_malloc0(sizeof(int32_t));
@@ -55,11 +62,16 @@ void parcel_init(struct parcel *p)
 	p->malformed = 0;
 }
 
+/*
+ * Grows the capacity geometrically, so that building a parcel out of
+ * many small fields doesn't reallocate the buffer for each of them.
+ */
 void parcel_grow(struct parcel *p, size_t size)
 {
-	char *new = g_realloc(p->data, p->capacity + size);
-	p->data = new;
-	p->capacity += size;
+	size_t capacity = MAX(p->capacity * 2, p->capacity + size);
+
+	p->data = g_realloc(p->data, capacity);
+	p->capacity = capacity;
 }
 
 void parcel_free(struct parcel *p)
@@ -106,6 +118,72 @@ int parcel_w_int32(struct parcel *p, int32_t val)
 	return 0;
 }
 
+/*
+ * Converts UTF-16 string to 8-bit characters if all of its code units
+ * are ASCII.  Four code units are checked (and converted) at a time.
+ * Returns FALSE at the first non-ASCII character, in which case the
+ * contents of the output buffer is undefined.
+ */
+static gboolean parcel_utf16_to_ascii(const char *in, size_t len16, char *out)
+{
+	const uint64_t mask = 0xff80ff80ff80ff80ULL;
+	size_t i = 0;
+
+	for (; i + 4 <= len16; i += 4) {
+		uint64_t w;
+
+		memcpy(&w, in + i * sizeof(char16_t), sizeof(w));
+		if (w & mask)
+			return FALSE;
+
+		out[i] = UTF16_LANE(w, 0);
+		out[i + 1] = UTF16_LANE(w, 1);
+		out[i + 2] = UTF16_LANE(w, 2);
+		out[i + 3] = UTF16_LANE(w, 3);
+	}
+
+	for (; i < len16; i++) {
+		char16_t c;
+
+		memcpy(&c, in + i * sizeof(char16_t), sizeof(c));
+		if (c & 0xff80)
+			return FALSE;
+
+		out[i] = (char) c;
+	}
+
+	out[len16] = 0;
+	return TRUE;
+}
+
+/*
+ * Same as above in the opposite direction, returns the number of bytes
+ * in the string or -1 if the string is not pure ASCII.
+ */
+static glong parcel_ascii_to_utf16(const char *str, gunichar2 **utf16)
+{
+	const unsigned char *in = (const unsigned char *) str;
+	gunichar2 *out;
+	size_t len = 0;
+	size_t i;
+
+	while (in[len]) {
+		if (in[len] & 0x80)
+			return -1;
+
+		len++;
+	}
+
+	out = g_new(gunichar2, len + 1);
+
+	for (i = 0; i < len; i++)
+		out[i] = in[i];
+
+	out[len] = 0;
+	*utf16 = out;
+	return len;
+}
+
 int parcel_w_string(struct parcel *p, const char *str)
 {
 	gunichar2 *gs16;
@@ -118,7 +196,9 @@ int parcel_w_string(struct parcel *p, const char *str)
 		return 0;
 	}
 
-	gs16 = g_utf8_to_utf16(str, -1, NULL, &gs16_len, NULL);
+	gs16_len = parcel_ascii_to_utf16(str, &gs16);
+	if (gs16_len < 0)
+		gs16 = g_utf8_to_utf16(str, -1, NULL, &gs16_len, NULL);
 
 	if (parcel_w_int32(p, gs16_len) == -1)
 		return -1;
@@ -186,6 +266,14 @@ char *parcel_r_string(struct parcel *p)
 		return NULL;
 	}
 
+	/* Most strings (numbers, APNs, PLMNs) are plain ASCII */
+	ret = g_malloc(len16 + 1);
+	if (parcel_utf16_to_ascii(p->data + p->offset, len16, ret)) {
+		p->offset += strbytes;
+		return ret;
+	}
+
+	g_free(ret);
 	ret = g_utf16_to_utf8((gunichar2 *) (void *) (p->data + p->offset),
 				len16, NULL, NULL, NULL);
 	if (ret == NULL) {
@@ -174,6 +174,14 @@ const char *ofono_dbus_access_method_name(enum ofono_dbus_access_intf intf,
 ofono_bool_t ofono_dbus_access_method_allowed(const char *sender,
 	enum ofono_dbus_access_intf iface, int method, const char *arg);
 
+/*
+ * Decisions without an argument are cached per sender. Plugins call
+ * this when their policy changes so that everything gets evaluated
+ * again.
+ */
+/* Since 1.29+git9 */
+void ofono_dbus_access_policy_changed(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -68,6 +68,24 @@ enum ofono_sms_data_flag {
 
 void ofono_sms_deliver_notify(struct ofono_sms *sms, const unsigned char *pdu,
 				int len, int tpdu_len);
+
+/* Since 1.29+git9 */
+struct ofono_sms_pdu {
+	const unsigned char *pdu;
+	int len;
+	int tpdu_len;
+};
+
+/*
+ * Same as calling ofono_sms_deliver_notify for each PDU, e.g. the ones
+ * read from the modem storage at startup, except that the fragments
+ * are backed up with one write and the completed messages are only
+ * dispatched after that. Returns FALSE if the backup failed, in which
+ * case nothing is dispatched and the PDUs must be kept on the modem.
+ * Otherwise they may be deleted from it. Since 1.29+git9
+ */
+ofono_bool_t ofono_sms_deliver_notify_batch(struct ofono_sms *sms,
+			const struct ofono_sms_pdu *pdus, unsigned int count);
 void ofono_sms_status_notify(struct ofono_sms *sms, const unsigned char *pdu,
 				int len, int tpdu_len);
 
@@ -84,6 +102,13 @@ void ofono_sms_remove(struct ofono_sms *sms);
 void ofono_sms_set_data(struct ofono_sms *sms, void *data);
 void *ofono_sms_get_data(struct ofono_sms *sms);
 
+/*
+ * Number of messages the core may have submissions outstanding for at
+ * the same time. Defaults to 1, for drivers that can't handle a submit
+ * before the previous one has completed. Since 1.29+git9
+ */
+void ofono_sms_set_submit_window(struct ofono_sms *sms, unsigned int window);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,79 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef OFONO_STATUS_PAGE_H
+#define OFONO_STATUS_PAGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Since 1.29+git9 */
+
+/*
+ * Layout of the read-only status page returned by the GetStatusPage
+ * method of org.ofono.Modem. The page is updated in place by ofonod.
+ * Readers map the fd with PROT_READ and MAP_SHARED and take snapshots
+ * with ofono_status_page_read(). The writer makes seq odd while it
+ * updates the page.
+ */
+
+#define OFONO_STATUS_PAGE_MAGIC		0x534e464f	/* "OFNS" */
+#define OFONO_STATUS_PAGE_VERSION	1
+
+struct ofono_status_page {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;			/* sizeof(struct ofono_status_page) */
+	uint32_t seq;
+	int32_t strength;		/* 0..100 or -1 if unknown */
+	int32_t registration;		/* NETWORK_REGISTRATION_STATUS_* */
+	int32_t technology;		/* ACCESS_TECHNOLOGY_* or -1 */
+	uint32_t attached;
+	uint32_t active_contexts;
+	uint32_t active_types;		/* 1 << OFONO_GPRS_CONTEXT_TYPE_* */
+};
+
+static inline void ofono_status_page_read(
+				const volatile struct ofono_status_page *page,
+				struct ofono_status_page *copy)
+{
+	uint32_t seq;
+
+	do {
+		while ((seq = page->seq) & 1);
+		__sync_synchronize();
+		copy->magic = page->magic;
+		copy->version = page->version;
+		copy->size = page->size;
+		copy->strength = page->strength;
+		copy->registration = page->registration;
+		copy->technology = page->technology;
+		copy->attached = page->attached;
+		copy->active_contexts = page->active_contexts;
+		copy->active_types = page->active_types;
+		__sync_synchronize();
+	} while (page->seq != seq);
+
+	copy->seq = seq;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OFONO_STATUS_PAGE_H */
@@ -53,6 +53,7 @@
 #include "mbpi.h"
 
 const char *mbpi_database = MBPI_DATABASE;
+gboolean mbpi_use_index = TRUE;
 
 /*
  * Use IPv4 for MMS contexts because gprs.c assumes that MMS proxy
@@ -66,6 +67,14 @@ enum ofono_gprs_auth_method mbpi_default_auth_method = OFONO_GPRS_AUTH_METHOD_AN
 
 #define OFONO_GPRS_AUTH_METHOD_UNSPECIFIED ((enum ofono_gprs_auth_method)(-1))
 
+/*
+ * Protocol defaults are resolved together with the authentication
+ * method once the whole <apn> element has been seen, the compiled index
+ * keeps them unresolved because the mbpi_default_* variables may change.
+ */
+#define MBPI_PROTO_UNSPECIFIED ((enum ofono_gprs_proto)(-1))
+#define MBPI_PROTO_USAGE_DEFAULT ((enum ofono_gprs_proto)(-2))
+
 #define _(x) case x: return (#x)
 
 enum MBPI_ERROR {
@@ -243,13 +252,13 @@ static void usage_start(GMarkupParseContext *context,
 
 	if (strcmp(text, "internet") == 0) {
 		apn->type = OFONO_GPRS_CONTEXT_TYPE_INTERNET;
-		apn->proto = mbpi_default_internet_proto;
+		apn->proto = MBPI_PROTO_USAGE_DEFAULT;
 	} else if (strcmp(text, "mms") == 0) {
 		apn->type = OFONO_GPRS_CONTEXT_TYPE_MMS;
-		apn->proto = mbpi_default_mms_proto;
+		apn->proto = MBPI_PROTO_USAGE_DEFAULT;
 	} else if (strcmp(text, "ims") == 0) {
 		apn->type = OFONO_GPRS_CONTEXT_TYPE_IMS;
-		apn->proto = mbpi_default_ims_proto;
+		apn->proto = MBPI_PROTO_USAGE_DEFAULT;
 	} else if (strcmp(text, "wap") == 0)
 		apn->type = OFONO_GPRS_CONTEXT_TYPE_WAP;
 	else
@@ -328,10 +337,10 @@ static const GMarkupParser skip_parser = {
 	NULL,
 };
 
-static void network_id_handler(GMarkupParseContext *context,
-				struct gsm_data *gsm,
+static gboolean network_id_parse(GMarkupParseContext *context,
 				const gchar **attribute_names,
 				const gchar **attribute_values,
+				const char **out_mcc, const char **out_mnc,
 				GError **error)
 {
 	const char *mcc = NULL, *mnc = NULL;
@@ -348,35 +357,48 @@ static void network_id_handler(GMarkupParseContext *context,
 		mbpi_g_set_error(context, error, G_MARKUP_ERROR,
 					G_MARKUP_ERROR_MISSING_ATTRIBUTE,
 					"Missing attribute: mcc");
-		return;
+		return FALSE;
 	}
 
 	if (mnc == NULL) {
 		mbpi_g_set_error(context, error, G_MARKUP_ERROR,
 					G_MARKUP_ERROR_MISSING_ATTRIBUTE,
 					"Missing attribute: mnc");
-		return;
+		return FALSE;
 	}
 
+	*out_mcc = mcc;
+	*out_mnc = mnc;
+	return TRUE;
+}
+
+static void network_id_handler(GMarkupParseContext *context,
+				struct gsm_data *gsm,
+				const gchar **attribute_names,
+				const gchar **attribute_values,
+				GError **error)
+{
+	const char *mcc, *mnc;
+
+	if (!network_id_parse(context, attribute_names, attribute_values,
+							&mcc, &mnc, error))
+		return;
+
 	if (g_str_equal(mcc, gsm->match_mcc) &&
 			g_str_equal(mnc, gsm->match_mnc))
 		gsm->match_found = TRUE;
 }
 
-static void apn_handler(GMarkupParseContext *context, struct gsm_data *gsm,
-			const gchar **attribute_names,
-			const gchar **attribute_values,
-			GError **error)
+static struct ofono_gprs_provision_data *apn_new(GMarkupParseContext *context,
+				const gchar **attribute_names,
+				const gchar **attribute_values,
+				const char *provider_name,
+				gboolean provider_primary, GError **error)
 {
 	struct ofono_gprs_provision_data *ap;
 	const char *apn;
 	int i;
 
-	if (gsm->match_found == FALSE) {
-		g_markup_parse_context_push(context, &skip_parser, NULL);
-		return;
-	}
-
 	for (i = 0, apn = NULL; attribute_names[i]; i++) {
 		if (g_str_equal(attribute_names[i], "value") == FALSE)
 			continue;
@@ -389,23 +411,69 @@ static void apn_handler(GMarkupParseContext *context, struct gsm_data *gsm,
 		mbpi_g_set_error(context, error, G_MARKUP_ERROR,
 					G_MARKUP_ERROR_MISSING_ATTRIBUTE,
 					"APN attribute missing");
-		return;
+		return NULL;
 	}
 
 	ap = g_new0(struct ofono_gprs_provision_data, 1);
-	ap->provider_name = g_strdup(gsm->provider_name);
-	ap->provider_primary = gsm->provider_primary;
+	ap->provider_name = g_strdup(provider_name);
+	ap->provider_primary = provider_primary;
 
 	ap->apn = g_strdup(apn);
 	ap->type = OFONO_GPRS_CONTEXT_TYPE_INTERNET;
-	ap->proto = mbpi_default_proto;
+	ap->proto = MBPI_PROTO_UNSPECIFIED;
 	ap->auth_method = OFONO_GPRS_AUTH_METHOD_UNSPECIFIED;
+	return ap;
+}
+
+static void apn_handler(GMarkupParseContext *context, struct gsm_data *gsm,
+			const gchar **attribute_names,
+			const gchar **attribute_values,
+			GError **error)
+{
+	struct ofono_gprs_provision_data *ap;
+
+	if (gsm->match_found == FALSE) {
+		g_markup_parse_context_push(context, &skip_parser, NULL);
+		return;
+	}
 
-	g_markup_parse_context_push(context, &apn_parser, ap);
+	ap = apn_new(context, attribute_names, attribute_values,
+			gsm->provider_name, gsm->provider_primary, error);
+	if (ap)
+		g_markup_parse_context_push(context, &apn_parser, ap);
 }
 
-static void sid_handler(GMarkupParseContext *context,
-				struct cdma_data *cdma,
+static void apn_fix_defaults(struct ofono_gprs_provision_data *ap)
+{
+	if (ap->proto == MBPI_PROTO_UNSPECIFIED) {
+		ap->proto = mbpi_default_proto;
+	} else if (ap->proto == MBPI_PROTO_USAGE_DEFAULT) {
+		switch (ap->type) {
+		case OFONO_GPRS_CONTEXT_TYPE_MMS:
+			ap->proto = mbpi_default_mms_proto;
+			break;
+		case OFONO_GPRS_CONTEXT_TYPE_IMS:
+			ap->proto = mbpi_default_ims_proto;
+			break;
+		default:
+			ap->proto = mbpi_default_internet_proto;
+			break;
+		}
+	}
+
+	/* Fix the authentication method if none was specified */
+	if (ap->auth_method == OFONO_GPRS_AUTH_METHOD_UNSPECIFIED) {
+		if ((!ap->username || !ap->username[0]) &&
+				(!ap->password || !ap->password[0])) {
+			/* No username or password => no authentication */
+			ap->auth_method = OFONO_GPRS_AUTH_METHOD_NONE;
+		} else {
+			ap->auth_method = mbpi_default_auth_method;
+		}
+	}
+}
+
+static const char *sid_parse(GMarkupParseContext *context,
 				const gchar **attribute_names,
 				const gchar **attribute_values,
 				GError **error)
@@ -425,10 +493,22 @@ static void sid_handler(GMarkupParseContext *context,
 		mbpi_g_set_error(context, error, G_MARKUP_ERROR,
 					G_MARKUP_ERROR_MISSING_ATTRIBUTE,
 					"Missing attribute: sid");
-		return;
+		return NULL;
 	}
 
-	if (g_str_equal(sid, cdma->match_sid))
+	return sid;
+}
+
+static void sid_handler(GMarkupParseContext *context,
+				struct cdma_data *cdma,
+				const gchar **attribute_names,
+				const gchar **attribute_values,
+				GError **error)
+{
+	const char *sid = sid_parse(context, attribute_names, attribute_values,
+									error);
+
+	if (sid && g_str_equal(sid, cdma->match_sid))
 		cdma->match_found = TRUE;
 }
 
@@ -469,16 +549,7 @@ static void gsm_end(GMarkupParseContext *context, const gchar *element_name,
 	if (ap == NULL)
 		return;
 
-	/* Fix the authentication method if none was specified */
-	if (ap->auth_method == OFONO_GPRS_AUTH_METHOD_UNSPECIFIED) {
-		if ((!ap->username || !ap->username[0]) &&
-				(!ap->password || !ap->password[0])) {
-			/* No username or password => no authentication */
-			ap->auth_method = OFONO_GPRS_AUTH_METHOD_NONE;
-		} else {
-			ap->auth_method = mbpi_default_auth_method;
-		}
-	}
+	apn_fix_defaults(ap);
 
 	if (gsm->allow_duplicates == FALSE) {
 		GSList *l;
@@ -733,12 +804,831 @@ static gboolean mbpi_parse(const GMarkupParser *parser, gpointer userdata,
 	return ret;
 }
 
+/*
+ * Compiled index of the database, kept next to it as <database>.idx and
+ * rebuilt whenever the database's size or mtime changes. It's only ever
+ * read on the machine that wrote it, so everything is in host byte order.
+ *
+ * The header is followed by these sections, in this order:
+ *
+ *   guint32 gsm_bucket[gsm_buckets + 1]   range of gsm_key[] per bucket
+ *   struct mbpi_index_key gsm_key[gsm_keys]
+ *   guint32 gsm_ref[gsm_refs]             indices into apn[]
+ *   struct mbpi_index_apn apn[apns]
+ *   guint32 cdma_bucket[cdma_buckets + 1] range of sid[] per bucket
+ *   struct mbpi_index_sid sid[sids]
+ *   char strings[strings]
+ *
+ * Strings are stored as offsets into the string pool, MBPI_INDEX_NONE
+ * stands for NULL. The APN records keep the protocol and authentication
+ * method unresolved, apn_fix_defaults() is applied on lookup.
+ */
+#define MBPI_INDEX_SUFFIX	".idx"
+#define MBPI_INDEX_MAGIC	"MBPI"
+#define MBPI_INDEX_VERSION	1
+#define MBPI_INDEX_NONE		((guint32)(-1))
+
+struct mbpi_index_header {
+	char magic[4];
+	guint32 version;
+	guint64 db_size;
+	gint64 db_mtime;
+	guint32 db_mtime_nsec;
+	guint32 gsm_buckets;
+	guint32 gsm_keys;
+	guint32 gsm_refs;
+	guint32 apns;
+	guint32 cdma_buckets;
+	guint32 sids;
+	guint32 strings;
+};
+
+/* The APNs of a network-id are gsm_ref[first] ... gsm_ref[first+count-1] */
+struct mbpi_index_key {
+	guint32 mcc;
+	guint32 mnc;
+	guint32 first;
+	guint32 count;
+};
+
+struct mbpi_index_apn {
+	guint32 provider_name;
+	guint32 provider_primary;
+	guint32 name;
+	guint32 apn;
+	guint32 username;
+	guint32 password;
+	guint32 message_proxy;
+	guint32 message_center;
+	guint32 type;
+	guint32 proto;
+	guint32 auth_method;
+};
+
+struct mbpi_index_sid {
+	guint32 sid;
+	guint32 provider_name;
+};
+
+struct mbpi_index {
+	const struct mbpi_index_header *header;
+	const guint32 *gsm_bucket;
+	const struct mbpi_index_key *gsm_key;
+	const guint32 *gsm_ref;
+	const struct mbpi_index_apn *apn;
+	const guint32 *cdma_bucket;
+	const struct mbpi_index_sid *sid;
+	const char *strings;
+};
+
+/* The index of the last database we have looked at */
+static struct mbpi_index_cache {
+	char *database;
+	off_t db_size;
+	struct timespec db_mtime;
+	GMappedFile *map;
+	void *data;
+	gboolean valid;
+	struct mbpi_index index;
+} *mbpi_index_cache;
+
+static guint32 mbpi_index_hash(const char *s1, const char *s2)
+{
+	/* FNV-1a, both strings including the terminating NUL */
+	guint32 h = 2166136261U;
+
+	do {
+		h = (h ^ (guchar) *s1) * 16777619U;
+	} while (*s1++);
+
+	if (s2) {
+		do {
+			h = (h ^ (guchar) *s2) * 16777619U;
+		} while (*s2++);
+	}
+
+	return h;
+}
+
+static const char *mbpi_index_str(const struct mbpi_index *index,
+							guint32 offset)
+{
+	return offset < index->header->strings ?
+				(index->strings + offset) : NULL;
+}
+
+static gboolean mbpi_index_section(const void **ptr, const char *data,
+					gsize size, gsize *offset,
+					guint32 count, gsize elem_size)
+{
+	if (count > (size - *offset) / elem_size)
+		return FALSE;
+
+	*ptr = data + *offset;
+	*offset += count * elem_size;
+	return TRUE;
+}
+
+static gboolean mbpi_index_buckets_valid(const guint32 *bucket,
+					guint32 buckets, guint32 entries)
+{
+	guint32 i;
+
+	/* The number of buckets must be a power of 2 */
+	if (!buckets || (buckets & (buckets - 1)))
+		return FALSE;
+
+	for (i = 0; i < buckets; i++)
+		if (bucket[i] > bucket[i + 1])
+			return FALSE;
+
+	return bucket[0] == 0 && bucket[buckets] == entries;
+}
+
+static gboolean mbpi_index_init(struct mbpi_index *index, const void *data,
+				gsize size, const struct stat *st)
+{
+	const struct mbpi_index_header *hdr = data;
+	gsize offset = sizeof(*hdr);
+	guint32 i;
+
+	if (size < sizeof(*hdr) ||
+			memcmp(hdr->magic, MBPI_INDEX_MAGIC, 4) ||
+			hdr->version != MBPI_INDEX_VERSION ||
+			hdr->db_size != (guint64) st->st_size ||
+			hdr->db_mtime != st->st_mtim.tv_sec ||
+			hdr->db_mtime_nsec != st->st_mtim.tv_nsec)
+		return FALSE;
+
+	memset(index, 0, sizeof(*index));
+	index->header = hdr;
+
+	if (!mbpi_index_section((const void **) &index->gsm_bucket, data,
+				size, &offset, hdr->gsm_buckets + 1,
+				sizeof(guint32)) ||
+			!mbpi_index_section((const void **) &index->gsm_key,
+				data, size, &offset, hdr->gsm_keys,
+				sizeof(struct mbpi_index_key)) ||
+			!mbpi_index_section((const void **) &index->gsm_ref,
+				data, size, &offset, hdr->gsm_refs,
+				sizeof(guint32)) ||
+			!mbpi_index_section((const void **) &index->apn,
+				data, size, &offset, hdr->apns,
+				sizeof(struct mbpi_index_apn)) ||
+			!mbpi_index_section((const void **) &index->cdma_bucket,
+				data, size, &offset, hdr->cdma_buckets + 1,
+				sizeof(guint32)) ||
+			!mbpi_index_section((const void **) &index->sid,
+				data, size, &offset, hdr->sids,
+				sizeof(struct mbpi_index_sid)) ||
+			!mbpi_index_section((const void **) &index->strings,
+				data, size, &offset, hdr->strings, 1) ||
+			offset != size)
+		return FALSE;
+
+	if (hdr->strings && index->strings[hdr->strings - 1])
+		return FALSE;
+
+	if (!mbpi_index_buckets_valid(index->gsm_bucket, hdr->gsm_buckets,
+							hdr->gsm_keys) ||
+			!mbpi_index_buckets_valid(index->cdma_bucket,
+					hdr->cdma_buckets, hdr->sids))
+		return FALSE;
+
+	for (i = 0; i < hdr->gsm_keys; i++) {
+		const struct mbpi_index_key *key = index->gsm_key + i;
+
+		if (key->first > hdr->gsm_refs ||
+				key->count > hdr->gsm_refs - key->first)
+			return FALSE;
+	}
+
+	for (i = 0; i < hdr->gsm_refs; i++)
+		if (index->gsm_ref[i] >= hdr->apns)
+			return FALSE;
+
+	return TRUE;
+}
+
+struct mbpi_compile_key {
+	char *mcc;
+	char *mnc;
+	GArray *refs;
+};
+
+struct mbpi_compiler {
+	GHashTable *strings;
+	GString *pool;
+	GHashTable *gsm;
+	GPtrArray *gsm_keys;
+	GArray *apns;
+	GHashTable *cdma;
+	GPtrArray *sids;
+	/* The provider being parsed */
+	char *provider_name;
+	gboolean provider_primary;
+	GPtrArray *provider_keys;
+	GPtrArray *provider_sids;
+};
+
+static guint mbpi_compile_key_hash(gconstpointer data)
+{
+	const struct mbpi_compile_key *key = data;
+
+	return mbpi_index_hash(key->mcc, key->mnc);
+}
+
+static gboolean mbpi_compile_key_equal(gconstpointer a, gconstpointer b)
+{
+	const struct mbpi_compile_key *k1 = a;
+	const struct mbpi_compile_key *k2 = b;
+
+	return g_str_equal(k1->mcc, k2->mcc) && g_str_equal(k1->mnc, k2->mnc);
+}
+
+static void mbpi_compile_key_free(gpointer data)
+{
+	struct mbpi_compile_key *key = data;
+
+	g_free(key->mcc);
+	g_free(key->mnc);
+	g_array_free(key->refs, TRUE);
+	g_free(key);
+}
+
+static guint32 mbpi_compile_str(struct mbpi_compiler *c, const char *str)
+{
+	gpointer value;
+	guint32 offset;
+
+	if (str == NULL)
+		return MBPI_INDEX_NONE;
+
+	if (g_hash_table_lookup_extended(c->strings, str, NULL, &value))
+		return GPOINTER_TO_UINT(value);
+
+	offset = c->pool->len;
+	g_string_append_len(c->pool, str, strlen(str) + 1);
+	g_hash_table_insert(c->strings, g_strdup(str),
+					GUINT_TO_POINTER(offset));
+	return offset;
+}
+
+static void compile_gsm_start(GMarkupParseContext *context,
+				const gchar *element_name,
+				const gchar **attribute_names,
+				const gchar **attribute_values,
+				gpointer userdata, GError **error)
+{
+	struct mbpi_compiler *c = userdata;
+
+	if (g_str_equal(element_name, "network-id")) {
+		struct mbpi_compile_key tmp, *key;
+		const char *mcc, *mnc;
+		guint i;
+
+		if (!network_id_parse(context, attribute_names,
+					attribute_values, &mcc, &mnc, error))
+			return;
+
+		tmp.mcc = (char *) mcc;
+		tmp.mnc = (char *) mnc;
+		key = g_hash_table_lookup(c->gsm, &tmp);
+		if (key == NULL) {
+			key = g_new(struct mbpi_compile_key, 1);
+			key->mcc = g_strdup(mcc);
+			key->mnc = g_strdup(mnc);
+			key->refs = g_array_new(FALSE, FALSE, sizeof(guint32));
+			g_hash_table_add(c->gsm, key);
+			g_ptr_array_add(c->gsm_keys, key);
+		}
+
+		for (i = 0; i < c->provider_keys->len; i++)
+			if (c->provider_keys->pdata[i] == key)
+				return;
+
+		g_ptr_array_add(c->provider_keys, key);
+	} else if (g_str_equal(element_name, "apn")) {
+		struct ofono_gprs_provision_data *ap;
+
+		/* Only the network-ids seen so far get this APN */
+		if (c->provider_keys->len == 0) {
+			g_markup_parse_context_push(context, &skip_parser,
+									NULL);
+			return;
+		}
+
+		ap = apn_new(context, attribute_names, attribute_values,
+				c->provider_name, c->provider_primary, error);
+		if (ap)
+			g_markup_parse_context_push(context, &apn_parser, ap);
+	}
+}
+
+static void compile_gsm_end(GMarkupParseContext *context,
+				const gchar *element_name,
+				gpointer userdata, GError **error)
+{
+	struct mbpi_compiler *c = userdata;
+	struct ofono_gprs_provision_data *ap;
+	struct mbpi_index_apn rec;
+	guint32 ref;
+	guint i;
+
+	if (!g_str_equal(element_name, "apn"))
+		return;
+
+	ap = g_markup_parse_context_pop(context);
+	if (ap == NULL)
+		return;
+
+	rec.provider_name = mbpi_compile_str(c, ap->provider_name);
+	rec.provider_primary = ap->provider_primary;
+	rec.name = mbpi_compile_str(c, ap->name);
+	rec.apn = mbpi_compile_str(c, ap->apn);
+	rec.username = mbpi_compile_str(c, ap->username);
+	rec.password = mbpi_compile_str(c, ap->password);
+	rec.message_proxy = mbpi_compile_str(c, ap->message_proxy);
+	rec.message_center = mbpi_compile_str(c, ap->message_center);
+	rec.type = ap->type;
+	rec.proto = ap->proto;
+	rec.auth_method = ap->auth_method;
+	mbpi_ap_free(ap);
+
+	ref = c->apns->len;
+	g_array_append_val(c->apns, rec);
+
+	for (i = 0; i < c->provider_keys->len; i++) {
+		struct mbpi_compile_key *key = c->provider_keys->pdata[i];
+
+		g_array_append_val(key->refs, ref);
+	}
+}
+
+static const GMarkupParser compile_gsm_parser = {
+	compile_gsm_start,
+	compile_gsm_end,
+	NULL,
+	NULL,
+	NULL,
+};
+
+static void compile_cdma_start(GMarkupParseContext *context,
+				const gchar *element_name,
+				const gchar **attribute_names,
+				const gchar **attribute_values,
+				gpointer userdata, GError **error)
+{
+	struct mbpi_compiler *c = userdata;
+
+	if (g_str_equal(element_name, "sid")) {
+		const char *sid = sid_parse(context, attribute_names,
+						attribute_values, error);
+
+		if (sid)
+			g_ptr_array_add(c->provider_sids, g_strdup(sid));
+	}
+}
+
+static const GMarkupParser compile_cdma_parser = {
+	compile_cdma_start,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+};
+
+static void compile_provider_start(GMarkupParseContext *context,
+				const gchar *element_name,
+				const gchar **attribute_names,
+				const gchar **attribute_values,
+				gpointer userdata, GError **error)
+{
+	struct mbpi_compiler *c = userdata;
+
+	if (g_str_equal(element_name, "name")) {
+		g_free(c->provider_name);
+		c->provider_name = NULL;
+		g_markup_parse_context_push(context, &text_parser,
+						&c->provider_name);
+	} else if (g_str_equal(element_name, "gsm")) {
+		g_ptr_array_set_size(c->provider_keys, 0);
+		g_markup_parse_context_push(context, &compile_gsm_parser, c);
+	} else if (g_str_equal(element_name, "cdma"))
+		g_markup_parse_context_push(context, &compile_cdma_parser, c);
+}
+
+static const GMarkupParser compile_provider_parser = {
+	compile_provider_start,
+	gsm_provider_end,
+	NULL,
+	NULL,
+	NULL,
+};
+
+static void compile_toplevel_start(GMarkupParseContext *context,
+				const gchar *element_name,
+				const gchar **attribute_names,
+				const gchar **attribute_values,
+				gpointer userdata, GError **error)
+{
+	struct mbpi_compiler *c = userdata;
+
+	if (g_str_equal(element_name, "provider")) {
+		g_markup_collect_attributes(element_name, attribute_names,
+				attribute_values, error,
+				G_MARKUP_COLLECT_BOOLEAN | G_MARKUP_COLLECT_OPTIONAL,
+				"primary", &c->provider_primary,
+				G_MARKUP_COLLECT_INVALID);
+
+		g_markup_parse_context_push(context, &compile_provider_parser,
+									c);
+	}
+}
+
+static void compile_toplevel_end(GMarkupParseContext *context,
+				const gchar *element_name,
+				gpointer userdata, GError **error)
+{
+	struct mbpi_compiler *c = userdata;
+	guint i;
+
+	if (!g_str_equal(element_name, "provider"))
+		return;
+
+	g_markup_parse_context_pop(context);
+
+	/*
+	 * The first provider listing a SID wins, with whatever name
+	 * was the last one seen by the end of that provider.
+	 */
+	for (i = 0; i < c->provider_sids->len; i++) {
+		char *sid = c->provider_sids->pdata[i];
+
+		if (g_hash_table_contains(c->cdma, sid))
+			continue;
+
+		g_hash_table_insert(c->cdma, g_strdup(sid), GUINT_TO_POINTER
+				(mbpi_compile_str(c, c->provider_name)));
+		g_ptr_array_add(c->sids, g_strdup(sid));
+	}
+
+	g_ptr_array_set_size(c->provider_sids, 0);
+}
+
+static const GMarkupParser compile_toplevel_parser = {
+	compile_toplevel_start,
+	compile_toplevel_end,
+	NULL,
+	NULL,
+	NULL,
+};
+
+static guint32 mbpi_index_buckets(guint32 count)
+{
+	guint32 n = 1;
+
+	while (n < count)
+		n <<= 1;
+
+	return n;
+}
+
+/* Writes the buckets and returns the entries in bucket order */
+static guint32 *mbpi_compile_buckets(GByteArray *out, const guint32 *hash,
+					guint32 count, guint32 buckets)
+{
+	guint32 *bucket = g_new0(guint32, buckets + 1);
+	guint32 *fill = g_new(guint32, buckets);
+	guint32 *order = g_new(guint32, count);
+	guint32 i;
+
+	for (i = 0; i < count; i++)
+		bucket[(hash[i] & (buckets - 1)) + 1]++;
+
+	for (i = 0; i < buckets; i++)
+		bucket[i + 1] += bucket[i];
+
+	memcpy(fill, bucket, buckets * sizeof(guint32));
+
+	for (i = 0; i < count; i++)
+		order[fill[hash[i] & (buckets - 1)]++] = i;
+
+	g_byte_array_append(out, (void *) bucket,
+				(buckets + 1) * sizeof(guint32));
+	g_free(fill);
+	g_free(bucket);
+	return order;
+}
+
+static GByteArray *mbpi_index_compile(const struct stat *st)
+{
+	struct mbpi_compiler c;
+	struct mbpi_index_header hdr;
+	GByteArray *out = NULL;
+	GError *error = NULL;
+	guint32 *hash;
+	guint32 *order;
+	guint32 i, first;
+
+	memset(&c, 0, sizeof(c));
+	c.strings = g_hash_table_new_full(g_str_hash, g_str_equal,
+							g_free, NULL);
+	c.pool = g_string_new(NULL);
+	c.gsm = g_hash_table_new(mbpi_compile_key_hash,
+						mbpi_compile_key_equal);
+	c.gsm_keys = g_ptr_array_new_with_free_func(mbpi_compile_key_free);
+	c.apns = g_array_new(FALSE, FALSE, sizeof(struct mbpi_index_apn));
+	c.cdma = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	c.sids = g_ptr_array_new_with_free_func(g_free);
+	c.provider_keys = g_ptr_array_new();
+	c.provider_sids = g_ptr_array_new_with_free_func(g_free);
+
+	/*
+	 * Anything the lookups would complain about makes the compilation
+	 * fail. Those lookups then go through the parser and report it.
+	 */
+	if (!mbpi_parse(&compile_toplevel_parser, &c, &error)) {
+		g_error_free(error);
+		goto out;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, MBPI_INDEX_MAGIC, 4);
+	hdr.version = MBPI_INDEX_VERSION;
+	hdr.db_size = st->st_size;
+	hdr.db_mtime = st->st_mtim.tv_sec;
+	hdr.db_mtime_nsec = st->st_mtim.tv_nsec;
+	hdr.gsm_keys = c.gsm_keys->len;
+	hdr.gsm_buckets = mbpi_index_buckets(hdr.gsm_keys);
+	hdr.apns = c.apns->len;
+	hdr.sids = c.sids->len;
+	hdr.cdma_buckets = mbpi_index_buckets(hdr.sids);
+
+	for (i = 0; i < c.gsm_keys->len; i++) {
+		struct mbpi_compile_key *key = c.gsm_keys->pdata[i];
+
+		hdr.gsm_refs += key->refs->len;
+	}
+
+	/* Intern the remaining strings before the size of the pool is known */
+	for (i = 0; i < c.gsm_keys->len; i++) {
+		struct mbpi_compile_key *key = c.gsm_keys->pdata[i];
+
+		mbpi_compile_str(&c, key->mcc);
+		mbpi_compile_str(&c, key->mnc);
+	}
+
+	for (i = 0; i < c.sids->len; i++)
+		mbpi_compile_str(&c, c.sids->pdata[i]);
+
+	hdr.strings = c.pool->len;
+
+	out = g_byte_array_new();
+	g_byte_array_append(out, (void *) &hdr, sizeof(hdr));
+
+	/* GSM */
+	hash = g_new(guint32, hdr.gsm_keys);
+	for (i = 0; i < hdr.gsm_keys; i++) {
+		struct mbpi_compile_key *key = c.gsm_keys->pdata[i];
+
+		hash[i] = mbpi_index_hash(key->mcc, key->mnc);
+	}
+
+	order = mbpi_compile_buckets(out, hash, hdr.gsm_keys,
+							hdr.gsm_buckets);
+
+	for (i = 0, first = 0; i < hdr.gsm_keys; i++) {
+		struct mbpi_compile_key *key = c.gsm_keys->pdata[order[i]];
+		struct mbpi_index_key rec;
+
+		rec.mcc = mbpi_compile_str(&c, key->mcc);
+		rec.mnc = mbpi_compile_str(&c, key->mnc);
+		rec.first = first;
+		rec.count = key->refs->len;
+		first += rec.count;
+		g_byte_array_append(out, (void *) &rec, sizeof(rec));
+	}
+
+	for (i = 0; i < hdr.gsm_keys; i++) {
+		struct mbpi_compile_key *key = c.gsm_keys->pdata[order[i]];
+
+		g_byte_array_append(out, (void *) key->refs->data,
+					key->refs->len * sizeof(guint32));
+	}
+
+	g_byte_array_append(out, (void *) c.apns->data,
+			c.apns->len * sizeof(struct mbpi_index_apn));
+	g_free(order);
+	g_free(hash);
+
+	/* CDMA */
+	hash = g_new(guint32, hdr.sids);
+	for (i = 0; i < hdr.sids; i++)
+		hash[i] = mbpi_index_hash(c.sids->pdata[i], NULL);
+
+	order = mbpi_compile_buckets(out, hash, hdr.sids, hdr.cdma_buckets);
+
+	for (i = 0; i < hdr.sids; i++) {
+		char *sid = c.sids->pdata[order[i]];
+		struct mbpi_index_sid rec;
+
+		rec.sid = mbpi_compile_str(&c, sid);
+		rec.provider_name = GPOINTER_TO_UINT
+					(g_hash_table_lookup(c.cdma, sid));
+		g_byte_array_append(out, (void *) &rec, sizeof(rec));
+	}
+
+	g_free(order);
+	g_free(hash);
+
+	g_byte_array_append(out, (void *) c.pool->str, c.pool->len);
+
+out:
+	g_hash_table_destroy(c.strings);
+	g_string_free(c.pool, TRUE);
+	g_hash_table_destroy(c.gsm);
+	g_ptr_array_free(c.gsm_keys, TRUE);
+	g_array_free(c.apns, TRUE);
+	g_hash_table_destroy(c.cdma);
+	g_ptr_array_free(c.sids, TRUE);
+	g_ptr_array_free(c.provider_keys, TRUE);
+	g_ptr_array_free(c.provider_sids, TRUE);
+	g_free(c.provider_name);
+	return out;
+}
+
+static void mbpi_index_cache_free(struct mbpi_index_cache *cache)
+{
+	if (cache == NULL)
+		return;
+
+	if (cache->map)
+		g_mapped_file_unref(cache->map);
+
+	g_free(cache->data);
+	g_free(cache->database);
+	g_free(cache);
+}
+
+static const struct mbpi_index *mbpi_index_get(void)
+{
+	struct mbpi_index_cache *cache = mbpi_index_cache;
+	GByteArray *compiled;
+	struct stat st;
+	char *path;
+
+	if (!mbpi_use_index || stat(mbpi_database, &st) < 0)
+		return NULL;
+
+	if (cache && g_str_equal(cache->database, mbpi_database) &&
+			cache->db_size == st.st_size &&
+			cache->db_mtime.tv_sec == st.st_mtim.tv_sec &&
+			cache->db_mtime.tv_nsec == st.st_mtim.tv_nsec)
+		return cache->valid ? &cache->index : NULL;
+
+	mbpi_index_cache_free(cache);
+	mbpi_index_cache = cache = g_new0(struct mbpi_index_cache, 1);
+	cache->database = g_strdup(mbpi_database);
+	cache->db_size = st.st_size;
+	cache->db_mtime = st.st_mtim;
+
+	path = g_strconcat(mbpi_database, MBPI_INDEX_SUFFIX, NULL);
+	cache->map = g_mapped_file_new(path, FALSE, NULL);
+
+	if (cache->map && mbpi_index_init(&cache->index,
+				g_mapped_file_get_contents(cache->map),
+				g_mapped_file_get_length(cache->map), &st)) {
+		cache->valid = TRUE;
+		goto out;
+	}
+
+	if (cache->map) {
+		g_mapped_file_unref(cache->map);
+		cache->map = NULL;
+	}
+
+	/* A failed compilation is remembered until the database changes */
+	compiled = mbpi_index_compile(&st);
+	if (compiled == NULL)
+		goto out;
+
+	/* Serve from memory if the database directory is read-only */
+	g_file_set_contents(path, (void *) compiled->data, compiled->len,
+									NULL);
+	cache->valid = mbpi_index_init(&cache->index, compiled->data,
+							compiled->len, &st);
+	cache->data = g_byte_array_free(compiled, FALSE);
+
+out:
+	g_free(path);
+	return cache->valid ? &cache->index : NULL;
+}
+
+static GSList *mbpi_index_lookup_apn(const struct mbpi_index *index,
+					const char *mcc, const char *mnc,
+					gboolean allow_duplicates,
+					GError **error)
+{
+	const struct mbpi_index_header *hdr = index->header;
+	const struct mbpi_index_key *key = NULL;
+	guint32 b = mbpi_index_hash(mcc, mnc) & (hdr->gsm_buckets - 1);
+	GSList *apns = NULL;
+	guint32 i;
+
+	for (i = index->gsm_bucket[b]; i < index->gsm_bucket[b + 1]; i++) {
+		const struct mbpi_index_key *k = index->gsm_key + i;
+
+		if (!g_strcmp0(mbpi_index_str(index, k->mcc), mcc) &&
+				!g_strcmp0(mbpi_index_str(index, k->mnc), mnc)) {
+			key = k;
+			break;
+		}
+	}
+
+	if (key == NULL)
+		return NULL;
+
+	for (i = 0; i < key->count; i++) {
+		const struct mbpi_index_apn *rec =
+				index->apn + index->gsm_ref[key->first + i];
+		struct ofono_gprs_provision_data *ap;
+
+		ap = g_new0(struct ofono_gprs_provision_data, 1);
+		ap->provider_name = g_strdup(mbpi_index_str(index,
+							rec->provider_name));
+		ap->provider_primary = rec->provider_primary;
+		ap->name = g_strdup(mbpi_index_str(index, rec->name));
+		ap->apn = g_strdup(mbpi_index_str(index, rec->apn));
+		ap->username = g_strdup(mbpi_index_str(index, rec->username));
+		ap->password = g_strdup(mbpi_index_str(index, rec->password));
+		ap->message_proxy = g_strdup(mbpi_index_str(index,
+							rec->message_proxy));
+		ap->message_center = g_strdup(mbpi_index_str(index,
+							rec->message_center));
+		ap->type = rec->type;
+		ap->proto = rec->proto;
+		ap->auth_method = rec->auth_method;
+		apn_fix_defaults(ap);
+
+		if (allow_duplicates == FALSE) {
+			GSList *l;
+
+			for (l = apns; l; l = l->next) {
+				struct ofono_gprs_provision_data *pd = l->data;
+
+				if (pd->type == ap->type)
+					break;
+			}
+
+			if (l) {
+				g_set_error(error, mbpi_error_quark(),
+						MBPI_ERROR_DUPLICATE,
+						"%s: Duplicate context detected",
+						mbpi_database);
+				mbpi_ap_free(ap);
+				g_slist_free_full(apns, (GDestroyNotify)
+							mbpi_ap_free);
+				return NULL;
+			}
+		}
+
+		apns = g_slist_prepend(apns, ap);
+	}
+
+	return g_slist_reverse(apns);
+}
+
+static char *mbpi_index_lookup_cdma_provider_name(
+					const struct mbpi_index *index,
+					const char *sid)
+{
+	const struct mbpi_index_header *hdr = index->header;
+	guint32 b = mbpi_index_hash(sid, NULL) & (hdr->cdma_buckets - 1);
+	guint32 i;
+
+	for (i = index->cdma_bucket[b]; i < index->cdma_bucket[b + 1]; i++) {
+		const struct mbpi_index_sid *rec = index->sid + i;
+
+		if (!g_strcmp0(mbpi_index_str(index, rec->sid), sid))
+			return g_strdup(mbpi_index_str(index,
+							rec->provider_name));
+	}
+
+	return NULL;
+}
+
 GSList *mbpi_lookup_apn(const char *mcc, const char *mnc,
 			gboolean allow_duplicates, GError **error)
 {
+	const struct mbpi_index *index = mbpi_index_get();
 	struct gsm_data gsm;
 	GSList *l;
 
+	if (index)
+		return mbpi_index_lookup_apn(index, mcc, mnc,
+						allow_duplicates, error);
+
 	memset(&gsm, 0, sizeof(gsm));
 	gsm.match_mcc = mcc;
 	gsm.match_mnc = mnc;
@@ -758,12 +1648,18 @@ GSList *mbpi_lookup_apn(const char *mcc, const char *mnc,
 
 char *mbpi_lookup_cdma_provider_name(const char *sid, GError **error)
 {
+	const struct mbpi_index *index = mbpi_index_get();
 	struct cdma_data cdma;
 
+	if (index)
+		return mbpi_index_lookup_cdma_provider_name(index, sid);
+
 	memset(&cdma, 0, sizeof(cdma));
 	cdma.match_sid = sid;
 
-	if (mbpi_parse(&toplevel_cdma_parser, &cdma, error) == FALSE) {
+	/* Only the name of the matching provider is of interest */
+	if (mbpi_parse(&toplevel_cdma_parser, &cdma, error) == FALSE ||
+						!cdma.match_found) {
 		g_free(cdma.provider_name);
 		cdma.provider_name = NULL;
 	}
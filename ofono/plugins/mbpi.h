@@ -21,6 +21,9 @@
  */
 
 extern const char *mbpi_database;
+
+/* Serve lookups from the compiled <database>.idx, on by default */
+extern gboolean mbpi_use_index;
 extern enum ofono_gprs_proto mbpi_default_internet_proto;
 extern enum ofono_gprs_proto mbpi_default_mms_proto;
 extern enum ofono_gprs_proto mbpi_default_ims_proto;
@@ -0,0 +1,488 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#define OFONO_API_SUBJECT_TO_CHANGE
+#include <ofono/log.h>
+#include <ofono/modem.h>
+#include <ofono/gprs-provision.h>
+
+#include "provision-cache.h"
+#include "mbpi.h"
+#include "storage.h"
+
+#define PROVISION_CACHE_STORE		"provision_cache"
+#define PROVISION_CACHE_GROUP		"Database"
+#define PROVISION_CACHE_FINGERPRINT	"Fingerprint"
+#define PROVISION_CACHE_MAX		32
+#define PROVISION_CACHE_MAX_APS		256
+
+#define PROVISION_CACHE_MCC		"MCC"
+#define PROVISION_CACHE_MNC		"MNC"
+#define PROVISION_CACHE_SPN		"SPN"
+#define PROVISION_CACHE_COUNT		"Count"
+#define PROVISION_CACHE_SEQ		"Seq"
+
+struct provision_cache_entry {
+	char *mcc;
+	char *mnc;
+	char *spn;
+	struct ofono_gprs_provision_data *settings;
+	int count;
+	guint seq;	/* Insertion order, the lowest goes first */
+};
+
+/* Entries by "<mcc>\n<mnc>[\n<spn>]" */
+static GHashTable *provision_cache;
+static char *provision_cache_fingerprint;
+static struct provision_cache_stats provision_cache_stats;
+static guint provision_cache_seq;
+
+static char *provision_cache_key(const char *mcc, const char *mnc,
+							const char *spn)
+{
+	/* No SPN and an empty one are different keys */
+	return g_strconcat(mcc, "\n", mnc, spn ? "\n" : NULL, spn, NULL);
+}
+
+/*
+ * Anything the results depend on besides MCC, MNC and SPN. If this
+ * changes, the whole cache is thrown away.
+ */
+static char *provision_cache_fingerprint_new(void)
+{
+	struct stat st;
+
+	if (stat(mbpi_database, &st) < 0)
+		memset(&st, 0, sizeof(st));
+
+	return g_strdup_printf("%s %lld.%09ld %lld %d %d %d %d %d",
+			mbpi_database, (long long) st.st_mtim.tv_sec,
+			(long) st.st_mtim.tv_nsec, (long long) st.st_size,
+			mbpi_default_internet_proto, mbpi_default_mms_proto,
+			mbpi_default_ims_proto, mbpi_default_proto,
+			mbpi_default_auth_method);
+}
+
+static struct ofono_gprs_provision_data *provision_cache_copy(
+			const struct ofono_gprs_provision_data *settings,
+			int count)
+{
+	struct ofono_gprs_provision_data *copy =
+			g_new0(struct ofono_gprs_provision_data, count);
+	int i;
+
+	for (i = 0; i < count; i++) {
+		const struct ofono_gprs_provision_data *src = settings + i;
+		struct ofono_gprs_provision_data *dest = copy + i;
+
+		*dest = *src;
+		dest->provider_name = g_strdup(src->provider_name);
+		dest->name = g_strdup(src->name);
+		dest->apn = g_strdup(src->apn);
+		dest->username = g_strdup(src->username);
+		dest->password = g_strdup(src->password);
+		dest->message_proxy = g_strdup(src->message_proxy);
+		dest->message_center = g_strdup(src->message_center);
+	}
+
+	return copy;
+}
+
+static void provision_cache_entry_free(gpointer data)
+{
+	struct provision_cache_entry *entry = data;
+
+	ofono_gprs_provision_free_settings(entry->settings, entry->count);
+	g_free(entry->mcc);
+	g_free(entry->mnc);
+	g_free(entry->spn);
+	g_free(entry);
+}
+
+static gboolean provision_cache_equal(
+			const struct ofono_gprs_provision_data *s1,
+			const struct ofono_gprs_provision_data *s2, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		const struct ofono_gprs_provision_data *ap1 = s1 + i;
+		const struct ofono_gprs_provision_data *ap2 = s2 + i;
+
+		if (ap1->type != ap2->type || ap1->proto != ap2->proto ||
+				ap1->provider_primary !=
+						ap2->provider_primary ||
+				ap1->auth_method != ap2->auth_method ||
+				g_strcmp0(ap1->provider_name,
+						ap2->provider_name) ||
+				g_strcmp0(ap1->name, ap2->name) ||
+				g_strcmp0(ap1->apn, ap2->apn) ||
+				g_strcmp0(ap1->username, ap2->username) ||
+				g_strcmp0(ap1->password, ap2->password) ||
+				g_strcmp0(ap1->message_proxy,
+						ap2->message_proxy) ||
+				g_strcmp0(ap1->message_center,
+						ap2->message_center))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Drops the entry that has been in the cache the longest */
+static void provision_cache_evict(void)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	gpointer oldest = NULL;
+	guint seq = 0;
+
+	g_hash_table_iter_init(&iter, provision_cache);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		const struct provision_cache_entry *entry = value;
+
+		if (!oldest || entry->seq < seq) {
+			oldest = key;
+			seq = entry->seq;
+		}
+	}
+
+	if (oldest)
+		g_hash_table_remove(provision_cache, oldest);
+}
+
+static void provision_cache_add(struct provision_cache_entry *entry)
+{
+	char *key = provision_cache_key(entry->mcc, entry->mnc, entry->spn);
+
+	if (!g_hash_table_contains(provision_cache, key) &&
+			g_hash_table_size(provision_cache) >=
+						PROVISION_CACHE_MAX)
+		provision_cache_evict();
+
+	if (provision_cache_seq < entry->seq)
+		provision_cache_seq = entry->seq;
+
+	g_hash_table_replace(provision_cache, key, entry);
+}
+
+static char *provision_cache_ap_key(const char *name, int i)
+{
+	return g_strdup_printf("%s.%d", name, i);
+}
+
+static void provision_cache_set_string(GKeyFile *k, const char *group,
+				const char *name, int i, const char *value)
+{
+	if (value) {
+		char *key = provision_cache_ap_key(name, i);
+
+		g_key_file_set_string(k, group, key, value);
+		g_free(key);
+	}
+}
+
+static void provision_cache_set_integer(GKeyFile *k, const char *group,
+				const char *name, int i, int value)
+{
+	char *key = provision_cache_ap_key(name, i);
+
+	g_key_file_set_integer(k, group, key, value);
+	g_free(key);
+}
+
+static char *provision_cache_get_string(GKeyFile *k, const char *group,
+						const char *name, int i)
+{
+	char *key = provision_cache_ap_key(name, i);
+	char *value = g_key_file_get_string(k, group, key, NULL);
+
+	g_free(key);
+	return value;
+}
+
+static int provision_cache_get_integer(GKeyFile *k, const char *group,
+						const char *name, int i)
+{
+	char *key = provision_cache_ap_key(name, i);
+	int value = g_key_file_get_integer(k, group, key, NULL);
+
+	g_free(key);
+	return value;
+}
+
+static void provision_cache_save_entry(GKeyFile *k,
+				const struct provision_cache_entry *entry)
+{
+	char *key = provision_cache_key(entry->mcc, entry->mnc, entry->spn);
+	char *group = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+	int i;
+
+	g_key_file_set_string(k, group, PROVISION_CACHE_MCC, entry->mcc);
+	g_key_file_set_string(k, group, PROVISION_CACHE_MNC, entry->mnc);
+	if (entry->spn)
+		g_key_file_set_string(k, group, PROVISION_CACHE_SPN,
+								entry->spn);
+	g_key_file_set_integer(k, group, PROVISION_CACHE_COUNT, entry->count);
+	g_key_file_set_integer(k, group, PROVISION_CACHE_SEQ, entry->seq);
+
+	for (i = 0; i < entry->count; i++) {
+		const struct ofono_gprs_provision_data *ap =
+							entry->settings + i;
+
+		provision_cache_set_integer(k, group, "Type", i, ap->type);
+		provision_cache_set_integer(k, group, "Protocol", i,
+								ap->proto);
+		provision_cache_set_string(k, group, "ProviderName", i,
+							ap->provider_name);
+		provision_cache_set_integer(k, group, "ProviderPrimary", i,
+							ap->provider_primary);
+		provision_cache_set_string(k, group, "Name", i, ap->name);
+		provision_cache_set_string(k, group, "AccessPointName", i,
+								ap->apn);
+		provision_cache_set_string(k, group, "Username", i,
+							ap->username);
+		provision_cache_set_string(k, group, "Password", i,
+							ap->password);
+		provision_cache_set_integer(k, group, "AuthenticationMethod",
+							i, ap->auth_method);
+		provision_cache_set_string(k, group, "MessageProxy", i,
+							ap->message_proxy);
+		provision_cache_set_string(k, group, "MessageCenter", i,
+							ap->message_center);
+	}
+
+	g_free(group);
+	g_free(key);
+}
+
+static struct provision_cache_entry *provision_cache_load_entry(GKeyFile *k,
+							const char *group)
+{
+	struct provision_cache_entry *entry;
+	char *mcc = g_key_file_get_string(k, group, PROVISION_CACHE_MCC, NULL);
+	char *mnc = g_key_file_get_string(k, group, PROVISION_CACHE_MNC, NULL);
+	int count = g_key_file_get_integer(k, group, PROVISION_CACHE_COUNT,
+									NULL);
+	int i;
+
+	if (mcc == NULL || mnc == NULL || count <= 0 ||
+					count > PROVISION_CACHE_MAX_APS) {
+		g_free(mcc);
+		g_free(mnc);
+		return NULL;
+	}
+
+	entry = g_new0(struct provision_cache_entry, 1);
+	entry->mcc = mcc;
+	entry->mnc = mnc;
+	entry->spn = g_key_file_get_string(k, group, PROVISION_CACHE_SPN,
+									NULL);
+	entry->settings = g_new0(struct ofono_gprs_provision_data, count);
+	entry->count = count;
+	entry->seq = g_key_file_get_integer(k, group, PROVISION_CACHE_SEQ,
+									NULL);
+
+	for (i = 0; i < count; i++) {
+		struct ofono_gprs_provision_data *ap = entry->settings + i;
+
+		ap->type = provision_cache_get_integer(k, group, "Type", i);
+		ap->proto = provision_cache_get_integer(k, group,
+							"Protocol", i);
+		ap->provider_name = provision_cache_get_string(k, group,
+							"ProviderName", i);
+		ap->provider_primary = provision_cache_get_integer(k, group,
+							"ProviderPrimary", i);
+		ap->name = provision_cache_get_string(k, group, "Name", i);
+		ap->apn = provision_cache_get_string(k, group,
+							"AccessPointName", i);
+		ap->username = provision_cache_get_string(k, group,
+							"Username", i);
+		ap->password = provision_cache_get_string(k, group,
+							"Password", i);
+		ap->auth_method = provision_cache_get_integer(k, group,
+						"AuthenticationMethod", i);
+		ap->message_proxy = provision_cache_get_string(k, group,
+							"MessageProxy", i);
+		ap->message_center = provision_cache_get_string(k, group,
+							"MessageCenter", i);
+	}
+
+	return entry;
+}
+
+static void provision_cache_load(void)
+{
+	GKeyFile *k = storage_open(NULL, PROVISION_CACHE_STORE);
+	char *fingerprint = g_key_file_get_string(k, PROVISION_CACHE_GROUP,
+					PROVISION_CACHE_FINGERPRINT, NULL);
+
+	provision_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+					g_free, provision_cache_entry_free);
+
+	/* What was cached for another database is of no use */
+	if (!g_strcmp0(fingerprint, provision_cache_fingerprint)) {
+		gchar **groups = g_key_file_get_groups(k, NULL);
+		gchar **group;
+
+		for (group = groups; *group; group++) {
+			struct provision_cache_entry *entry;
+
+			if (!strcmp(*group, PROVISION_CACHE_GROUP))
+				continue;
+
+			entry = provision_cache_load_entry(k, *group);
+			if (entry)
+				provision_cache_add(entry);
+		}
+
+		g_strfreev(groups);
+	}
+
+	DBG("%u entries", g_hash_table_size(provision_cache));
+	g_free(fingerprint);
+	g_key_file_free(k);
+}
+
+static void provision_cache_save(void)
+{
+	GKeyFile *k = g_key_file_new();
+	GHashTableIter iter;
+	gpointer value;
+
+	g_key_file_set_string(k, PROVISION_CACHE_GROUP,
+				PROVISION_CACHE_FINGERPRINT,
+				provision_cache_fingerprint);
+
+	g_hash_table_iter_init(&iter, provision_cache);
+	while (g_hash_table_iter_next(&iter, NULL, &value))
+		provision_cache_save_entry(k, value);
+
+	storage_close(NULL, PROVISION_CACHE_STORE, k, TRUE);
+}
+
+/* Makes sure that the cache matches the current database */
+static void provision_cache_check(void)
+{
+	char *fingerprint = provision_cache_fingerprint_new();
+
+	if (provision_cache && !g_strcmp0(fingerprint,
+					provision_cache_fingerprint)) {
+		g_free(fingerprint);
+		return;
+	}
+
+	g_free(provision_cache_fingerprint);
+	provision_cache_fingerprint = fingerprint;
+
+	if (provision_cache) {
+		DBG("database has changed");
+		g_hash_table_remove_all(provision_cache);
+	} else {
+		provision_cache_load();
+	}
+}
+
+gboolean provision_cache_get(const char *mcc, const char *mnc,
+				const char *spn,
+				struct ofono_gprs_provision_data **settings,
+				int *count)
+{
+	struct provision_cache_entry *entry;
+	char *key;
+
+	provision_cache_check();
+
+	key = provision_cache_key(mcc, mnc, spn);
+	entry = g_hash_table_lookup(provision_cache, key);
+	g_free(key);
+
+	if (entry == NULL) {
+		provision_cache_stats.misses++;
+		return FALSE;
+	}
+
+	provision_cache_stats.hits++;
+	*settings = provision_cache_copy(entry->settings, entry->count);
+	*count = entry->count;
+	return TRUE;
+}
+
+void provision_cache_put(const char *mcc, const char *mnc, const char *spn,
+			const struct ofono_gprs_provision_data *settings,
+			int count)
+{
+	struct provision_cache_entry *entry;
+	char *key;
+
+	if (count <= 0)
+		return;
+
+	provision_cache_check();
+
+	/* Nothing to write if the same thing is already there */
+	key = provision_cache_key(mcc, mnc, spn);
+	entry = g_hash_table_lookup(provision_cache, key);
+	g_free(key);
+
+	if (entry && entry->count == count &&
+			provision_cache_equal(entry->settings, settings, count))
+		return;
+
+	entry = g_new0(struct provision_cache_entry, 1);
+	entry->mcc = g_strdup(mcc);
+	entry->mnc = g_strdup(mnc);
+	entry->spn = g_strdup(spn);
+	entry->settings = provision_cache_copy(settings, count);
+	entry->count = count;
+	entry->seq = provision_cache_seq + 1;
+
+	provision_cache_add(entry);
+	provision_cache_save();
+}
+
+void provision_cache_cleanup(void)
+{
+	if (provision_cache) {
+		g_hash_table_destroy(provision_cache);
+		provision_cache = NULL;
+	}
+
+	g_free(provision_cache_fingerprint);
+	provision_cache_fingerprint = NULL;
+	provision_cache_seq = 0;
+}
+
+const struct provision_cache_stats *provision_cache_get_stats(void)
+{
+	return &provision_cache_stats;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
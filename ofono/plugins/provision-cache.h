@@ -0,0 +1,37 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+/*
+ * Final provisioning results by MCC, MNC and SPN, kept in memory and
+ * in STORAGEDIR so that they survive restarts. The whole cache is
+ * dropped when the database or the mbpi defaults change.
+ */
+
+struct ofono_gprs_provision_data;
+
+struct provision_cache_stats {
+	unsigned int hits;
+	unsigned int misses;
+};
+
+gboolean provision_cache_get(const char *mcc, const char *mnc,
+				const char *spn,
+				struct ofono_gprs_provision_data **settings,
+				int *count);
+void provision_cache_put(const char *mcc, const char *mnc, const char *spn,
+			const struct ofono_gprs_provision_data *settings,
+			int count);
+void provision_cache_cleanup(void);
+const struct provision_cache_stats *provision_cache_get_stats(void);
@@ -35,6 +35,7 @@
 #include <ofono/modem.h>
 #include <ofono/gprs-provision.h>
 
+#include "provision-cache.h"
 #include "mbpi.h"
 
 static int provision_get_settings(const char *mcc, const char *mnc,
@@ -50,6 +51,11 @@ static int provision_get_settings(const char *mcc, const char *mnc,
 
 	DBG("Provisioning for MCC %s, MNC %s, SPN '%s'", mcc, mnc, spn);
 
+	if (provision_cache_get(mcc, mnc, spn, settings, count)) {
+		DBG("Provisioning %d cached APs", *count);
+		return 0;
+	}
+
 	apns = mbpi_lookup_apn(mcc, mnc, FALSE, &error);
 	if (apns == NULL) {
 		if (error != NULL) {
@@ -94,6 +100,7 @@ static int provision_get_settings(const char *mcc, const char *mnc,
 	}
 
 	g_slist_free(apns);
+	provision_cache_put(mcc, mnc, spn, *settings, *count);
 
 	return 0;
 }
@@ -111,6 +118,7 @@ static int provision_init(void)
 static void provision_exit(void)
 {
 	ofono_gprs_provision_driver_unregister(&provision_driver);
+	provision_cache_cleanup();
 }
 
 OFONO_PLUGIN_DEFINE(provision, "Provisioning Plugin", VERSION,
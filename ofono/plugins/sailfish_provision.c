@@ -31,6 +31,7 @@
 #include <ofono/gprs-provision.h>
 
 #include "provision.h"
+#include "provision-cache.h"
 #include "mbpi.h"
 
 struct provision_ap_defaults {
@@ -201,6 +202,11 @@ int provision_get_settings(const char *mcc, const char *mnc,
 
 	ofono_info("Provisioning for MCC %s, MNC %s, SPN '%s'", mcc, mnc, spn);
 
+	if (provision_cache_get(mcc, mnc, spn, settings, count)) {
+		DBG("Provisioning %d cached APs", *count);
+		return 0;
+	}
+
 	/*
 	 * Passing FALSE to mbpi_lookup_apn() would return
 	 * an empty list if duplicates are found.
@@ -235,6 +241,7 @@ int provision_get_settings(const char *mcc, const char *mnc,
 	}
 
 	g_slist_free(apns);
+	provision_cache_put(mcc, mnc, spn, *settings, *count);
 
 	return 0;
 }
@@ -254,6 +261,7 @@ static void provision_exit(void)
 {
 	DBG("");
 	ofono_gprs_provision_driver_unregister(&provision_driver);
+	provision_cache_cleanup();
 }
 
 OFONO_PLUGIN_DEFINE(provision, "Provisioning Plugin", VERSION,
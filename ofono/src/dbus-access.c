@@ -16,11 +16,28 @@
 
 #include "ofono.h"
 
+#include <gdbus.h>
+
 #include <errno.h>
 #include <string.h>
 
 static GSList *dbus_access_plugins = NULL;
 
+/*
+ * Decisions are remembered per sender until it leaves the bus or
+ * the policy changes. Unique names are never reused, so whatever the
+ * plugins said about a particular peer stays valid for its lifetime.
+ */
+struct dbus_access_sender {
+	char *name;
+	guint watch_id;
+	GHashTable *decisions;	/* intf << 16 | method => decision + 1 */
+};
+
+static DBusConnection *dbus_access_conn = NULL;
+static GHashTable *dbus_access_cache = NULL;	/* name => sender */
+static struct ofono_dbus_access_cache_stats dbus_access_stats;
+
 const char *ofono_dbus_access_intf_name(enum ofono_dbus_access_intf intf)
 {
 	switch (intf) {
@@ -208,7 +225,65 @@ const char *ofono_dbus_access_method_name(enum ofono_dbus_access_intf intf,
 	return NULL;
 }
 
-ofono_bool_t ofono_dbus_access_method_allowed(const char *sender,
+static void dbus_access_sender_free(gpointer data)
+{
+	struct dbus_access_sender *s = data;
+
+	if (s->watch_id) {
+		g_dbus_remove_watch(dbus_access_conn, s->watch_id);
+	}
+	g_hash_table_destroy(s->decisions);
+	g_free(s->name);
+	g_slice_free(struct dbus_access_sender, s);
+}
+
+static void dbus_access_sender_gone(DBusConnection *conn, void *user_data)
+{
+	struct dbus_access_sender *s = user_data;
+
+	DBG("%s is gone", s->name);
+	g_hash_table_remove(dbus_access_cache, s->name);
+}
+
+/* Returns NULL if the sender can't be remembered */
+static struct dbus_access_sender *dbus_access_sender_get(const char *name)
+{
+	struct dbus_access_sender *s;
+
+	if (!dbus_access_cache) {
+		dbus_access_cache = g_hash_table_new_full(g_str_hash,
+				g_str_equal, NULL, dbus_access_sender_free);
+	}
+
+	s = g_hash_table_lookup(dbus_access_cache, name);
+	if (!s) {
+		s = g_slice_new0(struct dbus_access_sender);
+		s->name = g_strdup(name);
+		s->decisions = g_hash_table_new(g_direct_hash,
+							g_direct_equal);
+		if (dbus_access_conn) {
+			s->watch_id = g_dbus_add_disconnect_watch
+				(dbus_access_conn, s->name,
+				dbus_access_sender_gone, s, NULL);
+
+			/*
+			 * A sender that left before the watch was armed
+			 * would never be forgotten. Unique names aren't
+			 * reused, so checking once after arming it is enough.
+			 */
+			if (!s->watch_id || !dbus_bus_name_has_owner
+					(dbus_access_conn, s->name, NULL)) {
+				DBG("not caching %s", s->name);
+				dbus_access_sender_free(s);
+				return NULL;
+			}
+		}
+		g_hash_table_insert(dbus_access_cache, s->name, s);
+	}
+	return s;
+}
+
+static ofono_bool_t dbus_access_check(const char *sender,
 					enum ofono_dbus_access_intf intf,
 					int method, const char *arg)
 {
@@ -233,6 +308,74 @@ ofono_bool_t ofono_dbus_access_method_allowed(const char *sender,
 	return TRUE;
 }
 
+ofono_bool_t ofono_dbus_access_method_allowed(const char *sender,
+					enum ofono_dbus_access_intf intf,
+					int method, const char *arg)
+{
+	struct dbus_access_sender *s;
+	ofono_bool_t allowed;
+	gpointer value;
+	gpointer key;
+
+	/*
+	 * Nothing to remember for anonymous callers. Decisions that
+	 * depend on an argument aren't remembered either, the caller
+	 * picks the argument and could grow the cache without limit.
+	 */
+	if (!sender || arg || !dbus_access_plugins) {
+		return dbus_access_check(sender, intf, method, arg);
+	}
+
+	s = dbus_access_sender_get(sender);
+	if (!s) {
+		return dbus_access_check(sender, intf, method, arg);
+	}
+
+	key = GUINT_TO_POINTER((intf << 16) | method);
+	value = g_hash_table_lookup(s->decisions, key);
+	if (value) {
+		dbus_access_stats.hits++;
+		return GPOINTER_TO_INT(value) - 1;
+	}
+
+	dbus_access_stats.misses++;
+	allowed = dbus_access_check(sender, intf, method, arg);
+	g_hash_table_insert(s->decisions, key,
+				GINT_TO_POINTER((allowed != FALSE) + 1));
+	return allowed;
+}
+
+void ofono_dbus_access_policy_changed(void)
+{
+	if (dbus_access_cache) {
+		DBG("%u hits, %u misses", dbus_access_stats.hits,
+						dbus_access_stats.misses);
+		g_hash_table_remove_all(dbus_access_cache);
+	}
+}
+
+const struct ofono_dbus_access_cache_stats *
+				__ofono_dbus_access_cache_stats(void)
+{
+	return &dbus_access_stats;
+}
+
+void __ofono_dbus_access_init(DBusConnection *conn)
+{
+	ofono_dbus_access_policy_changed();
+	dbus_access_conn = conn;
+}
+
+void __ofono_dbus_access_cleanup(void)
+{
+	if (dbus_access_cache) {
+		ofono_dbus_access_policy_changed();
+		g_hash_table_destroy(dbus_access_cache);
+		dbus_access_cache = NULL;
+	}
+	dbus_access_conn = NULL;
+}
+
 /**
  * Returns 0 if both are equal;
  * <0 if a comes before b;
@@ -266,6 +409,7 @@ int ofono_dbus_access_plugin_register
 		DBG("%s", plugin->name);
 		dbus_access_plugins = g_slist_insert_sorted(dbus_access_plugins,
 				(void*)plugin, ofono_dbus_access_plugin_sort);
+		ofono_dbus_access_policy_changed();
 		return 0;
 	}
 }
@@ -277,6 +421,7 @@ void ofono_dbus_access_plugin_unregister
 		DBG("%s", plugin->name);
 		dbus_access_plugins = g_slist_remove(dbus_access_plugins,
 								plugin);
+		ofono_dbus_access_policy_changed();
 	}
 }
 
@@ -22,12 +22,42 @@
 
 #include <glib.h>
 #include <errno.h>
+#include <string.h>
 #include <gdbus.h>
 
 #include "ofono.h"
 
 static DBusConnection *g_connection;
 
+/*
+ * Optional coalescing of PropertyChanged signals. Changes are collected
+ * per (path, interface) until the main loop goes idle; a property that
+ * changes several times in the meantime is only reported once, with
+ * its latest value.
+ */
+struct property_batch {
+	DBusConnection *conn;
+	char *key;			/* "path interface" */
+	char *path;
+	char *interface;
+	GPtrArray *names;		/* In the order of the first change */
+	GHashTable *changes;		/* name => PropertyChanged signal */
+};
+
+static enum ofono_dbus_signal_batch_mode batch_mode;
+static struct ofono_dbus_signal_batch_stats batch_stats;
+static GHashTable *batch_table;		/* "path interface" => batch */
+static GQueue batch_queue = G_QUEUE_INIT;
+static guint batch_flush_id;
+static gboolean batch_sending;
+
+/*
+ * GetProperties replies of the busiest interfaces are kept around until
+ * one of the properties changes, so that repeated calls only copy the
+ * message instead of building the dictionary again.
+ */
+static GHashTable *reply_cache;		/* "path interface" => reply */
+
 struct error_mapping_entry {
 	int error;
 	DBusMessage *(*ofono_error_func)(DBusMessage *);
@@ -226,6 +256,380 @@ DBusMessage *ofono_dbus_signal_new_property_changed(const char *path,
 	return signal;
 }
 
+/* Copies a single value, containers included */
+void __ofono_dbus_append_iter(DBusMessageIter *dest, DBusMessageIter *src)
+{
+	int type = dbus_message_iter_get_arg_type(src);
+
+	if (dbus_type_is_basic(type)) {
+		union {
+			dbus_uint64_t u64;
+			double dbl;
+			const char *str;
+		} value;
+
+		dbus_message_iter_get_basic(src, &value);
+		dbus_message_iter_append_basic(dest, type, &value);
+	} else if (dbus_type_is_container(type)) {
+		DBusMessageIter src_sub, dest_sub;
+		char *sig = NULL;
+
+		dbus_message_iter_recurse(src, &src_sub);
+
+		/* Works for empty arrays too, unlike the contents */
+		if (type == DBUS_TYPE_ARRAY)
+			sig = dbus_message_iter_get_signature(src);
+		else if (type == DBUS_TYPE_VARIANT)
+			sig = dbus_message_iter_get_signature(&src_sub);
+
+		dbus_message_iter_open_container(dest, type,
+				type == DBUS_TYPE_ARRAY ? sig + 1 : sig,
+				&dest_sub);
+		dbus_free(sig);
+
+		while (dbus_message_iter_get_arg_type(&src_sub) !=
+							DBUS_TYPE_INVALID) {
+			__ofono_dbus_append_iter(&dest_sub, &src_sub);
+			dbus_message_iter_next(&src_sub);
+		}
+
+		dbus_message_iter_close_container(dest, &dest_sub);
+	}
+}
+
+static DBusMessage *property_batch_properties_changed(
+						struct property_batch *batch)
+{
+	DBusMessage *signal;
+	DBusMessageIter iter, dict, entry, src;
+	guint i;
+
+	signal = dbus_message_new_signal(batch->path,
+						DBUS_INTERFACE_PROPERTIES,
+						"PropertiesChanged");
+	if (signal == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(signal, &iter);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING,
+							&batch->interface);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+
+	for (i = 0; i < batch->names->len; i++) {
+		const char *name = batch->names->pdata[i];
+		DBusMessage *changed = g_hash_table_lookup(batch->changes,
+									name);
+
+		/* PropertyChanged is (name, value) */
+		dbus_message_iter_init(changed, &src);
+		dbus_message_iter_next(&src);
+
+		dbus_message_iter_open_container(&dict, DBUS_TYPE_DICT_ENTRY,
+								NULL, &entry);
+		dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING,
+								&name);
+		__ofono_dbus_append_iter(&entry, &src);
+		dbus_message_iter_close_container(&dict, &entry);
+	}
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	/* No invalidated properties */
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_STRING_AS_STRING, &dict);
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return signal;
+}
+
+static void property_batch_free(struct property_batch *batch)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init(&iter, batch->changes);
+	while (g_hash_table_iter_next(&iter, NULL, &value))
+		dbus_message_unref(value);
+
+	g_hash_table_destroy(batch->changes);
+	g_ptr_array_free(batch->names, TRUE);
+	g_free(batch->key);
+	g_free(batch->path);
+	g_free(batch->interface);
+	g_free(batch);
+}
+
+static void property_batch_send(struct property_batch *batch)
+{
+	DBusMessage *signal;
+	guint i;
+
+	/* Sending flushes the connection, which mustn't get back to us */
+	batch_sending = TRUE;
+
+	if (batch_mode == OFONO_DBUS_SIGNAL_BATCH_PROPERTIES) {
+		signal = property_batch_properties_changed(batch);
+
+		/*
+		 * gdbus only lets it through for interfaces that have
+		 * a property table, which ofono interfaces don't have.
+		 */
+		if (signal == NULL) {
+			ofono_error("Unable to allocate new %s.PropertiesChanged"
+					" signal", DBUS_INTERFACE_PROPERTIES);
+		} else {
+			if (dbus_connection_send(batch->conn, signal, NULL))
+				batch_stats.signals++;
+
+			dbus_message_unref(signal);
+		}
+	} else {
+		for (i = 0; i < batch->names->len; i++) {
+			signal = g_hash_table_lookup(batch->changes,
+						batch->names->pdata[i]);
+			g_hash_table_steal(batch->changes,
+						batch->names->pdata[i]);
+
+			if (g_dbus_send_message(batch->conn, signal))
+				batch_stats.signals++;
+		}
+	}
+
+	batch_sending = FALSE;
+}
+
+static void property_batch_flush_one(struct property_batch *batch)
+{
+	g_queue_remove(&batch_queue, batch);
+	g_hash_table_remove(batch_table, batch->key);
+
+	property_batch_send(batch);
+	property_batch_free(batch);
+}
+
+/* NULL flushes all connections */
+static void property_batch_flush(DBusConnection *conn)
+{
+	GList *l = batch_queue.head;
+
+	while (l != NULL) {
+		struct property_batch *batch = l->data;
+		GList *next = l->next;
+
+		if (conn == NULL || batch->conn == conn) {
+			g_queue_delete_link(&batch_queue, l);
+			g_hash_table_remove(batch_table, batch->key);
+
+			property_batch_send(batch);
+			property_batch_free(batch);
+		}
+
+		l = next;
+	}
+}
+
+static gboolean property_batch_flush_cb(gpointer user_data)
+{
+	batch_flush_id = 0;
+	property_batch_flush(NULL);
+
+	return FALSE;
+}
+
+/*
+ * gdbus calls this before sending anything else on the connection and
+ * before unregistering an interface. The changes collected so far go
+ * out first, so that they don't arrive after a method reply that
+ * follows them or after the object is gone.
+ */
+static void property_batch_flush_conn(DBusConnection *conn)
+{
+	if (!batch_sending)
+		property_batch_flush(conn);
+}
+
+static void property_batch_add(DBusConnection *conn, DBusMessage *signal)
+{
+	const char *path = dbus_message_get_path(signal);
+	const char *interface = dbus_message_get_interface(signal);
+	struct property_batch *batch;
+	DBusMessageIter iter;
+	const char *name;
+	gpointer key, old;
+	char *batch_key;
+
+	batch_key = g_strconcat(path, " ", interface, NULL);
+	batch = g_hash_table_lookup(batch_table, batch_key);
+
+	/* Don't let signals overtake each other between connections */
+	if (batch != NULL && batch->conn != conn) {
+		property_batch_flush_one(batch);
+		batch = NULL;
+	}
+
+	if (batch == NULL) {
+		batch = g_new0(struct property_batch, 1);
+		batch->conn = conn;
+		batch->key = batch_key;
+		batch->path = g_strdup(path);
+		batch->interface = g_strdup(interface);
+		batch->names = g_ptr_array_new_with_free_func(g_free);
+		batch->changes = g_hash_table_new(g_str_hash, g_str_equal);
+
+		g_hash_table_insert(batch_table, batch->key, batch);
+		g_queue_push_tail(&batch_queue, batch);
+	} else {
+		g_free(batch_key);
+	}
+
+	dbus_message_iter_init(signal, &iter);
+	dbus_message_iter_get_basic(&iter, &name);
+
+	if (g_hash_table_lookup_extended(batch->changes, name, &key, &old)) {
+		dbus_message_unref(old);
+		g_hash_table_insert(batch->changes, key, signal);
+		batch_stats.superseded++;
+	} else {
+		key = g_strdup(name);
+		g_ptr_array_add(batch->names, key);
+		g_hash_table_insert(batch->changes, key, signal);
+	}
+
+	batch_stats.changes++;
+
+	if (batch_flush_id == 0)
+		batch_flush_id = g_idle_add(property_batch_flush_cb, NULL);
+}
+
+DBusMessage *__ofono_dbus_cached_reply(DBusMessage *msg)
+{
+	DBusMessage *cached;
+	DBusMessage *reply;
+	char *key;
+
+	if (reply_cache == NULL)
+		return NULL;
+
+	key = g_strconcat(dbus_message_get_path(msg), " ",
+				dbus_message_get_interface(msg), NULL);
+	cached = g_hash_table_lookup(reply_cache, key);
+	g_free(key);
+
+	if (cached == NULL)
+		return NULL;
+
+	reply = dbus_message_copy(cached);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_set_reply_serial(reply, dbus_message_get_serial(msg));
+	dbus_message_set_destination(reply, dbus_message_get_sender(msg));
+
+	return reply;
+}
+
+void __ofono_dbus_cache_reply(DBusMessage *msg, DBusMessage *reply)
+{
+	if (reply == NULL ||
+		dbus_message_get_type(reply) != DBUS_MESSAGE_TYPE_METHOD_RETURN)
+		return;
+
+	if (reply_cache == NULL)
+		reply_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+				g_free, (GDestroyNotify) dbus_message_unref);
+
+	g_hash_table_replace(reply_cache,
+			g_strconcat(dbus_message_get_path(msg), " ",
+				dbus_message_get_interface(msg), NULL),
+			dbus_message_ref(reply));
+}
+
+void __ofono_dbus_invalidate_reply(const char *path, const char *interface)
+{
+	GHashTableIter iter;
+	gpointer key;
+	gsize len;
+
+	if (reply_cache == NULL || path == NULL)
+		return;
+
+	if (interface != NULL) {
+		key = g_strconcat(path, " ", interface, NULL);
+		g_hash_table_remove(reply_cache, key);
+		g_free(key);
+		return;
+	}
+
+	/* Everything registered on the path */
+	len = strlen(path);
+
+	g_hash_table_iter_init(&iter, reply_cache);
+	while (g_hash_table_iter_next(&iter, &key, NULL)) {
+		const char *str = key;
+
+		if (!strncmp(str, path, len) && str[len] == ' ')
+			g_hash_table_iter_remove(&iter);
+	}
+}
+
+static int property_changed_send(DBusConnection *conn, DBusMessage *signal)
+{
+	__ofono_dbus_invalidate_reply(dbus_message_get_path(signal),
+					dbus_message_get_interface(signal));
+
+	if (batch_mode == OFONO_DBUS_SIGNAL_BATCH_NONE)
+		return g_dbus_send_message(conn, signal);
+
+	property_batch_add(conn, signal);
+	return TRUE;
+}
+
+void __ofono_dbus_signal_batch_set_mode(
+				enum ofono_dbus_signal_batch_mode mode)
+{
+	if (batch_mode == mode)
+		return;
+
+	/* Pending changes go out the way they were collected */
+	__ofono_dbus_signal_batch_flush();
+
+	batch_mode = mode;
+
+	if (mode != OFONO_DBUS_SIGNAL_BATCH_NONE && batch_table == NULL)
+		batch_table = g_hash_table_new(g_str_hash, g_str_equal);
+
+	g_dbus_set_flush_function(mode == OFONO_DBUS_SIGNAL_BATCH_NONE ?
+					NULL : property_batch_flush_conn);
+}
+
+enum ofono_dbus_signal_batch_mode __ofono_dbus_signal_batch_get_mode(void)
+{
+	return batch_mode;
+}
+
+void __ofono_dbus_signal_batch_flush(void)
+{
+	if (batch_flush_id) {
+		g_source_remove(batch_flush_id);
+		batch_flush_id = 0;
+	}
+
+	property_batch_flush(NULL);
+}
+
+const struct ofono_dbus_signal_batch_stats *
+				__ofono_dbus_signal_batch_get_stats(void)
+{
+	return &batch_stats;
+}
+
+void __ofono_dbus_signal_batch_reset_stats(void)
+{
+	memset(&batch_stats, 0, sizeof(batch_stats));
+}
+
 int ofono_dbus_signal_property_changed(DBusConnection *conn,
 					const char *path,
 					const char *interface,
@@ -241,7 +645,7 @@ int ofono_dbus_signal_property_changed(DBusConnection *conn,
 		return -1;
 	}
 
-	return g_dbus_send_message(conn, signal);
+	return property_changed_send(conn, signal);
 }
 
 int ofono_dbus_signal_array_property_changed(DBusConnection *conn,
@@ -267,7 +671,7 @@ int ofono_dbus_signal_array_property_changed(DBusConnection *conn,
 
 	append_array_variant(&iter, type, value);
 
-	return g_dbus_send_message(conn, signal);
+	return property_changed_send(conn, signal);
 }
 
 int ofono_dbus_signal_dict_property_changed(DBusConnection *conn,
@@ -293,7 +697,7 @@ int ofono_dbus_signal_dict_property_changed(DBusConnection *conn,
 
 	append_dict_variant(&iter, type, value);
 
-	return g_dbus_send_message(conn, signal);
+	return property_changed_send(conn, signal);
 }
 
 DBusMessage *__ofono_error_invalid_args(DBusMessage *msg)
@@ -506,6 +910,18 @@ void __ofono_dbus_cleanup(void)
 {
 	DBusConnection *conn = ofono_dbus_get_connection();
 
+	__ofono_dbus_signal_batch_set_mode(OFONO_DBUS_SIGNAL_BATCH_NONE);
+
+	if (batch_table) {
+		g_hash_table_destroy(batch_table);
+		batch_table = NULL;
+	}
+
+	if (reply_cache) {
+		g_hash_table_destroy(reply_cache);
+		reply_cache = NULL;
+	}
+
 	if (conn == NULL || !dbus_connection_get_is_connected(conn))
 		return;
 
@@ -36,6 +36,9 @@ struct gprs_filter_request {
 	GSList *filter_link;
 	guint pending_id;
 	guint next_id;
+	gboolean in_process;
+	GSourceFunc sync_next;
+	gint64 start;
 	ofono_destroy_func destroy;
 	void* user_data;
 };
@@ -54,6 +57,7 @@ struct gprs_filter_request_check {
 struct gprs_filter_chain {
 	struct ofono_gprs *gprs;
 	GSList *req_list;
+	struct ofono_filter_chain_stats stats;
 };
 
 static GSList *gprs_filter_list = NULL;
@@ -69,6 +73,7 @@ static void gprs_filter_request_init(struct gprs_filter_request *req,
 	req->filter_link = gprs_filter_list;
 	req->destroy = destroy;
 	req->user_data = user_data;
+	req->start = g_get_monotonic_time();
 
 	/*
 	 * The list holds an implicit reference to the message. The reference
@@ -91,6 +96,7 @@ static void gprs_filter_request_cancel(struct gprs_filter_request *req)
 		f->cancel(req->pending_id);
 		req->pending_id = 0;
 	}
+	req->sync_next = NULL;
 	if (req->next_id) {
 		g_source_remove(req->next_id);
 		req->next_id = 0;
@@ -159,6 +165,18 @@ static void gprs_filter_request_dequeue(struct gprs_filter_request *req)
 static void gprs_filter_request_complete(struct gprs_filter_request *req,
 							gboolean allow)
 {
+	struct gprs_filter_chain *chain = req->chain;
+
+	if (chain) {
+		struct ofono_filter_chain_stats *stats = &chain->stats;
+		const unsigned int us = g_get_monotonic_time() - req->start;
+
+		stats->requests++;
+		stats->latency_total_us += us;
+		if (stats->latency_max_us < us)
+			stats->latency_max_us = us;
+	}
+
 	gprs_filter_request_ref(req);
 	req->fn->complete(req, allow);
 	gprs_filter_request_dispose(req);
@@ -166,23 +184,54 @@ static void gprs_filter_request_complete(struct gprs_filter_request *req,
 	gprs_filter_request_unref(req);
 }
 
+static gboolean gprs_filter_request_continue_cb(gpointer data);
+
 static void gprs_filter_request_process(struct gprs_filter_request *req)
 {
-	GSList *l = req->filter_link;
-	const struct ofono_gprs_filter *f = l->data;
 	const struct gprs_filter_request_fn *fn = req->fn;
 
-	while (f && !fn->can_process(f)) {
-		l = l->next;
-		f = l ? l->data : NULL;
-	}
-
+	/*
+	 * Filters that reply before returning from their process
+	 * callback are stepped through by this loop, without going
+	 * through the main loop and without recursion.
+	 */
 	gprs_filter_request_ref(req);
-	if (f) {
+	while (req->chain) {
+		GSList *l = req->filter_link;
+		const struct ofono_gprs_filter *f = l ? l->data : NULL;
+		GSourceFunc next;
+		guint id;
+
+		while (f && !fn->can_process(f)) {
+			l = l->next;
+			f = l ? l->data : NULL;
+		}
+
+		if (!f) {
+			gprs_filter_request_complete(req, TRUE);
+			break;
+		}
+
 		req->filter_link = l;
-		req->pending_id = fn->process(f, req);
-	} else {
-		gprs_filter_request_complete(req, TRUE);
+		req->in_process = TRUE;
+		id = fn->process(f, req);
+		req->in_process = FALSE;
+
+		next = req->sync_next;
+		req->sync_next = NULL;
+		if (!req->chain) {
+			/* Canceled by the filter */
+			break;
+		} else if (!next) {
+			/* The reply will come later */
+			req->pending_id = id;
+			break;
+		} else if (next != gprs_filter_request_continue_cb) {
+			next(req);
+			break;
+		}
+
+		req->filter_link = l->next;
 	}
 	gprs_filter_request_unref(req);
 }
@@ -190,8 +239,19 @@ static void gprs_filter_request_process(struct gprs_filter_request *req)
 static void gprs_filter_request_next(struct gprs_filter_request *req,
 							GSourceFunc fn)
 {
+	struct gprs_filter_chain *chain = req->chain;
+
 	req->pending_id = 0;
-	req->next_id = g_idle_add(fn, req);
+	if (req->in_process) {
+		/* gprs_filter_request_process() takes it from here */
+		req->sync_next = fn;
+		if (chain)
+			chain->stats.inline_steps++;
+	} else {
+		req->next_id = g_idle_add(fn, req);
+		if (chain)
+			chain->stats.async_steps++;
+	}
 }
 
 static gboolean gprs_filter_request_continue_cb(gpointer data)
@@ -403,11 +463,19 @@ struct gprs_filter_chain *__ofono_gprs_filter_chain_new(struct ofono_gprs *gp)
 void __ofono_gprs_filter_chain_free(struct gprs_filter_chain *chain)
 {
 	if (chain) {
+		OFONO_FILTER_CHAIN_STATS_DBG(&chain->stats);
+
 		__ofono_gprs_filter_chain_cancel(chain, NULL);
 		g_free(chain);
 	}
 }
 
+const struct ofono_filter_chain_stats *__ofono_gprs_filter_chain_get_stats
+					(struct gprs_filter_chain *chain)
+{
+	return chain ? &chain->stats : NULL;
+}
+
 void __ofono_gprs_filter_chain_cancel(struct gprs_filter_chain *chain,
 					struct ofono_gprs_context *gc)
 {
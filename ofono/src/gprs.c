@@ -308,6 +308,29 @@ static gboolean assign_context(struct pri_context *ctx, int use_cid)
 	return FALSE;
 }
 
+static void gprs_update_status_page(struct ofono_gprs *gprs)
+{
+	struct ofono_modem *modem = __ofono_atom_get_modem(gprs->atom);
+	struct status_page *page = __ofono_modem_get_status_page(modem);
+	unsigned int active = 0;
+	unsigned int types = 0;
+	GSList *l;
+
+	if (page == NULL)
+		return;
+
+	for (l = gprs->contexts; l; l = l->next) {
+		struct pri_context *ctx = l->data;
+
+		if (ctx->active) {
+			active++;
+			types |= 1 << ctx->type;
+		}
+	}
+
+	__ofono_status_page_update_gprs(page, gprs->attached, active, types);
+}
+
 static void release_context(struct pri_context *ctx)
 {
 	if (ctx == NULL || ctx->gprs == NULL || ctx->context_driver == NULL)
@@ -321,6 +344,7 @@ static void release_context(struct pri_context *ctx)
 	ctx->context_driver->inuse = FALSE;
 	ctx->context_driver = NULL;
 	ctx->active = FALSE;
+	gprs_update_status_page(ctx->gprs);
 }
 
 static struct pri_context *gprs_context_by_path(struct ofono_gprs *gprs,
@@ -879,6 +903,13 @@ static void pri_reset_context_properties(struct pri_context *ctx,
 
 	DBG("%s", ctx->path);
 
+	if (ctx->type != ap->type) {
+		ctx->type = ap->type;
+		changed = TRUE;
+		pri_str_signal_change(ctx, "Type",
+				gprs_context_type_to_string(ctx->type));
+	}
+
 	if (strcmp(ctx->context.apn, ap->apn)) {
 		changed = TRUE;
 		strcpy(ctx->context.apn, ap->apn);
@@ -1150,6 +1181,7 @@ static void pri_activate_callback(const struct ofono_error *error, void *data)
 	DBG("%p", ctx);
 
 	ctx->active = TRUE;
+	gprs_update_status_page(ctx->gprs);
 	__ofono_dbus_pending_reply(&ctx->pending,
 				dbus_message_new_method_return(ctx->pending));
 
@@ -1219,6 +1251,7 @@ static void gprs_set_attached_property(struct ofono_gprs *gprs,
 		return;
 
 	gprs->attached = attached;
+	gprs_update_status_page(gprs);
 
 	path = __ofono_atom_get_path(gprs->atom);
 	ofono_dbus_signal_property_changed(conn, path,
@@ -1246,6 +1279,7 @@ static void pri_read_settings_callback(const struct ofono_error *error,
 	}
 
 	pri_ctx->active = TRUE;
+	gprs_update_status_page(gprs);
 
 	if (gc->interface != NULL) {
 		pri_ifupdown(gc->interface, TRUE);
@@ -1731,6 +1765,124 @@ static DBusMessage *pri_set_property(DBusConnection *conn,
 	return __ofono_error_invalid_args(msg);
 }
 
+static DBusMessage *pri_set_properties(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct pri_context *ctx = data;
+	struct ofono_gprs_provision_data ap;
+	gboolean mms_only = FALSE;
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+
+	if (!dbus_message_iter_init(msg, &iter))
+		return __ofono_error_invalid_args(msg);
+
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY ||
+			dbus_message_iter_get_element_type(&iter) !=
+						DBUS_TYPE_DICT_ENTRY)
+		return __ofono_error_invalid_args(msg);
+
+	/* Start from the current state and overlay the requested values */
+	memset(&ap, 0, sizeof(ap));
+	ap.type = ctx->type;
+	ap.proto = ctx->context.proto;
+	ap.name = ctx->name;
+	ap.apn = ctx->context.apn;
+	ap.username = ctx->context.username;
+	ap.password = ctx->context.password;
+	ap.auth_method = ctx->context.auth_method;
+	ap.message_proxy = ctx->message_proxy;
+	ap.message_center = ctx->message_center;
+
+	dbus_message_iter_recurse(&iter, &dict);
+
+	while (dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY) {
+		DBusMessageIter entry;
+		DBusMessageIter var;
+		const char *property;
+		const char *str;
+
+		dbus_message_iter_recurse(&dict, &entry);
+		dbus_message_iter_get_basic(&entry, &property);
+		dbus_message_iter_next(&entry);
+		dbus_message_iter_recurse(&entry, &var);
+
+		if (!connctx_allow(msg, OFONO_DBUS_ACCESS_CONNCTX_SET_PROPERTY,
+								property))
+			return __ofono_error_access_denied(msg);
+
+		/* Active is still switched with SetProperty */
+		if (dbus_message_iter_get_arg_type(&var) != DBUS_TYPE_STRING)
+			return __ofono_error_invalid_args(msg);
+
+		dbus_message_iter_get_basic(&var, &str);
+
+		if (!strcmp(property, "AccessPointName")) {
+			if (strlen(str) > OFONO_GPRS_MAX_APN_LENGTH ||
+							!is_valid_apn(str))
+				return __ofono_error_invalid_format(msg);
+
+			ap.apn = (char *) str;
+		} else if (!strcmp(property, "Type")) {
+			if (!gprs_context_string_to_type(str, &ap.type))
+				return __ofono_error_invalid_format(msg);
+		} else if (!strcmp(property, "Protocol")) {
+			if (!gprs_proto_from_string(str, &ap.proto))
+				return __ofono_error_invalid_format(msg);
+		} else if (!strcmp(property, "Username")) {
+			if (strlen(str) > OFONO_GPRS_MAX_USERNAME_LENGTH)
+				return __ofono_error_invalid_format(msg);
+
+			ap.username = (char *) str;
+		} else if (!strcmp(property, "Password")) {
+			if (strlen(str) > OFONO_GPRS_MAX_PASSWORD_LENGTH)
+				return __ofono_error_invalid_format(msg);
+
+			ap.password = (char *) str;
+		} else if (!strcmp(property, "Name")) {
+			if (strlen(str) > MAX_CONTEXT_NAME_LENGTH)
+				return __ofono_error_invalid_format(msg);
+
+			ap.name = (char *) str;
+		} else if (!strcmp(property, "AuthenticationMethod")) {
+			if (!gprs_auth_method_from_string(str,
+							&ap.auth_method))
+				return __ofono_error_invalid_format(msg);
+		} else if (!strcmp(property, "MessageProxy")) {
+			if (strlen(str) > MAX_MESSAGE_PROXY_LENGTH)
+				return __ofono_error_invalid_format(msg);
+
+			ap.message_proxy = (char *) str;
+			mms_only = TRUE;
+		} else if (!strcmp(property, "MessageCenter")) {
+			if (strlen(str) > MAX_MESSAGE_CENTER_LENGTH)
+				return __ofono_error_invalid_format(msg);
+
+			ap.message_center = (char *) str;
+			mms_only = TRUE;
+		} else {
+			return __ofono_error_invalid_args(msg);
+		}
+
+		dbus_message_iter_next(&dict);
+	}
+
+	if (mms_only && ap.type != OFONO_GPRS_CONTEXT_TYPE_MMS)
+		return __ofono_error_invalid_args(msg);
+
+	/* All of these are read-only when context is active */
+	if (ctx->active == TRUE)
+		return __ofono_error_in_use(msg);
+
+	/*
+	 * Nothing has been touched so far. Apply the whole set at once,
+	 * with a single storage sync and a single settings notification.
+	 */
+	pri_reset_context_properties(ctx, &ap);
+
+	return dbus_message_new_method_return(msg);
+}
+
 static const GDBusMethodTable context_methods[] = {
 	{ GDBUS_METHOD("GetProperties",
 			NULL, GDBUS_ARGS({ "properties", "a{sv}" }),
@@ -1738,6 +1890,9 @@ static const GDBusMethodTable context_methods[] = {
 	{ GDBUS_ASYNC_METHOD("SetProperty",
 			GDBUS_ARGS({ "property", "s" }, { "value", "v" }),
 			NULL, pri_set_property) },
+	{ GDBUS_METHOD("SetProperties",
+			GDBUS_ARGS({ "properties", "a{sv}" }), NULL,
+			pri_set_properties) },
 	{ GDBUS_METHOD("ProvisionContext", NULL, NULL,
 			pri_provision_context) },
 	{ }
@@ -1850,6 +2005,8 @@ static void update_suspended_property(struct ofono_gprs *gprs,
 		suspended ? "suspended" : "resumed");
 
 	gprs->suspended = suspended;
+	__ofono_dbus_invalidate_reply(path,
+				OFONO_CONNECTION_MANAGER_INTERFACE);
 
 	if (gprs->attached)
 		ofono_dbus_signal_property_changed(conn, path,
@@ -1978,6 +2135,8 @@ static void gprs_set_attached(struct ofono_gprs *gprs, ofono_bool_t attached)
 	if (attached == FALSE) {
 		release_active_contexts(gprs);
 		gprs->bearer = -1;
+		__ofono_dbus_invalidate_reply(__ofono_atom_get_path(gprs->atom),
+					OFONO_CONNECTION_MANAGER_INTERFACE);
 	} else if (have_active_contexts(gprs) == TRUE) {
 		/*
 		 * Some times the context activates after a detach event and
@@ -2137,6 +2296,10 @@ static DBusMessage *gprs_get_properties(DBusConnection *conn,
 	DBusMessageIter dict;
 	dbus_bool_t value;
 
+	reply = __ofono_dbus_cached_reply(msg);
+	if (reply)
+		return reply;
+
 	reply = dbus_message_new_method_return(msg);
 	if (reply == NULL)
 		return NULL;
@@ -2172,6 +2335,7 @@ static DBusMessage *gprs_get_properties(DBusConnection *conn,
 
 	dbus_message_iter_close_container(&iter, &dict);
 
+	__ofono_dbus_cache_reply(msg, reply);
 	return reply;
 }
 
@@ -3534,6 +3698,8 @@ static void gprs_unregister(struct ofono_atom *atom)
 	DBG("%p", gprs);
 
 	free_contexts(gprs);
+	__ofono_status_page_update_gprs(__ofono_modem_get_status_page(modem),
+							FALSE, 0, 0);
 
 	if (gprs->cid_map) {
 		idmap_free(gprs->cid_map);
@@ -3858,6 +4024,9 @@ remove:
 
 	g_strfreev(groups);
 
+	__ofono_dbus_invalidate_reply(__ofono_atom_get_path(gprs->atom),
+					OFONO_CONNECTION_MANAGER_INTERFACE);
+
 	if (legacy)
 		storage_sync(imsi, SETTINGS_STORE, gprs->settings);
 }
@@ -39,6 +39,7 @@
 #endif
 
 #include "ofono.h"
+#include "storage.h"
 
 #define SHUTDOWN_GRACE_SECONDS 10
 
@@ -140,6 +141,9 @@ static gchar *option_noplugin = NULL;
 static gboolean option_detach = TRUE;
 static gboolean option_version = FALSE;
 static gboolean option_backtrace = TRUE;
+static gchar *option_signal_batch = NULL;
+static gboolean option_status_page = FALSE;
+static gint option_storage_delay = 0;
 
 static gboolean parse_debug(const char *key, const char *value,
 					gpointer user_data, GError **error)
@@ -177,6 +181,13 @@ static GOptionEntry options[] = {
 	{ "nobacktrace", 0, G_OPTION_FLAG_REVERSE,
 				G_OPTION_ARG_NONE, &option_backtrace,
 				"Don't print out backtrace information" },
+	{ "signal-batch", 0, 0, G_OPTION_ARG_STRING, &option_signal_batch,
+				"Coalesce property change signals",
+				"coalesce|properties" },
+	{ "status-page", 0, 0, G_OPTION_ARG_NONE, &option_status_page,
+				"Export modem status through shared memory" },
+	{ "storage-delay", 0, 0, G_OPTION_ARG_INT, &option_storage_delay,
+				"Defer and coalesce settings writes", "MS" },
 	{ NULL },
 };
 
@@ -213,6 +224,7 @@ int main(int argc, char **argv)
 	DBusConnection *conn;
 	DBusError error;
 	guint signal;
+	const struct ofono_storage_stats *storage_stats;
 #ifdef HAVE_ELL
 	struct ell_event_source *source;
 #endif
@@ -288,6 +300,27 @@ int main(int argc, char **argv)
 					NULL, NULL);
 
 	__ofono_dbus_init(conn);
+	__ofono_dbus_access_init(conn);
+
+	if (g_strcmp0(option_signal_batch, "coalesce") == 0)
+		__ofono_dbus_signal_batch_set_mode(
+					OFONO_DBUS_SIGNAL_BATCH_COALESCE);
+	else if (g_strcmp0(option_signal_batch, "properties") == 0)
+		__ofono_dbus_signal_batch_set_mode(
+					OFONO_DBUS_SIGNAL_BATCH_PROPERTIES);
+	else if (option_signal_batch != NULL)
+		ofono_warn("Unknown signal batch mode %s", option_signal_batch);
+
+	g_free(option_signal_batch);
+
+	__ofono_status_page_set_enabled(option_status_page);
+
+	/* GetStatusPage is experimental */
+	if (option_status_page)
+		g_dbus_set_flags(G_DBUS_FLAG_ENABLE_EXPERIMENTAL);
+
+	if (option_storage_delay > 0)
+		__ofono_storage_set_delay(option_storage_delay);
 
 	__ofono_modemwatch_init();
 
@@ -315,6 +348,14 @@ int main(int argc, char **argv)
 
 	__ofono_modemwatch_cleanup();
 
+	__ofono_storage_cleanup();
+	storage_stats = __ofono_storage_get_stats();
+	DBG("storage: %u syncs, %u writes, main loop stalled for %u us, "
+			"%u us max", storage_stats->syncs,
+			storage_stats->writes, storage_stats->stall_total_us,
+			storage_stats->stall_max_us);
+
+	__ofono_dbus_access_cleanup();
 	__ofono_dbus_cleanup();
 	dbus_connection_unref(conn);
 
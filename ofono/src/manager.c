@@ -80,10 +80,148 @@ static DBusMessage *manager_get_modems(DBusConnection *conn,
 	return reply;
 }
 
+struct managed_state {
+	DBusMessage *msg;
+	DBusMessageIter objects;
+};
+
+struct managed_object {
+	struct managed_state *state;
+	DBusMessageIter entry;
+	DBusMessageIter interfaces;
+	gboolean open;
+};
+
+static void append_interface_state(DBusConnection *conn, const char *path,
+				const char *interface, void *user_data)
+{
+	struct managed_object *obj = user_data;
+	DBusMessage *msg = obj->state->msg;
+	DBusMessage *call;
+	DBusMessage *reply;
+	DBusMessageIter entry;
+	DBusMessageIter iter;
+
+	call = dbus_message_new_method_call(NULL, path, interface,
+							"GetProperties");
+	if (call == NULL)
+		return;
+
+	/* Let the handlers see who is asking, as with a real call */
+	dbus_message_set_serial(call, dbus_message_get_serial(msg));
+	dbus_message_set_sender(call, dbus_message_get_sender(msg));
+
+	/* Interfaces which can't reply right away are left out */
+	reply = g_dbus_call_method(conn, call);
+	dbus_message_unref(call);
+
+	if (reply == NULL)
+		return;
+
+	if (dbus_message_get_type(reply) != DBUS_MESSAGE_TYPE_METHOD_RETURN ||
+			!dbus_message_has_signature(reply, "a{sv}"))
+		goto done;
+
+	if (!obj->open) {
+		dbus_message_iter_open_container(&obj->state->objects,
+						DBUS_TYPE_DICT_ENTRY,
+						NULL, &obj->entry);
+		dbus_message_iter_append_basic(&obj->entry,
+						DBUS_TYPE_OBJECT_PATH, &path);
+		dbus_message_iter_open_container(&obj->entry, DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_ARRAY_AS_STRING
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&obj->interfaces);
+		obj->open = TRUE;
+	}
+
+	dbus_message_iter_open_container(&obj->interfaces,
+					DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &interface);
+	dbus_message_iter_init(reply, &iter);
+	__ofono_dbus_append_iter(&entry, &iter);
+	dbus_message_iter_close_container(&obj->interfaces, &entry);
+
+done:
+	dbus_message_unref(reply);
+}
+
+static void append_object_state(DBusConnection *conn, const char *path,
+							void *user_data)
+{
+	struct managed_object obj;
+
+	memset(&obj, 0, sizeof(obj));
+	obj.state = user_data;
+
+	g_dbus_foreach_interface(conn, path, append_interface_state, &obj);
+
+	/* Objects without any properties are skipped */
+	if (!obj.open)
+		return;
+
+	dbus_message_iter_close_container(&obj.entry, &obj.interfaces);
+	dbus_message_iter_close_container(&obj.state->objects, &obj.entry);
+}
+
+static void append_modem_state(struct ofono_modem *modem, void *userdata)
+{
+	if (ofono_modem_is_registered(modem) == FALSE)
+		return;
+
+	/* The modem object itself and everything below it */
+	g_dbus_foreach_object(ofono_dbus_get_connection(),
+				ofono_modem_get_path(modem),
+				append_object_state, userdata);
+}
+
+static DBusMessage *manager_get_managed_state(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct managed_state state;
+	DBusMessage *reply;
+	DBusMessageIter iter;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	state.msg = msg;
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_OBJECT_PATH_AS_STRING
+					DBUS_TYPE_ARRAY_AS_STRING
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_ARRAY_AS_STRING
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&state.objects);
+	__ofono_modem_foreach(append_modem_state, &state);
+	dbus_message_iter_close_container(&iter, &state.objects);
+
+	return reply;
+}
+
 static const GDBusMethodTable manager_methods[] = {
 	{ GDBUS_METHOD("GetModems",
 				NULL, GDBUS_ARGS({ "modems", "a(oa{sv})" }),
 				manager_get_modems) },
+	{ GDBUS_METHOD("GetManagedState",
+			NULL, GDBUS_ARGS({ "objects", "a{oa{sa{sv}}}" }),
+			manager_get_managed_state) },
 	{ }
 };
 
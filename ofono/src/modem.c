@@ -34,6 +34,7 @@
 #include "ofono.h"
 
 #include "common.h"
+#include "storage.h"
 
 #define DEFAULT_POWERED_TIMEOUT (20)
 
@@ -92,6 +93,7 @@ struct ofono_modem {
 	void			*driver_data;
 	char			*driver_type;
 	char			*name;
+	struct status_page	*status_page;
 };
 
 struct ofono_devinfo {
@@ -295,6 +297,9 @@ void __ofono_atom_register(struct ofono_atom *atom,
 
 	atom->unregister = unregister;
 
+	/* The modem properties may include those of the atom */
+	__ofono_dbus_invalidate_reply(atom->modem->path, NULL);
+
 	call_watches(atom, OFONO_ATOM_WATCH_CONDITION_REGISTERED);
 }
 
@@ -307,6 +312,9 @@ void __ofono_atom_unregister(struct ofono_atom *atom)
 
 	atom->unregister(atom);
 	atom->unregister = NULL;
+
+	/* Its state goes away without PropertyChanged signals */
+	__ofono_dbus_invalidate_reply(atom->modem->path, NULL);
 }
 
 gboolean __ofono_atom_get_registered(struct ofono_atom *atom)
@@ -896,6 +904,10 @@ static DBusMessage *modem_get_properties(DBusConnection *conn,
 	DBusMessageIter iter;
 	DBusMessageIter dict;
 
+	reply = __ofono_dbus_cached_reply(msg);
+	if (reply)
+		return reply;
+
 	reply = dbus_message_new_method_return(msg);
 	if (reply == NULL)
 		return NULL;
@@ -908,6 +920,7 @@ static DBusMessage *modem_get_properties(DBusConnection *conn,
 	__ofono_modem_append_properties(modem, &dict);
 	dbus_message_iter_close_container(&iter, &dict);
 
+	__ofono_dbus_cache_reply(msg, reply);
 	return reply;
 }
 
@@ -1192,6 +1205,24 @@ static DBusMessage *modem_set_property(DBusConnection *conn,
 	return __ofono_error_invalid_args(msg);
 }
 
+static DBusMessage *modem_get_status_page(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct ofono_modem *modem = data;
+	int fd = __ofono_status_page_get_fd(modem->status_page);
+
+	if (fd < 0)
+		return __ofono_error_not_available(msg);
+
+	return g_dbus_create_reply(msg, DBUS_TYPE_UNIX_FD, &fd,
+							DBUS_TYPE_INVALID);
+}
+
+struct status_page *__ofono_modem_get_status_page(struct ofono_modem *modem)
+{
+	return modem ? modem->status_page : NULL;
+}
+
 static const GDBusMethodTable modem_methods[] = {
 	{ GDBUS_METHOD("GetProperties",
 			NULL, GDBUS_ARGS({ "properties", "a{sv}" }),
@@ -1199,6 +1230,9 @@ static const GDBusMethodTable modem_methods[] = {
 	{ GDBUS_ASYNC_METHOD("SetProperty",
 			GDBUS_ARGS({ "property", "s" }, { "value", "v" }),
 			NULL, modem_set_property) },
+	{ GDBUS_EXPERIMENTAL_METHOD("GetStatusPage",
+			NULL, GDBUS_ARGS({ "fd", "h" }),
+			modem_get_status_page) },
 	{ }
 };
 
@@ -1356,6 +1390,9 @@ void ofono_modem_add_interface(struct ofono_modem *modem,
 {
 	const char *feature;
 
+	/* A new atom may reuse the path of the old one */
+	__ofono_dbus_invalidate_reply(modem->path, NULL);
+
 	modem->interface_list = g_slist_prepend(modem->interface_list,
 						g_strdup(interface));
 
@@ -1389,6 +1426,7 @@ void ofono_modem_remove_interface(struct ofono_modem *modem,
 	g_free(found->data);
 	modem->interface_list = g_slist_remove(modem->interface_list,
 						found->data);
+	__ofono_dbus_invalidate_reply(modem->path, NULL);
 
 	feature = get_feature(interface);
 	if (feature) {
@@ -1793,6 +1831,9 @@ static int set_modem_property(struct ofono_modem *modem, const char *name,
 
 	g_hash_table_replace(modem->properties, g_strdup(name), property);
 
+	/* SystemPath is one of them, and isn't signalled */
+	__ofono_dbus_invalidate_reply(modem->path, OFONO_MODEM_INTERFACE);
+
 	return 0;
 }
 
@@ -2111,6 +2152,7 @@ int ofono_modem_register(struct ofono_modem *modem)
 	modem->atom_watches = __ofono_watchlist_new(g_free);
 	modem->online_watches = __ofono_watchlist_new(g_free);
 	modem->powered_watches = __ofono_watchlist_new(g_free);
+	modem->status_page = __ofono_status_page_new(modem->path);
 
 	emit_modem_added(modem);
 	call_modemwatches(modem, TRUE);
@@ -2152,11 +2194,15 @@ static void modem_unregister(struct ofono_modem *modem)
 	__ofono_watchlist_free(modem->powered_watches);
 	modem->powered_watches = NULL;
 
+	__ofono_status_page_free(modem->status_page);
+	modem->status_page = NULL;
+
 	modem->sim_watch = 0;
 	modem->sim_ready_watch = 0;
 
 	g_slist_free_full(modem->interface_list, g_free);
 	modem->interface_list = NULL;
+	__ofono_dbus_invalidate_reply(modem->path, NULL);
 
 	g_slist_free_full(modem->feature_list, g_free);
 	modem->feature_list = NULL;
@@ -2209,6 +2255,9 @@ void ofono_modem_remove(struct ofono_modem *modem)
 	if (modem->driver)
 		modem_unregister(modem);
 
+	/* Nothing deferred by the atoms may outlive the modem */
+	__ofono_storage_flush();
+
 	g_modem_list = g_slist_remove(g_modem_list, modem);
 
 	g_hash_table_destroy(modem->properties);
@@ -783,6 +783,10 @@ static DBusMessage *network_get_properties(DBusConnection *conn,
 	const char *operator;
 	const char *mode = registration_mode_to_string(netreg->mode);
 
+	reply = __ofono_dbus_cached_reply(msg);
+	if (reply)
+		return reply;
+
 	reply = dbus_message_new_method_return(msg);
 	if (reply == NULL)
 		return NULL;
@@ -846,6 +850,7 @@ static DBusMessage *network_get_properties(DBusConnection *conn,
 
 	dbus_message_iter_close_container(&iter, &dict);
 
+	__ofono_dbus_cache_reply(msg, reply);
 	return reply;
 }
 
@@ -1087,6 +1092,15 @@ static const GDBusSignalTable network_registration_signals[] = {
 	{ }
 };
 
+static void netreg_update_status_page(struct ofono_netreg *netreg)
+{
+	struct ofono_modem *modem = __ofono_atom_get_modem(netreg->atom);
+
+	__ofono_status_page_update_netreg(__ofono_modem_get_status_page(modem),
+				netreg->status, netreg->technology,
+				netreg->signal_strength);
+}
+
 static void set_registration_status(struct ofono_netreg *netreg, int status)
 {
 	const char *str_status = registration_status_to_string(status);
@@ -1094,6 +1108,7 @@ static void set_registration_status(struct ofono_netreg *netreg, int status)
 	DBusConnection *conn = ofono_dbus_get_connection();
 
 	netreg->status = status;
+	netreg_update_status_page(netreg);
 
 	ofono_dbus_signal_property_changed(conn, path,
 					OFONO_NETWORK_REGISTRATION_INTERFACE,
@@ -1144,6 +1159,7 @@ static void set_registration_technology(struct ofono_netreg *netreg, int tech)
 	const char *path = __ofono_atom_get_path(netreg->atom);
 
 	netreg->technology = tech;
+	netreg_update_status_page(netreg);
 
 	if (netreg->technology == -1)
 		return;
@@ -1434,6 +1450,7 @@ void ofono_netreg_status_notify(struct ofono_netreg *netreg, int status,
 		__ofono_netreg_set_base_station_name(netreg, NULL);
 
 		netreg->signal_strength = -1;
+		netreg_update_status_page(netreg);
 	}
 
 	notify_status_watches(netreg);
@@ -1581,6 +1598,7 @@ void ofono_netreg_strength_notify(struct ofono_netreg *netreg, int strength)
 	DBG("strength %d", strength);
 
 	netreg->signal_strength = strength;
+	netreg_update_status_page(netreg);
 
 	if (strength != -1) {
 		const char *path = __ofono_atom_get_path(netreg->atom);
@@ -1855,6 +1873,9 @@ static void netreg_unregister(struct ofono_atom *atom)
 
 	__ofono_modem_remove_atom_watch(modem, netreg->hfp_watch);
 
+	__ofono_status_page_update_netreg(__ofono_modem_get_status_page(modem),
+				NETWORK_REGISTRATION_STATUS_UNKNOWN, -1, -1);
+
 	__ofono_watchlist_free(netreg->status_watches);
 	netreg->status_watches = NULL;
 
@@ -2010,6 +2031,9 @@ static void netreg_load_settings(struct ofono_netreg *netreg)
 
 	g_free(strmode);
 
+	__ofono_dbus_invalidate_reply(__ofono_atom_get_path(netreg->atom),
+					OFONO_NETWORK_REGISTRATION_INTERFACE);
+
 	if (upgrade == FALSE)
 		return;
 
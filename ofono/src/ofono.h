@@ -51,6 +51,32 @@ void __ofono_log_enable(struct ofono_debug_desc *start,
 int __ofono_dbus_init(DBusConnection *conn);
 void __ofono_dbus_cleanup(void);
 
+enum ofono_dbus_signal_batch_mode {
+	OFONO_DBUS_SIGNAL_BATCH_NONE,		/* Send immediately */
+	OFONO_DBUS_SIGNAL_BATCH_COALESCE,	/* Latest PropertyChanged only */
+	OFONO_DBUS_SIGNAL_BATCH_PROPERTIES	/* One PropertiesChanged */
+};
+
+struct ofono_dbus_signal_batch_stats {
+	unsigned int changes;		/* Property changes reported */
+	unsigned int superseded;	/* Dropped in favor of a newer value */
+	unsigned int signals;		/* Signals actually sent */
+};
+
+void __ofono_dbus_signal_batch_set_mode(
+				enum ofono_dbus_signal_batch_mode mode);
+enum ofono_dbus_signal_batch_mode __ofono_dbus_signal_batch_get_mode(void);
+void __ofono_dbus_signal_batch_flush(void);
+const struct ofono_dbus_signal_batch_stats *
+				__ofono_dbus_signal_batch_get_stats(void);
+void __ofono_dbus_signal_batch_reset_stats(void);
+
+void __ofono_dbus_append_iter(DBusMessageIter *dest, DBusMessageIter *src);
+
+DBusMessage *__ofono_dbus_cached_reply(DBusMessage *msg);
+void __ofono_dbus_cache_reply(DBusMessage *msg, DBusMessage *reply);
+void __ofono_dbus_invalidate_reply(const char *path, const char *interface);
+
 #define __ofono_error_invalid_args ofono_dbus_error_invalid_args
 #define __ofono_error_invalid_format ofono_dbus_error_invalid_format
 #define __ofono_error_not_implemented ofono_dbus_error_not_implemented
@@ -255,6 +281,21 @@ void __ofono_modem_sim_reset(struct ofono_modem *modem);
 void __ofono_modem_inc_emergency_mode(struct ofono_modem *modem);
 void __ofono_modem_dec_emergency_mode(struct ofono_modem *modem);
 
+#include <ofono/status-page.h>
+
+struct status_page;
+
+void __ofono_status_page_set_enabled(gboolean enabled);
+struct status_page *__ofono_status_page_new(const char *name);
+void __ofono_status_page_free(struct status_page *page);
+int __ofono_status_page_get_fd(struct status_page *page);
+void __ofono_status_page_update_netreg(struct status_page *page,
+				int registration, int technology, int strength);
+void __ofono_status_page_update_gprs(struct status_page *page,
+				gboolean attached, unsigned int active_contexts,
+				unsigned int active_types);
+struct status_page *__ofono_modem_get_status_page(struct ofono_modem *modem);
+
 #include <ofono/call-barring.h>
 
 gboolean __ofono_call_barring_is_busy(struct ofono_call_barring *cb);
@@ -567,6 +608,23 @@ void __ofono_private_network_release(int id);
 ofono_bool_t __ofono_private_network_request(ofono_private_network_cb_t cb,
 						int *id, void *data);
 
+/* Kept by each sms, gprs and voicecall filter chain, logged on free */
+struct ofono_filter_chain_stats {
+	unsigned int requests;		/* Requests that went all the way */
+	unsigned int inline_steps;	/* Filters that replied right away */
+	unsigned int async_steps;	/* Filters that replied later */
+	guint64 latency_total_us;	/* From submission to completion */
+	unsigned int latency_max_us;
+};
+
+/* A macro so that DBG picks up the caller's file */
+#define OFONO_FILTER_CHAIN_STATS_DBG(stats) \
+	DBG("%u requests, %u inline and %u async steps, latency %" \
+		G_GUINT64_FORMAT " us average %u us max", (stats)->requests, \
+		(stats)->inline_steps, (stats)->async_steps, \
+		(stats)->requests ? (stats)->latency_total_us / \
+		(stats)->requests : 0, (stats)->latency_max_us)
+
 #include <ofono/sms-filter.h>
 
 struct sms_filter_chain;
@@ -618,6 +676,9 @@ void __ofono_sms_filter_chain_recv_text(struct sms_filter_chain *chain,
 		const struct sms_scts *scts,
 		sms_dispatch_recv_text_cb_t default_handler);
 
+const struct ofono_filter_chain_stats *__ofono_sms_filter_chain_get_stats
+					(struct sms_filter_chain *chain);
+
 #include <ofono/gprs-filter.h>
 
 struct gprs_filter_chain;
@@ -637,6 +698,8 @@ void __ofono_gprs_filter_chain_activate(struct gprs_filter_chain *chain,
 void __ofono_gprs_filter_chain_check(struct gprs_filter_chain *chain,
 		gprs_filter_check_cb_t cb, ofono_destroy_func destroy,
 		void *user_data);
+const struct ofono_filter_chain_stats *__ofono_gprs_filter_chain_get_stats
+					(struct gprs_filter_chain *chain);
 
 #include <ofono/voicecall-filter.h>
 
@@ -662,8 +725,20 @@ void __ofono_voicecall_filter_chain_incoming(struct voicecall_filter_chain *c,
 				const struct ofono_call *call,
 				ofono_voicecall_filter_incoming_cb_t cb,
 				ofono_destroy_func destroy, void *user_data);
+const struct ofono_filter_chain_stats *__ofono_voicecall_filter_chain_get_stats
+					(struct voicecall_filter_chain *c);
 
 #include <ofono/dbus-access.h>
+
+struct ofono_dbus_access_cache_stats {
+	unsigned int hits;
+	unsigned int misses;
+};
+
+void __ofono_dbus_access_init(DBusConnection *conn);
+void __ofono_dbus_access_cleanup(void);
+const struct ofono_dbus_access_cache_stats *
+				__ofono_dbus_access_cache_stats(void);
 #include <ofono/slot.h>
 
 void __ofono_slot_manager_init(void);
@@ -494,6 +494,10 @@ static DBusMessage *sim_get_properties(DBusConnection *conn,
 	dbus_bool_t fdn;
 	dbus_bool_t bdn;
 
+	reply = __ofono_dbus_cached_reply(msg);
+	if (reply)
+		return reply;
+
 	reply = dbus_message_new_method_return(msg);
 	if (reply == NULL)
 		return NULL;
@@ -588,6 +592,7 @@ static DBusMessage *sim_get_properties(DBusConnection *conn,
 done:
 	dbus_message_iter_close_container(&iter, &dict);
 
+	__ofono_dbus_cache_reply(msg, reply);
 	return reply;
 }
 
@@ -1789,6 +1794,8 @@ static void impi_read_cb(int ok, int total_length, int record,
 	}
 
 	sim->impi = g_strndup((const char *)data + 2, data[1]);
+	__ofono_dbus_invalidate_reply(__ofono_atom_get_path(sim->atom),
+					OFONO_SIM_MANAGER_INTERFACE);
 }
 
 static void discover_apps_cb(const struct ofono_error *error,
@@ -2966,6 +2973,8 @@ static void sim_free_state(struct ofono_sim *sim)
 {
 	sim_free_early_state(sim);
 	sim_free_main_state(sim);
+	__ofono_dbus_invalidate_reply(__ofono_atom_get_path(sim->atom),
+					OFONO_SIM_MANAGER_INTERFACE);
 }
 
 static void sim_set_locked_pin(struct ofono_sim *sim,
@@ -4123,12 +4132,18 @@ int ofono_sim_logical_access(struct ofono_sim *sim, int session_id,
 
 void ofono_sim_set_card_slot_count(struct ofono_sim *sim, unsigned int val)
 {
-	if (sim)
+	if (sim) {
 		sim->card_slot_count = val;
+		__ofono_dbus_invalidate_reply(__ofono_atom_get_path(sim->atom),
+					OFONO_SIM_MANAGER_INTERFACE);
+	}
 }
 
 void ofono_sim_set_active_card_slot(struct ofono_sim *sim, unsigned int val)
 {
-	if (sim)
+	if (sim) {
 		sim->active_card_slot = val;
+		__ofono_dbus_invalidate_reply(__ofono_atom_get_path(sim->atom),
+					OFONO_SIM_MANAGER_INTERFACE);
+	}
 }
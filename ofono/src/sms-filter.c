@@ -74,6 +74,9 @@ struct sms_filter_message {
 	GSList *filter_link;
 	guint pending_id;
 	guint continue_id;
+	gboolean in_process;
+	GSourceFunc sync_next;
+	gint64 start;
 };
 
 struct sms_filter_chain_send_text {
@@ -124,6 +127,7 @@ struct sms_filter_chain {
 	struct ofono_sms *sms;
 	struct ofono_modem *modem;
 	GSList *msg_list;
+	struct ofono_filter_chain_stats stats;
 };
 
 static GSList *sms_filter_list = NULL;
@@ -178,6 +182,7 @@ static void sms_filter_message_init(struct sms_filter_message *msg,
 	msg->fn = fn;
 	msg->chain = chain;
 	msg->filter_link = sms_filter_list;
+	msg->start = g_get_monotonic_time();
 
 	/*
 	 * The list holds an implicit reference to the message. The reference
@@ -188,35 +193,6 @@ static void sms_filter_message_init(struct sms_filter_message *msg,
 	chain->msg_list = g_slist_append(chain->msg_list, msg);
 }
 
-static void sms_filter_message_process(struct sms_filter_message *msg)
-{
-	GSList *filter_link = msg->filter_link;
-	const struct ofono_sms_filter *filter = filter_link->data;
-	const struct sms_filter_message_fn *fn = msg->fn;
-
-	while (filter && !fn->can_process(filter)) {
-		filter_link = filter_link->next;
-		filter = filter_link ? filter_link->data : NULL;
-	}
-
-	if (filter) {
-		guint id;
-
-		/*
-		 * If fn->process returns zero, the message may have
-		 * already been deallocated. It's only guaranteed to
-		 * be alive if fn->process returns non-zero id.
-		 */
-		msg->filter_link = filter_link;
-		id = fn->process(filter, msg);
-		if (id) {
-			msg->pending_id = id;
-		}
-	} else {
-		fn->passthrough(msg);
-	}
-}
-
 static void sms_filter_message_destroy(struct sms_filter_message *msg)
 {
 	/*
@@ -236,6 +212,7 @@ static void sms_filter_message_destroy(struct sms_filter_message *msg)
 		g_source_remove(msg->continue_id);
 		msg->continue_id = 0;
 	}
+	msg->sync_next = NULL;
 	if (!msg->destroyed) {
 		const struct sms_filter_message_fn *fn = msg->fn;
 
@@ -285,6 +262,14 @@ static void sms_filter_message_free(struct sms_filter_message *msg)
 	 * short (typically just one message), it's not worth optimization.
 	 */
 	if (chain && g_slist_find(chain->msg_list, msg)) {
+		struct ofono_filter_chain_stats *stats = &chain->stats;
+		const unsigned int us = g_get_monotonic_time() - msg->start;
+
+		stats->requests++;
+		stats->latency_total_us += us;
+		if (stats->latency_max_us < us)
+			stats->latency_max_us = us;
+
 		chain->msg_list = g_slist_remove(chain->msg_list, msg);
 		/*
 		 * The message has to be destroyed even if we are not
@@ -296,27 +281,95 @@ static void sms_filter_message_free(struct sms_filter_message *msg)
 	}
 }
 
+static void sms_filter_message_passthrough(struct sms_filter_message *msg)
+{
+	msg->refcount++;
+	msg->fn->passthrough(msg);
+	sms_filter_message_free(msg);
+	sms_filter_message_unref(msg);
+}
+
+static gboolean sms_filter_message_continue(gpointer data);
+
+static void sms_filter_message_process(struct sms_filter_message *msg)
+{
+	const struct sms_filter_message_fn *fn = msg->fn;
+
+	/*
+	 * Filters which invoke the callback before returning from
+	 * fn->process get the message handed to the next filter by
+	 * this loop. Only filters that actually go asynchronous cost
+	 * a trip through the main loop. The extra reference keeps the
+	 * message alive until we are done looking at it.
+	 */
+	msg->refcount++;
+	while (!msg->destroyed && msg->chain) {
+		GSList *filter_link = msg->filter_link;
+		const struct ofono_sms_filter *filter =
+			filter_link ? filter_link->data : NULL;
+		GSourceFunc next;
+		guint id;
+
+		while (filter && !fn->can_process(filter)) {
+			filter_link = filter_link->next;
+			filter = filter_link ? filter_link->data : NULL;
+		}
+
+		if (!filter) {
+			sms_filter_message_passthrough(msg);
+			break;
+		}
+
+		msg->filter_link = filter_link;
+		msg->in_process = TRUE;
+		id = fn->process(filter, msg);
+		msg->in_process = FALSE;
+
+		next = msg->sync_next;
+		msg->sync_next = NULL;
+		if (msg->destroyed || !msg->chain) {
+			break;
+		} else if (!next) {
+			msg->pending_id = id;
+			break;
+		} else if (next != sms_filter_message_continue) {
+			next(msg);
+			break;
+		}
+
+		msg->filter_link = filter_link->next;
+	}
+	sms_filter_message_unref(msg);
+}
+
 static void sms_filter_message_next(struct sms_filter_message *msg,
 							GSourceFunc fn)
 {
+	struct sms_filter_chain *chain = msg->chain;
+
 	msg->pending_id = 0;
-	msg->continue_id = g_idle_add(fn, msg);
+	if (msg->in_process) {
+		/* Picked up by sms_filter_message_process */
+		msg->sync_next = fn;
+		if (chain)
+			chain->stats.inline_steps++;
+	} else {
+		msg->continue_id = g_idle_add(fn, msg);
+		if (chain)
+			chain->stats.async_steps++;
+	}
 }
 
 static gboolean sms_filter_message_continue(gpointer data)
 {
 	struct sms_filter_message *msg = data;
-	const struct sms_filter_message_fn *fn = msg->fn;
 
 	msg->continue_id = 0;
 	msg->filter_link = msg->filter_link->next;
 	if (msg->filter_link) {
 		sms_filter_message_process(msg);
 	} else {
-		msg->refcount++;
-		fn->passthrough(msg);
-		sms_filter_message_free(msg);
-		sms_filter_message_unref(msg);
+		sms_filter_message_passthrough(msg);
 	}
 	return G_SOURCE_REMOVE;
 }
@@ -832,11 +885,19 @@ struct sms_filter_chain *__ofono_sms_filter_chain_new(struct ofono_sms *sms,
 void __ofono_sms_filter_chain_free(struct sms_filter_chain *chain)
 {
 	if (chain) {
+		OFONO_FILTER_CHAIN_STATS_DBG(&chain->stats);
+
 		g_slist_free_full(chain->msg_list, sms_filter_message_free1);
 		g_free(chain);
 	}
 }
 
+const struct ofono_filter_chain_stats *__ofono_sms_filter_chain_get_stats
+					(struct sms_filter_chain *chain)
+{
+	return chain ? &chain->stats : NULL;
+}
+
 void __ofono_sms_filter_chain_send_text(struct sms_filter_chain *chain,
 		const struct sms_address *addr, const char *text,
 		sms_send_text_cb_t sender, ofono_destroy_func destroy,
@@ -0,0 +1,648 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "storage.h"
+#include "sms-journal.h"
+
+#define SMS_JOURNAL_MODE 0600
+#define SMS_JOURNAL_PATH STORAGEDIR "/%s/sms_journal"
+#define SMS_JOURNAL_LEGACY_PATH STORAGEDIR "/%s/%s"
+
+#define SMS_JOURNAL_MAGIC 0x4a534d53	/* "SMSJ" */
+#define SMS_JOURNAL_VERSION 1
+
+/*
+ * On-disk layout, host byte order:
+ *
+ *   header: magic(4) version(4)
+ *   record: check(4) op(1) reserved(1) key_len(2) len(4) ts(8) key data
+ *
+ * check is FNV-1a over everything in the record that follows it.
+ * A record that doesn't fit or doesn't check out ends the journal,
+ * that's what a write interrupted by a crash looks like.
+ */
+#define SMS_JOURNAL_HEADER_SIZE 8
+#define SMS_JOURNAL_RECORD_SIZE 20
+#define SMS_JOURNAL_MAX_KEY 0xffff
+#define SMS_JOURNAL_MAX_DATA 0x10000
+
+/* Compact once superseded records outnumber live ones this much */
+#define SMS_JOURNAL_COMPACT_MIN 256
+#define SMS_JOURNAL_COMPACT_RATIO 2
+
+enum sms_journal_op {
+	SMS_JOURNAL_OP_PUT = 1,
+	SMS_JOURNAL_OP_REMOVE = 2
+};
+
+struct sms_journal_entry {
+	time_t ts;
+	unsigned int len;
+	unsigned char data[];
+};
+
+struct sms_journal {
+	int ref;
+	int fd;
+	char *imsi;
+	char *path;
+	GHashTable *entries;
+	unsigned int dead;
+	int batch;
+	GByteArray *pending;	/* Records waiting for sms_journal_commit */
+};
+
+/* Directories the journal replaces, in the order they are migrated */
+static const char *sms_journal_legacy_dirs[] = {
+	"sms_assembly", "sms_sr", "tx_queue"
+};
+
+static GHashTable *sms_journals;
+
+static guint32 sms_journal_hash(guint32 h, const void *data, gsize len)
+{
+	const unsigned char *p = data;
+	gsize i;
+
+	for (i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+static struct sms_journal_entry *sms_journal_entry_new(const void *data,
+						unsigned int len, time_t ts)
+{
+	struct sms_journal_entry *entry =
+		g_malloc(sizeof(struct sms_journal_entry) + len);
+
+	entry->ts = ts;
+	entry->len = len;
+	memcpy(entry->data, data, len);
+	return entry;
+}
+
+static void sms_journal_apply(struct sms_journal *journal,
+				enum sms_journal_op op, const char *key,
+				const void *data, unsigned int len, time_t ts)
+{
+	if (op == SMS_JOURNAL_OP_PUT) {
+		if (g_hash_table_contains(journal->entries, key))
+			journal->dead++;
+
+		g_hash_table_replace(journal->entries, g_strdup(key),
+				sms_journal_entry_new(data, len, ts));
+	} else if (g_hash_table_remove(journal->entries, key)) {
+		/* Both the put and the remove are dead now */
+		journal->dead += 2;
+	} else {
+		journal->dead++;
+	}
+}
+
+static gsize sms_journal_encode(GByteArray *buf, enum sms_journal_op op,
+				const char *key, const void *data,
+				unsigned int len, time_t ts)
+{
+	gsize start = buf->len;
+	guint16 key_len = strlen(key);
+	guint32 data_len = len;
+	gint64 ts64 = ts;
+	guint8 op8 = op;
+	guint8 reserved = 0;
+	guint32 check;
+
+	g_byte_array_set_size(buf, start + SMS_JOURNAL_RECORD_SIZE);
+	memcpy(buf->data + start + 4, &op8, 1);
+	memcpy(buf->data + start + 5, &reserved, 1);
+	memcpy(buf->data + start + 6, &key_len, 2);
+	memcpy(buf->data + start + 8, &data_len, 4);
+	memcpy(buf->data + start + 12, &ts64, 8);
+	g_byte_array_append(buf, (const guint8 *) key, key_len);
+
+	if (len)
+		g_byte_array_append(buf, data, len);
+
+	check = sms_journal_hash(2166136261u, buf->data + start + 4,
+						buf->len - start - 4);
+	memcpy(buf->data + start, &check, 4);
+
+	return buf->len - start;
+}
+
+static void sms_journal_load(struct sms_journal *journal)
+{
+	gchar *contents;
+	gsize size;
+	gsize pos;
+	guint32 magic, version;
+
+	if (!g_file_get_contents(journal->path, &contents, &size, NULL))
+		return;
+
+	if (size < SMS_JOURNAL_HEADER_SIZE) {
+		pos = 0;
+		goto out;
+	}
+
+	memcpy(&magic, contents, 4);
+	memcpy(&version, contents + 4, 4);
+
+	if (magic != SMS_JOURNAL_MAGIC || version != SMS_JOURNAL_VERSION) {
+		pos = 0;
+		goto out;
+	}
+
+	pos = SMS_JOURNAL_HEADER_SIZE;
+
+	while (size - pos >= SMS_JOURNAL_RECORD_SIZE) {
+		const char *rec = contents + pos;
+		guint32 check;
+		guint8 op;
+		guint16 key_len;
+		guint32 len;
+		gint64 ts;
+		gsize total;
+		char *key;
+
+		memcpy(&check, rec, 4);
+		memcpy(&op, rec + 4, 1);
+		memcpy(&key_len, rec + 6, 2);
+		memcpy(&len, rec + 8, 4);
+		memcpy(&ts, rec + 12, 8);
+
+		total = SMS_JOURNAL_RECORD_SIZE + key_len + len;
+
+		if (!key_len || len > SMS_JOURNAL_MAX_DATA ||
+				size - pos < total)
+			break;
+
+		if (check != sms_journal_hash(2166136261u, rec + 4,
+								total - 4))
+			break;
+
+		if (op != SMS_JOURNAL_OP_PUT && op != SMS_JOURNAL_OP_REMOVE)
+			break;
+
+		key = g_strndup(rec + SMS_JOURNAL_RECORD_SIZE, key_len);
+
+		if (strlen(key) == key_len)
+			sms_journal_apply(journal, op, key,
+				rec + SMS_JOURNAL_RECORD_SIZE + key_len,
+				len, (time_t) ts);
+
+		g_free(key);
+		pos += total;
+	}
+
+out:
+	/* Drop whatever a crash may have left at the end */
+	if (pos < size && truncate(journal->path, pos) < 0)
+		unlink(journal->path);
+
+	g_free(contents);
+}
+
+static gboolean sms_journal_open_fd(struct sms_journal *journal)
+{
+	struct stat st;
+
+	if (journal->fd >= 0)
+		return TRUE;
+
+	if (create_dirs(journal->path, SMS_JOURNAL_MODE | S_IXUSR) != 0)
+		return FALSE;
+
+	journal->fd = TFR(open(journal->path, O_WRONLY | O_APPEND |
+					O_CREAT | O_CLOEXEC, SMS_JOURNAL_MODE));
+	if (journal->fd < 0)
+		return FALSE;
+
+	if (fstat(journal->fd, &st) == 0 && st.st_size == 0) {
+		guint32 header[2] = { SMS_JOURNAL_MAGIC, SMS_JOURNAL_VERSION };
+
+		if (TFR(write(journal->fd, header, sizeof(header))) !=
+							sizeof(header)) {
+			TFR(close(journal->fd));
+			journal->fd = -1;
+			unlink(journal->path);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static gboolean sms_journal_write(struct sms_journal *journal,
+					const void *buf, gsize size)
+{
+	off_t end;
+	gboolean ok;
+
+	if (!sms_journal_open_fd(journal))
+		return FALSE;
+
+	end = lseek(journal->fd, 0, SEEK_END);
+	ok = (TFR(write(journal->fd, buf, size)) == (ssize_t) size);
+
+	/* Don't leave a torn record in front of the following ones */
+	if (!ok && end >= 0 && ftruncate(journal->fd, end) < 0) {
+		TFR(close(journal->fd));
+		journal->fd = -1;
+	}
+
+	return ok;
+}
+
+static gboolean sms_journal_append(struct sms_journal *journal,
+				enum sms_journal_op op, const char *key,
+				const void *data, unsigned int len, time_t ts)
+{
+	GByteArray *buf;
+	gsize size;
+	gboolean ok;
+
+	if (journal->batch) {
+		if (journal->pending == NULL)
+			journal->pending = g_byte_array_new();
+
+		sms_journal_encode(journal->pending, op, key, data, len, ts);
+		return TRUE;
+	}
+
+	buf = g_byte_array_new();
+	size = sms_journal_encode(buf, op, key, data, len, ts);
+	ok = sms_journal_write(journal, buf->data, size);
+	g_byte_array_free(buf, TRUE);
+	return ok;
+}
+
+/* Imports the old one-file-per-backup directories, if there are any */
+static void sms_journal_migrate_dir(struct sms_journal *journal,
+					const char *path, const char *prefix,
+					int depth)
+{
+	GDir *dir = g_dir_open(path, 0, NULL);
+	const char *name;
+
+	if (dir == NULL)
+		return;
+
+	while ((name = g_dir_read_name(dir))) {
+		char *file = g_build_filename(path, name, NULL);
+		char *key = g_strconcat(prefix, "/", name, NULL);
+		struct stat st;
+
+		if (stat(file, &st) == 0) {
+			if (S_ISDIR(st.st_mode)) {
+				if (depth > 0)
+					sms_journal_migrate_dir(journal, file,
+								key, depth - 1);
+			} else if (g_str_has_suffix(name, ".tmp")) {
+				/* Leftover from an interrupted write_file */
+				unlink(file);
+			} else {
+				gchar *data = NULL;
+				gsize len;
+
+				if (g_file_get_contents(file, &data, &len,
+								NULL) &&
+					len <= SMS_JOURNAL_MAX_DATA &&
+					sms_journal_put(journal, key, data, len,
+								st.st_mtime))
+					unlink(file);
+
+				g_free(data);
+			}
+		}
+
+		g_free(key);
+		g_free(file);
+	}
+
+	g_dir_close(dir);
+	rmdir(path);
+}
+
+static void sms_journal_migrate(struct sms_journal *journal)
+{
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(sms_journal_legacy_dirs); i++) {
+		const char *name = sms_journal_legacy_dirs[i];
+		char *path = g_strdup_printf(SMS_JOURNAL_LEGACY_PATH,
+							journal->imsi, name);
+
+		sms_journal_migrate_dir(journal, path, name, 1);
+		g_free(path);
+	}
+}
+
+static gboolean sms_journal_need_compact(struct sms_journal *journal)
+{
+	return !journal->batch &&
+		journal->dead >= SMS_JOURNAL_COMPACT_MIN &&
+		journal->dead > SMS_JOURNAL_COMPACT_RATIO *
+				g_hash_table_size(journal->entries);
+}
+
+gboolean sms_journal_compact(struct sms_journal *journal)
+{
+	GByteArray *buf;
+	GHashTableIter iter;
+	gpointer key, value;
+	guint32 header[2] = { SMS_JOURNAL_MAGIC, SMS_JOURNAL_VERSION };
+	char *tmp_path;
+	gboolean ok;
+	int fd;
+
+	if (journal == NULL)
+		return FALSE;
+
+	if (journal->fd >= 0) {
+		TFR(close(journal->fd));
+		journal->fd = -1;
+	}
+
+	if (g_hash_table_size(journal->entries) == 0) {
+		unlink(journal->path);
+		journal->dead = 0;
+
+		if (journal->pending)
+			g_byte_array_set_size(journal->pending, 0);
+
+		return TRUE;
+	}
+
+	if (create_dirs(journal->path, SMS_JOURNAL_MODE | S_IXUSR) != 0)
+		return FALSE;
+
+	buf = g_byte_array_new();
+	g_byte_array_append(buf, (const guint8 *) header, sizeof(header));
+	g_hash_table_iter_init(&iter, journal->entries);
+
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		struct sms_journal_entry *entry = value;
+
+		sms_journal_encode(buf, SMS_JOURNAL_OP_PUT, key,
+					entry->data, entry->len, entry->ts);
+	}
+
+	/* Same trick as write_file(), the rename is atomic */
+	tmp_path = g_strdup_printf("%s.XXXXXX.tmp", journal->path);
+	fd = TFR(g_mkstemp_full(tmp_path, O_WRONLY | O_CREAT | O_TRUNC,
+							SMS_JOURNAL_MODE));
+	ok = (fd >= 0);
+
+	if (ok) {
+		ok = (TFR(write(fd, buf->data, buf->len)) ==
+						(ssize_t) buf->len) &&
+			fsync(fd) == 0;
+		TFR(close(fd));
+
+		if (ok)
+			ok = (rename(tmp_path, journal->path) == 0);
+
+		if (!ok)
+			unlink(tmp_path);
+	}
+
+	if (ok) {
+		journal->dead = 0;
+
+		/* The compacted journal already has whatever was pending */
+		if (journal->pending)
+			g_byte_array_set_size(journal->pending, 0);
+	}
+
+	g_byte_array_free(buf, TRUE);
+	g_free(tmp_path);
+	return ok;
+}
+
+void sms_journal_begin(struct sms_journal *journal)
+{
+	if (journal)
+		journal->batch++;
+}
+
+gboolean sms_journal_commit(struct sms_journal *journal)
+{
+	GByteArray *pending;
+	gboolean ok = TRUE;
+
+	if (journal == NULL || journal->batch <= 0 || --journal->batch > 0)
+		return TRUE;
+
+	pending = journal->pending;
+	journal->pending = NULL;
+
+	if (pending) {
+		if (pending->len)
+			ok = sms_journal_write(journal, pending->data,
+								pending->len);
+
+		g_byte_array_free(pending, TRUE);
+	}
+
+	if (sms_journal_need_compact(journal))
+		sms_journal_compact(journal);
+
+	return ok;
+}
+
+struct sms_journal *sms_journal_open(const char *imsi)
+{
+	struct sms_journal *journal;
+
+	if (imsi == NULL)
+		return NULL;
+
+	if (sms_journals == NULL)
+		sms_journals = g_hash_table_new(g_str_hash, g_str_equal);
+
+	journal = g_hash_table_lookup(sms_journals, imsi);
+	if (journal) {
+		journal->ref++;
+		return journal;
+	}
+
+	journal = g_new0(struct sms_journal, 1);
+	journal->ref = 1;
+	journal->fd = -1;
+	journal->imsi = g_strdup(imsi);
+	journal->path = g_strdup_printf(SMS_JOURNAL_PATH, imsi);
+	journal->entries = g_hash_table_new_full(g_str_hash, g_str_equal,
+							g_free, g_free);
+
+	sms_journal_load(journal);
+	sms_journal_migrate(journal);
+
+	if (sms_journal_need_compact(journal))
+		sms_journal_compact(journal);
+
+	g_hash_table_insert(sms_journals, journal->imsi, journal);
+	return journal;
+}
+
+void sms_journal_close(struct sms_journal *journal)
+{
+	if (journal == NULL || --journal->ref > 0)
+		return;
+
+	g_hash_table_remove(sms_journals, journal->imsi);
+	if (g_hash_table_size(sms_journals) == 0) {
+		g_hash_table_destroy(sms_journals);
+		sms_journals = NULL;
+	}
+
+	/* An unfinished batch still gets written */
+	journal->batch = 1;
+	sms_journal_commit(journal);
+
+	if (sms_journal_need_compact(journal))
+		sms_journal_compact(journal);
+
+	if (journal->fd >= 0)
+		TFR(close(journal->fd));
+
+	g_hash_table_destroy(journal->entries);
+	g_free(journal->path);
+	g_free(journal->imsi);
+	g_free(journal);
+}
+
+gboolean sms_journal_put(struct sms_journal *journal, const char *key,
+				const void *data, unsigned int len, time_t ts)
+{
+	if (journal == NULL || key == NULL || !key[0] ||
+			strlen(key) > SMS_JOURNAL_MAX_KEY ||
+			len > SMS_JOURNAL_MAX_DATA)
+		return FALSE;
+
+	if (!sms_journal_append(journal, SMS_JOURNAL_OP_PUT, key, data,
+								len, ts))
+		return FALSE;
+
+	sms_journal_apply(journal, SMS_JOURNAL_OP_PUT, key, data, len, ts);
+	return TRUE;
+}
+
+gboolean sms_journal_remove(struct sms_journal *journal, const char *key)
+{
+	if (journal == NULL || key == NULL ||
+			!g_hash_table_contains(journal->entries, key))
+		return FALSE;
+
+	sms_journal_append(journal, SMS_JOURNAL_OP_REMOVE, key, NULL, 0, 0);
+
+	/*
+	 * Even if the record didn't make it to the disk, the backup
+	 * is gone as far as we are concerned. The worst that can
+	 * happen is that it gets restored after restart.
+	 */
+	sms_journal_apply(journal, SMS_JOURNAL_OP_REMOVE, key, NULL, 0, 0);
+
+	if (sms_journal_need_compact(journal))
+		sms_journal_compact(journal);
+
+	return TRUE;
+}
+
+static GPtrArray *sms_journal_keys(struct sms_journal *journal,
+							const char *prefix)
+{
+	GPtrArray *keys = g_ptr_array_new_with_free_func(g_free);
+	GHashTableIter iter;
+	gpointer key;
+
+	g_hash_table_iter_init(&iter, journal->entries);
+
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		if (prefix == NULL || g_str_has_prefix(key, prefix))
+			g_ptr_array_add(keys, g_strdup(key));
+
+	return keys;
+}
+
+unsigned int sms_journal_remove_prefix(struct sms_journal *journal,
+						const char *prefix)
+{
+	GPtrArray *keys;
+	unsigned int i, n = 0;
+
+	if (journal == NULL)
+		return 0;
+
+	keys = sms_journal_keys(journal, prefix);
+
+	for (i = 0; i < keys->len; i++)
+		if (sms_journal_remove(journal, keys->pdata[i]))
+			n++;
+
+	g_ptr_array_free(keys, TRUE);
+	return n;
+}
+
+static gint sms_journal_key_compare(gconstpointer a, gconstpointer b)
+{
+	return strverscmp(*(const char **) a, *(const char **) b);
+}
+
+void sms_journal_foreach(struct sms_journal *journal, const char *prefix,
+				sms_journal_foreach_cb_t cb, void *user_data)
+{
+	GPtrArray *keys;
+	unsigned int i;
+
+	if (journal == NULL)
+		return;
+
+	keys = sms_journal_keys(journal, prefix);
+	g_ptr_array_sort(keys, sms_journal_key_compare);
+
+	/* The callback is allowed to modify the journal */
+	for (i = 0; i < keys->len; i++) {
+		const char *key = keys->pdata[i];
+		struct sms_journal_entry *entry =
+			g_hash_table_lookup(journal->entries, key);
+
+		if (entry)
+			cb(key, entry->data, entry->len, entry->ts,
+								user_data);
+	}
+
+	g_ptr_array_free(keys, TRUE);
+}
+
+unsigned int sms_journal_count(struct sms_journal *journal)
+{
+	return journal ? g_hash_table_size(journal->entries) : 0;
+}
@@ -0,0 +1,55 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+/*
+ * Append-only key/value store for the SMS backups of one IMSI. Keys are
+ * the paths the backups used to have relative to the IMSI directory,
+ * e.g. "sms_assembly/<addr>-<ref>-<max>/<seq>". The whole store is kept
+ * in memory. Every change is appended to STORAGEDIR/<imsi>/sms_journal,
+ * which is rewritten once it's mostly made of superseded records.
+ */
+
+struct sms_journal;
+
+typedef void (*sms_journal_foreach_cb_t)(const char *key,
+					const void *data, unsigned int len,
+					time_t ts, void *user_data);
+
+struct sms_journal *sms_journal_open(const char *imsi);
+void sms_journal_close(struct sms_journal *journal);
+
+gboolean sms_journal_put(struct sms_journal *journal, const char *key,
+				const void *data, unsigned int len, time_t ts);
+gboolean sms_journal_remove(struct sms_journal *journal, const char *key);
+unsigned int sms_journal_remove_prefix(struct sms_journal *journal,
+						const char *prefix);
+
+/*
+ * Calls cb in strverscmp() order of the keys. The callback may modify
+ * the journal but mustn't look at data after doing so.
+ */
+void sms_journal_foreach(struct sms_journal *journal, const char *prefix,
+				sms_journal_foreach_cb_t cb, void *user_data);
+
+/*
+ * Between begin and commit the records are only kept in memory and
+ * then appended with a single write. The journal itself is updated
+ * right away. Calls may nest, the outermost commit does the writing.
+ */
+void sms_journal_begin(struct sms_journal *journal);
+gboolean sms_journal_commit(struct sms_journal *journal);
+
+unsigned int sms_journal_count(struct sms_journal *journal);
+gboolean sms_journal_compact(struct sms_journal *journal);
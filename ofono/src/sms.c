@@ -49,9 +49,11 @@
 #define SETTINGS_GROUP "Settings"
 
 #define TXQ_MAX_RETRIES 4
+#define TXQ_MAX_WINDOW 16
 #define NETWORK_TIMEOUT 332
 
 static gboolean tx_next(gpointer user_data);
+static gboolean tx_retry(gpointer user_data);
 
 static GSList *g_drivers = NULL;
 
@@ -72,6 +74,8 @@ struct ofono_sms {
 	GQueue *txq;
 	unsigned long tx_counter;
 	guint tx_source;
+	unsigned int tx_window;
+	unsigned int tx_pending;
 	struct ofono_message_waiting *mw;
 	unsigned int mw_watch;
 	ofono_bool_t registered;
@@ -81,6 +85,7 @@ struct ofono_sms {
 	GKeyFile *settings;
 	char *imsi;
 	int bearer;
+	struct sms_staged_props *staged;	/* SetProperties in progress */
 	enum sms_alphabet alphabet;
 	const struct ofono_sms_driver *driver;
 	void *driver_data;
@@ -90,6 +95,21 @@ struct ofono_sms {
 	GHashTable *messages;
 	struct ofono_watchlist *text_handlers;
 	struct ofono_watchlist *datagram_handlers;
+	gboolean rx_batching;
+	GSList *rx_batch;	/* Messages held back until the batch is done */
+};
+
+/*
+ * SetProperties changes nothing until all the driver calls have
+ * succeeded. Values that don't need the driver are -1 if not set.
+ */
+struct sms_staged_props {
+	int use_delivery_reports;
+	int alphabet;
+	int bearer;
+	ofono_bool_t sca_changed;	/* Set on the modem, sca is valid */
+	struct ofono_phone_number sca;	/* As queried back */
+	ofono_bool_t sca_known;		/* sms->sca was queried before */
 };
 
 struct pending_pdu {
@@ -99,12 +119,15 @@ struct pending_pdu {
 };
 
 struct tx_queue_entry {
+	struct ofono_sms *sms;
 	struct pending_pdu *pdus;
 	unsigned char num_pdus;
 	unsigned char cur_pdu;
 	struct sms_address receiver;
 	struct ofono_uuid uuid;
 	unsigned int retry;
+	guint retry_source;
+	gboolean in_flight;
 	unsigned int flags;
 	ofono_sms_txq_submit_cb_t cb;
 	void *data;
@@ -466,6 +489,98 @@ static DBusMessage *sms_get_properties(DBusConnection *conn,
 	return NULL;
 }
 
+static void sms_staged_commit(struct ofono_sms *sms)
+{
+	struct sms_staged_props *staged = sms->staged;
+	DBusConnection *conn = ofono_dbus_get_connection();
+	const char *path = __ofono_atom_get_path(sms->atom);
+	gboolean changed = FALSE;
+	const char *value;
+
+	sms->staged = NULL;
+
+	if (staged->sca_changed)
+		set_sca(sms, &staged->sca);
+
+	if (staged->bearer >= 0 && sms->bearer != staged->bearer) {
+		sms->bearer = staged->bearer;
+		changed = TRUE;
+
+		if (sms->settings)
+			g_key_file_set_integer(sms->settings, SETTINGS_GROUP,
+						"Bearer", sms->bearer);
+
+		value = sms_bearer_to_string(sms->bearer);
+		ofono_dbus_signal_property_changed(conn, path,
+						OFONO_MESSAGE_MANAGER_INTERFACE,
+						"Bearer",
+						DBUS_TYPE_STRING, &value);
+	}
+
+	if (staged->use_delivery_reports >= 0 &&
+			sms->use_delivery_reports !=
+			(ofono_bool_t) staged->use_delivery_reports) {
+		dbus_bool_t flag = staged->use_delivery_reports;
+
+		sms->use_delivery_reports = flag;
+		changed = TRUE;
+
+		if (sms->settings)
+			g_key_file_set_boolean(sms->settings, SETTINGS_GROUP,
+						"UseDeliveryReports", flag);
+
+		ofono_dbus_signal_property_changed(conn, path,
+						OFONO_MESSAGE_MANAGER_INTERFACE,
+						"UseDeliveryReports",
+						DBUS_TYPE_BOOLEAN, &flag);
+	}
+
+	if (staged->alphabet >= 0 &&
+			sms->alphabet != (enum sms_alphabet) staged->alphabet) {
+		sms->alphabet = staged->alphabet;
+		changed = TRUE;
+
+		if (sms->settings)
+			g_key_file_set_integer(sms->settings, SETTINGS_GROUP,
+						"Alphabet", sms->alphabet);
+
+		value = sms_alphabet_to_string(sms->alphabet);
+		ofono_dbus_signal_property_changed(conn, path,
+						OFONO_MESSAGE_MANAGER_INTERFACE,
+						"Alphabet",
+						DBUS_TYPE_STRING, &value);
+	}
+
+	/* Everything the call changed goes to disk in one go */
+	if (changed && sms->settings)
+		storage_sync(sms->imsi, SETTINGS_STORE, sms->settings);
+
+	g_free(staged);
+}
+
+static void sca_restore_callback(const struct ofono_error *error, void *data)
+{
+	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
+		ofono_error("Failed to restore the SCA");
+}
+
+/* Takes back what's already been set on the modem and fails the call */
+static void sms_staged_fail(struct ofono_sms *sms)
+{
+	struct sms_staged_props *staged = sms->staged;
+
+	sms->staged = NULL;
+
+	/* Without a query there is no old SCA to put back */
+	if (staged->sca_changed && staged->sca_known)
+		sms->driver->sca_set(sms, &sms->sca, sca_restore_callback, sms);
+
+	g_free(staged);
+
+	__ofono_dbus_pending_reply(&sms->pending,
+					__ofono_error_failed(sms->pending));
+}
+
 static void bearer_set_query_callback(const struct ofono_error *error,
 					int bearer, void *data)
 {
@@ -474,6 +589,12 @@ static void bearer_set_query_callback(const struct ofono_error *error,
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		ofono_error("Set Bearer succeeded, but query failed");
+
+		if (sms->staged) {
+			sms_staged_fail(sms);
+			return;
+		}
+
 		reply = __ofono_error_failed(sms->pending);
 		__ofono_dbus_pending_reply(&sms->pending, reply);
 		return;
@@ -482,6 +603,12 @@ static void bearer_set_query_callback(const struct ofono_error *error,
 	reply = dbus_message_new_method_return(sms->pending);
 	__ofono_dbus_pending_reply(&sms->pending, reply);
 
+	if (sms->staged) {
+		sms->staged->bearer = bearer;
+		sms_staged_commit(sms);
+		return;
+	}
+
 	set_bearer(sms, bearer);
 }
 
@@ -491,6 +618,12 @@ static void bearer_set_callback(const struct ofono_error *error, void *data)
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		DBG("Setting Bearer failed");
+
+		if (sms->staged) {
+			sms_staged_fail(sms);
+			return;
+		}
+
 		__ofono_dbus_pending_reply(&sms->pending,
 					__ofono_error_failed(sms->pending));
 		return;
@@ -504,16 +637,41 @@ static void sca_set_query_callback(const struct ofono_error *error,
 					void *data)
 {
 	struct ofono_sms *sms = data;
+	struct sms_staged_props *staged = sms->staged;
 	DBusMessage *reply;
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		ofono_error("Set SCA succeeded, but query failed");
 		sms->flags &= ~MESSAGE_MANAGER_FLAG_CACHED;
+
+		if (staged) {
+			/* What's on the modem is unknown, don't restore */
+			g_free(staged);
+			sms->staged = NULL;
+		}
+
 		reply = __ofono_error_failed(sms->pending);
 		__ofono_dbus_pending_reply(&sms->pending, reply);
 		return;
 	}
 
+	if (staged) {
+		staged->sca_changed = TRUE;
+		staged->sca = *sca;
+
+		/* The bearer is set after the SCA */
+		if (staged->bearer >= 0) {
+			sms->driver->bearer_set(sms, staged->bearer,
+						bearer_set_callback, sms);
+			return;
+		}
+
+		reply = dbus_message_new_method_return(sms->pending);
+		__ofono_dbus_pending_reply(&sms->pending, reply);
+		sms_staged_commit(sms);
+		return;
+	}
+
 	set_sca(sms, sca);
 
 	reply = dbus_message_new_method_return(sms->pending);
@@ -526,6 +684,12 @@ static void sca_set_callback(const struct ofono_error *error, void *data)
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		DBG("Setting SCA failed");
+
+		if (sms->staged) {
+			sms_staged_fail(sms);
+			return;
+		}
+
 		__ofono_dbus_pending_reply(&sms->pending,
 					__ofono_error_failed(sms->pending));
 		return;
@@ -648,6 +812,118 @@ static DBusMessage *sms_set_property(DBusConnection *conn, DBusMessage *msg,
 	return __ofono_error_invalid_args(msg);
 }
 
+static DBusMessage *sms_set_properties(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct ofono_sms *sms = data;
+	struct sms_staged_props *staged;
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+	const char *sca_str = NULL;
+	struct ofono_phone_number sca;
+	int bearer = -1;
+	int use_dr = -1;
+	int alphabet = -1;
+
+	if (sms->pending)
+		return __ofono_error_busy(msg);
+
+	if (!dbus_message_iter_init(msg, &iter))
+		return __ofono_error_invalid_args(msg);
+
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY ||
+			dbus_message_iter_get_element_type(&iter) !=
+						DBUS_TYPE_DICT_ENTRY)
+		return __ofono_error_invalid_args(msg);
+
+	dbus_message_iter_recurse(&iter, &dict);
+
+	/* Validate everything before touching anything */
+	while (dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY) {
+		DBusMessageIter entry;
+		DBusMessageIter var;
+		const char *property;
+		const char *value;
+		dbus_bool_t flag;
+		enum sms_alphabet a;
+
+		dbus_message_iter_recurse(&dict, &entry);
+		dbus_message_iter_get_basic(&entry, &property);
+		dbus_message_iter_next(&entry);
+		dbus_message_iter_recurse(&entry, &var);
+
+		if (!strcmp(property, "UseDeliveryReports")) {
+			if (dbus_message_iter_get_arg_type(&var) !=
+							DBUS_TYPE_BOOLEAN)
+				return __ofono_error_invalid_args(msg);
+
+			dbus_message_iter_get_basic(&var, &flag);
+			use_dr = flag ? 1 : 0;
+			dbus_message_iter_next(&dict);
+			continue;
+		}
+
+		if (dbus_message_iter_get_arg_type(&var) != DBUS_TYPE_STRING)
+			return __ofono_error_invalid_args(msg);
+
+		dbus_message_iter_get_basic(&var, &value);
+
+		if (!strcmp(property, "ServiceCenterAddress")) {
+			if (strlen(value) == 0 ||
+					!valid_phone_number_format(value))
+				return __ofono_error_invalid_format(msg);
+
+			if (sms->driver->sca_set == NULL ||
+					sms->driver->sca_query == NULL)
+				return __ofono_error_not_implemented(msg);
+
+			sca_str = value;
+		} else if (!strcmp(property, "Bearer")) {
+			if (sms_bearer_from_string(value, &bearer) != TRUE)
+				return __ofono_error_invalid_format(msg);
+
+			if (sms->driver->bearer_set == NULL ||
+					sms->driver->bearer_query == NULL)
+				return __ofono_error_not_implemented(msg);
+		} else if (!strcmp(property, "Alphabet")) {
+			if (!sms_alphabet_from_string(value, &a))
+				return __ofono_error_invalid_format(msg);
+
+			alphabet = a;
+		} else {
+			return __ofono_error_invalid_args(msg);
+		}
+
+		dbus_message_iter_next(&dict);
+	}
+
+	staged = g_new0(struct sms_staged_props, 1);
+	staged->use_delivery_reports = use_dr;
+	staged->alphabet = alphabet;
+	staged->bearer = bearer;
+	staged->sca_known = sms->flags & MESSAGE_MANAGER_FLAG_CACHED;
+	sms->staged = staged;
+
+	/* Nothing can fail without the driver */
+	if (sca_str == NULL && bearer < 0) {
+		g_dbus_send_reply(conn, msg, DBUS_TYPE_INVALID);
+		sms_staged_commit(sms);
+		return NULL;
+	}
+
+	sms->pending = dbus_message_ref(msg);
+
+	/* The modem settings go one after another, SCA first */
+	if (sca_str) {
+		string_to_phone_number(sca_str, &sca);
+		sms->driver->sca_set(sms, &sca, sca_set_callback, sms);
+	} else {
+		sms->driver->bearer_set(sms, bearer, bearer_set_callback, sms);
+	}
+
+	return NULL;
+}
+
 /*
  * Destroy/release the contents of a 'struct tx_queue_entry'
  *
@@ -656,6 +932,9 @@ static DBusMessage *sms_set_property(DBusConnection *conn, DBusMessage *msg,
  */
 static void tx_queue_entry_destroy(struct tx_queue_entry *entry)
 {
+	if (entry->retry_source)
+		g_source_remove(entry->retry_source);
+
 	if (entry->destroy)
 		entry->destroy(entry->data);
 
@@ -724,16 +1003,27 @@ done:
 	tx_queue_entry_destroy(entry);
 }
 
+static void tx_schedule(struct ofono_sms *sms, guint delay)
+{
+	if (sms->tx_source)
+		return;
+
+	sms->tx_source = g_timeout_add(delay, tx_next, sms);
+}
+
 static void tx_finished(const struct ofono_error *error, int mr, void *data)
 {
-	struct ofono_sms *sms = data;
-	struct tx_queue_entry *entry = g_queue_peek_head(sms->txq);
+	struct tx_queue_entry *entry = data;
+	struct ofono_sms *sms = entry->sms;
 	gboolean ok = error->type == OFONO_ERROR_TYPE_NO_ERROR;
 	enum message_state tx_state;
 
 	DBG("tx_finished %p", entry);
 
-	sms->flags &= ~MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
+	entry->in_flight = FALSE;
+
+	if (--sms->tx_pending == 0)
+		sms->flags &= ~MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
 
 	if (ok == FALSE) {
 		/* Retry again when back in online mode */
@@ -756,8 +1046,9 @@ static void tx_finished(const struct ofono_error *error, int mr, void *data)
 		if (entry->retry < TXQ_MAX_RETRIES) {
 			DBG("Sending failed, retry in %d secs",
 					entry->retry * 5);
-			sms->tx_source = g_timeout_add_seconds(entry->retry * 5,
-								tx_next, sms);
+			entry->retry_source = g_timeout_add_seconds(
+							entry->retry * 5,
+							tx_retry, entry);
 			return;
 		}
 
@@ -781,14 +1072,14 @@ static void tx_finished(const struct ofono_error *error, int mr, void *data)
 							entry->num_pdus);
 
 	if (entry->cur_pdu < entry->num_pdus) {
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
+		tx_schedule(sms, 0);
 		return;
 	}
 
 	tx_state = MESSAGE_STATE_SENT;
 
 next_q:
-	sms_tx_queue_remove_entry(sms, g_queue_peek_head_link(sms->txq),
+	sms_tx_queue_remove_entry(sms, g_queue_find(sms->txq, entry),
 					tx_state);
 
 	if (sms->registered == FALSE)
@@ -796,32 +1087,73 @@ next_q:
 
 	if (g_queue_peek_head(sms->txq)) {
 		DBG("Scheduling next");
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
+		tx_schedule(sms, 0);
 	}
 }
 
-static gboolean tx_next(gpointer user_data)
+static void tx_send(struct ofono_sms *sms, struct tx_queue_entry *entry)
 {
-	struct ofono_sms *sms = user_data;
-	int send_mms = 0;
-	struct tx_queue_entry *entry = g_queue_peek_head(sms->txq);
 	struct pending_pdu *pdu = &entry->pdus[entry->cur_pdu];
+	int send_mms = 0;
 
-	DBG("tx_next: %p", entry);
-
-	sms->tx_source = 0;
-
-	if (sms->registered == FALSE)
-		return FALSE;
+	DBG("tx_send: %p", entry);
 
 	if (g_queue_get_length(sms->txq) > 1
 			|| (entry->num_pdus - entry->cur_pdu) > 1)
 		send_mms = 1;
 
+	entry->in_flight = TRUE;
+	sms->tx_pending++;
 	sms->flags |= MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
 
 	sms->driver->submit(sms, pdu->pdu, pdu->pdu_len, pdu->tpdu_len,
-				send_mms, tx_finished, sms);
+				send_mms, tx_finished, entry);
+}
+
+/*
+ * Keeps the first tx_window entries of the queue going. Each of them has
+ * at most one PDU with the driver, so the PDUs of a message still go out
+ * in order. An entry waiting for its retry holds on to its slot, which
+ * with the default window of one stalls the queue just like it always did.
+ */
+static void tx_fill_window(struct ofono_sms *sms)
+{
+	GList *l = g_queue_peek_head_link(sms->txq);
+	unsigned int slot = 0;
+
+	while (l && slot < sms->tx_window && sms->registered) {
+		struct tx_queue_entry *entry = l->data;
+
+		if (entry->in_flight || entry->retry_source) {
+			l = l->next;
+			slot++;
+			continue;
+		}
+
+		tx_send(sms, entry);
+
+		/* The driver may have already called back, start over */
+		l = g_queue_peek_head_link(sms->txq);
+		slot = 0;
+	}
+}
+
+static gboolean tx_next(gpointer user_data)
+{
+	struct ofono_sms *sms = user_data;
+
+	sms->tx_source = 0;
+	tx_fill_window(sms);
+
+	return FALSE;
+}
+
+static gboolean tx_retry(gpointer user_data)
+{
+	struct tx_queue_entry *entry = user_data;
+
+	entry->retry_source = 0;
+	tx_fill_window(entry->sms);
 
 	return FALSE;
 }
@@ -854,7 +1186,7 @@ static void netreg_status_watch(int status, int lac, int ci, int tech,
 		return;
 
 	if (g_queue_get_length(sms->txq))
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
+		tx_schedule(sms, 0);
 }
 
 static void netreg_watch(struct ofono_atom *atom,
@@ -1277,32 +1609,22 @@ int __ofono_sms_txq_cancel(struct ofono_sms *sms, const struct ofono_uuid *uuid)
 
 	entry = l->data;
 
-	if (entry == g_queue_peek_head(sms->txq)) {
-		/*
-		 * Fail if any pdu was already transmitted or if we are
-		 * waiting the answer from driver.
-		 */
-		if (entry->cur_pdu > 0)
-			return -EPERM;
-
-		if (sms->flags & MESSAGE_MANAGER_FLAG_TXQ_ACTIVE)
-			return -EPERM;
-		/*
-		 * Make sure we don't call tx_next() if there are no entries
-		 * and that next entry doesn't have to wait a 'retry time'
-		 * from this one.
-		 */
-		if (sms->tx_source) {
-			g_source_remove(sms->tx_source);
-			sms->tx_source = 0;
-
-			if (g_queue_get_length(sms->txq) > 1)
-				sms->tx_source = g_timeout_add(0, tx_next, sms);
-		}
-	}
+	/*
+	 * Fail if any pdu was already transmitted or if we are
+	 * waiting the answer from driver.
+	 */
+	if (entry->cur_pdu > 0 || entry->in_flight)
+		return -EPERM;
 
 	sms_tx_queue_remove_entry(sms, l, MESSAGE_STATE_CANCELLED);
 
+	/*
+	 * The entry may have been holding a slot in the window for its
+	 * retry time, make sure the next one doesn't have to wait for it.
+	 */
+	if (sms->registered && g_queue_get_length(sms->txq) > 0)
+		tx_schedule(sms, 0);
+
 	return 0;
 }
 
@@ -1313,6 +1635,9 @@ static const GDBusMethodTable sms_manager_methods[] = {
 	{ GDBUS_ASYNC_METHOD("SetProperty",
 			GDBUS_ARGS({ "property", "s" }, { "value", "v" }),
 			NULL, sms_set_property) },
+	{ GDBUS_ASYNC_METHOD("SetProperties",
+			GDBUS_ARGS({ "properties", "a{sv}" }), NULL,
+			sms_set_properties) },
 	{ GDBUS_ASYNC_METHOD("SendMessage",
 			GDBUS_ARGS({ "to", "s" }, { "text", "s" }),
 			GDBUS_ARGS({ "path", "o" }),
@@ -1631,12 +1956,24 @@ static void handle_deliver(struct ofono_sms *sms, const struct sms *incoming)
 		if (sms_list == NULL)
 			return;
 
+		if (sms->rx_batching) {
+			sms->rx_batch = g_slist_prepend(sms->rx_batch,
+								sms_list);
+			return;
+		}
+
 		sms_dispatch(sms, sms_list);
 		g_slist_free_full(sms_list, g_free);
 
 		return;
 	}
 
+	if (sms->rx_batching) {
+		l = g_slist_append(NULL, g_memdup(incoming, sizeof(*incoming)));
+		sms->rx_batch = g_slist_prepend(sms->rx_batch, l);
+		return;
+	}
+
 	l = g_slist_append(NULL, (void *) incoming);
 	sms_dispatch(sms, l);
 	g_slist_free(l);
@@ -1822,6 +2159,50 @@ out:
 	handle_deliver(sms, &s);
 }
 
+ofono_bool_t ofono_sms_deliver_notify_batch(struct ofono_sms *sms,
+			const struct ofono_sms_pdu *pdus, unsigned int count)
+{
+	GSList *batch;
+	GSList *l;
+	unsigned int i;
+
+	DBG("%u PDUs", count);
+
+	if (sms->assembly)
+		sms_assembly_begin(sms->assembly);
+
+	sms->rx_batching = TRUE;
+
+	for (i = 0; i < count; i++)
+		ofono_sms_deliver_notify(sms, pdus[i].pdu, pdus[i].len,
+							pdus[i].tpdu_len);
+
+	sms->rx_batching = FALSE;
+
+	batch = g_slist_reverse(sms->rx_batch);
+	sms->rx_batch = NULL;
+
+	if (sms->assembly && !sms_assembly_commit(sms->assembly)) {
+		/* The PDUs stay on the modem and come back next time */
+		ofono_error("Unable to back up received SMS fragments");
+
+		for (l = batch; l; l = l->next)
+			g_slist_free_full(l->data, g_free);
+
+		g_slist_free(batch);
+		return FALSE;
+	}
+
+	/* Everything is backed up, now the messages can go out */
+	for (l = batch; l; l = l->next) {
+		sms_dispatch(sms, l->data);
+		g_slist_free_full(l->data, g_free);
+	}
+
+	g_slist_free(batch);
+	return TRUE;
+}
+
 void ofono_sms_status_notify(struct ofono_sms *sms, const unsigned char *pdu,
 				int len, int tpdu_len)
 {
@@ -1951,6 +2332,9 @@ static void sms_remove(struct ofono_atom *atom)
 	if (sms->driver && sms->driver->remove)
 		sms->driver->remove(sms);
 
+	g_free(sms->staged);
+	sms->staged = NULL;
+
 	if (sms->tx_source) {
 		g_source_remove(sms->tx_source);
 		sms->tx_source = 0;
@@ -2023,6 +2407,7 @@ struct ofono_sms *ofono_sms_create(struct ofono_modem *modem,
 	sms->sca.type = 129;
 	sms->ref = 1;
 	sms->txq = g_queue_new();
+	sms->tx_window = 1;
 	sms->messages = g_hash_table_new(uuid_hash, uuid_equal);
 
 	sms->atom = __ofono_modem_add_atom(modem, OFONO_ATOM_TYPE_SMS,
@@ -2165,6 +2550,7 @@ static void sms_restore_tx_queue(struct ofono_sms *sms)
 		g_hash_table_insert(sms->messages, &txq_entry->uuid, m);
 
 		txq_entry->id = sms->tx_counter++;
+		txq_entry->sms = sms;
 		g_queue_push_tail(sms->txq, txq_entry);
 
 loop_out:
@@ -2173,7 +2559,7 @@ loop_out:
 	}
 
 	if (g_queue_get_length(sms->txq) > 0)
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
+		tx_schedule(sms, 0);
 
 	g_queue_free(backupq);
 }
@@ -2261,6 +2647,14 @@ void *ofono_sms_get_data(struct ofono_sms *sms)
 	return sms->driver_data;
 }
 
+void ofono_sms_set_submit_window(struct ofono_sms *sms, unsigned int window)
+{
+	if (sms == NULL)
+		return;
+
+	sms->tx_window = CLAMP(window, 1, TXQ_MAX_WINDOW);
+}
+
 unsigned short __ofono_sms_get_next_ref(struct ofono_sms *sms)
 {
 	return sms->ref;
@@ -2300,10 +2694,12 @@ int __ofono_sms_txq_submit(struct ofono_sms *sms, GSList *list,
 
 	entry->id = sms->tx_counter++;
 
+	entry->sms = sms;
 	g_queue_push_tail(sms->txq, entry);
 
-	if (sms->registered && g_queue_get_length(sms->txq) == 1)
-		sms->tx_source = g_timeout_add(100, tx_next, sms);
+	if (sms->registered &&
+			g_queue_get_length(sms->txq) <= sms->tx_window)
+		tx_schedule(sms, 100);
 
 	if (uuid)
 		memcpy(uuid, &entry->uuid, sizeof(*uuid));
@@ -28,32 +28,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dirent.h>
 #include <sys/types.h>
-#include <sys/stat.h>
 #include <unistd.h>
 
 #include <glib.h>
 
 #include "util.h"
-#include "storage.h"
 #include "smsutil.h"
+#include "sms-journal.h"
 
 #include <ofono/misc.h>
 
 #define uninitialized_var(x) x = x
 
-#define SMS_BACKUP_MODE 0600
-#define SMS_BACKUP_PATH STORAGEDIR "/%s/sms_assembly"
-#define SMS_BACKUP_PATH_DIR SMS_BACKUP_PATH "/%s-%i-%i"
-#define SMS_BACKUP_PATH_FILE SMS_BACKUP_PATH_DIR "/%03i"
+/* Journal keys, these used to be paths under STORAGEDIR/<imsi> */
+#define SMS_BACKUP_KEY_PREFIX "sms_assembly/"
+#define SMS_BACKUP_KEY SMS_BACKUP_KEY_PREFIX "%s-%i-%i/%03i"
 
-#define SMS_SR_BACKUP_PATH STORAGEDIR "/%s/sms_sr"
-#define SMS_SR_BACKUP_PATH_FILE SMS_SR_BACKUP_PATH "/%s-%s"
+#define SMS_SR_BACKUP_KEY_PREFIX "sms_sr/"
+#define SMS_SR_BACKUP_KEY SMS_SR_BACKUP_KEY_PREFIX "%s-%s"
 
-#define SMS_TX_BACKUP_PATH STORAGEDIR "/%s/tx_queue"
-#define SMS_TX_BACKUP_PATH_DIR SMS_TX_BACKUP_PATH "/%lu-%lu-%s"
-#define SMS_TX_BACKUP_PATH_FILE SMS_TX_BACKUP_PATH_DIR "/%03i"
+#define SMS_TX_BACKUP_KEY_PREFIX "tx_queue/"
+#define SMS_TX_BACKUP_KEY_DIR SMS_TX_BACKUP_KEY_PREFIX "%lu-%lu-%s/"
+#define SMS_TX_BACKUP_KEY SMS_TX_BACKUP_KEY_DIR "%03i"
 
 #define SMS_ADDR_FMT "%24[0-9A-F]"
 #define SMS_MSGID_FMT "%40[0-9A-F]"
@@ -2424,79 +2421,32 @@ gboolean sms_address_to_hex_string(const struct sms_address *in, char *straddr)
 	return TRUE;
 }
 
-static void sms_assembly_load(struct sms_assembly *assembly,
-				const struct dirent *dir)
+static void sms_assembly_load(const char *key, const void *data,
+				unsigned int len, time_t ts, void *user_data)
 {
+	struct sms_assembly *assembly = user_data;
 	struct sms_address addr;
 	DECLARE_SMS_ADDR_STR(straddr);
 	guint16 ref;
 	guint8 max;
 	guint8 seq;
-	char *path;
-	int len;
-	struct stat segment_stat;
-	struct dirent **segments;
-	char *endp;
-	int r;
-	int i;
-	unsigned char buf[177];
+	char endc;
 	struct sms segment;
 
-	if (dir->d_type != DT_DIR)
-		return;
-
 	/* Max of SMS address size is 12 bytes, hex encoded */
-	if (sscanf(dir->d_name, SMS_ADDR_FMT "-%hi-%hhi",
-				straddr, &ref, &max) < 3)
+	if (sscanf(key, SMS_BACKUP_KEY_PREFIX SMS_ADDR_FMT "-%hi-%hhi/%hhu%c",
+				straddr, &ref, &max, &seq, &endc) != 4)
 		return;
 
 	if (sms_assembly_extract_address(straddr, &addr) == FALSE)
 		return;
 
-	path = g_strdup_printf(SMS_BACKUP_PATH "/%s",
-			assembly->imsi, dir->d_name);
-	len = scandir(path, &segments, NULL, versionsort);
-	g_free(path);
-
-	if (len < 0)
+	if (!sms_deserialize(data, &segment, len))
 		return;
 
-	for (i = 0; i < len; i++) {
-		if (segments[i]->d_type != DT_REG)
-			continue;
-
-		seq = strtol(segments[i]->d_name, &endp, 10);
-		if (*endp != '\0')
-			continue;
-
-		r = read_file(buf, sizeof(buf), SMS_BACKUP_PATH "/%s/%s",
-				assembly->imsi,
-				dir->d_name, segments[i]->d_name);
-		if (r < 0)
-			continue;
-
-		if (!sms_deserialize(buf, &segment, r))
-			continue;
-
-		path = g_strdup_printf(SMS_BACKUP_PATH "/%s/%s",
-				assembly->imsi,
-				dir->d_name, segments[i]->d_name);
-		r = stat(path, &segment_stat);
-		g_free(path);
-
-		if (r != 0)
-			continue;
-
-		/* Errors cannot occur here */
-		sms_assembly_add_fragment_backup(assembly, &segment,
-						segment_stat.st_mtime,
+	/* Errors cannot occur here */
+	sms_assembly_add_fragment_backup(assembly, &segment, ts,
 						&addr, ref, max, seq, FALSE);
-	}
-
-	for (i = 0; i < len; i++)
-		free(segments[i]);
-
-	free(segments);
 }
 
 static gboolean sms_assembly_store(struct sms_assembly *assembly,
@@ -2506,8 +2456,10 @@ static gboolean sms_assembly_store(struct sms_assembly *assembly,
 	unsigned char buf[177];
 	int len;
 	DECLARE_SMS_ADDR_STR(straddr);
+	char *key;
+	gboolean ret;
 
-	if (assembly->imsi == NULL)
+	if (assembly->journal == NULL)
 		return FALSE;
 
 	if (sms_address_to_hex_string(&node->addr, straddr) == FALSE)
@@ -2515,22 +2467,22 @@ static gboolean sms_assembly_store(struct sms_assembly *assembly,
 
 	len = sms_serialize(buf, sms);
 
-	if (write_file(buf, len, SMS_BACKUP_MODE,
-				SMS_BACKUP_PATH_FILE, assembly->imsi, straddr,
-				node->ref, node->max_fragments, seq) != len)
-		return FALSE;
+	key = g_strdup_printf(SMS_BACKUP_KEY, straddr, node->ref,
+					node->max_fragments, seq);
+	ret = sms_journal_put(assembly->journal, key, buf, len, time(NULL));
+	g_free(key);
 
-	return TRUE;
+	return ret;
 }
 
 static void sms_assembly_backup_free(struct sms_assembly *assembly,
 					struct sms_assembly_node *node)
 {
-	char *path;
+	char *key;
 	int seq;
 	DECLARE_SMS_ADDR_STR(straddr);
 
-	if (assembly->imsi == NULL)
+	if (assembly->journal == NULL)
 		return;
 
 	if (sms_address_to_hex_string(&node->addr, straddr) == FALSE)
@@ -2541,45 +2493,72 @@ static void sms_assembly_backup_free(struct sms_assembly *assembly,
 		int bit = 1 << (seq % 32);
 
 		if (node->bitmap[offset] & bit) {
-			path = g_strdup_printf(SMS_BACKUP_PATH_FILE,
-					assembly->imsi, straddr,
+			key = g_strdup_printf(SMS_BACKUP_KEY, straddr,
 					node->ref, node->max_fragments, seq);
-			unlink(path);
-			g_free(path);
+			sms_journal_remove(assembly->journal, key);
+			g_free(key);
 		}
 	}
+}
+
+static guint sms_assembly_node_hash(gconstpointer v)
+{
+	const struct sms_assembly_node *node = v;
 
-	path = g_strdup_printf(SMS_BACKUP_PATH_DIR, assembly->imsi, straddr,
-				node->ref, node->max_fragments);
-	rmdir(path);
-	g_free(path);
+	return g_str_hash(node->addr.address) ^
+		(node->addr.number_type << 28) ^
+		(node->addr.numbering_plan << 24) ^ node->ref;
+}
+
+static gboolean sms_assembly_node_equal(gconstpointer v1, gconstpointer v2)
+{
+	const struct sms_assembly_node *a = v1;
+	const struct sms_assembly_node *b = v2;
+
+	return a->ref == b->ref &&
+		a->addr.number_type == b->addr.number_type &&
+		a->addr.numbering_plan == b->addr.numbering_plan &&
+		!strcmp(a->addr.address, b->addr.address);
+}
+
+static gint sms_assembly_node_compare_ts(gconstpointer v1, gconstpointer v2,
+							gpointer user_data)
+{
+	const struct sms_assembly_node *a = v1;
+	const struct sms_assembly_node *b = v2;
+
+	return (a->ts > b->ts) - (a->ts < b->ts);
+}
+
+static void sms_assembly_node_free(struct sms_assembly_node *node)
+{
+	g_slist_free_full(node->fragment_list, g_free);
+	g_free(node);
+}
+
+/* Forgets about the node, the caller takes care of its contents */
+static void sms_assembly_node_remove(struct sms_assembly *assembly,
+					struct sms_assembly_node *node)
+{
+	g_sequence_remove(node->expiry);
+	g_hash_table_remove(assembly->assembly_table, node);
 }
 
 struct sms_assembly *sms_assembly_new(const char *imsi)
 {
 	struct sms_assembly *ret = g_new0(struct sms_assembly, 1);
-	char *path;
-	struct dirent **entries;
-	int len;
+
+	ret->assembly_table = g_hash_table_new(sms_assembly_node_hash,
+						sms_assembly_node_equal);
+	ret->expiry_queue = g_sequence_new(NULL);
 
 	if (imsi) {
 		ret->imsi = imsi;
+		ret->journal = sms_journal_open(imsi);
 
 		/* Restore state from backup */
-
-		path = g_strdup_printf(SMS_BACKUP_PATH, imsi);
-		len = scandir(path, &entries, NULL, alphasort);
-		g_free(path);
-
-		if (len < 0)
-			return ret;
-
-		while (len--) {
-			sms_assembly_load(ret, entries[len]);
-			free(entries[len]);
-		}
-
-		free(entries);
+		sms_journal_foreach(ret->journal, SMS_BACKUP_KEY_PREFIX,
+						sms_assembly_load, ret);
 	}
 
 	return ret;
@@ -2587,19 +2566,35 @@ struct sms_assembly *sms_assembly_new(const char *imsi)
 
 void sms_assembly_free(struct sms_assembly *assembly)
 {
-	GSList *l;
+	GHashTableIter iter;
+	gpointer node;
 
-	for (l = assembly->assembly_list; l; l = l->next) {
-		struct sms_assembly_node *node = l->data;
+	g_hash_table_iter_init(&iter, assembly->assembly_table);
 
-		g_slist_free_full(node->fragment_list, g_free);
-		g_free(node);
-	}
+	while (g_hash_table_iter_next(&iter, &node, NULL))
+		sms_assembly_node_free(node);
 
-	g_slist_free(assembly->assembly_list);
+	g_hash_table_destroy(assembly->assembly_table);
+	g_sequence_free(assembly->expiry_queue);
+	sms_journal_close(assembly->journal);
 	g_free(assembly);
 }
 
+/*
+ * Fragments added until the matching sms_assembly_commit() are backed up
+ * with a single write. The status report assembly for the same IMSI
+ * shares the journal, so its backups go along.
+ */
+void sms_assembly_begin(struct sms_assembly *assembly)
+{
+	sms_journal_begin(assembly->journal);
+}
+
+gboolean sms_assembly_commit(struct sms_assembly *assembly)
+{
+	return sms_journal_commit(assembly->journal);
+}
+
 GSList *sms_assembly_add_fragment(struct sms_assembly *assembly,
 					const struct sms *sms, time_t ts,
 					const struct sms_address *addr,
@@ -2617,32 +2612,19 @@ static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
 {
 	unsigned int offset = seq / 32;
 	unsigned int bit = 1 << (seq % 32);
-	GSList *l;
-	GSList *prev;
+	struct sms_assembly_node lookup;
 	struct sms *newsms;
 	struct sms_assembly_node *node;
 	GSList *completed;
 	unsigned int position;
 	unsigned int i;
-	unsigned int j;
 
-	prev = NULL;
+	memcpy(&lookup.addr, addr, sizeof(struct sms_address));
+	lookup.ref = ref;
 
-	for (l = assembly->assembly_list; l; prev = l, l = l->next) {
-		node = l->data;
-
-		if (node->addr.number_type != addr->number_type)
-			continue;
-
-		if (node->addr.numbering_plan != addr->numbering_plan)
-			continue;
-
-		if (strcmp(node->addr.address, addr->address))
-			continue;
-
-		if (ref != node->ref)
-			continue;
+	node = g_hash_table_lookup(assembly->assembly_table, &lookup);
 
+	if (node) {
 		/*
 		 * Message Reference and address the same, but max is not
 		 * ignore the SMS completely
@@ -2655,39 +2637,29 @@ static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
 			return NULL;
 
 		/*
-		 * Iterate over the bitmap to find in which position
-		 * should the fragment be inserted -- basically we
-		 * walk each bit in the bitmap until the bit we care
-		 * about (offset:bit) and count which are stored --
-		 * that gives us in which position we have to insert.
+		 * The fragment goes after all the stored fragments with
+		 * a lower seq number, count the bits below (offset:bit).
 		 */
 		position = 0;
 		for (i = 0; i < offset; i++)
-			for (j = 0; j < 32; j++)
-				if (node->bitmap[i] & (1 << j))
-					position += 1;
-
-		for (j = 1; j < bit; j = j << 1)
-			if (node->bitmap[offset] & j)
-				position += 1;
+			position += __builtin_popcount(node->bitmap[i]);
 
-		goto out;
+		position += __builtin_popcount(node->bitmap[offset] &
+								(bit - 1));
+	} else {
+		node = g_new0(struct sms_assembly_node, 1);
+		memcpy(&node->addr, addr, sizeof(struct sms_address));
+		node->ts = ts;
+		node->ref = ref;
+		node->max_fragments = max;
+		node->expiry = g_sequence_insert_sorted(assembly->expiry_queue,
+					node, sms_assembly_node_compare_ts,
+					NULL);
+
+		g_hash_table_add(assembly->assembly_table, node);
+		position = 0;
 	}
 
-	node = g_new0(struct sms_assembly_node, 1);
-	memcpy(&node->addr, addr, sizeof(struct sms_address));
-	node->ts = ts;
-	node->ref = ref;
-	node->max_fragments = max;
-
-	assembly->assembly_list = g_slist_prepend(assembly->assembly_list,
-							node);
-
-	prev = NULL;
-	l = assembly->assembly_list;
-	position = 0;
-
-out:
 	newsms = g_new(struct sms, 1);
 
 	memcpy(newsms, sms, sizeof(struct sms));
@@ -2706,14 +2678,9 @@ out:
 	completed = node->fragment_list;
 
 	sms_assembly_backup_free(assembly, node);
-
-	if (prev)
-		prev->next = l->next;
-	else
-		assembly->assembly_list = l->next;
+	sms_assembly_node_remove(assembly, node);
 
 	g_free(node);
-	g_slist_free_1(l);
 	return completed;
 }
 
@@ -2724,35 +2691,20 @@ out:
  */
 void sms_assembly_expire(struct sms_assembly *assembly, time_t before)
 {
-	GSList *cur;
-	GSList *prev;
-	GSList *tmp;
+	GSequenceIter *iter = g_sequence_get_begin_iter(assembly->expiry_queue);
 
-	prev = NULL;
-	cur = assembly->assembly_list;
+	/* The queue is ordered by time stamp, oldest first */
+	while (!g_sequence_iter_is_end(iter)) {
+		struct sms_assembly_node *node = g_sequence_get(iter);
 
-	while (cur) {
-		struct sms_assembly_node *node = cur->data;
+		if (node->ts > before)
+			break;
 
-		if (node->ts > before) {
-			prev = cur;
-			cur = cur->next;
-			continue;
-		}
+		iter = g_sequence_iter_next(iter);
 
 		sms_assembly_backup_free(assembly, node);
-
-		g_slist_free_full(node->fragment_list, g_free);
-		g_free(node);
-
-		if (prev)
-			prev->next = cur->next;
-		else
-			assembly->assembly_list = cur->next;
-
-		tmp = cur;
-		cur = cur->next;
-		g_slist_free_1(tmp);
+		sms_assembly_node_remove(assembly, node);
+		sms_assembly_node_free(node);
 	}
 }
 
@@ -2770,32 +2722,212 @@ static guint sha1_hash(gconstpointer v)
 	return h;
 }
 
-static void sr_assembly_load_backup(GHashTable *assembly_table,
-					const char *imsi,
-					const struct dirent *addr_dir)
+/* Status reports are matched on the last this many digits of the address */
+#define SR_ADDR_SUFFIX_LEN 6
+
+/* What's kept in memory for each message waiting for status reports */
+struct sr_assembly_node {
+	struct id_table_node data;	/* This is what gets backed up */
+	unsigned char msgid[SMS_MSGID_LEN];
+	const char *addr;		/* Key of the node in assembly_table */
+	GSequenceIter *expiry;
+};
+
+struct sr_mr_key {
+	const char *addr;
+	unsigned char mr;
+};
+
+static guint sr_mr_key_hash(gconstpointer v)
+{
+	const struct sr_mr_key *key = v;
+
+	return g_direct_hash(key->addr) * 31 + key->mr;
+}
+
+static gboolean sr_mr_key_equal(gconstpointer v1, gconstpointer v2)
+{
+	const struct sr_mr_key *key1 = v1;
+	const struct sr_mr_key *key2 = v2;
+
+	return key1->addr == key2->addr && key1->mr == key2->mr;
+}
+
+static int sr_assembly_compare_expiration(gconstpointer a, gconstpointer b,
+						gpointer user_data)
+{
+	const struct sr_assembly_node *node1 = a;
+	const struct sr_assembly_node *node2 = b;
+
+	if (node1->data.expiration < node2->data.expiration)
+		return -1;
+
+	return node1->data.expiration > node2->data.expiration;
+}
+
+static const char *sr_addr_suffix(const char *addr)
 {
+	size_t len = strlen(addr);
+
+	return len > SR_ADDR_SUFFIX_LEN ? addr + len - SR_ADDR_SUFFIX_LEN :
+						addr;
+}
+
+static void sr_suffix_index_add(struct status_report_assembly *assembly,
+					const char *addr)
+{
+	const char *suffix = sr_addr_suffix(addr);
+	GQueue *addrs = g_hash_table_lookup(assembly->suffix_table, suffix);
+
+	if (addrs == NULL) {
+		addrs = g_queue_new();
+		g_hash_table_insert(assembly->suffix_table, g_strdup(suffix),
+					addrs);
+	}
+
+	g_queue_push_tail(addrs, (gpointer) addr);
+}
+
+static void sr_suffix_index_remove(struct status_report_assembly *assembly,
+					const char *addr)
+{
+	const char *suffix = sr_addr_suffix(addr);
+	GQueue *addrs = g_hash_table_lookup(assembly->suffix_table, suffix);
+
+	if (addrs == NULL)
+		return;
+
+	g_queue_remove(addrs, addr);
+
+	if (g_queue_is_empty(addrs))
+		g_hash_table_remove(assembly->suffix_table, suffix);
+}
+
+static void sr_mr_index_add(struct status_report_assembly *assembly,
+				struct sr_assembly_node *node, unsigned char mr)
+{
+	struct sr_mr_key lookup = { node->addr, mr };
+	GQueue *nodes = g_hash_table_lookup(assembly->mr_table, &lookup);
+
+	if (nodes == NULL) {
+		nodes = g_queue_new();
+		g_hash_table_insert(assembly->mr_table,
+					g_memdup(&lookup, sizeof(lookup)),
+					nodes);
+	}
+
+	g_queue_push_tail(nodes, node);
+}
+
+static void sr_mr_index_remove(struct status_report_assembly *assembly,
+				struct sr_assembly_node *node, unsigned char mr)
+{
+	struct sr_mr_key lookup = { node->addr, mr };
+	GQueue *nodes = g_hash_table_lookup(assembly->mr_table, &lookup);
+
+	if (nodes == NULL)
+		return;
+
+	g_queue_remove(nodes, node);
+
+	if (g_queue_is_empty(nodes))
+		g_hash_table_remove(assembly->mr_table, &lookup);
+}
+
+/*
+ * Returns the id table of the address, creating it if needed. The node
+ * keys of the address point to the key in assembly_table.
+ */
+static GHashTable *sr_assembly_id_table(struct status_report_assembly *assembly,
+					const char *straddr,
+					const char **out_addr)
+{
+	gpointer key;
+	gpointer id_table;
+
+	if (g_hash_table_lookup_extended(assembly->assembly_table, straddr,
+						&key, &id_table)) {
+		*out_addr = key;
+		return id_table;
+	}
+
+	key = g_strdup(straddr);
+	id_table = g_hash_table_new_full(sha1_hash, sha1_equal, NULL, g_free);
+	g_hash_table_insert(assembly->assembly_table, key, id_table);
+	sr_suffix_index_add(assembly, key);
+
+	*out_addr = key;
+	return id_table;
+}
+
+static struct sr_assembly_node *sr_assembly_node_new(
+					struct status_report_assembly *assembly,
+					const char *straddr,
+					const unsigned char *msgid)
+{
+	struct sr_assembly_node *node = g_new0(struct sr_assembly_node, 1);
+	GHashTable *id_table;
+
+	id_table = sr_assembly_id_table(assembly, straddr, &node->addr);
+	memcpy(node->msgid, msgid, SMS_MSGID_LEN);
+	g_hash_table_insert(id_table, node->msgid, node);
+
+	return node;
+}
+
+static void sr_assembly_node_remove(struct status_report_assembly *assembly,
+					struct sr_assembly_node *node)
+{
+	const char *addr = node->addr;
+	GHashTable *id_table = g_hash_table_lookup(assembly->assembly_table,
+							addr);
+	unsigned int i;
+
+	for (i = 0; i < 8; i++) {
+		unsigned int mrs = node->data.mrs[i];
+
+		while (mrs) {
+			sr_mr_index_remove(assembly, node,
+						i * 32 + __builtin_ctz(mrs));
+			mrs &= mrs - 1;
+		}
+	}
+
+	if (node->expiry)
+		g_sequence_remove(node->expiry);
+
+	/* This frees the node */
+	g_hash_table_remove(id_table, node->msgid);
+
+	if (g_hash_table_size(id_table) > 0)
+		return;
+
+	sr_suffix_index_remove(assembly, addr);
+	g_hash_table_remove(assembly->assembly_table, addr);
+}
+
+static void sr_assembly_load_backup(const char *key, const void *data,
+				unsigned int len, time_t ts, void *user_data)
+{
+	struct status_report_assembly *assembly = user_data;
 	struct sms_address addr;
 	DECLARE_SMS_ADDR_STR(straddr);
-	struct id_table_node *node;
-	GHashTable *id_table;
-	int r;
-	char *assembly_table_key;
-	unsigned int *id_table_key;
+	struct sr_assembly_node *node;
 	char msgid_str[SMS_MSGID_LEN * 2 + 1];
 	unsigned char msgid[SMS_MSGID_LEN];
+	unsigned int i;
 	char endc;
 
-	if (addr_dir->d_type != DT_REG)
+	if (len != sizeof(struct id_table_node))
 		return;
 
 	/*
-	 * All SMS-messages under the same IMSI-code are
-	 * included in the same directory.
-	 * So, SMS-address and message ID are included in the same file name
+	 * SMS-address and message ID are both part of the key
 	 * Max of SMS address size is 12 bytes, hex encoded
 	 * Max of SMS SHA1 hash is 20 bytes, hex encoded
 	 */
-	if (sscanf(addr_dir->d_name, SMS_ADDR_FMT "-" SMS_MSGID_FMT "%c",
+	if (sscanf(key, SMS_SR_BACKUP_KEY_PREFIX SMS_ADDR_FMT "-"
+				SMS_MSGID_FMT "%c",
 				straddr, msgid_str, &endc) != 2)
 		return;
 
@@ -2809,87 +2941,60 @@ static void sr_assembly_load_backup(GHashTable *assembly_table,
 				NULL, 0, msgid) == NULL)
 		return;
 
-	node = g_new0(struct id_table_node, 1);
+	node = sr_assembly_node_new(assembly, sms_address_to_string(&addr),
+					msgid);
+	memcpy(&node->data, data, len);
 
-	r = read_file((unsigned char *) node,
-			sizeof(struct id_table_node),
-			SMS_SR_BACKUP_PATH "/%s",
-			imsi, addr_dir->d_name);
+	for (i = 0; i < 8; i++) {
+		unsigned int mrs = node->data.mrs[i];
 
-	if (r < 0) {
-		g_free(node);
-		return;
-	}
-
-	id_table = g_hash_table_lookup(assembly_table,
-					sms_address_to_string(&addr));
-
-	/* Create hashtable keyed by the to address if required */
-	if (id_table == NULL) {
-		id_table = g_hash_table_new_full(sha1_hash, sha1_equal,
-							g_free, g_free);
-
-		assembly_table_key = g_strdup(sms_address_to_string(&addr));
-		g_hash_table_insert(assembly_table, assembly_table_key,
-					id_table);
+		while (mrs) {
+			sr_mr_index_add(assembly, node,
+						i * 32 + __builtin_ctz(mrs));
+			mrs &= mrs - 1;
+		}
 	}
 
-	/* Node ready, create key and add them to the table */
-	id_table_key = g_memdup(msgid, SMS_MSGID_LEN);
-
-	g_hash_table_insert(id_table, id_table_key, node);
+	node->expiry = g_sequence_insert_sorted(assembly->expiry_queue, node,
+					sr_assembly_compare_expiration, NULL);
 }
 
 struct status_report_assembly *status_report_assembly_new(const char *imsi)
 {
-	char *path;
-	int len;
-	struct dirent **addresses;
 	struct status_report_assembly *ret =
 				g_new0(struct status_report_assembly, 1);
 
 	ret->assembly_table = g_hash_table_new_full(g_str_hash, g_str_equal,
 				g_free, (GDestroyNotify) g_hash_table_destroy);
+	ret->mr_table = g_hash_table_new_full(sr_mr_key_hash, sr_mr_key_equal,
+				g_free, (GDestroyNotify) g_queue_free);
+	ret->suffix_table = g_hash_table_new_full(g_str_hash, g_str_equal,
+				g_free, (GDestroyNotify) g_queue_free);
+	ret->expiry_queue = g_sequence_new(NULL);
 
 	if (imsi) {
 		ret->imsi = imsi;
+		ret->journal = sms_journal_open(imsi);
 
 		/* Restore state from backup */
-		path = g_strdup_printf(SMS_SR_BACKUP_PATH, imsi);
-		len = scandir(path, &addresses, NULL, alphasort);
-
-		g_free(path);
-
-		if (len < 0)
-			return ret;
-
-		/*
-		 * Go through different addresses. Each address can relate to
-		 * 1-n msg_ids.
-		 */
-
-		while (len--) {
-			sr_assembly_load_backup(ret->assembly_table, imsi,
-								addresses[len]);
-			g_free(addresses[len]);
-		}
-
-		g_free(addresses);
+		sms_journal_foreach(ret->journal, SMS_SR_BACKUP_KEY_PREFIX,
+					sr_assembly_load_backup, ret);
 	}
 
 	return ret;
 }
 
-static gboolean sr_assembly_add_fragment_backup(const char *imsi,
+static gboolean sr_assembly_add_fragment_backup(struct sms_journal *journal,
 					const struct id_table_node *node,
 					const struct sms_address *addr,
 					const unsigned char *msgid)
 {
-	int len = sizeof(struct id_table_node);
 	DECLARE_SMS_ADDR_STR(straddr);
 	char msgid_str[SMS_MSGID_LEN * 2 + 1];
+	char *key;
+	gboolean ret;
 
-	if (imsi == NULL)
+	if (journal == NULL)
 		return FALSE;
 
 	if (sms_address_to_hex_string(addr, straddr) == FALSE)
@@ -2898,24 +3003,23 @@ static gboolean sr_assembly_add_fragment_backup(const char *imsi,
 	if (encode_hex_own_buf(msgid, SMS_MSGID_LEN, 0, msgid_str) == NULL)
 		return FALSE;
 
-	/* storagedir/%s/sms_sr/%s-%s */
-	if (write_file((unsigned char *) node, len, SMS_BACKUP_MODE,
-			SMS_SR_BACKUP_PATH_FILE, imsi,
-			straddr, msgid_str) != len)
-		return FALSE;
+	key = g_strdup_printf(SMS_SR_BACKUP_KEY, straddr, msgid_str);
+	ret = sms_journal_put(journal, key, node,
+				sizeof(struct id_table_node), time(NULL));
+	g_free(key);
 
-	return TRUE;
+	return ret;
 }
 
-static gboolean sr_assembly_remove_fragment_backup(const char *imsi,
+static gboolean sr_assembly_remove_fragment_backup(struct sms_journal *journal,
 					const struct sms_address *addr,
 					const unsigned char *sha1)
 {
-	char *path;
+	char *key;
 	DECLARE_SMS_ADDR_STR(straddr);
 	char msgid_str[SMS_MSGID_LEN * 2 + 1];
 
-	if (imsi == NULL)
+	if (journal == NULL)
 		return FALSE;
 
 	if (sms_address_to_hex_string(addr, straddr) == FALSE)
@@ -2924,18 +3028,20 @@ static gboolean sr_assembly_remove_fragment_backup(const char *imsi,
 	if (encode_hex_own_buf(sha1, SMS_MSGID_LEN, 0, msgid_str) == FALSE)
 		return FALSE;
 
-	path = g_strdup_printf(SMS_SR_BACKUP_PATH_FILE,
-					imsi, straddr, msgid_str);
-
-	unlink(path);
-	g_free(path);
+	key = g_strdup_printf(SMS_SR_BACKUP_KEY, straddr, msgid_str);
+	sms_journal_remove(journal, key);
+	g_free(key);
 
 	return TRUE;
 }
 
 void status_report_assembly_free(struct status_report_assembly *assembly)
 {
+	g_sequence_free(assembly->expiry_queue);
+	g_hash_table_destroy(assembly->mr_table);
+	g_hash_table_destroy(assembly->suffix_table);
 	g_hash_table_destroy(assembly->assembly_table);
+	sms_journal_close(assembly->journal);
 	g_free(assembly);
 }
 
@@ -2960,30 +3066,48 @@ static gboolean sr_st_to_delivered(enum sms_st st, gboolean *delivered)
 	return FALSE;
 }
 
-static struct id_table_node *find_by_mr_and_mark(GHashTable *id_table,
-						unsigned char mr,
-						GHashTableIter *out_iter,
-						unsigned char **out_id)
+static struct sr_assembly_node *find_by_mr_and_mark(
+					struct status_report_assembly *assembly,
+					const char *addr, unsigned char mr)
 {
-	unsigned int offset = mr / 32;
-	unsigned int bit = 1 << (mr % 32);
-	gpointer key, value;
-	struct id_table_node *node;
+	struct sr_mr_key lookup = { addr, mr };
+	GQueue *nodes = g_hash_table_lookup(assembly->mr_table, &lookup);
+	struct sr_assembly_node *node;
 
-	g_hash_table_iter_init(out_iter, id_table);
-	while (g_hash_table_iter_next(out_iter, &key, &value)) {
-		node = value;
+	if (nodes == NULL)
+		return NULL;
 
-		/* Address and MR matched */
-		if (node->mrs[offset] & bit) {
-			node->mrs[offset] ^= bit;
-			*out_id = key;
+	/* Address and MR matched, the oldest message gets the report */
+	node = g_queue_pop_head(nodes);
+	node->data.mrs[mr / 32] &= ~(1U << (mr % 32));
 
-			return node;
-		}
-	}
+	if (g_queue_is_empty(nodes))
+		g_hash_table_remove(assembly->mr_table, &lookup);
 
-	return NULL;
+	return node;
+}
+
+static gboolean sr_addr_fuzzy_equal(const char *r_addr, const char *s_addr)
+{
+	unsigned int len, r_len, s_len;
+	unsigned int i;
+
+	if (r_addr[0] == '+' && s_addr[0] == '+')
+		return FALSE;
+
+	if (r_addr[0] != '+' && s_addr[0] != '+')
+		return FALSE;
+
+	r_len = strlen(r_addr);
+	s_len = strlen(s_addr);
+
+	len = MIN(SR_ADDR_SUFFIX_LEN, MIN(r_len, s_len));
+
+	for (i = 0; i < len; i++)
+		if (s_addr[s_len - i - 1] != r_addr[r_len - i - 1])
+			return FALSE;
+
+	return TRUE;
 }
 
 /*
@@ -2993,52 +3117,53 @@ static struct id_table_node *find_by_mr_and_mark(GHashTable *id_table,
  * Notify these special cases by comparing only last six digits of the assembly
  * addresses and received address. If address contains less than six digits,
  * compare only existing digits.
+ *
+ * Addresses are indexed by their last six digits, or all of them if there
+ * are fewer. A received address with at least six digits can only match
+ * those indexed under one of its last 1 to 6 digits.
  */
-static struct id_table_node *fuzzy_lookup(struct status_report_assembly *assy,
-						const struct sms *sr,
-						const char **out_addr,
-						GHashTableIter *out_iter,
-						unsigned char **out_msgid)
-{
-	GHashTableIter iter_addr;
-	gpointer key, value;
-	const char *r_addr;
-
-	r_addr = sms_address_to_string(&sr->status_report.raddr);
-	g_hash_table_iter_init(&iter_addr, assy->assembly_table);
-
-	while (g_hash_table_iter_next(&iter_addr, &key, &value)) {
-		const char *s_addr = key;
-		GHashTable *id_table = value;
-		unsigned int len, r_len, s_len;
-		unsigned int i;
-		struct id_table_node *node;
+static struct sr_assembly_node *fuzzy_lookup(
+					struct status_report_assembly *assy,
+					const char *r_addr, unsigned char mr)
+{
+	unsigned int r_len = strlen(r_addr);
+	struct sr_assembly_node *node;
+	unsigned int i;
+	GQueue *addrs;
+	GList *l;
 
-		if (r_addr[0] == '+' && s_addr[0] == '+')
-			continue;
+	if (r_len < SR_ADDR_SUFFIX_LEN) {
+		GHashTableIter iter;
+		gpointer key;
 
-		if (r_addr[0] != '+' && s_addr[0] != '+')
-			continue;
+		g_hash_table_iter_init(&iter, assy->assembly_table);
 
-		r_len = strlen(r_addr);
-		s_len = strlen(s_addr);
+		while (g_hash_table_iter_next(&iter, &key, NULL)) {
+			if (!sr_addr_fuzzy_equal(r_addr, key))
+				continue;
 
-		len = MIN(6, MIN(r_len, s_len));
+			node = find_by_mr_and_mark(assy, key, mr);
+			if (node != NULL)
+				return node;
+		}
 
-		for (i = 0; i < len; i++)
-			if (s_addr[s_len - i - 1] != r_addr[r_len - i - 1])
-				break;
+		return NULL;
+	}
 
-		/* Not all digits matched. */
-		if (i < len)
+	for (i = SR_ADDR_SUFFIX_LEN; i > 0; i--) {
+		addrs = g_hash_table_lookup(assy->suffix_table,
+						r_addr + r_len - i);
+		if (addrs == NULL)
 			continue;
 
-		/* Address matched. Check message reference. */
-		node = find_by_mr_and_mark(id_table, sr->status_report.mr,
-						out_iter, out_msgid);
-		if (node != NULL) {
-			*out_addr = s_addr;
-			return node;
+		for (l = addrs->head; l; l = l->next) {
+			if (!sr_addr_fuzzy_equal(r_addr, l->data))
+				continue;
+
+			/* Address matched. Check message reference. */
+			node = find_by_mr_and_mark(assy, l->data, mr);
+			if (node != NULL)
+				return node;
 		}
 	}
 
@@ -3051,13 +3176,11 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 					gboolean *out_delivered)
 {
 	const char *straddr;
-	GHashTable *id_table;
-	GHashTableIter iter;
+	gpointer key;
 	struct sms_address addr;
-	struct id_table_node *node;
+	struct sr_assembly_node *node;
 	gboolean delivered;
 	gboolean pending;
-	unsigned char *msgid;
 	int i;
 
 	/* We ignore temporary or tempfinal status reports */
@@ -3065,58 +3188,55 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 		return FALSE;
 
 	straddr = sms_address_to_string(&sr->status_report.raddr);
-	id_table = g_hash_table_lookup(assembly->assembly_table, straddr);
 
-	if (id_table != NULL)
-		node = find_by_mr_and_mark(id_table, sr->status_report.mr,
-						&iter, &msgid);
+	if (g_hash_table_lookup_extended(assembly->assembly_table, straddr,
+						&key, NULL))
+		node = find_by_mr_and_mark(assembly, key,
+						sr->status_report.mr);
 	else
-		node = fuzzy_lookup(assembly, sr, &straddr, &iter, &msgid);
+		node = fuzzy_lookup(assembly, straddr, sr->status_report.mr);
 
 	/* Unable to find a message reference belonging to this address */
 	if (node == NULL)
 		return FALSE;
 
-	node->deliverable = node->deliverable && delivered;
+	node->data.deliverable = node->data.deliverable && delivered;
 
 	/* If we haven't sent the entire message yet, wait until sent */
-	if (node->sent_mrs < node->total_mrs)
+	if (node->data.sent_mrs < node->data.total_mrs)
 		return FALSE;
 
 	/* Figure out if we are expecting more status reports */
 	for (i = 0, pending = FALSE; i < 8; i++) {
 		/* There are still pending mr(s). */
-		if (node->mrs[i] != 0) {
+		if (node->data.mrs[i] != 0) {
 			pending = TRUE;
 			break;
 		}
 	}
 
-	sms_address_from_string(&addr, straddr);
+	sms_address_from_string(&addr, node->addr);
 
-	if (pending == TRUE && node->deliverable == TRUE) {
+	if (pending == TRUE && node->data.deliverable == TRUE) {
 		/*
 		 * More status reports expected, and already received
 		 * reports completed. Update backup file.
 		 */
-		sr_assembly_add_fragment_backup(assembly->imsi, node,
-						&addr, msgid);
+		sr_assembly_add_fragment_backup(assembly->journal, &node->data,
+						&addr, node->msgid);
 
 		return FALSE;
 	}
 
 	if (out_delivered)
-		*out_delivered = node->deliverable;
+		*out_delivered = node->data.deliverable;
 
 	if (out_msgid)
-		memcpy(out_msgid, msgid, SMS_MSGID_LEN);
-
-	sr_assembly_remove_fragment_backup(assembly->imsi, &addr, msgid);
-	id_table = g_hash_table_iter_get_hash_table(&iter);
-	g_hash_table_iter_remove(&iter);
+		memcpy(out_msgid, node->msgid, SMS_MSGID_LEN);
 
-	if (g_hash_table_size(id_table) == 0)
-		g_hash_table_remove(assembly->assembly_table, straddr);
+	sr_assembly_remove_fragment_backup(assembly->journal, &addr,
+						node->msgid);
+	sr_assembly_node_remove(assembly, node);
 
 	return TRUE;
 }
@@ -3130,157 +3250,127 @@ void status_report_assembly_add_fragment(
 {
 	unsigned int offset = mr / 32;
 	unsigned int bit = 1 << (mr % 32);
+	const char *straddr = sms_address_to_string(to);
 	GHashTable *id_table;
-	struct id_table_node *node;
-	unsigned char *id_table_key;
+	struct sr_assembly_node *node;
 
-	id_table = g_hash_table_lookup(assembly->assembly_table,
-					sms_address_to_string(to));
-
-	/* Create hashtable keyed by the to address if required */
-	if (id_table == NULL) {
-		id_table = g_hash_table_new_full(sha1_hash, sha1_equal,
-								g_free, g_free);
-		g_hash_table_insert(assembly->assembly_table,
-					g_strdup(sms_address_to_string(to)),
-					id_table);
-	}
-
-	node = g_hash_table_lookup(id_table, msgid);
+	id_table = g_hash_table_lookup(assembly->assembly_table, straddr);
+	node = id_table ? g_hash_table_lookup(id_table, msgid) : NULL;
 
 	/* Create node in the message id hashtable if required */
 	if (node == NULL) {
-		id_table_key = g_memdup(msgid, SMS_MSGID_LEN);
-
-		node = g_new0(struct id_table_node, 1);
-		node->total_mrs = total_mrs;
-		node->deliverable = TRUE;
+		node = sr_assembly_node_new(assembly, straddr, msgid);
+		node->data.total_mrs = total_mrs;
+		node->data.deliverable = TRUE;
+	}
 
-		g_hash_table_insert(id_table, id_table_key, node);
+	if (!(node->data.mrs[offset] & bit)) {
+		node->data.mrs[offset] |= bit;
+		sr_mr_index_add(assembly, node, mr);
 	}
 
-	/* id_table and node both exists */
-	node->mrs[offset] |= bit;
-	node->expiration = expiration;
-	node->sent_mrs++;
-	sr_assembly_add_fragment_backup(assembly->imsi, node, to, msgid);
+	node->data.expiration = expiration;
+	node->data.sent_mrs++;
+
+	if (node->expiry == NULL)
+		node->expiry = g_sequence_insert_sorted(assembly->expiry_queue,
+					node, sr_assembly_compare_expiration,
+					NULL);
+	else
+		g_sequence_sort_changed(node->expiry,
+					sr_assembly_compare_expiration, NULL);
+
+	sr_assembly_add_fragment_backup(assembly->journal, &node->data, to,
+					msgid);
 }
 
 void status_report_assembly_expire(struct status_report_assembly *assembly,
 					time_t before)
 {
-	GHashTable *id_table;
-	GHashTableIter iter_addr, iter_node;
 	struct sms_address addr;
-	char *straddr;
-	gpointer key;
-	struct id_table_node *node;
+	struct sr_assembly_node *node;
+	GSequenceIter *iter;
 
-	g_hash_table_iter_init(&iter_addr, assembly->assembly_table);
+	/* Messages come soonest expiring first, stop at the first one left */
+	while (1) {
+		iter = g_sequence_get_begin_iter(assembly->expiry_queue);
 
-	/*
-	 * Go through different addresses. Each address can relate to
-	 * 1-n msg_ids.
-	 */
-	while (g_hash_table_iter_next(&iter_addr, (gpointer) &straddr,
-					(gpointer) &id_table)) {
-
-		sms_address_from_string(&addr, straddr);
-		g_hash_table_iter_init(&iter_node, id_table);
+		if (g_sequence_iter_is_end(iter))
+			break;
 
-		/* Go through different messages. */
-		while (g_hash_table_iter_next(&iter_node, &key,
-						(gpointer) &node)) {
-			/*
-			 * If message is expired, removed it from the
-			 * hash-table and remove the backup-file
-			 */
-			if (node->expiration <= before) {
-				g_hash_table_iter_remove(&iter_node);
+		node = g_sequence_get(iter);
 
-				sr_assembly_remove_fragment_backup(
-								assembly->imsi,
-								&addr,
-								key);
-			}
-		}
+		if (node->data.expiration > before)
+			break;
 
-		/*
-		 * If all messages are removed, remove address
-		 * from the hash-table.
-		 */
-		if (g_hash_table_size(id_table) == 0)
-			g_hash_table_iter_remove(&iter_addr);
+		sms_address_from_string(&addr, node->addr);
+		sr_assembly_remove_fragment_backup(assembly->journal, &addr,
+							node->msgid);
+		sr_assembly_node_remove(assembly, node);
 	}
 }
 
-static int sms_tx_load_filter(const struct dirent *dent)
-{
-	char *endp;
-	guint8 seq __attribute__ ((unused));
-
-	if (dent->d_type != DT_REG)
-		return 0;
-
-	seq = strtol(dent->d_name, &endp, 10);
-	if (*endp != '\0')
-		return 0;
-
-	return 1;
-}
+struct sms_tx_load_group {
+	unsigned long oldid;
+	unsigned long flags;
+	char uuid[SMS_MSGID_LEN * 2 + 1];
+	GSList *msg_list;
+};
 
 /*
- * Each directory contains a file per pdu.
+ * Each message has a key per pdu, the keys come in queue order.
  */
-static GSList *sms_tx_load(const char *imsi, const struct dirent *dir)
+static void sms_tx_load(const char *key, const void *data, unsigned int len,
+				time_t ts, void *user_data)
 {
-	GSList *list = NULL;
-	struct dirent **pdus;
-	char *path;
-	int len, r;
-	unsigned char buf[177];
+	GSList **groups = user_data;
+	struct sms_tx_load_group *group = *groups ? (*groups)->data : NULL;
+	char uuid[SMS_MSGID_LEN * 2 + 1];
+	unsigned long id;
+	unsigned long flags;
+	guint8 seq;
+	char endc;
 	struct sms s;
 
-	if (dir->d_type != DT_DIR)
-		return NULL;
-
-	path = g_strdup_printf(SMS_TX_BACKUP_PATH "/%s", imsi, dir->d_name);
-	len = scandir(path, &pdus, sms_tx_load_filter, versionsort);
-	g_free(path);
-
-	if (len < 0)
-		return NULL;
-
-	while (len--) {
-		r = read_file(buf, sizeof(buf), SMS_TX_BACKUP_PATH "/%s/%s",
-					imsi, dir->d_name, pdus[len]->d_name);
+	if (sscanf(key, SMS_TX_BACKUP_KEY_PREFIX "%lu-%lu-" SMS_MSGID_FMT
+				"/%hhu%c", &id, &flags, uuid, &seq, &endc) != 4)
+		return;
 
-		if (r < 0)
-			goto free_pdu;
+	if (strlen(uuid) != 2 * SMS_MSGID_LEN)
+		return;
 
-		if (sms_deserialize_outgoing(buf, &s, r) == FALSE)
-			goto free_pdu;
+	if (sms_deserialize_outgoing(data, &s, len) == FALSE)
+		return;
 
-		list = g_slist_prepend(list, g_memdup(&s, sizeof(s)));
+	if (group == NULL || group->oldid != id || group->flags != flags ||
+			strcmp(group->uuid, uuid)) {
+		group = g_new0(struct sms_tx_load_group, 1);
+		group->oldid = id;
+		group->flags = flags;
+		strcpy(group->uuid, uuid);
 
-free_pdu:
-		g_free(pdus[len]);
+		*groups = g_slist_prepend(*groups, group);
 	}
 
-	g_free(pdus);
-
-	return list;
+	group->msg_list = g_slist_prepend(group->msg_list,
+						g_memdup(&s, sizeof(s)));
 }
 
-static int sms_tx_queue_filter(const struct dirent *dirent)
+struct sms_tx_rekey_data {
+	struct sms_journal *journal;
+	const char *prefix;
+};
+
+static void sms_tx_rekey(const char *key, const void *data, unsigned int len,
+				time_t ts, void *user_data)
 {
-	if (dirent->d_type != DT_DIR)
-		return 0;
+	struct sms_tx_rekey_data *rekey = user_data;
+	char *newkey = g_strconcat(rekey->prefix, strrchr(key, '/') + 1, NULL);
 
-	if (!strcmp(dirent->d_name, ".") || !strcmp(dirent->d_name, ".."))
-		return 0;
+	if (sms_journal_put(rekey->journal, newkey, data, len, ts))
+		sms_journal_remove(rekey->journal, key);
 
-	return 1;
+	g_free(newkey);
 }
 
 /*
@@ -3289,76 +3379,59 @@ static int sms_tx_queue_filter(const struct dirent *dirent)
  */
 GQueue *sms_tx_queue_load(const char *imsi)
 {
-	GQueue *retq = 0;
-	char *path;
-	struct dirent **entries;
-	int len;
-	int i;
+	struct sms_journal *journal;
+	GQueue *retq;
+	GSList *groups = NULL;
+	GSList *l;
 	unsigned long id;
 
 	if (imsi == NULL)
 		return NULL;
 
-	path = g_strdup_printf(SMS_TX_BACKUP_PATH, imsi);
-
-	len = scandir(path, &entries, sms_tx_queue_filter, versionsort);
-	if (len < 0)
-		goto nodir_exit;
+	journal = sms_journal_open(imsi);
+	sms_journal_foreach(journal, SMS_TX_BACKUP_KEY_PREFIX,
+						sms_tx_load, &groups);
+	groups = g_slist_reverse(groups);
 
 	retq = g_queue_new();
 
-	for (i = 0, id = 0; i < len; i++) {
-		char uuid[SMS_MSGID_LEN * 2 + 1];
-		GSList *msg_list;
-		unsigned long oldid;
-		unsigned long flags;
-		char *oldpath, *newpath;
+	for (l = groups, id = 0; l; l = l->next, id++) {
+		struct sms_tx_load_group *group = l->data;
 		struct txq_backup_entry *entry;
-		struct dirent *dir = entries[i];
-		char endc;
-
-		if (sscanf(dir->d_name, "%lu-%lu-" SMS_MSGID_FMT "%c",
-					&oldid, &flags, uuid, &endc) != 3)
-			continue;
-
-		if (strlen(uuid) !=  2 * SMS_MSGID_LEN)
-			continue;
-
-		msg_list = sms_tx_load(imsi, dir);
-		if (msg_list == NULL)
-			continue;
+		struct sms_tx_rekey_data rekey;
+		char *oldprefix, *newprefix;
 
 		entry = g_new0(struct txq_backup_entry, 1);
-		entry->msg_list = msg_list;
-		entry->flags = flags;
-		decode_hex_own_buf(uuid, -1, NULL, 0, entry->uuid);
+		entry->msg_list = g_slist_reverse(group->msg_list);
+		entry->flags = group->flags;
+		decode_hex_own_buf(group->uuid, -1, NULL, 0, entry->uuid);
 
 		g_queue_push_tail(retq, entry);
 
 		/* Don't bother re-shuffling the ids if they are the same */
-		if (oldid == id) {
-			id++;
+		if (group->oldid == id) {
+			g_free(group);
 			continue;
 		}
 
-		oldpath = g_strdup_printf("%s/%s", path, dir->d_name);
-		newpath = g_strdup_printf(SMS_TX_BACKUP_PATH_DIR,
-						imsi, id++, flags, uuid);
+		oldprefix = g_strdup_printf(SMS_TX_BACKUP_KEY_DIR,
+					group->oldid, group->flags, group->uuid);
+		newprefix = g_strdup_printf(SMS_TX_BACKUP_KEY_DIR,
+					id, group->flags, group->uuid);
 
-		/* rename directory to reflect new position in queue */
-		rename(oldpath, newpath);
+		/* re-key the pdus to reflect new position in queue */
+		rekey.journal = journal;
+		rekey.prefix = newprefix;
+		sms_journal_foreach(journal, oldprefix, sms_tx_rekey, &rekey);
 
-		g_free(newpath);
-		g_free(oldpath);
+		g_free(newprefix);
+		g_free(oldprefix);
+		g_free(group);
 	}
 
-	for (i = 0; i < len; i++)
-		g_free(entries[i]);
-
-	g_free(entries);
+	g_slist_free(groups);
+	sms_journal_close(journal);
 
-nodir_exit:
-	g_free(path);
 	return retq;
 }
 
@@ -3367,8 +3440,11 @@ gboolean sms_tx_backup_store(const char *imsi, unsigned long id,
 				guint8 seq, const unsigned char *pdu,
 				int pdu_len, int tpdu_len)
 {
+	struct sms_journal *journal;
 	unsigned char buf[177];
 	int len;
+	char *key;
+	gboolean ret;
 
 	if (!imsi)
 		return FALSE;
@@ -3378,62 +3454,46 @@ gboolean sms_tx_backup_store(const char *imsi, unsigned long id,
 	len = pdu_len + 1;
 
 	/*
-	 * file name is: imsi/tx_queue/order-flags-uuid/pdu
+	 * key is: tx_queue/order-flags-uuid/pdu
 	 */
-	if (write_file(buf, len, SMS_BACKUP_MODE, SMS_TX_BACKUP_PATH_FILE,
-					imsi, id, flags, uuid, seq) != len)
-		return FALSE;
+	key = g_strdup_printf(SMS_TX_BACKUP_KEY, id, flags, uuid, seq);
+	journal = sms_journal_open(imsi);
+	ret = sms_journal_put(journal, key, buf, len, time(NULL));
+	sms_journal_close(journal);
+	g_free(key);
 
-	return TRUE;
+	return ret;
 }
 
 void sms_tx_backup_free(const char *imsi, unsigned long id,
 				unsigned long flags, const char *uuid)
 {
-	char *path;
-	struct dirent **entries;
-	int len;
-
-	path = g_strdup_printf(SMS_TX_BACKUP_PATH_DIR,
-					imsi, id, flags, uuid);
+	struct sms_journal *journal = sms_journal_open(imsi);
+	char *prefix;
 
-	len = scandir(path, &entries, NULL, versionsort);
-
-	if (len < 0)
-		goto nodir_exit;
-
-	/* skip '..' and '.' entries */
-	while (len-- > 2) {
-		struct dirent *dir = entries[len];
-		char *file = g_strdup_printf("%s/%s", path, dir->d_name);
-
-		unlink(file);
-		g_free(file);
-
-		g_free(entries[len]);
-	}
-
-	g_free(entries[1]);
-	g_free(entries[0]);
-	g_free(entries);
-
-	rmdir(path);
+	if (journal == NULL)
+		return;
 
-nodir_exit:
-	g_free(path);
+	prefix = g_strdup_printf(SMS_TX_BACKUP_KEY_DIR, id, flags, uuid);
+	sms_journal_remove_prefix(journal, prefix);
+	sms_journal_close(journal);
+	g_free(prefix);
 }
 
 void sms_tx_backup_remove(const char *imsi, unsigned long id,
 				unsigned long flags, const char *uuid,
 				guint8 seq)
 {
-	char *path;
+	struct sms_journal *journal = sms_journal_open(imsi);
+	char *key;
 
-	path = g_strdup_printf(SMS_TX_BACKUP_PATH_FILE,
-					imsi, id, flags, uuid, seq);
-	unlink(path);
+	if (journal == NULL)
+		return;
 
-	g_free(path);
+	key = g_strdup_printf(SMS_TX_BACKUP_KEY, id, flags, uuid, seq);
+	sms_journal_remove(journal, key);
+	sms_journal_close(journal);
+	g_free(key);
 }
 
 static inline GSList *sms_list_append(GSList *l, const struct sms *in)
@@ -3619,6 +3679,83 @@ GSList *sms_datagram_prepare(const char *to,
 					SMS_DATAGRAM_ENDIANESS_GSM);
 }
 
+/*
+ * How many SMSes the GSM encoded text takes with the dialects given.
+ * Without the encoded text this is a lower bound, which only holds if
+ * no escape pair falls on a boundary between SMSes.
+ */
+static long sms_text_segments_gsm(long septets, const unsigned char *gsm,
+					enum gsm_dialect locking,
+					enum gsm_dialect single,
+					gboolean use_16bit)
+{
+	int offset = 0;
+	long capacity;
+	long segments;
+	long i;
+
+	if (single != GSM_DIALECT_DEFAULT)
+		offset += 3;
+
+	if (locking != GSM_DIALECT_DEFAULT)
+		offset += 3;
+
+	if (offset)
+		offset += 1;
+
+	if (septets <= sms_text_capacity_gsm(160, offset))
+		return 1;
+
+	if (!offset)
+		offset = 1;
+
+	offset += use_16bit ? 6 : 5;
+	capacity = sms_text_capacity_gsm(160, offset);
+
+	if (gsm == NULL)
+		return (septets + capacity - 1) / capacity;
+
+	/* Split the way sms_text_prepare_with_alphabet() does */
+	for (i = 0, segments = 0; i < septets; segments++) {
+		long chunk = MIN(capacity, septets - i);
+
+		if (gsm[i + chunk - 1] == 0x1b)
+			chunk -= 1;
+
+		i += chunk;
+	}
+
+	return segments;
+}
+
+/* UTF-16BE, surrogate pairs included, as ucs2_len of the analysis */
+static char *sms_text_encode_ucs2(const char *utf8, long ucs2_len)
+{
+	/* An empty text still makes an empty SMS, hence the extra byte */
+	unsigned char *ucs2 = g_malloc(ucs2_len + 1);
+	unsigned char *out = ucs2;
+	const char *in;
+
+	for (in = utf8; *in; in = g_utf8_next_char(in)) {
+		gunichar c = g_utf8_get_char(in);
+
+		if (c > 0xffff) {
+			c -= 0x10000;
+			out[0] = 0xd8 | ((c >> 18) & 0x03);
+			out[1] = (c >> 10) & 0xff;
+			out[2] = 0xdc | ((c >> 8) & 0x03);
+			out[3] = c & 0xff;
+			out += 4;
+		} else {
+			out[0] = c >> 8;
+			out[1] = c & 0xff;
+			out += 2;
+		}
+	}
+
+	return (char *) ucs2;
+}
+
 /*
  * Prepares the text for transmission.  Breaks up into fragments if
  * necessary using ref as the concatenated message reference number.
@@ -3640,8 +3777,11 @@ GSList *sms_text_prepare_with_alphabet(const char *to, const char *utf8,
 	long left;
 	guint8 seq;
 	GSList *r = NULL;
-	enum gsm_dialect used_locking;
-	enum gsm_dialect used_single;
+	struct utf8_gsm_analysis analysis;
+	enum gsm_dialect used_locking = GSM_DIALECT_DEFAULT;
+	enum gsm_dialect used_single = GSM_DIALECT_DEFAULT;
+	long segments = 0;
+	unsigned int i;
 
 	memset(&template, 0, sizeof(struct sms));
 	template.type = SMS_TYPE_SUBMIT;
@@ -3656,16 +3796,68 @@ GSList *sms_text_prepare_with_alphabet(const char *to, const char *utf8,
 	/*
 	 * UDHI, UDL, UD and DCS actually depend on the contents of
 	 * the text, and also on the GSM dialect we use to encode it.
+	 * Size up all the candidate dialects in one go and only encode
+	 * with the one taking the fewest SMSes, the earlier one on a tie.
 	 */
-	gsm_encoded = convert_utf8_to_gsm_best_lang(utf8, -1, NULL, &written, 0,
-							alphabet, &used_locking,
-							&used_single);
-	if (gsm_encoded == NULL) {
-		gsize converted;
+	if (!analyze_utf8_for_gsm(utf8, -1, (enum gsm_dialect) alphabet,
+								&analysis))
+		return NULL;
 
-		ucs2_encoded = g_convert(utf8, -1, "UTF-16BE//TRANSLIT", "UTF-8",
-						NULL, &converted, NULL);
-		written = converted;
+	for (i = 0; i < analysis.n_candidates; i++) {
+		long septets = analysis.candidates[i].septets;
+		enum gsm_dialect locking = analysis.candidates[i].locking;
+		enum gsm_dialect single = analysis.candidates[i].single;
+		unsigned char *encoded;
+		long n;
+
+		if (septets < 0)
+			continue;
+
+		n = sms_text_segments_gsm(septets, NULL, locking, single,
+								use_16bit);
+
+		if (segments && n >= segments)
+			continue;
+
+		/*
+		 * An escape pair on a boundary pushes the rest of the text
+		 * out by one septet, which may take another SMS. Only the
+		 * encoded text tells, and it's kept for the winner.
+		 */
+		if (n > 1 && analysis.candidates[i].escapes) {
+			encoded = convert_utf8_to_gsm_with_lang(utf8, -1,
+						NULL, NULL, 0, locking, single);
+			if (encoded == NULL)
+				continue;
+
+			n = sms_text_segments_gsm(septets, encoded, locking,
+							single, use_16bit);
+
+			if (segments && n >= segments) {
+				g_free(encoded);
+				continue;
+			}
+		} else {
+			encoded = NULL;
+		}
+
+		g_free(gsm_encoded);
+		gsm_encoded = encoded;
+		written = septets;
+		segments = n;
+		used_locking = locking;
+		used_single = single;
+	}
+
+	if (segments && gsm_encoded == NULL)
+		gsm_encoded = convert_utf8_to_gsm_with_lang(utf8, -1, NULL,
+							&written, 0,
+							used_locking,
+							used_single);
+
+	if (gsm_encoded == NULL) {
+		ucs2_encoded = sms_text_encode_ucs2(utf8, analysis.ucs2_len);
+		written = analysis.ucs2_len;
 	}
 
 	if (gsm_encoded == NULL && ucs2_encoded == NULL)
@@ -4303,102 +4495,84 @@ static inline gboolean cbs_is_update_newer(unsigned int n, unsigned int o)
 	return FALSE;
 }
 
-struct cbs_assembly *cbs_assembly_new(void)
+static void cbs_assembly_node_free(gpointer data)
 {
-	return g_new0(struct cbs_assembly, 1);
+	struct cbs_assembly_node *node = data;
+
+	g_slist_free_full(node->pages, g_free);
+	g_free(node);
 }
 
-void cbs_assembly_free(struct cbs_assembly *assembly)
+struct cbs_assembly *cbs_assembly_new(void)
 {
-	GSList *l;
-
-	for (l = assembly->assembly_list; l; l = l->next) {
-		struct cbs_assembly_node *node = l->data;
+	struct cbs_assembly *ret = g_new0(struct cbs_assembly, 1);
 
-		g_slist_free_full(node->pages, g_free);
-		g_free(node);
-	}
+	ret->assembly_table = g_hash_table_new_full(g_direct_hash,
+						g_direct_equal, NULL,
+						cbs_assembly_node_free);
+	ret->recv_plmn = g_hash_table_new(g_direct_hash, g_direct_equal);
+	ret->recv_loc = g_hash_table_new(g_direct_hash, g_direct_equal);
+	ret->recv_cell = g_hash_table_new(g_direct_hash, g_direct_equal);
 
-	g_slist_free(assembly->assembly_list);
-	g_slist_free(assembly->recv_plmn);
-	g_slist_free(assembly->recv_loc);
-	g_slist_free(assembly->recv_cell);
-
-	g_free(assembly);
+	return ret;
 }
 
-static gint cbs_compare_node_by_gs(gconstpointer a, gconstpointer b)
+void cbs_assembly_free(struct cbs_assembly *assembly)
 {
-	const struct cbs_assembly_node *node = a;
-	unsigned int gs = GPOINTER_TO_UINT(b);
-
-	if (((node->serial >> 14) & 0x3) == gs)
-		return 0;
+	g_hash_table_destroy(assembly->assembly_table);
+	g_hash_table_destroy(assembly->recv_plmn);
+	g_hash_table_destroy(assembly->recv_loc);
+	g_hash_table_destroy(assembly->recv_cell);
 
-	return 1;
+	g_free(assembly);
 }
 
-static gint cbs_compare_node_by_update(gconstpointer a, gconstpointer b)
+/*
+ * The serial is the message identifier, geographical scope, message code
+ * and update number. The received tables are keyed by all but the update.
+ */
+#define CBS_SERIAL_MESSAGE(serial) ((serial) & ~0xf)
+
+static void cbs_assembly_expire_gs(struct cbs_assembly *assembly,
+					enum cbs_geo_scope gs)
 {
-	const struct cbs_assembly_node *node = a;
-	unsigned int serial = GPOINTER_TO_UINT(b);
+	GHashTableIter iter;
+	gpointer value;
 
-	if ((serial & (~0xf)) != (node->serial & (~0xf)))
-		return 1;
+	g_hash_table_iter_init(&iter, assembly->assembly_table);
 
-	if (cbs_is_update_newer(node->serial, serial))
-		return 1;
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct cbs_assembly_node *node = value;
 
-	return 0;
+		if (((node->serial >> 14) & 0x3) == gs)
+			g_hash_table_iter_remove(&iter);
+	}
 }
 
-static gint cbs_compare_recv_by_serial(gconstpointer a, gconstpointer b)
+/*
+ * Take care of the case where several updates are being reassembled at
+ * the same time. If the newer one is assembled first, then the subsequent
+ * old update is discarded, make sure that we're also discarding the
+ * assembly node for the partially assembled ones
+ */
+static void cbs_assembly_expire_updates(struct cbs_assembly *assembly,
+					unsigned int serial)
 {
-	unsigned int old_serial = GPOINTER_TO_UINT(a);
-	unsigned int new_serial = GPOINTER_TO_UINT(b);
-
-	if ((old_serial & (~0xf)) == (new_serial & (~0xf)))
-		return 0;
+	unsigned int update;
 
-	return 1;
-}
+	for (update = 0; update < 16; update++) {
+		gpointer key = GUINT_TO_POINTER(CBS_SERIAL_MESSAGE(serial) |
+							update);
+		struct cbs_assembly_node *node;
 
-static void cbs_assembly_expire(struct cbs_assembly *assembly,
-				GCompareFunc func, gconstpointer *userdata)
-{
-	GSList *l;
-	GSList *prev;
-	GSList *tmp;
-
-	/*
-	 * Take care of the case where several updates are being
-	 * reassembled at the same time. If the newer one is assembled
-	 * first, then the subsequent old update is discarded, make
-	 * sure that we're also discarding the assembly node for the
-	 * partially assembled ones
-	 */
-	prev = NULL;
-	l = assembly->assembly_list;
-
-	while (l) {
-		struct cbs_assembly_node *node = l->data;
-
-		if (func(node, userdata) != 0) {
-			prev = l;
-			l = l->next;
+		node = g_hash_table_lookup(assembly->assembly_table, key);
+		if (node == NULL)
 			continue;
-		}
 
-		if (prev)
-			prev->next = l->next;
-		else
-			assembly->assembly_list = l->next;
+		if (cbs_is_update_newer(node->serial, serial))
+			continue;
 
-		g_slist_free_full(node->pages, g_free);
-		g_free(node->pages);
-		tmp = l;
-		l = l->next;
-		g_slist_free_1(tmp);
+		g_hash_table_remove(assembly->assembly_table, key);
 	}
 }
 
@@ -4422,30 +4596,23 @@ void cbs_assembly_location_changed(struct cbs_assembly *assembly, gboolean plmn,
 
 	if (plmn) {
 		lac = TRUE;
-		g_slist_free(assembly->recv_plmn);
-		assembly->recv_plmn = NULL;
+		g_hash_table_remove_all(assembly->recv_plmn);
 
-		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
-				GUINT_TO_POINTER(CBS_GEO_SCOPE_PLMN));
+		cbs_assembly_expire_gs(assembly, CBS_GEO_SCOPE_PLMN);
 	}
 
 	if (lac) {
 		/* If LAC changed, then cell id has changed */
 		ci = TRUE;
-		g_slist_free(assembly->recv_loc);
-		assembly->recv_loc = NULL;
+		g_hash_table_remove_all(assembly->recv_loc);
 
-		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
-				GUINT_TO_POINTER(CBS_GEO_SCOPE_SERVICE_AREA));
+		cbs_assembly_expire_gs(assembly, CBS_GEO_SCOPE_SERVICE_AREA);
 	}
 
 	if (ci) {
-		g_slist_free(assembly->recv_cell);
-		assembly->recv_cell = NULL;
-		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
-				GUINT_TO_POINTER(CBS_GEO_SCOPE_CELL_IMMEDIATE));
-		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
-				GUINT_TO_POINTER(CBS_GEO_SCOPE_CELL_NORMAL));
+		g_hash_table_remove_all(assembly->recv_cell);
+		cbs_assembly_expire_gs(assembly, CBS_GEO_SCOPE_CELL_IMMEDIATE);
+		cbs_assembly_expire_gs(assembly, CBS_GEO_SCOPE_CELL_NORMAL);
 	}
 }
 
@@ -4456,9 +4623,9 @@ GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
 	struct cbs_assembly_node *node;
 	GSList *completed;
 	unsigned int new_serial;
-	GSList **recv;
-	GSList *l;
-	GSList *prev;
+	GHashTable *recv;
+	gpointer message;
+	gpointer old_serial;
 	int position;
 
 	new_serial = cbs->gs << 14;
@@ -4467,27 +4634,24 @@ GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
 	new_serial |= cbs->message_identifier << 16;
 
 	if (cbs->gs == CBS_GEO_SCOPE_PLMN)
-		recv = &assembly->recv_plmn;
+		recv = assembly->recv_plmn;
 	else if (cbs->gs == CBS_GEO_SCOPE_SERVICE_AREA)
-		recv = &assembly->recv_loc;
+		recv = assembly->recv_loc;
 	else
-		recv = &assembly->recv_cell;
+		recv = assembly->recv_cell;
 
-	/* Have we seen this message before? */
-	l = g_slist_find_custom(*recv, GUINT_TO_POINTER(new_serial),
-				cbs_compare_recv_by_serial);
+	message = GUINT_TO_POINTER(CBS_SERIAL_MESSAGE(new_serial));
 
-	/* If we have, is the message newer? */
-	if (l && !cbs_is_update_newer(new_serial, GPOINTER_TO_UINT(l->data)))
+	/* Have we seen this message before? If we have, is it newer? */
+	if (g_hash_table_lookup_extended(recv, message, NULL, &old_serial) &&
+			!cbs_is_update_newer(new_serial,
+						GPOINTER_TO_UINT(old_serial)))
 		return NULL;
 
 	/* Easy case first, page 1 of 1 */
 	if (cbs->max_pages == 1 && cbs->page == 1) {
-		if (l)
-			l->data = GUINT_TO_POINTER(new_serial);
-		else
-			*recv = g_slist_prepend(*recv,
-						GUINT_TO_POINTER(new_serial));
+		g_hash_table_insert(recv, message,
+					GUINT_TO_POINTER(new_serial));
 
 		newcbs = g_new(struct cbs, 1);
 		memcpy(newcbs, cbs, sizeof(struct cbs));
@@ -4496,37 +4660,21 @@ GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
 		return completed;
 	}
 
-	prev = NULL;
-	position = 0;
-
-	for (l = assembly->assembly_list; l; prev = l, l = l->next) {
-		int j;
-		node = l->data;
-
-		if (new_serial != node->serial)
-			continue;
-
-		if (node->bitmap & (1 << cbs->page))
-			return NULL;
-
-		for (j = 1; j < cbs->page; j++)
-			if (node->bitmap & (1 << j))
-				position += 1;
+	node = g_hash_table_lookup(assembly->assembly_table,
+					GUINT_TO_POINTER(new_serial));
 
-		goto out;
-	}
-
-	node = g_new0(struct cbs_assembly_node, 1);
-	node->serial = new_serial;
+	if (node == NULL) {
+		node = g_new0(struct cbs_assembly_node, 1);
+		node->serial = new_serial;
 
-	assembly->assembly_list = g_slist_prepend(assembly->assembly_list,
-							node);
+		g_hash_table_insert(assembly->assembly_table,
+					GUINT_TO_POINTER(new_serial), node);
+	} else if (node->bitmap & (1 << cbs->page))
+		return NULL;
 
-	prev = NULL;
-	l = assembly->assembly_list;
-	position = 0;
+	/* Pages are kept in order, count the ones before this one */
+	position = __builtin_popcount(node->bitmap & ((1 << cbs->page) - 1));
 
-out:
 	newcbs = g_new(struct cbs, 1);
 	memcpy(newcbs, cbs, sizeof(struct cbs));
 	node->pages = g_slist_insert(node->pages, newcbs, position);
@@ -4536,18 +4684,12 @@ out:
 		return NULL;
 
 	completed = node->pages;
-
-	if (prev)
-		prev->next = l->next;
-	else
-		assembly->assembly_list = l->next;
-
-	g_free(node);
-	g_slist_free_1(l);
-
-	cbs_assembly_expire(assembly, cbs_compare_node_by_update,
+	node->pages = NULL;
+	g_hash_table_remove(assembly->assembly_table,
 				GUINT_TO_POINTER(new_serial));
-	*recv = g_slist_prepend(*recv, GUINT_TO_POINTER(new_serial));
+
+	cbs_assembly_expire_updates(assembly, new_serial);
+	g_hash_table_insert(recv, message, GUINT_TO_POINTER(new_serial));
 
 	return completed;
 }
@@ -4791,6 +4933,57 @@ gboolean cbs_topic_in_range(unsigned int topic, GSList *ranges)
 					cbs_topic_compare) != NULL;
 }
 
+#define CBS_TOPIC_BITMAP_WORDS (65536 / 32)
+
+/*
+ * One bit per message identifier, so that checking a page is a single
+ * load. Returns NULL if there are no ranges, which matches no topic.
+ */
+guint32 *cbs_topic_ranges_to_bitmap(GSList *ranges)
+{
+	guint32 *bitmap;
+	GSList *l;
+
+	if (ranges == NULL)
+		return NULL;
+
+	bitmap = g_new0(guint32, CBS_TOPIC_BITMAP_WORDS);
+
+	for (l = ranges; l; l = l->next) {
+		const struct cbs_topic_range *range = l->data;
+		unsigned int first = range->min / 32;
+		unsigned int last = range->max / 32;
+		guint32 first_mask = ~0U << (range->min % 32);
+		guint32 last_mask = ~0U >> (31 - range->max % 32);
+		unsigned int i;
+
+		if (range->min > range->max)
+			continue;
+
+		if (first == last) {
+			bitmap[first] |= first_mask & last_mask;
+			continue;
+		}
+
+		bitmap[first] |= first_mask;
+
+		for (i = first + 1; i < last; i++)
+			bitmap[i] = ~0U;
+
+		bitmap[last] |= last_mask;
+	}
+
+	return bitmap;
+}
+
+gboolean cbs_topic_in_bitmap(unsigned int topic, const guint32 *bitmap)
+{
+	if (bitmap == NULL || topic > 65535)
+		return FALSE;
+
+	return (bitmap[topic / 32] >> (topic % 32)) & 1;
+}
+
 char *ussd_decode(int dcs, int len, const unsigned char *data)
 {
 	gboolean udhi;
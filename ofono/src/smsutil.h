@@ -389,11 +389,14 @@ struct sms_assembly_node {
 	guint8 max_fragments;
 	guint8 num_fragments;
 	unsigned int bitmap[8];
+	GSequenceIter *expiry;
 };
 
 struct sms_assembly {
 	const char *imsi;
-	GSList *assembly_list;
+	struct sms_journal *journal;
+	GHashTable *assembly_table;	/* Nodes by address and reference */
+	GSequence *expiry_queue;	/* Nodes by time stamp, oldest first */
 };
 
 struct id_table_node {
@@ -406,7 +409,11 @@ struct id_table_node {
 
 struct status_report_assembly {
 	const char *imsi;
-	GHashTable *assembly_table;
+	struct sms_journal *journal;
+	GHashTable *assembly_table;	/* Address -> message id -> node */
+	GHashTable *mr_table;		/* Address and MR -> nodes */
+	GHashTable *suffix_table;	/* Last digits -> addresses */
+	GSequence *expiry_queue;	/* Nodes, soonest expiring first */
 };
 
 struct cbs {
@@ -428,10 +435,10 @@ struct cbs_assembly_node {
 };
 
 struct cbs_assembly {
-	GSList *assembly_list;
-	GSList *recv_plmn;
-	GSList *recv_loc;
-	GSList *recv_cell;
+	GHashTable *assembly_table;	/* Nodes by serial */
+	GHashTable *recv_plmn;		/* Serials received, by message */
+	GHashTable *recv_loc;
+	GHashTable *recv_cell;
 };
 
 struct cbs_topic_range {
@@ -538,6 +545,8 @@ GSList *sms_assembly_add_fragment(struct sms_assembly *assembly,
 					const struct sms_address *addr,
 					guint16 ref, guint8 max, guint8 seq);
 void sms_assembly_expire(struct sms_assembly *assembly, time_t before);
+void sms_assembly_begin(struct sms_assembly *assembly);
+gboolean sms_assembly_commit(struct sms_assembly *assembly);
 gboolean sms_address_to_hex_string(const struct sms_address *in, char *straddr);
 
 struct status_report_assembly *status_report_assembly_new(const char *imsi);
@@ -612,6 +621,8 @@ char *cbs_topic_ranges_to_string(GSList *ranges);
 GSList *cbs_extract_topic_ranges(const char *ranges);
 GSList *cbs_optimize_ranges(GSList *ranges);
 gboolean cbs_topic_in_range(unsigned int topic, GSList *ranges);
+guint32 *cbs_topic_ranges_to_bitmap(GSList *ranges);
+gboolean cbs_topic_in_bitmap(unsigned int topic, const guint32 *bitmap);
 
 char *ussd_decode(int dcs, int len, const unsigned char *data);
 gboolean ussd_encode(const char *str, long *items_written, unsigned char *pdu);
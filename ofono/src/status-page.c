@@ -0,0 +1,243 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <glib.h>
+
+#include "ofono.h"
+#include "common.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC		0x0001U
+#endif
+
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING	0x0002U
+#endif
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS		1033
+#define F_SEAL_SEAL		0x0001
+#define F_SEAL_SHRINK		0x0002
+#define F_SEAL_GROW		0x0004
+#endif
+
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE	0x0010
+#endif
+
+struct status_page {
+	int fd;				/* Handed to clients */
+	struct ofono_status_page *map;	/* Our writable mapping */
+};
+
+static gboolean status_page_enabled;
+
+void __ofono_status_page_set_enabled(gboolean enabled)
+{
+	status_page_enabled = enabled;
+}
+
+static int status_page_memfd(const char *name)
+{
+#ifdef __NR_memfd_create
+	return syscall(__NR_memfd_create, name,
+					MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+struct status_page *__ofono_status_page_new(const char *name)
+{
+	const size_t size = sizeof(struct ofono_status_page);
+	struct status_page *page;
+	struct ofono_status_page *map;
+	int fd;
+
+	if (!status_page_enabled)
+		return NULL;
+
+	fd = status_page_memfd(name);
+	if (fd < 0) {
+		ofono_warn("Failed to create status page: %s",
+							strerror(errno));
+		return NULL;
+	}
+
+	if (ftruncate(fd, size) < 0) {
+		ofono_warn("Failed to size status page: %s", strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		ofono_warn("Failed to map status page: %s", strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	/*
+	 * Clients get this very descriptor and can reopen it read-write
+	 * through /proc. The seals keep anyone from writing to it, mapping
+	 * it writable or resizing it from now on. Our own mapping predates
+	 * them and stays writable.
+	 */
+	if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+				F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) < 0) {
+		char *path;
+		int rdonly;
+
+		/*
+		 * F_SEAL_FUTURE_WRITE came with Linux 5.1. Without it
+		 * clients get a read-only descriptor, which they can't
+		 * map writable, but can still reopen through /proc.
+		 */
+		if (errno != EINVAL || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK |
+					F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+			ofono_warn("Failed to seal status page: %s",
+							strerror(errno));
+			munmap(map, size);
+			close(fd);
+			return NULL;
+		}
+
+		path = g_strdup_printf("/proc/self/fd/%d", fd);
+		rdonly = open(path, O_RDONLY | O_CLOEXEC);
+		g_free(path);
+
+		if (rdonly < 0) {
+			ofono_warn("Failed to reopen status page: %s",
+							strerror(errno));
+			munmap(map, size);
+			close(fd);
+			return NULL;
+		}
+
+		/* Our mapping outlives the descriptor it came from */
+		close(fd);
+		fd = rdonly;
+	}
+
+	map->magic = OFONO_STATUS_PAGE_MAGIC;
+	map->version = OFONO_STATUS_PAGE_VERSION;
+	map->size = size;
+	map->strength = -1;
+	map->registration = NETWORK_REGISTRATION_STATUS_UNKNOWN;
+	map->technology = -1;
+
+	page = g_new0(struct status_page, 1);
+	page->fd = fd;
+	page->map = map;
+
+	DBG("%s", name);
+	return page;
+}
+
+void __ofono_status_page_free(struct status_page *page)
+{
+	if (page == NULL)
+		return;
+
+	munmap(page->map, sizeof(struct ofono_status_page));
+	close(page->fd);
+	g_free(page);
+}
+
+int __ofono_status_page_get_fd(struct status_page *page)
+{
+	return page ? page->fd : -1;
+}
+
+/* Seqlock writer side, see ofono_status_page_read() for the reader */
+static inline void status_page_write_begin(struct ofono_status_page *map)
+{
+	map->seq++;
+	__sync_synchronize();
+}
+
+static inline void status_page_write_end(struct ofono_status_page *map)
+{
+	__sync_synchronize();
+	map->seq++;
+}
+
+void __ofono_status_page_update_netreg(struct status_page *page,
+				int registration, int technology, int strength)
+{
+	struct ofono_status_page *map;
+
+	if (page == NULL)
+		return;
+
+	map = page->map;
+
+	if (map->registration == registration &&
+			map->technology == technology &&
+			map->strength == strength)
+		return;
+
+	status_page_write_begin(map);
+	map->registration = registration;
+	map->technology = technology;
+	map->strength = strength;
+	status_page_write_end(map);
+}
+
+void __ofono_status_page_update_gprs(struct status_page *page,
+				gboolean attached, unsigned int active_contexts,
+				unsigned int active_types)
+{
+	struct ofono_status_page *map;
+
+	if (page == NULL)
+		return;
+
+	map = page->map;
+
+	attached = attached ? 1 : 0;
+
+	if (map->attached == (uint32_t) attached &&
+			map->active_contexts == active_contexts &&
+			map->active_types == active_types)
+		return;
+
+	status_page_write_begin(map);
+	map->attached = attached;
+	map->active_contexts = active_contexts;
+	map->active_types = active_types;
+	status_page_write_end(map);
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -38,7 +38,33 @@
 #include "storage.h"
 #include "ofono.h"
 
+/*
+ * Write-behind state. Everything except storage_jobs and storage_done
+ * belongs to the main thread. The worker only ever sees storage_job
+ * structures, which aren't touched by anyone else while it owns them.
+ */
+struct storage_job {
+	char *path;
+	char *data;
+	gsize length;
+};
+
+struct storage_file {
+	struct storage_job *pending;	/* Waiting for the window to close */
+	struct storage_job *inflight;	/* Being written by the worker */
+};
+
 static char* config_dir = NULL;
+static guint storage_delay_ms;
+static guint storage_timer_id;
+static GHashTable *storage_files;
+static GThreadPool *storage_pool;
+static GMutex storage_mutex;
+static GCond storage_cond;
+static guint storage_jobs;
+static GSList *storage_done;
+static guint storage_done_id;
+static struct ofono_storage_stats storage_stats;
 
 void __ofono_set_config_dir(const char *dir)
 {
@@ -180,6 +206,205 @@ error_create_dirs:
 	return r;
 }
 
+static char *storage_path(const char *imsi, const char *store)
+{
+	if (imsi)
+		return g_strdup_printf(STORAGEDIR "/%s/%s", imsi, store);
+	else
+		return g_strdup_printf(STORAGEDIR "/%s", store);
+}
+
+static void storage_job_write(struct storage_job *job)
+{
+	if (create_dirs(job->path, S_IRUSR | S_IWUSR | S_IXUSR) != 0)
+		return;
+
+	g_file_set_contents(job->path, job->data, job->length, NULL);
+}
+
+static void storage_job_free(struct storage_job *job)
+{
+	g_free(job->path);
+	g_free(job->data);
+	g_free(job);
+}
+
+static void storage_file_free(gpointer data)
+{
+	struct storage_file *file = data;
+
+	/* In-flight jobs are freed by storage_reap() */
+	if (file->pending)
+		storage_job_free(file->pending);
+
+	g_free(file);
+}
+
+static gboolean storage_timer_cb(gpointer user_data);
+
+/* Main thread: forget the jobs that the worker has finished */
+static void storage_reap(void)
+{
+	GSList *done, *l;
+
+	g_mutex_lock(&storage_mutex);
+	done = storage_done;
+	storage_done = NULL;
+	if (storage_done_id) {
+		g_source_remove(storage_done_id);
+		storage_done_id = 0;
+	}
+	g_mutex_unlock(&storage_mutex);
+
+	for (l = done; l; l = l->next) {
+		struct storage_job *job = l->data;
+		struct storage_file *file = storage_files ?
+			g_hash_table_lookup(storage_files, job->path) : NULL;
+
+		if (file && file->inflight == job) {
+			file->inflight = NULL;
+			if (!file->pending)
+				g_hash_table_remove(storage_files, job->path);
+			else if (!storage_timer_id)
+				/* Its window closed while this one was busy */
+				storage_timer_id = g_timeout_add(
+						storage_delay_ms,
+						storage_timer_cb, NULL);
+		}
+
+		storage_job_free(job);
+	}
+
+	g_slist_free(done);
+}
+
+static gboolean storage_done_cb(gpointer user_data)
+{
+	g_mutex_lock(&storage_mutex);
+	storage_done_id = 0;
+	g_mutex_unlock(&storage_mutex);
+
+	storage_reap();
+	return G_SOURCE_REMOVE;
+}
+
+/* Worker thread */
+static void storage_worker(gpointer data, gpointer user_data)
+{
+	struct storage_job *job = data;
+
+	storage_job_write(job);
+
+	g_mutex_lock(&storage_mutex);
+	storage_done = g_slist_append(storage_done, job);
+	if (!storage_done_id)
+		storage_done_id = g_idle_add(storage_done_cb, NULL);
+	storage_jobs--;
+	g_cond_broadcast(&storage_cond);
+	g_mutex_unlock(&storage_mutex);
+}
+
+static void storage_submit(gpointer key, gpointer value, gpointer user_data)
+{
+	struct storage_file *file = value;
+	struct storage_job *job = file->pending;
+
+	/*
+	 * Only one write per file at a time. Whatever is left pending
+	 * will go out in the next window.
+	 */
+	if (!job || file->inflight)
+		return;
+
+	file->pending = NULL;
+	file->inflight = job;
+	storage_stats.writes++;
+
+	g_mutex_lock(&storage_mutex);
+	storage_jobs++;
+	g_mutex_unlock(&storage_mutex);
+
+	g_thread_pool_push(storage_pool, job, NULL);
+}
+
+static gboolean storage_timer_cb(gpointer user_data)
+{
+	storage_timer_id = 0;
+
+	g_hash_table_foreach(storage_files, storage_submit, NULL);
+	return G_SOURCE_REMOVE;
+}
+
+static void storage_wait(void)
+{
+	g_mutex_lock(&storage_mutex);
+	while (storage_jobs)
+		g_cond_wait(&storage_cond, &storage_mutex);
+	g_mutex_unlock(&storage_mutex);
+
+	storage_reap();
+}
+
+void __ofono_storage_set_delay(guint ms)
+{
+	if (!ms)
+		__ofono_storage_flush();
+
+	storage_delay_ms = ms;
+
+	if (ms && !storage_pool) {
+		storage_files = g_hash_table_new_full(g_str_hash, g_str_equal,
+						g_free, storage_file_free);
+		/* A single exclusive thread keeps the writes in order */
+		storage_pool = g_thread_pool_new(storage_worker, NULL, 1,
+								TRUE, NULL);
+	}
+}
+
+/*
+ * Writes out everything that's been deferred and waits for it
+ * to hit the disk. Loops because a file can have both an in-flight
+ * and a pending write.
+ */
+void __ofono_storage_flush(void)
+{
+	if (!storage_files)
+		return;
+
+	while (g_hash_table_size(storage_files)) {
+		g_hash_table_foreach(storage_files, storage_submit, NULL);
+		storage_wait();
+	}
+
+	/* storage_wait() may have rearmed it */
+	if (storage_timer_id) {
+		g_source_remove(storage_timer_id);
+		storage_timer_id = 0;
+	}
+}
+
+void __ofono_storage_cleanup(void)
+{
+	__ofono_storage_flush();
+
+	if (storage_pool) {
+		g_thread_pool_free(storage_pool, FALSE, TRUE);
+		storage_pool = NULL;
+	}
+
+	if (storage_files) {
+		g_hash_table_destroy(storage_files);
+		storage_files = NULL;
+	}
+
+	storage_delay_ms = 0;
+}
+
+const struct ofono_storage_stats *__ofono_storage_get_stats(void)
+{
+	return &storage_stats;
+}
+
 GKeyFile *storage_open(const char *imsi, const char *store)
 {
 	GKeyFile *keyfile;
@@ -188,15 +413,24 @@ GKeyFile *storage_open(const char *imsi, const char *store)
 	if (store == NULL)
 		return NULL;
 
-	if (imsi)
-		path = g_strdup_printf(STORAGEDIR "/%s/%s", imsi, store);
-	else
-		path = g_strdup_printf(STORAGEDIR "/%s", store);
-
+	path = storage_path(imsi, store);
 	keyfile = g_key_file_new();
 
 	if (path) {
-		g_key_file_load_from_file(keyfile, path, 0, NULL);
+		struct storage_file *file = storage_files ?
+			g_hash_table_lookup(storage_files, path) : NULL;
+
+		/* What's on the disk may be older than what we've got */
+		if (file) {
+			struct storage_job *job = file->pending ?
+					file->pending : file->inflight;
+
+			g_key_file_load_from_data(keyfile, job->data,
+						job->length, 0, NULL);
+		} else {
+			g_key_file_load_from_file(keyfile, path, 0, NULL);
+		}
+
 		g_free(path);
 	}
 
@@ -205,29 +439,44 @@ GKeyFile *storage_open(const char *imsi, const char *store)
 
 void storage_sync(const char *imsi, const char *store, GKeyFile *keyfile)
 {
-	char *path;
-	char *data;
-	gsize length = 0;
-
-	if (imsi)
-		path = g_strdup_printf(STORAGEDIR "/%s/%s", imsi, store);
-	else
-		path = g_strdup_printf(STORAGEDIR "/%s", store);
-
-	if (path == NULL)
-		return;
+	struct storage_job *job;
+	struct storage_file *file;
+	gint64 start = g_get_monotonic_time();
+	guint stall;
+
+	job = g_new0(struct storage_job, 1);
+	job->path = storage_path(imsi, store);
+	job->data = g_key_file_to_data(keyfile, &job->length, NULL);
+	storage_stats.syncs++;
+
+	if (!storage_delay_ms) {
+		storage_job_write(job);
+		storage_job_free(job);
+		storage_stats.writes++;
+		goto done;
+	}
 
-	if (create_dirs(path, S_IRUSR | S_IWUSR | S_IXUSR) != 0) {
-		g_free(path);
-		return;
+	file = g_hash_table_lookup(storage_files, job->path);
+	if (!file) {
+		file = g_new0(struct storage_file, 1);
+		g_hash_table_insert(storage_files, g_strdup(job->path), file);
 	}
 
-	data = g_key_file_to_data(keyfile, &length, NULL);
+	/* Newer contents supersede whatever hasn't been written yet */
+	if (file->pending)
+		storage_job_free(file->pending);
 
-	g_file_set_contents(path, data, length, NULL);
+	file->pending = job;
 
-	g_free(data);
-	g_free(path);
+	if (!storage_timer_id)
+		storage_timer_id = g_timeout_add(storage_delay_ms,
+						storage_timer_cb, NULL);
+
+done:
+	stall = g_get_monotonic_time() - start;
+	storage_stats.stall_total_us += stall;
+	if (storage_stats.stall_max_us < stall)
+		storage_stats.stall_max_us = stall;
 }
 
 void storage_close(const char *imsi, const char *store, GKeyFile *keyfile,
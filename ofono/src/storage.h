@@ -47,3 +47,20 @@ GKeyFile *storage_open(const char *imsi, const char *store);
 void storage_sync(const char *imsi, const char *store, GKeyFile *keyfile);
 void storage_close(const char *imsi, const char *store, GKeyFile *keyfile,
 			gboolean save);
+
+/*
+ * With a non-zero delay storage_sync() only serializes the keyfile.
+ * Writes to the same file within the delay are coalesced, and the
+ * fsync and rename happen on a worker thread.
+ */
+struct ofono_storage_stats {
+	unsigned int syncs;		/* storage_sync() calls */
+	unsigned int writes;		/* Files actually written */
+	unsigned int stall_total_us;	/* Time spent in storage_sync() */
+	unsigned int stall_max_us;
+};
+
+void __ofono_storage_set_delay(guint ms);
+void __ofono_storage_flush(void);
+void __ofono_storage_cleanup(void);
+const struct ofono_storage_stats *__ofono_storage_get_stats(void);
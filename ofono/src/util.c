@@ -27,7 +27,6 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdlib.h>
 
 #include <glib.h>
@@ -74,7 +73,32 @@ struct codepoint {
 	unsigned short to;
 };
 
+struct utf8_char {
+	unsigned char len;
+	char bytes[3];
+};
+
+/* Precomputed tables of one dialect, see dialect_tables_get() */
+struct dialect_tables {
+	gsize initialized;
+
+	/* To UTF-8, indexed by septet. Single shift len is 0 if unmapped */
+	struct utf8_char locking_utf8[128];
+	struct utf8_char single_utf8[128];
+
+	/* To unicode single shift, indexed by byte */
+	unsigned short single_g[256];
+
+	/* To GSM, in pages of 256 code points */
+	const unsigned short *locking_u[256];
+	const unsigned short *single_u[256];
+};
+
 struct conversion_table {
+	/* Dense versions of the tables below */
+	const struct dialect_tables *locking;
+	const struct dialect_tables *single;
+
 	/* To unicode locking shift table */
 	const struct codepoint *locking_u;
 	unsigned int locking_len_u;
@@ -2644,26 +2668,6 @@ const struct codepoint urd_unicode[] = {
 	{ 0x06CC, 0x59 }, { 0x06D0, 0x5A }, { 0x06D2, 0x5B }, { 0x06D5, 0x55 }
 };
 
-static int compare_codepoints(const void *a, const void *b)
-{
-	const struct codepoint *ca = (const struct codepoint *) a;
-	const struct codepoint *cb = (const struct codepoint *) b;
-
-	return (ca->from > cb->from) - (ca->from < cb->from);
-}
-
-static unsigned short codepoint_lookup(struct codepoint *key,
-					const struct codepoint *table,
-					unsigned int len)
-{
-	struct codepoint *result = NULL;
-
-	result = bsearch(key, table, len, sizeof(struct codepoint),
-				compare_codepoints);
-
-	return result ? result->to : GUND;
-}
-
 static unsigned short gsm_locking_shift_lookup(struct conversion_table *t,
 						unsigned char k)
 {
@@ -2673,22 +2677,19 @@ static unsigned short gsm_locking_shift_lookup(struct conversion_table *t,
 static unsigned short gsm_single_shift_lookup(struct conversion_table *t,
 						unsigned char k)
 {
-	struct codepoint key = { k, 0 };
-	return codepoint_lookup(&key, t->single_g, t->single_len_g);
+	return t->single->single_g[k];
 }
 
 static unsigned short unicode_locking_shift_lookup(struct conversion_table *t,
 							unsigned short k)
 {
-	struct codepoint key = { k, 0 };
-	return codepoint_lookup(&key, t->locking_u, t->locking_len_u);
+	return t->locking->locking_u[k >> 8][k & 0xff];
 }
 
 static unsigned short unicode_single_shift_lookup(struct conversion_table *t,
 							unsigned short k)
 {
-	struct codepoint key = { k, 0 };
-	return codepoint_lookup(&key, t->single_u, t->single_len_u);
+	return t->single->single_u[k >> 8][k & 0xff];
 }
 
 static bool populate_locking_shift(struct conversion_table *t,
@@ -2884,14 +2885,96 @@ static bool populate_single_shift(struct conversion_table *t,
 	return false;
 }
 
+static struct dialect_tables dialect_tables[GSM_DIALECT_URDU + 1];
+static unsigned short unmapped_page[256];
+static gsize unmapped_page_initialized;
+
+static void dialect_tables_add(const unsigned short **pages,
+				const struct codepoint *table, unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		unsigned short *page = (unsigned short *)
+						pages[table[i].from >> 8];
+
+		if (page == unmapped_page) {
+			page = g_memdup(unmapped_page, sizeof(unmapped_page));
+			pages[table[i].from >> 8] = page;
+		}
+
+		page[table[i].from & 0xff] = table[i].to;
+	}
+}
+
+/*
+ * Builds the flat tables of a dialect from the sorted ones above the
+ * first time the dialect is used. They are never freed.
+ */
+static const struct dialect_tables *dialect_tables_get(enum gsm_dialect lang)
+{
+	struct dialect_tables *d;
+	struct conversion_table t;
+	unsigned int i;
+
+	if ((unsigned int) lang >= G_N_ELEMENTS(dialect_tables))
+		return NULL;
+
+	d = &dialect_tables[lang];
+
+	if (!g_once_init_enter(&d->initialized))
+		return d;
+
+	memset(&t, 0, sizeof(t));
+	populate_locking_shift(&t, lang);
+	populate_single_shift(&t, lang);
+
+	if (g_once_init_enter(&unmapped_page_initialized)) {
+		for (i = 0; i < G_N_ELEMENTS(unmapped_page); i++)
+			unmapped_page[i] = GUND;
+
+		g_once_init_leave(&unmapped_page_initialized, 1);
+	}
+
+	for (i = 0; i < 256; i++) {
+		d->locking_u[i] = unmapped_page;
+		d->single_u[i] = unmapped_page;
+		d->single_g[i] = GUND;
+	}
+
+	for (i = 0; i < 128; i++)
+		d->locking_utf8[i].len = g_unichar_to_utf8(t.locking_g[i],
+						d->locking_utf8[i].bytes);
+
+	for (i = 0; i < t.single_len_g; i++) {
+		unsigned short from = t.single_g[i].from;
+
+		d->single_g[from] = t.single_g[i].to;
+		d->single_utf8[from].len = g_unichar_to_utf8(t.single_g[i].to,
+						d->single_utf8[from].bytes);
+	}
+
+	dialect_tables_add(d->locking_u, t.locking_u, t.locking_len_u);
+	dialect_tables_add(d->single_u, t.single_u, t.single_len_u);
+
+	g_once_init_leave(&d->initialized, 1);
+	return d;
+}
+
 static bool conversion_table_init(struct conversion_table *t,
 					enum gsm_dialect locking,
 					enum gsm_dialect single)
 {
 	memset(t, 0, sizeof(struct conversion_table));
 
-	return populate_locking_shift(t, locking) &&
-			populate_single_shift(t, single);
+	if (!populate_locking_shift(t, locking) ||
+			!populate_single_shift(t, single))
+		return false;
+
+	t->locking = dialect_tables_get(locking);
+	t->single = dialect_tables_get(single);
+
+	return true;
 }
 
 /*!
@@ -2916,7 +2999,6 @@ char *convert_gsm_to_utf8_with_lang(const unsigned char *text, long len,
 	char *res = NULL;
 	char *out;
 	long i = 0;
-	long res_length;
 
 	struct conversion_table t;
 
@@ -2935,18 +3017,30 @@ char *convert_gsm_to_utf8_with_lang(const unsigned char *text, long len,
 		len = i;
 	}
 
-	for (i = 0, res_length = 0; i < len; i++) {
-		unsigned short c;
+	/* A septet never takes more than 3 bytes of UTF-8 */
+	res = g_try_malloc(len * 3 + 1);
+	if (res == NULL)
+		goto error;
+
+	out = res;
+
+	for (i = 0; i < len; i++) {
+		unsigned char c = text[i];
+		const struct utf8_char *u;
 
-		if (text[i] > 0x7f)
+		if (c > 0x7f)
 			goto error;
 
-		if (text[i] == 0x1b) {
+		if (c == 0x1b) {
 			++i;
 			if (i >= len)
 				goto error;
 
-			c = gsm_single_shift_lookup(&t, text[i]);
+			c = text[i];
+			if (c > 0x7f)
+				goto error;
+
+			u = &t.single->single_utf8[c];
 
 			/*
 			 * According to the comment in the table from
@@ -2960,35 +3054,13 @@ char *convert_gsm_to_utf8_with_lang(const unsigned char *text, long len,
 			 * case where the locking shift mechanism as defined
 			 * in subclause 6.2.1.2.3 is used."
 			 */
-			if (c == GUND)
-				c = gsm_locking_shift_lookup(&t, text[i]);
-		} else
-			c = gsm_locking_shift_lookup(&t, text[i]);
-
-		res_length += UTF8_LENGTH(c);
-	}
-
-	res = g_try_malloc(res_length + 1);
-	if (res == NULL)
-		goto error;
-
-	out = res;
-
-	i = 0;
-	while (out < res + res_length) {
-		unsigned short c;
-
-		if (text[i] == 0x1b) {
-			c = gsm_single_shift_lookup(&t, text[++i]);
-
-			if (c == GUND)
-				c = gsm_locking_shift_lookup(&t, text[i]);
+			if (u->len == 0)
+				u = &t.locking->locking_utf8[c];
 		} else
-			c = gsm_locking_shift_lookup(&t, text[i]);
-
-		out += g_unichar_to_utf8(c, out);
+			u = &t.locking->locking_utf8[c];
 
-		++i;
+		memcpy(out, u->bytes, sizeof(u->bytes));
+		out += u->len;
 	}
 
 	*out = '\0';
@@ -2996,11 +3068,18 @@ char *convert_gsm_to_utf8_with_lang(const unsigned char *text, long len,
 	if (items_written)
 		*items_written = out - res;
 
+	if (items_read)
+		*items_read = i;
+
+	return g_realloc(res, out - res + 1);
+
 error:
+	g_free(res);
+
 	if (items_read)
 		*items_read = i;
 
-	return res;
+	return NULL;
 }
 
 char *convert_gsm_to_utf8(const unsigned char *text, long len,
@@ -3031,18 +3110,22 @@ unsigned char *convert_utf8_to_gsm_with_lang(const char *text, long len,
 					enum gsm_dialect single_lang)
 {
 	struct conversion_table t;
-	long nchars = 0;
 	const char *in;
 	unsigned char *out;
 	unsigned char *res = NULL;
-	long res_len;
-	long i;
 
 	if (!conversion_table_init(&t, locking_lang, single_lang))
 		return NULL;
 
 	in = text;
-	res_len = 0;
+
+	/* At most two septets per character, which is at least a byte */
+	res = g_try_malloc(2 * (len < 0 ? (long) strlen(text) : len) +
+							(terminator ? 1 : 0));
+	if (res == NULL)
+		goto err_out;
+
+	out = res;
 
 	while ((len < 0 || text + len - in > 0) && *in) {
 		long max = len < 0 ? 6 : text + len - in;
@@ -3063,31 +3146,6 @@ unsigned char *convert_utf8_to_gsm_with_lang(const char *text, long len,
 		if (converted == GUND)
 			goto err_out;
 
-		if (converted & 0x1b00)
-			res_len += 2;
-		else
-			res_len += 1;
-
-		in = g_utf8_next_char(in);
-		nchars += 1;
-	}
-
-	res = g_try_malloc(res_len + (terminator ? 1 : 0));
-	if (res == NULL)
-		goto err_out;
-
-	in = text;
-	out = res;
-	for (i = 0; i < nchars; i++) {
-		unsigned short converted;
-
-		gunichar c = g_utf8_get_char(in);
-
-		converted = unicode_locking_shift_lookup(&t, c);
-
-		if (converted == GUND)
-			converted = unicode_single_shift_lookup(&t, c);
-
 		if (converted & 0x1b00) {
 			*out = 0x1b;
 			++out;
@@ -3100,16 +3158,23 @@ unsigned char *convert_utf8_to_gsm_with_lang(const char *text, long len,
 	}
 
 	if (terminator)
-		*out = terminator;
+		*out++ = terminator;
 
 	if (items_written)
-		*items_written = out - res;
+		*items_written = out - res - (terminator ? 1 : 0);
+
+	if (items_read)
+		*items_read = in - text;
+
+	return g_realloc(res, out - res);
 
 err_out:
+	g_free(res);
+
 	if (items_read)
 		*items_read = in - text;
 
-	return res;
+	return NULL;
 }
 
 unsigned char *convert_utf8_to_gsm(const char *text, long len,
@@ -3123,6 +3188,90 @@ unsigned char *convert_utf8_to_gsm(const char *text, long len,
 						GSM_DIALECT_DEFAULT);
 }
 
+/*!
+ * Scans UTF-8 encoded text once and works out how long it would be in
+ * UCS-2 and with each of the GSM dialect combinations that may be used
+ * for the hint given. The combinations are, in this order: the default
+ * dialect's tables, the hinted dialect's single shift table, and both
+ * of the hinted dialect's tables.
+ *
+ * Returns false if the text isn't valid UTF-8. A combination that can't
+ * encode the text has septets set to -1. Escape pairs can't be split
+ * between SMSes, so escapes are counted for each combination too.
+ */
+bool analyze_utf8_for_gsm(const char *utf8, long len, enum gsm_dialect hint,
+				struct utf8_gsm_analysis *analysis)
+{
+	struct conversion_table t[GSM_DIALECT_CANDIDATES];
+	const char *in = utf8;
+	unsigned int n = 0;
+	unsigned int i;
+
+	memset(analysis, 0, sizeof(struct utf8_gsm_analysis));
+
+	analysis->candidates[n].locking = GSM_DIALECT_DEFAULT;
+	analysis->candidates[n++].single = GSM_DIALECT_DEFAULT;
+
+	if (hint != GSM_DIALECT_DEFAULT) {
+		analysis->candidates[n].locking = GSM_DIALECT_DEFAULT;
+		analysis->candidates[n++].single = hint;
+	}
+
+	/* Spanish dialect uses the default locking shift table */
+	if (hint != GSM_DIALECT_DEFAULT && hint != GSM_DIALECT_SPANISH) {
+		analysis->candidates[n].locking = hint;
+		analysis->candidates[n++].single = hint;
+	}
+
+	analysis->n_candidates = n;
+
+	for (i = 0; i < n; i++)
+		if (!conversion_table_init(&t[i],
+					analysis->candidates[i].locking,
+					analysis->candidates[i].single))
+			analysis->candidates[i].septets = -1;
+
+	while ((len < 0 || utf8 + len - in > 0) && *in) {
+		long max = len < 0 ? 6 : utf8 + len - in;
+		gunichar c = g_utf8_get_char_validated(in, max);
+
+		if (c & 0x80000000)
+			return false;
+
+		/* Outside of the BMP it takes a surrogate pair */
+		analysis->ucs2_len += c > 0xffff ? 4 : 2;
+
+		for (i = 0; i < n; i++) {
+			long *septets = &analysis->candidates[i].septets;
+			unsigned short converted = GUND;
+
+			if (*septets < 0)
+				continue;
+
+			if (c <= 0xffff) {
+				converted = unicode_locking_shift_lookup(&t[i], c);
+
+				if (converted == GUND)
+					converted = unicode_single_shift_lookup(
+								&t[i], c);
+			}
+
+			if (converted == GUND) {
+				*septets = -1;
+			} else if (converted & 0x1b00) {
+				*septets += 2;
+				analysis->candidates[i].escapes++;
+			} else {
+				*septets += 1;
+			}
+		}
+
+		in = g_utf8_next_char(in);
+	}
+
+	return true;
+}
+
 /*!
  * Converts UTF-8 encoded text to GSM alphabet. It finds an encoding
  * that uses the minimum set of GSM dialects based on the hint given.
@@ -3146,48 +3295,47 @@ unsigned char *convert_utf8_to_gsm_best_lang(const char *utf8, long len,
 					enum gsm_dialect *used_locking,
 					enum gsm_dialect *used_single)
 {
-	enum gsm_dialect locking = GSM_DIALECT_DEFAULT;
-	enum gsm_dialect single = GSM_DIALECT_DEFAULT;
+	struct utf8_gsm_analysis analysis;
 	unsigned char *encoded;
+	unsigned int i;
 
-	encoded = convert_utf8_to_gsm_with_lang(utf8, len, items_read,
-						items_written, terminator,
-						locking, single);
-	if (encoded != NULL)
-		goto out;
-
-	if (hint == GSM_DIALECT_DEFAULT)
+	if (!analyze_utf8_for_gsm(utf8, len, hint, &analysis))
 		return NULL;
 
-	single = hint;
-	encoded = convert_utf8_to_gsm_with_lang(utf8, len, items_read,
-						items_written, terminator,
-						locking, single);
-	if (encoded != NULL)
-		goto out;
+	for (i = 0; i < analysis.n_candidates; i++)
+		if (analysis.candidates[i].septets >= 0)
+			break;
 
-	/* Spanish dialect uses the default locking shift table */
-	if (hint == GSM_DIALECT_SPANISH)
+	if (i == analysis.n_candidates)
 		return NULL;
 
-	locking = hint;
 	encoded = convert_utf8_to_gsm_with_lang(utf8, len, items_read,
-						items_written, terminator,
-						locking, single);
-
+					items_written, terminator,
+					analysis.candidates[i].locking,
+					analysis.candidates[i].single);
 	if (encoded == NULL)
 		return NULL;
 
-out:
 	if (used_locking != NULL)
-		*used_locking = locking;
+		*used_locking = analysis.candidates[i].locking;
 
 	if (used_single != NULL)
-		*used_single = single;
+		*used_single = analysis.candidates[i].single;
 
 	return encoded;
 }
 
+/* Value of each hex digit with bit 4 set, 0 for anything else */
+static const unsigned char hex_values[256] = {
+	['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13,
+	['4'] = 0x14, ['5'] = 0x15, ['6'] = 0x16, ['7'] = 0x17,
+	['8'] = 0x18, ['9'] = 0x19,
+	['A'] = 0x1a, ['B'] = 0x1b, ['C'] = 0x1c, ['D'] = 0x1d,
+	['E'] = 0x1e, ['F'] = 0x1f,
+	['a'] = 0x1a, ['b'] = 0x1b, ['c'] = 0x1c, ['d'] = 0x1d,
+	['e'] = 0x1e, ['f'] = 0x1f,
+};
+
 /*!
  * Decodes the hex encoded data and converts to a byte array.  If terminator
  * is not 0, the terminator character is appended to the end of the result.
@@ -3202,39 +3350,27 @@ unsigned char *decode_hex_own_buf(const char *in, long len, long *items_written,
 					unsigned char terminator,
 					unsigned char *buf)
 {
+	const unsigned char *hex = (const unsigned char *) in;
+	unsigned char valid = 0x10;
 	long i, j;
-	char c;
-	unsigned char b;
 
 	if (len < 0)
 		len = strlen(in);
 
 	len &= ~0x1;
 
-	for (i = 0, j = 0; i < len; i++, j++) {
-		c = toupper(in[i]);
-
-		if (c >= '0' && c <= '9')
-			b = c - '0';
-		else if (c >= 'A' && c <= 'F')
-			b = 10 + c - 'A';
-		else
-			return NULL;
-
-		i += 1;
+	/* No branches in the loop, bit 4 of valid is cleared by a non-digit */
+	for (i = 0, j = 0; i < len; i += 2, j++) {
+		unsigned char hi = hex_values[hex[i]];
+		unsigned char lo = hex_values[hex[i + 1]];
 
-		c = toupper(in[i]);
-
-		if (c >= '0' && c <= '9')
-			b = b * 16 + c - '0';
-		else if (c >= 'A' && c <= 'F')
-			b = b * 16 + 10 + c - 'A';
-		else
-			return NULL;
-
-		buf[j] = b;
+		valid &= hi & lo;
+		buf[j] = (hi << 4) | (lo & 0xf);
 	}
 
+	if (!valid)
+		return NULL;
+
 	if (terminator)
 		buf[j] = terminator;
 
@@ -3248,7 +3384,6 @@ unsigned char *decode_hex(const char *in, long len, long *items_written,
 				unsigned char terminator)
 {
 	long i;
-	char c;
 	unsigned char *buf;
 
 	if (len < 0)
@@ -3256,20 +3391,39 @@ unsigned char *decode_hex(const char *in, long len, long *items_written,
 
 	len &= ~0x1;
 
-	for (i = 0; i < len; i++) {
-		c = toupper(in[i]);
-
-		if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'F'))
-			continue;
-
-		return NULL;
-	}
+	for (i = 0; i < len; i++)
+		if (!hex_values[(unsigned char) in[i]])
+			return NULL;
 
 	buf = g_new(unsigned char, (len >> 1) + (terminator ? 1 : 0));
 
 	return decode_hex_own_buf(in, len, items_written, terminator, buf);
 }
 
+/*
+ * Turns 4 bytes into 8 upper case hex digits, in memory order, all in
+ * one 64 bit word.
+ */
+static inline guint64 encode_hex_word(guint32 bytes)
+{
+	guint64 x = GUINT32_FROM_LE(bytes);
+	guint64 n;
+	guint64 letters;
+
+	/* Spread the bytes out to one per 16 bit lane */
+	x = (x | (x << 16)) & 0x0000ffff0000ffffULL;
+	x = (x | (x << 8)) & 0x00ff00ff00ff00ffULL;
+
+	/* High nibble first, one nibble per byte */
+	n = ((x >> 4) & 0x000f000f000f000fULL) |
+		((x & 0x000f000f000f000fULL) << 8);
+
+	/* 0x80 is set in the bytes holding 10..15, make that 7 */
+	letters = ((n + 0x7676767676767676ULL) & 0x8080808080808080ULL) >> 7;
+
+	return GUINT64_TO_LE(n + 0x3030303030303030ULL + letters * 7);
+}
+
 /*!
  * Encodes the data using hexadecimal characters.  len can be negative,
  * in that case the terminator is used to find the last character.  This is
@@ -3291,7 +3445,16 @@ char *encode_hex_own_buf(const unsigned char *in, long len,
 		len = i;
 	}
 
-	for (i = 0, j = 0; i < len; i++, j++) {
+	for (i = 0, j = 0; i + 4 <= len; i += 4, j += 8) {
+		guint32 bytes;
+		guint64 digits;
+
+		memcpy(&bytes, in + i, 4);
+		digits = encode_hex_word(bytes);
+		memcpy(buf + j, &digits, 8);
+	}
+
+	for (; i < len; i++, j++) {
 		c = (in[i] >> 4) & 0xf;
 
 		if (c <= 9)
@@ -3333,15 +3496,40 @@ char *encode_hex(const unsigned char *in, long len, unsigned char terminator)
 	return encode_hex_own_buf(in, len, terminator, buf);
 }
 
+/* Loads up to 8 bytes as a little endian word, missing bytes read as 0 */
+static inline guint64 load_le64(const unsigned char *in, long avail)
+{
+	guint64 w = 0;
+
+	if (avail >= 8) {
+		memcpy(&w, in, 8);
+		return GUINT64_FROM_LE(w);
+	}
+
+	while (avail-- > 0)
+		w = (w << 8) | in[avail];
+
+	return w;
+}
+
+/*
+ * Septets are packed LSB first. After a header of byte_offset octets
+ * the first one starts at the next septet boundary, this many bits in.
+ */
+static inline int septet_fill_bits(int byte_offset)
+{
+	return byte_offset % 7 ? 7 - byte_offset % 7 : 0;
+}
+
 unsigned char *unpack_7bit_own_buf(const unsigned char *in, long len,
 					int byte_offset, bool ussd,
 					long max_to_unpack, long *items_written,
 					unsigned char terminator,
 					unsigned char *buf)
 {
-	unsigned char rest = 0;
+	int fill = septet_fill_bits(byte_offset);
 	unsigned char *out = buf;
-	int bits = 7 - (byte_offset % 7);
+	long septets;
 	long i;
 
 	if (len <= 0)
@@ -3351,39 +3539,36 @@ unsigned char *unpack_7bit_own_buf(const unsigned char *in, long len,
 	if (ussd == true)
 		max_to_unpack = len * 8 / 7;
 
-	for (i = 0; (i < len) && ((out-buf) < max_to_unpack); i++) {
-		/* Grab what we have in the current octet */
-		*out = (in[i] & ((1 << bits) - 1)) << (7 - bits);
-
-		/* Append what we have from the previous octet, if any */
-		*out |= rest;
-
-		/* Figure out the remainder */
-		rest = (in[i] >> bits) & ((1 << (8-bits)) - 1);
+	septets = (len * 8 - fill) / 7;
+
+	if (septets > max_to_unpack)
+		septets = max_to_unpack;
+
+	/* Every 8 septets take exactly 7 octets, so fill stays the same */
+	for (i = 0; i + 8 <= septets; i += 8) {
+		long offset = i / 8 * 7;
+		guint64 w = load_le64(in + offset, len - offset) >> fill;
+
+		out[0] = w & 0x7f;
+		out[1] = (w >> 7) & 0x7f;
+		out[2] = (w >> 14) & 0x7f;
+		out[3] = (w >> 21) & 0x7f;
+		out[4] = (w >> 28) & 0x7f;
+		out[5] = (w >> 35) & 0x7f;
+		out[6] = (w >> 42) & 0x7f;
+		out[7] = (w >> 49) & 0x7f;
+		out += 8;
+	}
 
-		/*
-		 * We have the entire character, here we don't increate
-		 * out if this is we started at an offset.  Instead
-		 * we effectively populate variable rest
-		 */
-		if (i != 0 || bits == 7)
-			out++;
+	for (; i < septets; i++) {
+		long bit = fill + i * 7;
+		long offset = bit / 8;
+		unsigned int w = in[offset];
 
-		if ((out-buf) == max_to_unpack)
-			break;
+		if (offset + 1 < len)
+			w |= in[offset + 1] << 8;
 
-		/*
-		 * We expected only 1 bit from this octet, means there's 7
-		 * left, take care of them here
-		 */
-		if (bits == 1) {
-			*out = rest;
-			out++;
-			bits = 7;
-			rest = 0;
-		} else {
-			bits = bits - 1;
-		}
+		*out++ = (w >> (bit % 8)) & 0x7f;
 	}
 
 	/*
@@ -3399,7 +3584,8 @@ unsigned char *unpack_7bit_own_buf(const unsigned char *in, long len,
 	 * the message ends on an octet boundary with <CR> as the last
 	 * character.
 	 */
-	if (ussd && (((out - buf) % 8) == 0) && (*(out - 1) == '\r'))
+	if (ussd && out > buf && (((out - buf) % 8) == 0) &&
+				(*(out - 1) == '\r'))
 		out = out - 1;
 
 	if (terminator)
@@ -3422,10 +3608,14 @@ unsigned char *unpack_7bit(const unsigned char *in, long len, int byte_offset,
 				items_written, terminator, buf);
 }
 
-unsigned char *pack_7bit_own_buf(const unsigned char *in, long len,
+/*
+ * The original octet at a time packer. Characters with the 8th bit set
+ * bleed into the following septet here, which the word at a time version
+ * doesn't bother to reproduce, so such input is left to this one.
+ */
+static unsigned char *pack_7bit_bytewise(const unsigned char *in, long len,
 					int byte_offset, bool ussd,
 					long *items_written,
-					unsigned char terminator,
 					unsigned char *buf)
 {
 	int bits = 7 - (byte_offset % 7);
@@ -3433,18 +3623,6 @@ unsigned char *pack_7bit_own_buf(const unsigned char *in, long len,
 	long i;
 	long total_bits;
 
-	if (len == 0)
-		return NULL;
-
-	if (len < 0) {
-		i = 0;
-
-		while (in[i] != terminator)
-			i++;
-
-		len = i;
-	}
-
 	total_bits = len * 7;
 
 	if (bits != 7) {
@@ -3495,6 +3673,105 @@ unsigned char *pack_7bit_own_buf(const unsigned char *in, long len,
 	return buf;
 }
 
+static bool is_septets(const unsigned char *in, long len)
+{
+	guint64 high = 0;
+	long i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		guint64 w;
+
+		memcpy(&w, in + i, 8);
+		high |= w;
+	}
+
+	for (; i < len; i++)
+		high |= in[i];
+
+	return (high & 0x8080808080808080ULL) == 0;
+}
+
+/* Stores the low n bytes of w, little endian */
+static inline void store_le(unsigned char *out, guint64 w, int n)
+{
+	w = GUINT64_TO_LE(w);
+	memcpy(out, &w, n);
+}
+
+unsigned char *pack_7bit_own_buf(const unsigned char *in, long len,
+					int byte_offset, bool ussd,
+					long *items_written,
+					unsigned char terminator,
+					unsigned char *buf)
+{
+	int fill = septet_fill_bits(byte_offset);
+	unsigned char *out = buf;
+	long total_bits;
+	guint64 w;
+	long i;
+	int j;
+
+	if (len == 0)
+		return NULL;
+
+	if (len < 0) {
+		i = 0;
+
+		while (in[i] != terminator)
+			i++;
+
+		len = i;
+	}
+
+	if (!is_septets(in, len))
+		return pack_7bit_bytewise(in, len, byte_offset, ussd,
+						items_written, buf);
+
+	total_bits = len * 7 + fill;
+
+	/*
+	 * 8 septets make 7 whole octets, the fill bits are carried over
+	 * to the next group
+	 */
+	for (i = 0, w = 0; i + 8 <= len; i += 8) {
+		for (j = 0; j < 8; j++)
+			w |= (guint64) in[i + j] << (fill + j * 7);
+
+		store_le(out, w, 7);
+		out += 7;
+		w >>= 56;
+	}
+
+	for (j = 0; i < len; i++, j++)
+		w |= (guint64) in[i] << (fill + j * 7);
+
+	j = (fill + j * 7 + 7) / 8;
+
+	/*
+	 * If <CR> is intended to be the last character and the message
+	 * (including the wanted <CR>) ends on an octet boundary, then
+	 * another <CR> must be added together with a padding bit 0. The
+	 * receiving entity will perform the carriage return function twice,
+	 * but this will not result in misoperation as the definition of
+	 * <CR> in clause 6.1.1 is identical to the definition of <CR><CR>.
+	 */
+	if (ussd && ((total_bits % 8) == 1))
+		w |= (guint64) '\r' << ((j - 1) * 8 + 1);
+
+	store_le(out, w, j);
+	out += j;
+
+	if (ussd && ((total_bits % 8) == 0) && (in[len - 1] == '\r')) {
+		*out = '\r';
+		out++;
+	}
+
+	if (items_written)
+		*items_written = out - buf;
+
+	return buf;
+}
+
 unsigned char *pack_7bit(const unsigned char *in, long len, int byte_offset,
 				bool ussd, long *items_written,
 				unsigned char terminator)
@@ -63,6 +63,22 @@ unsigned char *convert_utf8_to_gsm_best_lang(const char *utf8, long len,
 					enum gsm_dialect *used_locking,
 					enum gsm_dialect *used_single);
 
+#define GSM_DIALECT_CANDIDATES 3
+
+struct utf8_gsm_analysis {
+	long ucs2_len;			/* In bytes */
+	unsigned int n_candidates;
+	struct {
+		enum gsm_dialect locking;
+		enum gsm_dialect single;
+		long septets;		/* -1 if the text can't be encoded */
+		long escapes;		/* Characters taking two septets */
+	} candidates[GSM_DIALECT_CANDIDATES];
+};
+
+bool analyze_utf8_for_gsm(const char *utf8, long len, enum gsm_dialect hint,
+				struct utf8_gsm_analysis *analysis);
+
 unsigned char *decode_hex_own_buf(const char *in, long len, long *items_written,
 					unsigned char terminator,
 					unsigned char *buf);
@@ -37,6 +37,9 @@ struct voicecall_filter_request {
 	GSList *filter_link;
 	guint pending_id;
 	guint next_id;
+	gboolean in_process;
+	GSourceFunc sync_next;
+	gint64 start;
 	ofono_destroy_func destroy;
 	void* user_data;
 };
@@ -56,6 +59,7 @@ struct voicecall_filter_request_incoming {
 struct voicecall_filter_chain {
 	struct ofono_voicecall *vc;
 	GSList *req_list;
+	struct ofono_filter_chain_stats stats;
 };
 
 static GSList *voicecall_filters = NULL;
@@ -71,6 +75,7 @@ static void voicecall_filter_request_init(struct voicecall_filter_request *req,
 	req->filter_link = voicecall_filters;
 	req->destroy = destroy;
 	req->user_data = user_data;
+	req->start = g_get_monotonic_time();
 
 	/*
 	 * The list holds an implicit reference to the message. The reference
@@ -94,6 +99,7 @@ static void voicecall_filter_request_cancel
 		f->filter_cancel(req->pending_id);
 		req->pending_id = 0;
 	}
+	req->sync_next = NULL;
 	if (req->next_id) {
 		g_source_remove(req->next_id);
 		req->next_id = 0;
@@ -158,6 +164,18 @@ static void voicecall_filter_request_complete
 		(struct voicecall_filter_request *req,
 			void (*complete)(struct voicecall_filter_request *req))
 {
+	struct voicecall_filter_chain *chain = req->chain;
+
+	if (chain) {
+		struct ofono_filter_chain_stats *stats = &chain->stats;
+		const unsigned int us = g_get_monotonic_time() - req->start;
+
+		stats->requests++;
+		stats->latency_total_us += us;
+		if (stats->latency_max_us < us)
+			stats->latency_max_us = us;
+	}
+
 	voicecall_filter_request_ref(req);
 	complete(req);
 	voicecall_filter_request_dispose(req);
@@ -165,24 +183,55 @@ static void voicecall_filter_request_complete
 	voicecall_filter_request_unref(req);
 }
 
+static gboolean voicecall_filter_request_continue_cb(gpointer data);
+
 static void voicecall_filter_request_process
 		(struct voicecall_filter_request *req)
 {
-	GSList *l = req->filter_link;
-	const struct ofono_voicecall_filter *f = l->data;
 	const struct voicecall_filter_request_fn *fn = req->fn;
 
-	while (f && !fn->can_process(f)) {
-		l = l->next;
-		f = l ? l->data : NULL;
-	}
-
+	/*
+	 * A filter that has already replied by the time its process
+	 * callback returns is followed by the next one right here.
+	 * Only those that reply later go through the main loop.
+	 */
 	voicecall_filter_request_ref(req);
-	if (f) {
+	while (req->chain) {
+		GSList *l = req->filter_link;
+		const struct ofono_voicecall_filter *f = l ? l->data : NULL;
+		GSourceFunc next;
+		guint id;
+
+		while (f && !fn->can_process(f)) {
+			l = l->next;
+			f = l ? l->data : NULL;
+		}
+
+		if (!f) {
+			voicecall_filter_request_complete(req, fn->allow);
+			break;
+		}
+
 		req->filter_link = l;
-		req->pending_id = fn->process(f, req);
-	} else {
-		voicecall_filter_request_complete(req, fn->allow);
+		req->in_process = TRUE;
+		id = fn->process(f, req);
+		req->in_process = FALSE;
+
+		next = req->sync_next;
+		req->sync_next = NULL;
+		if (!req->chain) {
+			/* Canceled while the filter was running */
+			break;
+		} else if (!next) {
+			req->pending_id = id;
+			break;
+		} else if (next != voicecall_filter_request_continue_cb) {
+			/* Blocked, hung up or ignored */
+			next(req);
+			break;
+		}
+
+		req->filter_link = l->next;
 	}
 	voicecall_filter_request_unref(req);
 }
@@ -190,8 +239,18 @@ static void voicecall_filter_request_process
 static void voicecall_filter_request_next(struct voicecall_filter_request *req,
 							GSourceFunc fn)
 {
+	struct voicecall_filter_chain *chain = req->chain;
+
 	req->pending_id = 0;
-	req->next_id = g_idle_add(fn, req);
+	if (req->in_process) {
+		req->sync_next = fn;
+		if (chain)
+			chain->stats.inline_steps++;
+	} else {
+		req->next_id = g_idle_add(fn, req);
+		if (chain)
+			chain->stats.async_steps++;
+	}
 }
 
 static gboolean voicecall_filter_request_continue_cb(gpointer data)
@@ -468,6 +527,8 @@ struct voicecall_filter_chain *__ofono_voicecall_filter_chain_new
 void __ofono_voicecall_filter_chain_free(struct voicecall_filter_chain *chain)
 {
 	if (chain) {
+		OFONO_FILTER_CHAIN_STATS_DBG(&chain->stats);
+
 		__ofono_voicecall_filter_chain_cancel(chain, NULL);
 		g_free(chain);
 	}
@@ -541,6 +602,13 @@ static void voicecall_filter_chain_process(struct voicecall_filter_chain *c,
 	g_slist_free(selected);
 }
 
+const struct ofono_filter_chain_stats *
+		__ofono_voicecall_filter_chain_get_stats
+					(struct voicecall_filter_chain *c)
+{
+	return c ? &c->stats : NULL;
+}
+
 void __ofono_voicecall_filter_chain_restart(struct voicecall_filter_chain *c,
 				const struct ofono_call *call)
 {
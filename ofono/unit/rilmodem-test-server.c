@@ -43,6 +43,9 @@ struct server_data {
 	GIOChannel *server_io;
 	const struct rilmodem_test_data *rtd;
 	void *user_data;
+	gboolean echo;
+	guint echo_watch;
+	GByteArray *echo_buf;
 };
 
 /* Warning: length is stored in network order */
@@ -121,6 +124,64 @@ static gboolean read_server(gpointer data)
 	return FALSE;
 }
 
+static void echo_server_reply(struct server_data *sd, uint32_t serial)
+{
+	struct rsp_hdr rsp;
+	GIOStatus status;
+	gsize wbytes;
+
+	rsp.length = htonl(sizeof(rsp) - sizeof(rsp.length));
+	rsp.unsolicited = 0;
+	rsp.serial = serial;
+	rsp.error = 0;
+
+	status = g_io_channel_write_chars(sd->server_io, (const char *) &rsp,
+						sizeof(rsp), &wbytes, NULL);
+	g_assert(status == G_IO_STATUS_NORMAL);
+	g_assert(wbytes == sizeof(rsp));
+}
+
+static gboolean echo_server_read(GIOChannel *chan, GIOCondition cond,
+								gpointer data)
+{
+	struct server_data *sd = data;
+	gchar buf[MAX_REQUEST_SIZE];
+	GIOStatus status;
+	gsize rbytes;
+	uint32_t len;
+
+	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR)) {
+		sd->echo_watch = 0;
+		return FALSE;
+	}
+
+	status = g_io_channel_read_chars(chan, buf, sizeof(buf), &rbytes, NULL);
+	if (status != G_IO_STATUS_NORMAL || rbytes == 0) {
+		sd->echo_watch = 0;
+		return FALSE;
+	}
+
+	g_byte_array_append(sd->echo_buf, (guint8 *) buf, rbytes);
+
+	/*
+	 * header: size (uint32, network order), reqid (uint32),
+	 * serial (uint32); size excludes itself
+	 */
+	while (sd->echo_buf->len >= sizeof(uint32_t) * 3) {
+		memcpy(&len, sd->echo_buf->data, sizeof(len));
+		len = ntohl(len) + sizeof(len);
+
+		if (sd->echo_buf->len < len)
+			break;
+
+		echo_server_reply(sd, *(uint32_t *) (void *)
+				(sd->echo_buf->data + sizeof(uint32_t) * 2));
+		g_byte_array_remove_range(sd->echo_buf, 0, len);
+	}
+
+	return TRUE;
+}
+
 static gboolean on_socket_connected(GIOChannel *chan, GIOCondition cond,
 								gpointer data)
 {
@@ -147,7 +208,11 @@ static gboolean on_socket_connected(GIOChannel *chan, GIOCondition cond,
 	if (sd->connect_func)
 		sd->connect_func(sd->user_data);
 
-	if (sd->rtd->unsol_test == FALSE)
+	if (sd->echo)
+		sd->echo_watch = g_io_add_watch(sd->server_io,
+				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+				echo_server_read, sd);
+	else if (sd->rtd->unsol_test == FALSE)
 		g_idle_add(read_server, sd);
 
 	return FALSE;
@@ -157,6 +222,17 @@ void rilmodem_test_server_close(struct server_data *sd)
 {
 	g_assert(sd->server_sk);
 	close(sd->server_sk);
+
+	if (sd->echo_watch)
+		g_source_remove(sd->echo_watch);
+
+	if (sd->echo) {
+		if (sd->server_io)
+			g_io_channel_unref(sd->server_io);
+
+		g_byte_array_free(sd->echo_buf, TRUE);
+	}
+
 	g_free(sd);
 }
 
@@ -223,3 +299,16 @@ void rilmodem_test_server_write(struct server_data *sd,
 
 	g_assert(status == G_IO_STATUS_NORMAL);
 }
+
+struct server_data *rilmodem_test_server_create_echo(ConnectFunc connect,
+								void *data)
+{
+	static const struct rilmodem_test_data echo_data;
+	struct server_data *sd;
+
+	sd = rilmodem_test_server_create(connect, &echo_data, data);
+	sd->echo = TRUE;
+	sd->echo_buf = g_byte_array_new();
+
+	return sd;
+}
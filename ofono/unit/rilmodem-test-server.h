@@ -42,6 +42,13 @@ struct server_data *rilmodem_test_server_create(ConnectFunc connect,
 				const struct rilmodem_test_data *test_data,
 				void *data);
 
+/*
+ * The echo server replies to every request it receives with an empty
+ * successful response, in the order the requests arrive.
+ */
+struct server_data *rilmodem_test_server_create_echo(ConnectFunc connect,
+								void *data);
+
 void rilmodem_test_server_write(struct server_data *sd,
 						const unsigned char *buf,
 						const size_t buf_len);
@@ -187,6 +187,74 @@ static void test_register()
 	ofono_dbus_access_plugin_unregister(&access_dontcare);
 }
 
+static int count_calls;
+
+static enum ofono_dbus_access count_method_access(const char *sender,
+	enum ofono_dbus_access_intf intf, int method, const char *arg)
+{
+	count_calls++;
+	return g_strcmp0(arg, "Powered") ? OFONO_DBUS_ACCESS_ALLOW :
+		OFONO_DBUS_ACCESS_DENY;
+}
+
+struct ofono_dbus_access_plugin access_count = {
+	.name = "Count",
+	.priority = OFONO_DBUS_ACCESS_PRIORITY_DEFAULT,
+	.method_access = count_method_access
+};
+
+static void test_cache()
+{
+	const struct ofono_dbus_access_cache_stats *stats =
+		__ofono_dbus_access_cache_stats();
+	const enum ofono_dbus_access_intf intf = OFONO_DBUS_ACCESS_INTF_MODEM;
+	const int method = OFONO_DBUS_ACCESS_MODEM_SET_PROPERTY;
+	unsigned int hits, misses;
+	int i;
+
+	count_calls = 0;
+	g_assert(!ofono_dbus_access_plugin_register(&access_count));
+	hits = stats->hits;
+	misses = stats->misses;
+
+	/* Plugin is asked once per sender and method, always with an arg */
+	for (i = 0; i < 10; i++) {
+		g_assert(ofono_dbus_access_method_allowed(":1.0", intf,
+							method, "Online"));
+		g_assert(!ofono_dbus_access_method_allowed(":1.0", intf,
+							method, "Powered"));
+		g_assert(ofono_dbus_access_method_allowed(":1.1", intf,
+							method, "Online"));
+		g_assert(ofono_dbus_access_method_allowed(":1.1", intf,
+							method, NULL));
+	}
+	g_assert_cmpint(count_calls, == ,31);
+	g_assert_cmpuint(stats->misses - misses, == ,1);
+	g_assert_cmpuint(stats->hits - hits, == ,9);
+
+	/* Anonymous callers are never cached */
+	g_assert(ofono_dbus_access_method_allowed(NULL, intf, method, NULL));
+	g_assert(ofono_dbus_access_method_allowed(NULL, intf, method, NULL));
+	g_assert_cmpint(count_calls, == ,33);
+
+	/* Policy change forgets everything */
+	ofono_dbus_access_policy_changed();
+	g_assert(ofono_dbus_access_method_allowed(":1.1", intf,
+							method, NULL));
+	g_assert_cmpint(count_calls, == ,34);
+
+	/* And so does another plugin coming or going */
+	g_assert(!ofono_dbus_access_plugin_register(&access_deny));
+	g_assert(ofono_dbus_access_method_allowed(":1.1", intf,
+							method, NULL));
+	g_assert_cmpint(count_calls, == ,35);
+	ofono_dbus_access_plugin_unregister(&access_deny);
+	ofono_dbus_access_plugin_unregister(&access_count);
+
+	g_test_message("%u hits, %u misses", stats->hits, stats->misses);
+	__ofono_dbus_access_cleanup();
+}
+
 #define TEST_(test) "/dbus-access/" test
 
 int main(int argc, char *argv[])
@@ -208,6 +276,7 @@ int main(int argc, char *argv[])
 		g_free(name);
 	}
 	g_test_add_func(TEST_("register"), test_register);
+	g_test_add_func(TEST_("cache"), test_cache);
 	return g_test_run();
 }
 
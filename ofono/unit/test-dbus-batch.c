@@ -0,0 +1,410 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "test-dbus.h"
+
+#include <ofono/dbus.h>
+
+#include "ofono.h"
+
+#include <gutil_log.h>
+#include <gutil_macros.h>
+
+#include <string.h>
+
+#define TEST_TIMEOUT			(10)   /* seconds */
+#define TEST_DBUS_INTERFACE		"test.interface"
+#define TEST_DBUS_PATH			"/"
+#define TEST_FLAPS			(100)
+
+static gboolean test_debug;
+
+static gboolean test_timeout(gpointer param)
+{
+	g_assert(!"TIMEOUT");
+	return G_SOURCE_REMOVE;
+}
+
+static guint test_setup_timeout(void)
+{
+	if (test_debug) {
+		return 0;
+	} else {
+		return g_timeout_add_seconds(TEST_TIMEOUT, test_timeout, NULL);
+	}
+}
+
+static const GDBusSignalTable test_signals[] = {
+	{ GDBUS_SIGNAL("PropertyChanged",
+			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ GDBUS_SIGNAL("Done", NULL) },
+	{ }
+};
+
+struct test_batch_data {
+	struct test_dbus_context dbus;
+	enum ofono_dbus_signal_batch_mode mode;
+	struct ofono_dbus_signal_batch_stats stats;
+};
+
+static const char *test_status[] = {
+	"searching", "registered", "unregistered", "roaming"
+};
+
+static gboolean test_batch_done(gpointer data)
+{
+	struct test_batch_data *test = data;
+
+	/* The batch went out before us, being queued first */
+	test->stats = *__ofono_dbus_signal_batch_get_stats();
+	g_dbus_emit_signal(ofono_dbus_get_connection(), TEST_DBUS_PATH,
+				TEST_DBUS_INTERFACE, "Done", DBUS_TYPE_INVALID);
+	return G_SOURCE_REMOVE;
+}
+
+static void test_batch_handle_signal(struct test_dbus_context *dbus,
+							DBusMessage *msg)
+{
+	if (dbus_message_is_signal(msg, TEST_DBUS_INTERFACE, "Done"))
+		g_main_loop_quit(dbus->loop);
+}
+
+static void test_batch_start(struct test_dbus_context *dbus)
+{
+	struct test_batch_data *test =
+		G_CAST(dbus, struct test_batch_data, dbus);
+	DBusConnection *conn = ofono_dbus_get_connection();
+	static const char *test_cells[] = { "1234", "5678", NULL };
+	const char **cells = test_cells;
+	dbus_uint16_t lac;
+	unsigned char strength;
+	const char *status;
+	int i;
+
+	g_assert(g_dbus_register_interface(conn, TEST_DBUS_PATH,
+				TEST_DBUS_INTERFACE, NULL, test_signals,
+				NULL, test, NULL));
+
+	__ofono_dbus_signal_batch_set_mode(test->mode);
+	__ofono_dbus_signal_batch_reset_stats();
+
+	/* Registration flapping at the edge of coverage */
+	for (i = 0; i < TEST_FLAPS; i++) {
+		status = test_status[i % G_N_ELEMENTS(test_status)];
+		strength = i;
+		lac = 1000 + (i & 1);
+
+		ofono_dbus_signal_property_changed(conn, TEST_DBUS_PATH,
+				TEST_DBUS_INTERFACE, "Status",
+				DBUS_TYPE_STRING, &status);
+		ofono_dbus_signal_property_changed(conn, TEST_DBUS_PATH,
+				TEST_DBUS_INTERFACE, "Strength",
+				DBUS_TYPE_BYTE, &strength);
+		ofono_dbus_signal_property_changed(conn, TEST_DBUS_PATH,
+				TEST_DBUS_INTERFACE, "LocationAreaCode",
+				DBUS_TYPE_UINT16, &lac);
+		ofono_dbus_signal_array_property_changed(conn,
+				TEST_DBUS_PATH, TEST_DBUS_INTERFACE, "Cells",
+				DBUS_TYPE_STRING, &cells);
+	}
+
+	g_idle_add(test_batch_done, test);
+}
+
+static void test_batch_check_value(DBusMessageIter *it, const char *name)
+{
+	DBusMessageIter var, array;
+
+	g_assert(dbus_message_iter_get_arg_type(it) == DBUS_TYPE_VARIANT);
+	dbus_message_iter_recurse(it, &var);
+
+	if (!g_strcmp0(name, "Status")) {
+		g_assert_cmpstr(test_dbus_get_string(&var), ==,
+			test_status[(TEST_FLAPS - 1) % G_N_ELEMENTS(test_status)]);
+	} else if (!g_strcmp0(name, "Strength")) {
+		unsigned char strength;
+
+		g_assert(dbus_message_iter_get_arg_type(&var) ==
+							DBUS_TYPE_BYTE);
+		dbus_message_iter_get_basic(&var, &strength);
+		g_assert_cmpuint(strength, ==, TEST_FLAPS - 1);
+	} else if (!g_strcmp0(name, "LocationAreaCode")) {
+		dbus_uint16_t lac;
+
+		g_assert(dbus_message_iter_get_arg_type(&var) ==
+							DBUS_TYPE_UINT16);
+		dbus_message_iter_get_basic(&var, &lac);
+		g_assert_cmpuint(lac, ==, 1000 + ((TEST_FLAPS - 1) & 1));
+	} else {
+		g_assert_cmpstr(name, ==, "Cells");
+		g_assert(dbus_message_iter_get_arg_type(&var) ==
+							DBUS_TYPE_ARRAY);
+		dbus_message_iter_recurse(&var, &array);
+		g_assert_cmpstr(test_dbus_get_string(&array), ==, "1234");
+		g_assert_cmpstr(test_dbus_get_string(&array), ==, "5678");
+		g_assert(dbus_message_iter_get_arg_type(&array) ==
+							DBUS_TYPE_INVALID);
+	}
+}
+
+static const char *test_names[] = {
+	"Status", "Strength", "LocationAreaCode", "Cells"
+};
+
+static void test_batch_check_coalesced(struct test_batch_data *test)
+{
+	DBusMessage *msg;
+	DBusMessageIter it;
+	guint i;
+
+	/* One signal per property, in the order of the first change */
+	for (i = 0; i < G_N_ELEMENTS(test_names); i++) {
+		msg = test_dbus_take_signal(&test->dbus, TEST_DBUS_PATH,
+				TEST_DBUS_INTERFACE, "PropertyChanged");
+		g_assert(msg);
+
+		dbus_message_iter_init(msg, &it);
+		g_assert_cmpstr(test_dbus_get_string(&it), ==,
+							test_names[i]);
+		test_batch_check_value(&it, test_names[i]);
+		dbus_message_unref(msg);
+	}
+
+	g_assert(!test_dbus_find_signal(&test->dbus, TEST_DBUS_PATH,
+				TEST_DBUS_INTERFACE, "PropertyChanged"));
+}
+
+static void test_batch_check_properties(struct test_batch_data *test)
+{
+	DBusMessage *msg;
+	DBusMessageIter it, dict, entry;
+	guint i;
+
+	g_assert(!test_dbus_find_signal(&test->dbus, TEST_DBUS_PATH,
+				TEST_DBUS_INTERFACE, "PropertyChanged"));
+
+	msg = test_dbus_take_signal(&test->dbus, TEST_DBUS_PATH,
+				DBUS_INTERFACE_PROPERTIES, "PropertiesChanged");
+	g_assert(msg);
+	g_assert_cmpstr(dbus_message_get_signature(msg), ==, "sa{sv}as");
+
+	dbus_message_iter_init(msg, &it);
+	g_assert_cmpstr(test_dbus_get_string(&it), ==, TEST_DBUS_INTERFACE);
+
+	dbus_message_iter_recurse(&it, &dict);
+	for (i = 0; i < G_N_ELEMENTS(test_names); i++) {
+		g_assert(dbus_message_iter_get_arg_type(&dict) ==
+							DBUS_TYPE_DICT_ENTRY);
+		dbus_message_iter_recurse(&dict, &entry);
+		g_assert_cmpstr(test_dbus_get_string(&entry), ==,
+							test_names[i]);
+		test_batch_check_value(&entry, test_names[i]);
+		dbus_message_iter_next(&dict);
+	}
+
+	g_assert(dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_INVALID);
+	dbus_message_unref(msg);
+
+	g_assert(!test_dbus_find_signal(&test->dbus, TEST_DBUS_PATH,
+				DBUS_INTERFACE_PROPERTIES, "PropertiesChanged"));
+}
+
+static void test_batch(gconstpointer data)
+{
+	struct test_batch_data test;
+	const guint changes = TEST_FLAPS * G_N_ELEMENTS(test_names);
+	guint timeout = test_setup_timeout();
+	DBusMessage *msg;
+	guint i;
+
+	memset(&test, 0, sizeof(test));
+	test.mode = GPOINTER_TO_INT(data);
+	test_dbus_setup(&test.dbus);
+	test.dbus.start = test_batch_start;
+	test.dbus.handle_signal = test_batch_handle_signal;
+
+	g_main_loop_run(test.dbus.loop);
+
+	switch (test.mode) {
+	case OFONO_DBUS_SIGNAL_BATCH_NONE:
+		/* Stats are only collected when batching */
+		g_assert(!test.stats.changes);
+		for (i = 0; i < changes; i++) {
+			msg = test_dbus_take_signal(&test.dbus, TEST_DBUS_PATH,
+				TEST_DBUS_INTERFACE, "PropertyChanged");
+			g_assert(msg);
+			dbus_message_unref(msg);
+		}
+		g_assert(!test_dbus_find_signal(&test.dbus, TEST_DBUS_PATH,
+				TEST_DBUS_INTERFACE, "PropertyChanged"));
+		break;
+	case OFONO_DBUS_SIGNAL_BATCH_COALESCE:
+		g_assert_cmpuint(test.stats.changes, ==, changes);
+		g_assert_cmpuint(test.stats.superseded, ==,
+					changes - G_N_ELEMENTS(test_names));
+		g_assert_cmpuint(test.stats.signals, ==,
+					G_N_ELEMENTS(test_names));
+		test_batch_check_coalesced(&test);
+		break;
+	case OFONO_DBUS_SIGNAL_BATCH_PROPERTIES:
+		g_assert_cmpuint(test.stats.changes, ==, changes);
+		g_assert_cmpuint(test.stats.superseded, ==,
+					changes - G_N_ELEMENTS(test_names));
+		g_assert_cmpuint(test.stats.signals, ==, 1);
+		test_batch_check_properties(&test);
+		break;
+	}
+
+	if (test.stats.changes)
+		g_test_message("%u changes, %u signals sent, %u saved",
+				test.stats.changes, test.stats.signals,
+				test.stats.changes - test.stats.signals);
+
+	/* Leaves the batching mode too */
+	test_dbus_shutdown(&test.dbus);
+	g_assert(__ofono_dbus_signal_batch_get_mode() ==
+						OFONO_DBUS_SIGNAL_BATCH_NONE);
+
+	if (timeout) {
+		g_source_remove(timeout);
+	}
+}
+
+/* ==== order ==== */
+
+#define TEST_DBUS_PATH_GONE		"/gone"
+
+static void test_order_start(struct test_dbus_context *dbus)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	const char *status = "registered";
+
+	g_assert(g_dbus_register_interface(conn, TEST_DBUS_PATH,
+				TEST_DBUS_INTERFACE, NULL, test_signals,
+				NULL, NULL, NULL));
+	g_assert(g_dbus_register_interface(conn, TEST_DBUS_PATH_GONE,
+				TEST_DBUS_INTERFACE, NULL, test_signals,
+				NULL, NULL, NULL));
+
+	__ofono_dbus_signal_batch_set_mode(OFONO_DBUS_SIGNAL_BATCH_COALESCE);
+
+	/* Goes out before the interface does */
+	ofono_dbus_signal_property_changed(conn, TEST_DBUS_PATH_GONE,
+				TEST_DBUS_INTERFACE, "Status",
+				DBUS_TYPE_STRING, &status);
+	g_assert(g_dbus_unregister_interface(conn, TEST_DBUS_PATH_GONE,
+				TEST_DBUS_INTERFACE));
+
+	/* Isn't overtaken by a signal sent right away */
+	ofono_dbus_signal_property_changed(conn, TEST_DBUS_PATH,
+				TEST_DBUS_INTERFACE, "Status",
+				DBUS_TYPE_STRING, &status);
+	g_dbus_emit_signal(conn, TEST_DBUS_PATH, TEST_DBUS_INTERFACE,
+				"Done", DBUS_TYPE_INVALID);
+}
+
+static void test_order(void)
+{
+	struct test_dbus_context dbus;
+	guint timeout = test_setup_timeout();
+	DBusMessage *msg;
+
+	memset(&dbus, 0, sizeof(dbus));
+	test_dbus_setup(&dbus);
+	dbus.start = test_order_start;
+	dbus.handle_signal = test_batch_handle_signal;
+
+	g_main_loop_run(dbus.loop);
+
+	g_assert_cmpuint(g_slist_length(dbus.client_signals), == ,3);
+	msg = dbus.client_signals->data;
+	g_assert_cmpstr(dbus_message_get_path(msg), == ,TEST_DBUS_PATH_GONE);
+	g_assert(dbus_message_is_signal(msg, TEST_DBUS_INTERFACE,
+						"PropertyChanged"));
+	msg = dbus.client_signals->next->data;
+	g_assert_cmpstr(dbus_message_get_path(msg), == ,TEST_DBUS_PATH);
+	g_assert(dbus_message_is_signal(msg, TEST_DBUS_INTERFACE,
+						"PropertyChanged"));
+	msg = dbus.client_signals->next->next->data;
+	g_assert(dbus_message_is_signal(msg, TEST_DBUS_INTERFACE, "Done"));
+
+	test_dbus_shutdown(&dbus);
+	if (timeout) {
+		g_source_remove(timeout);
+	}
+}
+
+/* ==== flush ==== */
+
+static void test_flush(void)
+{
+	const struct ofono_dbus_signal_batch_stats *stats =
+		__ofono_dbus_signal_batch_get_stats();
+
+	/* Nothing to flush, nothing happens */
+	__ofono_dbus_signal_batch_set_mode(OFONO_DBUS_SIGNAL_BATCH_COALESCE);
+	__ofono_dbus_signal_batch_reset_stats();
+	__ofono_dbus_signal_batch_flush();
+	g_assert(!stats->changes);
+	g_assert(!stats->signals);
+	__ofono_dbus_signal_batch_set_mode(OFONO_DBUS_SIGNAL_BATCH_NONE);
+	__ofono_dbus_cleanup();
+}
+
+#define TEST_(name) "/dbus-batch/" name
+
+int main(int argc, char *argv[])
+{
+	int i;
+
+	g_test_init(&argc, &argv, NULL);
+	for (i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		if (!strcmp(arg, "-d") || !strcmp(arg, "--debug")) {
+			test_debug = TRUE;
+		} else {
+			GWARN("Unsupported command line option %s", arg);
+		}
+	}
+
+	gutil_log_timestamp = FALSE;
+	gutil_log_default.level = g_test_verbose() ?
+		GLOG_LEVEL_VERBOSE : GLOG_LEVEL_NONE;
+	__ofono_log_init("test-dbus-batch",
+				g_test_verbose() ? "*" : NULL,
+				FALSE, FALSE);
+
+	g_test_add_func(TEST_("flush"), test_flush);
+	g_test_add_data_func(TEST_("none"),
+			GINT_TO_POINTER(OFONO_DBUS_SIGNAL_BATCH_NONE),
+			test_batch);
+	g_test_add_data_func(TEST_("coalesce"),
+			GINT_TO_POINTER(OFONO_DBUS_SIGNAL_BATCH_COALESCE),
+			test_batch);
+	g_test_add_data_func(TEST_("properties"),
+			GINT_TO_POINTER(OFONO_DBUS_SIGNAL_BATCH_PROPERTIES),
+			test_batch);
+	g_test_add_func(TEST_("order"), test_order);
+
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
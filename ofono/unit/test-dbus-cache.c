@@ -0,0 +1,410 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "test-dbus.h"
+
+#include <ofono/dbus.h>
+
+#include "ofono.h"
+
+#include <gutil_log.h>
+#include <gutil_macros.h>
+
+#include <string.h>
+
+#define TEST_TIMEOUT			(10)   /* seconds */
+#define TEST_DBUS_INTERFACE		"test.interface"
+#define TEST_DBUS_PATH			"/"
+#define TEST_CALLS			(1000)
+#define TEST_NUMBERS			(8)
+
+static gboolean test_debug;
+
+static gboolean test_timeout(gpointer param)
+{
+	g_assert(!"TIMEOUT");
+	return G_SOURCE_REMOVE;
+}
+
+static guint test_setup_timeout(void)
+{
+	if (test_debug) {
+		return 0;
+	} else {
+		return g_timeout_add_seconds(TEST_TIMEOUT, test_timeout, NULL);
+	}
+}
+
+struct test_cache_data {
+	struct test_dbus_context dbus;
+	gboolean cached;
+	guint built;
+	guint replies;
+	guint calls;
+	const char *status;
+	void (*done)(struct test_cache_data *test);
+};
+
+static DBusMessage *test_get_properties(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct test_cache_data *test = data;
+	DBusMessage *reply;
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+	char *numbers[TEST_NUMBERS + 1];
+	char **list = numbers;
+	dbus_bool_t present = TRUE;
+	unsigned char strength = 42;
+	int i;
+
+	if (test->cached) {
+		reply = __ofono_dbus_cached_reply(msg);
+		if (reply)
+			return reply;
+	}
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	test->built++;
+
+	/* Roughly what SimManager and NetworkRegistration report */
+	for (i = 0; i < TEST_NUMBERS; i++)
+		numbers[i] = g_strdup_printf("+3584012345%02d", i);
+
+	numbers[i] = NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+	ofono_dbus_dict_append(&dict, "Status", DBUS_TYPE_STRING,
+							&test->status);
+	ofono_dbus_dict_append(&dict, "Present", DBUS_TYPE_BOOLEAN, &present);
+	ofono_dbus_dict_append(&dict, "Strength", DBUS_TYPE_BYTE, &strength);
+	ofono_dbus_dict_append_array(&dict, "SubscriberNumbers",
+					DBUS_TYPE_STRING, &list);
+	dbus_message_iter_close_container(&iter, &dict);
+
+	for (i = 0; i < TEST_NUMBERS; i++)
+		g_free(numbers[i]);
+
+	if (test->cached)
+		__ofono_dbus_cache_reply(msg, reply);
+
+	return reply;
+}
+
+static const GDBusMethodTable test_methods[] = {
+	{ GDBUS_METHOD("GetProperties",
+			NULL, GDBUS_ARGS({ "properties", "a{sv}" }),
+			test_get_properties) },
+	{ }
+};
+
+static const GDBusSignalTable test_signals[] = {
+	{ GDBUS_SIGNAL("PropertyChanged",
+			GDBUS_ARGS({ "name", "s" }, { "value", "v" })) },
+	{ }
+};
+
+static const char *test_reply_status(DBusMessage *reply)
+{
+	DBusMessageIter it, dict, entry, var;
+
+	g_assert(dbus_message_get_type(reply) ==
+					DBUS_MESSAGE_TYPE_METHOD_RETURN);
+	g_assert_cmpstr(dbus_message_get_signature(reply), ==, "a{sv}");
+
+	dbus_message_iter_init(reply, &it);
+	dbus_message_iter_recurse(&it, &dict);
+	dbus_message_iter_recurse(&dict, &entry);
+	g_assert_cmpstr(test_dbus_get_string(&entry), ==, "Status");
+	dbus_message_iter_recurse(&entry, &var);
+	return test_dbus_get_string(&var);
+}
+
+static void test_cache_reply(DBusPendingCall *call, void *data)
+{
+	struct test_cache_data *test = data;
+	DBusMessage *reply = dbus_pending_call_steal_reply(call);
+
+	g_assert_cmpstr(test_reply_status(reply), ==, test->status);
+	dbus_message_unref(reply);
+	dbus_pending_call_unref(call);
+
+	if (++test->replies == test->calls)
+		test->done(test);
+}
+
+static void test_cache_call(struct test_cache_data *test, guint count)
+{
+	DBusConnection *conn = test->dbus.client_connection;
+	guint i;
+
+	test->calls = count;
+	test->replies = 0;
+
+	for (i = 0; i < count; i++) {
+		DBusPendingCall *call;
+		DBusMessage *msg;
+
+		msg = dbus_message_new_method_call(NULL, TEST_DBUS_PATH,
+					TEST_DBUS_INTERFACE, "GetProperties");
+		g_assert(dbus_connection_send_with_reply(conn, msg, &call,
+						DBUS_TIMEOUT_INFINITE));
+		dbus_pending_call_set_notify(call, test_cache_reply, test,
+									NULL);
+		dbus_message_unref(msg);
+	}
+}
+
+static void test_cache_register(struct test_cache_data *test)
+{
+	g_assert(g_dbus_register_interface(ofono_dbus_get_connection(),
+				TEST_DBUS_PATH, TEST_DBUS_INTERFACE,
+				test_methods, test_signals, NULL, test, NULL));
+}
+
+/* ==== bench ==== */
+
+static void test_bench_done(struct test_cache_data *test)
+{
+	g_main_loop_quit(test->dbus.loop);
+}
+
+static void test_bench_start(struct test_dbus_context *dbus)
+{
+	struct test_cache_data *test =
+		G_CAST(dbus, struct test_cache_data, dbus);
+
+	test_cache_register(test);
+	test->done = test_bench_done;
+	g_test_timer_start();
+	test_cache_call(test, TEST_CALLS);
+}
+
+static void test_bench(gconstpointer data)
+{
+	struct test_cache_data test;
+	guint timeout = test_setup_timeout();
+	gdouble elapsed;
+
+	memset(&test, 0, sizeof(test));
+	test.cached = GPOINTER_TO_INT(data);
+	test.status = "registered";
+	test_dbus_setup(&test.dbus);
+	test.dbus.start = test_bench_start;
+
+	g_main_loop_run(test.dbus.loop);
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpuint(test.replies, ==, TEST_CALLS);
+	g_assert_cmpuint(test.built, ==, test.cached ? 1 : TEST_CALLS);
+	g_test_message("%s: %u GetProperties calls in %.3f sec",
+				test.cached ? "cached" : "uncached",
+				TEST_CALLS, elapsed);
+
+	test_dbus_shutdown(&test.dbus);
+	if (timeout) {
+		g_source_remove(timeout);
+	}
+}
+
+/* ==== invalidate ==== */
+
+static void test_invalidate_changed(struct test_cache_data *test)
+{
+	g_assert_cmpuint(test->built, ==, 2);
+	g_main_loop_quit(test->dbus.loop);
+}
+
+static void test_invalidate_cached(struct test_cache_data *test)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+
+	/* Both calls were answered from the same reply */
+	g_assert_cmpuint(test->built, ==, 1);
+
+	test->status = "roaming";
+	ofono_dbus_signal_property_changed(conn, TEST_DBUS_PATH,
+				TEST_DBUS_INTERFACE, "Status",
+				DBUS_TYPE_STRING, &test->status);
+
+	test->done = test_invalidate_changed;
+	test_cache_call(test, 1);
+}
+
+static void test_invalidate_start(struct test_dbus_context *dbus)
+{
+	struct test_cache_data *test =
+		G_CAST(dbus, struct test_cache_data, dbus);
+
+	test_cache_register(test);
+	test->done = test_invalidate_cached;
+	test_cache_call(test, 2);
+}
+
+static void test_invalidate(void)
+{
+	struct test_cache_data test;
+	guint timeout = test_setup_timeout();
+
+	memset(&test, 0, sizeof(test));
+	test.cached = TRUE;
+	test.status = "registered";
+	test_dbus_setup(&test.dbus);
+	test.dbus.start = test_invalidate_start;
+
+	g_main_loop_run(test.dbus.loop);
+
+	test_dbus_shutdown(&test.dbus);
+	if (timeout) {
+		g_source_remove(timeout);
+	}
+}
+
+/* ==== silent ==== */
+
+/* Changes the state without PropertyChanged, like SystemPath does */
+static void test_silent_set(struct test_cache_data *test, const char *status)
+{
+	test->status = status;
+	__ofono_dbus_invalidate_reply(TEST_DBUS_PATH, TEST_DBUS_INTERFACE);
+}
+
+static void test_silent_get(struct test_cache_data *test, DBusMessage *msg,
+							guint built)
+{
+	DBusMessage *reply = test_get_properties(NULL, msg, test);
+
+	g_assert_cmpstr(test_reply_status(reply), ==, test->status);
+	g_assert_cmpuint(test->built, ==, built);
+	dbus_message_unref(reply);
+}
+
+static void test_silent(void)
+{
+	struct test_cache_data test;
+	DBusMessage *msg = dbus_message_new_method_call(NULL, TEST_DBUS_PATH,
+				TEST_DBUS_INTERFACE, "GetProperties");
+
+	memset(&test, 0, sizeof(test));
+	test.cached = TRUE;
+	test.status = "registered";
+	dbus_message_set_serial(msg, 1);
+
+	test_silent_get(&test, msg, 1);
+	test_silent_get(&test, msg, 1);
+
+	/* The setter drops the reply even though nothing is signalled */
+	test_silent_set(&test, "roaming");
+	test_silent_get(&test, msg, 2);
+	test_silent_get(&test, msg, 2);
+
+	/* And so does an atom going away from the path */
+	test.status = "unknown";
+	__ofono_dbus_invalidate_reply(TEST_DBUS_PATH, NULL);
+	test_silent_get(&test, msg, 3);
+
+	dbus_message_unref(msg);
+	__ofono_dbus_cleanup();
+}
+
+/* ==== path ==== */
+
+static void test_path(void)
+{
+	DBusMessage *msg = dbus_message_new_method_call(NULL, "/modem",
+				TEST_DBUS_INTERFACE, "GetProperties");
+	DBusMessage *other = dbus_message_new_method_call(NULL, "/modem2",
+				TEST_DBUS_INTERFACE, "GetProperties");
+	DBusMessage *reply;
+
+	dbus_message_set_serial(msg, 1);
+	dbus_message_set_serial(other, 2);
+	g_assert(!__ofono_dbus_cached_reply(msg));
+
+	reply = dbus_message_new_method_return(msg);
+	__ofono_dbus_cache_reply(msg, reply);
+	dbus_message_unref(reply);
+
+	reply = dbus_message_new_method_return(other);
+	__ofono_dbus_cache_reply(other, reply);
+	dbus_message_unref(reply);
+
+	reply = __ofono_dbus_cached_reply(other);
+	g_assert(reply);
+	g_assert_cmpuint(dbus_message_get_reply_serial(reply), ==, 2);
+	dbus_message_unref(reply);
+
+	/* "/modem" doesn't cover "/modem2" */
+	__ofono_dbus_invalidate_reply("/modem", NULL);
+	g_assert(!__ofono_dbus_cached_reply(msg));
+	reply = __ofono_dbus_cached_reply(other);
+	g_assert(reply);
+	dbus_message_unref(reply);
+
+	__ofono_dbus_invalidate_reply("/modem2", TEST_DBUS_INTERFACE);
+	g_assert(!__ofono_dbus_cached_reply(other));
+
+	dbus_message_unref(msg);
+	dbus_message_unref(other);
+	__ofono_dbus_cleanup();
+}
+
+#define TEST_(name) "/dbus-cache/" name
+
+int main(int argc, char *argv[])
+{
+	int i;
+
+	g_test_init(&argc, &argv, NULL);
+	for (i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		if (!strcmp(arg, "-d") || !strcmp(arg, "--debug")) {
+			test_debug = TRUE;
+		} else {
+			GWARN("Unsupported command line option %s", arg);
+		}
+	}
+
+	gutil_log_timestamp = FALSE;
+	gutil_log_default.level = g_test_verbose() ?
+		GLOG_LEVEL_VERBOSE : GLOG_LEVEL_NONE;
+	__ofono_log_init("test-dbus-cache",
+				g_test_verbose() ? "*" : NULL,
+				FALSE, FALSE);
+
+	g_test_add_func(TEST_("path"), test_path);
+	g_test_add_func(TEST_("silent"), test_silent);
+	g_test_add_func(TEST_("invalidate"), test_invalidate);
+	g_test_add_data_func(TEST_("bench/uncached"), GINT_TO_POINTER(FALSE),
+								test_bench);
+	g_test_add_data_func(TEST_("bench/cached"), GINT_TO_POINTER(TRUE),
+								test_bench);
+
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -241,6 +241,90 @@ static void test_signal(void)
 	}
 }
 
+/* ==== cost ==== */
+
+#define TEST_COST_CHANGES       (100)
+
+struct test_cost_data {
+	struct test_dbus_context dbus;
+	struct ofono_dbus_clients *clients;
+	int subscribers;
+	int expected;
+	int count;
+};
+
+static void test_cost_handle(struct test_dbus_context *dbus, DBusMessage *msg)
+{
+	struct test_cost_data *test =
+		G_CAST(dbus, struct test_cost_data, dbus);
+
+	g_assert_cmpstr(dbus_message_get_member(msg), == ,
+						TEST_PROPERTY_CHANGED_SIGNAL);
+	g_assert(dbus_message_get_destination(msg));
+	test->count++;
+	if (test->count == test->expected) {
+		test_loop_quit_later(dbus->loop);
+	}
+}
+
+static void test_cost_start(struct test_dbus_context *dbus)
+{
+	struct test_cost_data *test =
+		G_CAST(dbus, struct test_cost_data, dbus);
+	int i;
+
+	test_register_dummy_interface();
+	test->clients = ofono_dbus_clients_new(ofono_dbus_get_connection(),
+								NULL, NULL);
+	for (i = 0; i < test->subscribers; i++) {
+		char *name = g_strdup_printf(":1.%d", i);
+
+		g_assert(ofono_dbus_clients_add(test->clients, name));
+		g_free(name);
+	}
+
+	g_test_timer_start();
+	for (i = 0; i < TEST_COST_CHANGES; i++) {
+		const char *value = TEST_PROPERTY_VALUE;
+		DBusMessage *signal =
+			ofono_dbus_signal_new_property_changed(TEST_DBUS_PATH,
+				TEST_DBUS_INTERFACE, TEST_PROPERTY_NAME,
+				DBUS_TYPE_STRING, &value);
+
+		ofono_dbus_clients_signal(test->clients, signal);
+		dbus_message_unref(signal);
+	}
+}
+
+static void test_cost(gconstpointer data)
+{
+	struct test_cost_data test;
+	guint timeout = test_setup_timeout();
+	gdouble elapsed;
+
+	memset(&test, 0, sizeof(test));
+	test.subscribers = GPOINTER_TO_INT(data);
+	test.expected = TEST_COST_CHANGES * test.subscribers;
+	test_dbus_setup(&test.dbus);
+	test.dbus.start = test_cost_start;
+	test.dbus.handle_signal = test_cost_handle;
+
+	g_main_loop_run(test.dbus.loop);
+	elapsed = g_test_timer_elapsed();
+
+	/* Exactly one copy per subscriber */
+	g_assert_cmpint(test.count, == ,test.expected);
+	g_test_message("%d subscriber(s): %.1f us per change",
+			test.subscribers, elapsed * 1000000 / TEST_COST_CHANGES);
+
+	test_dbus_watch_disconnect_all();
+	ofono_dbus_clients_free(test.clients);
+	test_dbus_shutdown(&test.dbus);
+	if (timeout) {
+		g_source_remove(timeout);
+	}
+}
+
 #define TEST_(name) "/dbus-clients/" name
 
 int main(int argc, char *argv[])
@@ -267,6 +351,9 @@ int main(int argc, char *argv[])
 	g_test_add_func(TEST_("null"), test_null);
 	g_test_add_func(TEST_("basic"), test_basic);
 	g_test_add_func(TEST_("signal"), test_signal);
+	g_test_add_data_func(TEST_("cost/1"), GINT_TO_POINTER(1), test_cost);
+	g_test_add_data_func(TEST_("cost/10"), GINT_TO_POINTER(10), test_cost);
+	g_test_add_data_func(TEST_("cost/50"), GINT_TO_POINTER(50), test_cost);
 
 	return g_test_run();
 }
@@ -0,0 +1,379 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <glib.h>
+
+#include "modem.h"
+#include "common.h"
+
+#define TEST_RESOURCES		4
+#define TEST_REQ_ID		0x10
+#define TEST_RESP_ID		0x11
+#define TEST_IND_ID		0x20
+#define TEST_TIMEOUT_SEC	30
+
+struct test_peer {
+	int fd;
+	guint count;
+	GThread *thread;
+};
+
+struct test_load {
+	GMainLoop *loop;
+	guint count;
+	guint received;
+	gint64 start;
+	gint64 end;
+};
+
+struct test_req {
+	struct test_load *load;
+	uint8_t resource;
+	uint8_t utid;
+	gboolean done;
+};
+
+static gboolean test_timeout(gpointer data)
+{
+	g_assert(FALSE);
+	return G_SOURCE_REMOVE;
+}
+
+static ssize_t test_peer_recv(int fd, struct sockaddr_pn *addr,
+				uint8_t *buf, size_t len, int flags)
+{
+	struct iovec iov[2] = {
+		{ .iov_base = addr, .iov_len = sizeof(*addr) },
+		{ .iov_base = buf, .iov_len = len },
+	};
+	struct msghdr msg = {
+		.msg_iov = iov,
+		.msg_iovlen = 2,
+	};
+	ssize_t ret = recvmsg(fd, &msg, flags);
+
+	if (ret < 0)
+		return ret;
+
+	g_assert(ret >= (ssize_t) sizeof(*addr));
+	return ret - sizeof(*addr);
+}
+
+static void test_peer_send(int fd, uint8_t resource, const uint8_t *buf,
+								size_t len)
+{
+	struct sockaddr_pn addr = {
+		.spn_family = AF_PHONET,
+		.spn_resource = resource,
+	};
+	struct iovec iov[2] = {
+		{ .iov_base = &addr, .iov_len = sizeof(addr) },
+		{ .iov_base = (void *) buf, .iov_len = len },
+	};
+	struct msghdr msg = {
+		.msg_iov = iov,
+		.msg_iovlen = 2,
+	};
+
+	g_assert(sendmsg(fd, &msg, 0) == (ssize_t) (sizeof(addr) + len));
+}
+
+/*
+ * The fake modem runs in its own thread, because the PhoNet requests
+ * are written to a blocking socket.  It collects all the requests and
+ * answers them in reverse order.
+ */
+static gpointer test_peer_thread(gpointer data)
+{
+	struct test_peer *peer = data;
+	struct sockaddr_pn *addrs = g_new(struct sockaddr_pn, peer->count);
+	uint8_t *utids = g_new(uint8_t, peer->count);
+	guint i;
+
+	for (i = 0; i < peer->count; i++) {
+		uint8_t buf[8];
+		ssize_t len;
+
+		len = test_peer_recv(peer->fd, addrs + i, buf, sizeof(buf), 0);
+		g_assert(len >= 2);
+		g_assert(buf[1] == TEST_REQ_ID);
+		utids[i] = buf[0];
+	}
+
+	while (i-- > 0) {
+		const uint8_t resp[] = { utids[i], TEST_RESP_ID, 0, 0 };
+
+		test_peer_send(peer->fd, addrs[i].spn_resource, resp,
+							sizeof(resp));
+	}
+
+	g_free(addrs);
+	g_free(utids);
+	return NULL;
+}
+
+static void test_resp_cb(const GIsiMessage *msg, void *data)
+{
+	struct test_req *req = data;
+	struct test_load *load = req->load;
+
+	g_assert(!g_isi_msg_error(msg));
+	g_assert(g_isi_msg_id(msg) == TEST_RESP_ID);
+	g_assert(g_isi_msg_utid(msg) == req->utid);
+	g_assert(g_isi_msg_resource(msg) == req->resource);
+	g_assert(!req->done);
+	req->done = TRUE;
+
+	if (!load->received++)
+		load->start = g_get_monotonic_time();
+
+	if (load->received == load->count) {
+		load->end = g_get_monotonic_time();
+		g_main_loop_quit(load->loop);
+	}
+}
+
+static void test_load(gconstpointer data)
+{
+	const guint per_resource = GPOINTER_TO_UINT(data);
+	struct test_load load;
+	struct test_peer peer;
+	struct test_req *reqs;
+	GIsiModem *modem;
+	int req_fds[2];
+	int ind_fds[2];
+	guint timeout;
+	guint i;
+
+	g_assert(!socketpair(AF_UNIX, SOCK_SEQPACKET, 0, req_fds));
+	g_assert(!socketpair(AF_UNIX, SOCK_SEQPACKET, 0, ind_fds));
+
+	memset(&load, 0, sizeof(load));
+	load.count = per_resource * TEST_RESOURCES;
+	load.loop = g_main_loop_new(NULL, FALSE);
+	reqs = g_new0(struct test_req, load.count);
+
+	modem = g_isi_modem_create_fake(req_fds[0], ind_fds[0]);
+	g_assert(modem);
+
+	peer.fd = req_fds[1];
+	peer.count = load.count;
+	peer.thread = g_thread_new("test-gisi-peer", test_peer_thread, &peer);
+
+	for (i = 0; i < load.count; i++) {
+		const uint8_t msg[] = { TEST_REQ_ID, 0 };
+		struct test_req *req = reqs + i;
+		GIsiPending *pend;
+
+		req->load = &load;
+		req->resource = 1 + i % TEST_RESOURCES;
+		pend = g_isi_request_send(modem, req->resource, msg,
+						sizeof(msg), 0, test_resp_cb,
+						req, NULL);
+		g_assert(pend);
+		req->utid = g_isi_request_utid(pend);
+	}
+
+	timeout = g_timeout_add_seconds(TEST_TIMEOUT_SEC, test_timeout, NULL);
+	g_main_loop_run(load.loop);
+	g_source_remove(timeout);
+	g_thread_join(peer.thread);
+
+	for (i = 0; i < load.count; i++)
+		g_assert(reqs[i].done);
+
+	g_test_message("%u pending requests: %.2f us per response",
+			load.count, (double) (load.end - load.start) /
+			load.count);
+
+	g_isi_modem_destroy(modem);
+	g_main_loop_unref(load.loop);
+	g_free(reqs);
+	close(req_fds[1]);
+	close(ind_fds[1]);
+}
+
+static void test_ind_cb(const GIsiMessage *msg, void *data)
+{
+	int *count = data;
+
+	g_assert(g_isi_msg_id(msg) == TEST_IND_ID);
+	(*count)++;
+}
+
+static void test_iterate(void)
+{
+	while (g_main_context_iteration(NULL, FALSE));
+}
+
+static void test_subscribe(void)
+{
+	GIsiPending *inds[TEST_RESOURCES * 2];
+	GIsiPending *extra;
+	GIsiModem *modem;
+	struct sockaddr_pn addr;
+	const uint8_t ind[] = { 0, TEST_IND_ID, 0, 0 };
+	uint8_t buf[64];
+	int req_fds[2];
+	int ind_fds[2];
+	int count = 0;
+	ssize_t len;
+	guint i;
+
+	g_assert(!socketpair(AF_UNIX, SOCK_SEQPACKET, 0, req_fds));
+	g_assert(!socketpair(AF_UNIX, SOCK_SEQPACKET, 0, ind_fds));
+
+	modem = g_isi_modem_create_fake(req_fds[0], ind_fds[0]);
+	g_assert(modem);
+
+	/* Subscriptions made in one iteration are reported at once */
+	for (i = 0; i < G_N_ELEMENTS(inds); i++) {
+		inds[i] = g_isi_ind_subscribe(modem, 1 + i % TEST_RESOURCES,
+					TEST_IND_ID, test_ind_cb, &count,
+					NULL);
+		g_assert(inds[i]);
+	}
+
+	test_iterate();
+
+	len = test_peer_recv(ind_fds[1], &addr, buf, sizeof(buf),
+							MSG_DONTWAIT);
+	g_assert(len == 4 + TEST_RESOURCES * 4);
+	g_assert(addr.spn_resource == PN_COMMGR);
+	g_assert(buf[1] == PNS_SUBSCRIBED_RESOURCES_EXTEND_IND);
+	g_assert(buf[2] == TEST_RESOURCES);
+
+	for (i = 0; i < TEST_RESOURCES; i++)
+		g_assert(buf[4 + i * 4 + 3] == 1 + i);
+
+	g_assert(test_peer_recv(ind_fds[1], &addr, buf, sizeof(buf),
+						MSG_DONTWAIT) < 0);
+
+	/* Indications are dispatched to all subscribers of the resource */
+	test_peer_send(ind_fds[1], 1, ind, sizeof(ind));
+	test_iterate();
+	g_assert(count == 2);
+
+	/* Subscribing and unsubscribing in one go sends nothing */
+	extra = g_isi_ind_subscribe(modem, TEST_RESOURCES + 1, TEST_IND_ID,
+						test_ind_cb, &count, NULL);
+	g_assert(extra);
+	g_isi_pending_remove(extra);
+	test_iterate();
+	g_assert(test_peer_recv(ind_fds[1], &addr, buf, sizeof(buf),
+						MSG_DONTWAIT) < 0);
+
+	/* Nothing changes while another subscriber remains */
+	g_isi_pending_remove(inds[0]);
+	test_iterate();
+	g_assert(test_peer_recv(ind_fds[1], &addr, buf, sizeof(buf),
+						MSG_DONTWAIT) < 0);
+
+	g_isi_pending_remove(inds[TEST_RESOURCES]);
+	test_iterate();
+	len = test_peer_recv(ind_fds[1], &addr, buf, sizeof(buf),
+							MSG_DONTWAIT);
+	g_assert(len == 4 + (TEST_RESOURCES - 1) * 4);
+	g_assert(buf[2] == TEST_RESOURCES - 1);
+	g_assert(buf[4 + 3] == 2);
+
+	/* Destroying the modem unsubscribes everything */
+	g_isi_modem_destroy(modem);
+	len = test_peer_recv(ind_fds[1], &addr, buf, sizeof(buf),
+							MSG_DONTWAIT);
+	g_assert(len == 4);
+	g_assert(buf[2] == 0);
+
+	close(req_fds[1]);
+	close(ind_fds[1]);
+}
+
+static void test_remove_resp(const GIsiMessage *msg, void *data)
+{
+	int *errors = data;
+
+	g_assert(g_isi_msg_error(msg) == -ESHUTDOWN);
+	(*errors)++;
+}
+
+static void test_owner(void)
+{
+	static const uint8_t msg[] = { TEST_REQ_ID, 0 };
+	GIsiModem *modem;
+	GIsiPending *pend;
+	uint8_t buf[8];
+	struct sockaddr_pn addr;
+	int req_fds[2];
+	int ind_fds[2];
+	int errors = 0;
+	int owner;
+	int i;
+
+	g_assert(!socketpair(AF_UNIX, SOCK_SEQPACKET, 0, req_fds));
+	g_assert(!socketpair(AF_UNIX, SOCK_SEQPACKET, 0, ind_fds));
+
+	modem = g_isi_modem_create_fake(req_fds[0], ind_fds[0]);
+	g_assert(modem);
+
+	for (i = 0; i < 5; i++) {
+		pend = g_isi_request_send(modem, 1, msg, sizeof(msg), 0,
+					test_remove_resp, &errors, NULL);
+		g_assert(pend);
+		g_isi_pending_set_owner(pend, &owner);
+		g_assert(test_peer_recv(req_fds[1], &addr, buf,
+					sizeof(buf), 0) == sizeof(msg) + 1);
+	}
+
+	g_isi_remove_pending_by_owner(modem, 1, &owner);
+	g_assert(errors == 5);
+
+	g_isi_modem_destroy(modem);
+	close(req_fds[1]);
+	close(ind_fds[1]);
+}
+
+#define TEST_(name) "/gisi/" name
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func(TEST_("subscribe"), test_subscribe);
+	g_test_add_func(TEST_("owner"), test_owner);
+	g_test_add_data_func(TEST_("load/10"), GUINT_TO_POINTER(10),
+								test_load);
+	g_test_add_data_func(TEST_("load/100"), GUINT_TO_POINTER(100),
+								test_load);
+	g_test_add_data_func(TEST_("load/250"), GUINT_TO_POINTER(250),
+								test_load);
+
+	return g_test_run();
+}
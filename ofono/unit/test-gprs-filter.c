@@ -24,6 +24,7 @@
 
 static gboolean test_debug = FALSE;
 static GMainLoop *test_loop = NULL;
+static gboolean test_done = FALSE;
 static int test_filter_cancel_count;
 static int test_filter_activate_count;
 static int test_filter_check_count;
@@ -53,6 +54,20 @@ struct ofono_gprs {
 
 /* Code shared by all tests */
 
+static void test_quit(void)
+{
+	test_done = TRUE;
+	g_main_loop_quit(test_loop);
+}
+
+static void test_run(void)
+{
+	/* Synchronous filters may have completed the request already */
+	if (!test_done) {
+		g_main_loop_run(test_loop);
+	}
+}
+
 static gboolean test_timeout_cb(gpointer user_data)
 {
 	g_assert(FALSE);
@@ -61,7 +76,7 @@ static gboolean test_timeout_cb(gpointer user_data)
 
 static gboolean test_quit_cb(gpointer user_data)
 {
-	g_main_loop_quit(test_loop);
+	test_quit();
 	return G_SOURCE_REMOVE;
 }
 
@@ -82,7 +97,7 @@ static void test_activate_expect_allow_and_quit
 {
 	g_assert(ctx);
 	if (data) (*(int*)data)++;
-	g_main_loop_quit(test_loop);
+	test_quit();
 }
 
 static void test_activate_expect_disallow
@@ -97,7 +112,7 @@ static void test_activate_expect_disallow_and_quit
 {
 	g_assert(!ctx);
 	if (data) (*(int*)data)++;
-	g_main_loop_quit(test_loop);
+	test_quit();
 }
 
 static void test_check_expect_allow(ofono_bool_t allow, void *data)
@@ -110,14 +125,14 @@ static void test_check_expect_allow_and_quit(ofono_bool_t allow, void *data)
 {
 	g_assert(allow);
 	if (data) (*(int*)data)++;
-	g_main_loop_quit(test_loop);
+	test_quit();
 }
 
 static void test_check_expect_disallow_and_quit(ofono_bool_t allow, void *data)
 {
 	g_assert(!allow);
 	if (data) (*(int*)data)++;
-	g_main_loop_quit(test_loop);
+	test_quit();
 }
 
 static void test_clear_counts()
@@ -131,6 +146,7 @@ static void test_common_init()
 {
 	test_clear_counts();
 	test_loop = g_main_loop_new(NULL, FALSE);
+	test_done = FALSE;
 	if (!test_debug) {
 		g_timeout_add_seconds(TEST_TIMEOUT_SEC, test_timeout_cb, NULL);
 	}
@@ -328,7 +344,7 @@ static void test_activate_allow_cb(const struct ofono_gprs_primary_context *ctx,
 
 	g_assert(ctx);
 	g_assert(!memcmp(ctx, &gc->ctx, sizeof(*ctx)));
-	g_main_loop_quit(test_loop);
+	test_quit();
 }
 
 static void test_activate_allow(void)
@@ -369,7 +385,7 @@ static void test_activate_allow(void)
 	/* Completion callback will terminate the loop */
 	__ofono_gprs_filter_chain_activate(gprs.chain, &gc, ctx,
 					test_activate_allow_cb, NULL, &gc);
-	g_main_loop_run(test_loop);
+	test_run();
 
 	/* Nothing to cancel */
 	__ofono_gprs_filter_chain_cancel(gprs.chain, NULL);
@@ -413,7 +429,7 @@ static void test_activate_allow_async(void)
 	/* Completion callback will terminate the loop */
 	__ofono_gprs_filter_chain_activate(gprs.chain, &gc, ctx,
 			test_activate_expect_allow_and_quit, test_inc, &count);
-	g_main_loop_run(test_loop);
+	test_run();
 	g_assert(count == 2); /* test_activate_expect_allow_and_quit+test_inc */
 	g_assert(test_filter_activate_count == 1);
 	__ofono_gprs_filter_chain_free(gprs.chain);
@@ -434,7 +450,7 @@ static void test_activate_change_cb
 	g_assert(!g_strcmp0(ctx->username, TEST_CHANGE_USERNAME));
 	g_assert(!g_strcmp0(ctx->password, TEST_CHANGE_PASSWORD));
 	(*(int*)data)++;
-	g_main_loop_quit(test_loop);
+	test_quit();
 }
 
 static unsigned int test_activate_change_filter(struct ofono_gprs_context *gc,
@@ -477,7 +493,7 @@ static void test_activate_change(void)
 	/* test_activate_change_cb will terminate the loop */
 	__ofono_gprs_filter_chain_activate(gprs.chain, &gc, ctx,
 					test_activate_change_cb, NULL, &count);
-	g_main_loop_run(test_loop);
+	test_run();
 	g_assert(count == 1);
 
 	__ofono_gprs_filter_chain_free(gprs.chain);
@@ -511,7 +527,7 @@ static void test_activate_disallow(void)
 	/* Completion callback will terminate the loop */
 	__ofono_gprs_filter_chain_activate(gprs.chain, &gc, ctx,
 			test_activate_expect_disallow_and_quit, NULL, &count);
-	g_main_loop_run(test_loop);
+	test_run();
 	g_assert(count == 1); /* test_activate_expect_disallow_and_quit */
 	g_assert(test_filter_cancel_count == 1);
 	__ofono_gprs_filter_chain_free(gprs.chain);
@@ -624,7 +640,7 @@ static void test_check_allow(void)
 	/* Completion callback will terminate the loop */
 	__ofono_gprs_filter_chain_check(gprs.chain,
 			test_check_expect_allow_and_quit, test_inc, &count);
-	g_main_loop_run(test_loop);
+	test_run();
 
 	/* test_check_expect_allow_and_quit + test_inc = 2 */
 	g_assert(count == 2);
@@ -661,7 +677,7 @@ static void test_check_disallow(void)
 	/* Completion callback will terminate the loop */
 	__ofono_gprs_filter_chain_check(gprs.chain,
 			test_check_expect_disallow_and_quit, test_inc, &count);
-	g_main_loop_run(test_loop);
+	test_run();
 
 	/* test_check_expect_disallow_and_quit + test_inc = 2 */
 	g_assert(count == 2);
@@ -726,10 +742,9 @@ static unsigned int test_cancel2_activate(struct ofono_gprs_context *gc,
 {
 	DBG("");
 
-	/* Request gets cancelled before completion. */
+	/* Request gets cancelled before the filter replies. */
 	g_idle_add(test_cancel2_free_chain, gc->gprs);
-	cb(NULL, user_data);
-	return 0;
+	return filter_later(cb, NULL, user_data);
 }
 
 static void test_cancel2(void)
@@ -756,7 +771,7 @@ static void test_cancel2(void)
 	/* This schedules asynchronous callback */
 	__ofono_gprs_filter_chain_activate(gprs.chain, &gc, ctx,
 				test_activate_expect_allow, test_inc, &count);
-	g_main_loop_run(test_loop);
+	test_run();
 
 	/* Chain is destroyed by test_cancel2_free_chain */
 	g_assert(!gprs.chain);
@@ -785,10 +800,9 @@ static unsigned int test_cancel3_activate(struct ofono_gprs_context *gc,
 {
 	DBG("");
 
-	/* Request gets cancelled before completion. */
+	/* Request gets cancelled before the filter replies. */
 	g_idle_add(test_cancel3_cb, gc->gprs);
-	cb(NULL, user_data);
-	return 0;
+	return filter_later(cb, NULL, user_data);
 }
 
 static void test_cancel3(void)
@@ -815,7 +829,7 @@ static void test_cancel3(void)
 	/* This schedules asynchronous callback */
 	__ofono_gprs_filter_chain_activate(gprs.chain, &gc, ctx,
 				test_activate_expect_allow, test_inc, &count);
-	g_main_loop_run(test_loop);
+	test_run();
 
 	g_assert(!test_filter_cancel_count);
 	g_assert(count == 1); /* test_inc */
@@ -867,7 +881,7 @@ static void test_cancel4(void)
 	/* This schedules asynchronous callback */
 	__ofono_gprs_filter_chain_activate(gprs.chain, &gc, ctx,
 			test_activate_expect_allow_and_quit, test_inc, &count);
-	g_main_loop_run(test_loop);
+	test_run();
 
 	g_assert(!test_filter_cancel_count);
 	g_assert(count == 2); /* test_activate_expect_allow_and_quit+test_inc */
@@ -896,10 +910,9 @@ static unsigned int test_cancel5_activate(struct ofono_gprs_context *gc,
 {
 	DBG("");
 
-	/* Request gets cancelled before completion. */
+	/* Request gets cancelled before the filter replies. */
 	g_idle_add(test_cancel5_cb, gc);
-	cb(NULL, user_data);
-	return 0;
+	return filter_later(cb, NULL, user_data);
 }
 
 static void test_cancel5(void)
@@ -926,7 +939,7 @@ static void test_cancel5(void)
 	/* This schedules asynchronous callback */
 	__ofono_gprs_filter_chain_activate(gprs.chain, &gc, ctx,
 				test_activate_expect_allow, test_inc, &count);
-	g_main_loop_run(test_loop);
+	test_run();
 
 	g_assert(!test_filter_cancel_count);
 	g_assert(count == 1); /* test_inc */
@@ -969,7 +982,7 @@ static void test_cancel6(void)
 	/* And cancel the second one */
 	__ofono_gprs_filter_chain_cancel(gprs.chain, &gc2);
 
-	g_main_loop_run(test_loop);
+	test_run();
 
 	g_assert(test_filter_activate_count == 2);
 	g_assert(!test_filter_cancel_count);
@@ -1024,7 +1037,7 @@ static void test_priorities1(void)
 	/* Completion callback will terminate the loop */
 	__ofono_gprs_filter_chain_activate(gprs.chain, &gc, ctx,
 		test_activate_expect_disallow_and_quit, test_inc, &count);
-	g_main_loop_run(test_loop);
+	test_run();
 	g_assert(count == 2); /* test_activate_expect_disallow_and_quit
 			       * and test_inc */
 	g_assert(test_filter_cancel_count == 1);
@@ -1073,7 +1086,7 @@ static void test_priorities2(void)
 	__ofono_gprs_filter_chain_activate(gprs.chain, &gc, ctx,
 		test_activate_expect_disallow_and_quit, test_inc, &count);
 
-	g_main_loop_run(test_loop);
+	test_run();
 	g_assert(count == 2); /* test_activate_expect_disallow_and_quit
 			       * and test_inc */
 	g_assert(test_filter_cancel_count == 1);
@@ -1084,6 +1097,79 @@ static void test_priorities2(void)
 	test_common_deinit();
 }
 
+/* ==== sync ==== */
+
+static void test_sync(void)
+{
+	static struct ofono_gprs_filter sync1 = {
+		.name = "sync1",
+		.api_version = OFONO_GPRS_FILTER_API_VERSION,
+		.priority = OFONO_GPRS_FILTER_PRIORITY_HIGH,
+		.filter_activate = filter_activate_continue,
+		.filter_check = filter_check_allow
+	};
+	static struct ofono_gprs_filter sync2 = {
+		.name = "sync2",
+		.api_version = OFONO_GPRS_FILTER_API_VERSION,
+		.priority = OFONO_GPRS_FILTER_PRIORITY_DEFAULT,
+		.filter_activate = filter_activate_continue,
+		.filter_check = filter_check_allow
+	};
+	static struct ofono_gprs_filter async = {
+		.name = "async",
+		.api_version = OFONO_GPRS_FILTER_API_VERSION,
+		.priority = OFONO_GPRS_FILTER_PRIORITY_LOW,
+		.filter_activate = filter_activate_continue_later,
+		.cancel = filter_cancel
+	};
+
+	int count = 0;
+	struct ofono_gprs gprs;
+	struct ofono_gprs_context gc;
+	struct ofono_gprs_primary_context *ctx = &gc.ctx;
+	const struct ofono_filter_chain_stats *stats;
+
+	test_common_init();
+	test_gprs_init(&gprs, &gc);
+
+	g_assert((gprs.chain = __ofono_gprs_filter_chain_new(&gprs)) != NULL);
+	g_assert(ofono_gprs_filter_register(&sync1) == 0);
+	g_assert(ofono_gprs_filter_register(&sync2) == 0);
+	stats = __ofono_gprs_filter_chain_get_stats(gprs.chain);
+	g_assert(stats);
+	g_assert(!__ofono_gprs_filter_chain_get_stats(NULL));
+
+	/* Both filters reply inline, so does the chain */
+	__ofono_gprs_filter_chain_activate(gprs.chain, &gc, ctx,
+				test_activate_expect_allow, NULL, &count);
+	g_assert(count == 1);
+	__ofono_gprs_filter_chain_check(gprs.chain, test_check_expect_allow,
+							NULL, &count);
+	g_assert(count == 2);
+	g_assert(test_filter_activate_count == 2);
+	g_assert(test_filter_check_count == 2);
+	g_assert(stats->requests == 2);
+	g_assert(stats->inline_steps == 4);
+	g_assert(!stats->async_steps);
+
+	/* One asynchronous filter is enough to defer the completion */
+	g_assert(ofono_gprs_filter_register(&async) == 0);
+	__ofono_gprs_filter_chain_activate(gprs.chain, &gc, ctx,
+			test_activate_expect_allow_and_quit, NULL, &count);
+	g_assert(count == 2);
+	test_run();
+	g_assert(count == 3);
+	g_assert(stats->requests == 3);
+	g_assert(stats->inline_steps == 6);
+	g_assert(stats->async_steps == 1);
+
+	__ofono_gprs_filter_chain_free(gprs.chain);
+	ofono_gprs_filter_unregister(&sync1);
+	ofono_gprs_filter_unregister(&sync2);
+	ofono_gprs_filter_unregister(&async);
+	test_common_deinit();
+}
+
 #define TEST_(name) "/gprs-filter/" name
 
 int main(int argc, char *argv[])
@@ -1120,6 +1206,7 @@ int main(int argc, char *argv[])
 	g_test_add_func(TEST_("cancel6"), test_cancel6);
 	g_test_add_func(TEST_("priorities1"), test_priorities1);
 	g_test_add_func(TEST_("priorities2"), test_priorities2);
+	g_test_add_func(TEST_("sync"), test_sync);
 
 	return g_test_run();
 }
@@ -0,0 +1,309 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "grilreader.h"
+
+#define TEST_MAX_SIZE 64
+
+struct test_stream {
+	GByteArray *data;
+	GPtrArray *parcels;	/* Expected payloads (GByteArray) */
+};
+
+static void test_stream_add(struct test_stream *ts, gsize len, guchar seed)
+{
+	GByteArray *payload = g_byte_array_sized_new(len);
+	guchar hdr[4];
+	gsize i;
+
+	hdr[0] = (len >> 24) & 0xff;
+	hdr[1] = (len >> 16) & 0xff;
+	hdr[2] = (len >> 8) & 0xff;
+	hdr[3] = len & 0xff;
+	g_byte_array_append(ts->data, hdr, sizeof(hdr));
+
+	for (i = 0; i < len; i++) {
+		guchar c = seed + i;
+
+		g_byte_array_append(payload, &c, 1);
+	}
+
+	g_byte_array_append(ts->data, payload->data, payload->len);
+
+	if (len <= TEST_MAX_SIZE)
+		g_ptr_array_add(ts->parcels, payload);
+	else
+		g_byte_array_free(payload, TRUE);
+}
+
+static void test_stream_init(struct test_stream *ts)
+{
+	ts->data = g_byte_array_new();
+	ts->parcels = g_ptr_array_new();
+
+	test_stream_add(ts, 12, 0x10);
+	test_stream_add(ts, 0, 0);
+	test_stream_add(ts, 1, 0x20);
+	test_stream_add(ts, TEST_MAX_SIZE + 1, 0x30);	/* Dropped */
+	test_stream_add(ts, TEST_MAX_SIZE, 0x40);
+	test_stream_add(ts, 8, 0x50);
+}
+
+static void test_stream_cleanup(struct test_stream *ts)
+{
+	guint i;
+
+	for (i = 0; i < ts->parcels->len; i++)
+		g_byte_array_free(ts->parcels->pdata[i], TRUE);
+
+	g_ptr_array_free(ts->parcels, TRUE);
+	g_byte_array_free(ts->data, TRUE);
+}
+
+/* Feeds a chunk, validates every parcel and returns the parcel count */
+static guint test_feed(GRilReader *reader, struct test_stream *ts,
+			const guchar *data, gsize len, guint index,
+			guint *dropped)
+{
+	while (len > 0) {
+		GRilReaderStatus status;
+		GByteArray *expect;
+		guchar *buf;
+		gsize consumed;
+		gsize buf_len;
+
+		status = g_ril_reader_feed(reader, data, len, &consumed);
+		g_assert(consumed <= len);
+
+		data += consumed;
+		len -= consumed;
+
+		switch (status) {
+		case G_RIL_READER_NEED_MORE:
+			g_assert(len == 0);
+			break;
+		case G_RIL_READER_DROPPED:
+			g_assert(g_ril_reader_dropped_size(reader) ==
+							TEST_MAX_SIZE + 1);
+			(*dropped)++;
+			break;
+		case G_RIL_READER_PARCEL:
+			g_assert(index < ts->parcels->len);
+			expect = ts->parcels->pdata[index++];
+			buf = g_ril_reader_steal_parcel(reader, &buf_len);
+			g_assert(buf_len == expect->len);
+			g_assert(!buf_len || !memcmp(buf, expect->data,
+								buf_len));
+			g_assert(!buf_len || buf);
+			g_free(buf);
+			break;
+		}
+	}
+
+	return index;
+}
+
+static void test_split(void)
+{
+	struct test_stream ts;
+	gsize split;
+
+	test_stream_init(&ts);
+
+	/* Split the stream in two at every possible offset */
+	for (split = 0; split <= ts.data->len; split++) {
+		GRilReader *reader = g_ril_reader_new(TEST_MAX_SIZE);
+		guint dropped = 0;
+		guint n;
+
+		n = test_feed(reader, &ts, ts.data->data, split, 0, &dropped);
+		n = test_feed(reader, &ts, ts.data->data + split,
+				ts.data->len - split, n, &dropped);
+
+		g_assert(n == ts.parcels->len);
+		g_assert(dropped == 1);
+		g_ril_reader_free(reader);
+	}
+
+	test_stream_cleanup(&ts);
+}
+
+static void test_split3(void)
+{
+	struct test_stream ts;
+	gsize i, j;
+
+	test_stream_init(&ts);
+
+	/* And in three pieces, covering chunks inside a single parcel */
+	for (i = 0; i <= ts.data->len; i++) {
+		for (j = i; j <= ts.data->len; j++) {
+			GRilReader *reader = g_ril_reader_new(TEST_MAX_SIZE);
+			const guchar *data = ts.data->data;
+			guint dropped = 0;
+			guint n;
+
+			n = test_feed(reader, &ts, data, i, 0, &dropped);
+			n = test_feed(reader, &ts, data + i, j - i, n,
+								&dropped);
+			n = test_feed(reader, &ts, data + j,
+					ts.data->len - j, n, &dropped);
+
+			g_assert(n == ts.parcels->len);
+			g_assert(dropped == 1);
+			g_ril_reader_free(reader);
+		}
+	}
+
+	test_stream_cleanup(&ts);
+}
+
+static void test_bytewise(void)
+{
+	struct test_stream ts;
+	GRilReader *reader;
+	guint dropped = 0;
+	guint n = 0;
+	gsize i;
+
+	test_stream_init(&ts);
+	reader = g_ril_reader_new(TEST_MAX_SIZE);
+
+	for (i = 0; i < ts.data->len; i++)
+		n = test_feed(reader, &ts, ts.data->data + i, 1, n, &dropped);
+
+	g_assert(n == ts.parcels->len);
+	g_assert(dropped == 1);
+
+	g_ril_reader_free(reader);
+	test_stream_cleanup(&ts);
+}
+
+static void test_large(void)
+{
+	static const guchar hdr[] = { 0x00, 0x01, 0x00, 0x00 };
+	const gsize size = 0x10000;
+	guchar *data = g_malloc0(size);
+	GRilReader *reader;
+	gsize consumed;
+	gsize off = 0;
+	guchar *buf;
+	gsize len;
+
+	/* Much bigger than the 8k ring buffer used by GRilIO */
+	reader = g_ril_reader_new(GRIL_MAX_PARCEL_SIZE);
+	memset(data, 0xab, size);
+
+	g_assert(g_ril_reader_feed(reader, hdr, sizeof(hdr), &consumed) ==
+						G_RIL_READER_NEED_MORE);
+	g_assert(consumed == sizeof(hdr));
+
+	while (size - off > 8192) {
+		g_assert(g_ril_reader_feed(reader, data + off, 8192,
+				&consumed) == G_RIL_READER_NEED_MORE);
+		g_assert(consumed == 8192);
+		off += consumed;
+	}
+
+	g_assert(g_ril_reader_feed(reader, data + off, size - off,
+				&consumed) == G_RIL_READER_PARCEL);
+	g_assert(consumed == size - off);
+
+	buf = g_ril_reader_steal_parcel(reader, &len);
+	g_assert(len == size);
+	g_assert(!memcmp(buf, data, size));
+	g_free(buf);
+
+	/* Nothing left */
+	g_assert(!g_ril_reader_steal_parcel(reader, &len));
+	g_assert(len == 0);
+
+	g_ril_reader_free(reader);
+	g_free(data);
+}
+
+static void test_reset(void)
+{
+	static const guchar data[] = { 0x00, 0x00, 0x00, 0x02, 0x01 };
+	static const guchar next[] = { 0x00, 0x00, 0x00, 0x01, 0x07 };
+	GRilReader *reader = g_ril_reader_new(TEST_MAX_SIZE);
+	gsize consumed;
+	guchar *buf;
+	gsize len;
+
+	g_assert(g_ril_reader_feed(reader, data, sizeof(data), &consumed) ==
+						G_RIL_READER_NEED_MORE);
+
+	/* Partial parcel is forgotten */
+	g_ril_reader_reset(reader);
+
+	g_assert(g_ril_reader_feed(reader, next, sizeof(next), &consumed) ==
+						G_RIL_READER_PARCEL);
+	g_assert(consumed == sizeof(next));
+
+	buf = g_ril_reader_steal_parcel(reader, &len);
+	g_assert(len == 1);
+	g_assert(buf[0] == 0x07);
+	g_free(buf);
+
+	g_ril_reader_free(reader);
+}
+
+static void test_null(void)
+{
+	gsize consumed = 1;
+	gsize len = 1;
+
+	g_assert(g_ril_reader_feed(NULL, NULL, 0, &consumed) ==
+						G_RIL_READER_NEED_MORE);
+	g_assert(consumed == 0);
+	g_assert(!g_ril_reader_steal_parcel(NULL, &len));
+	g_assert(len == 0);
+	g_assert(!g_ril_reader_dropped_size(NULL));
+	g_assert(!g_ril_reader_get_max_size(NULL));
+	g_ril_reader_set_max_size(NULL, 0);
+	g_ril_reader_reset(NULL);
+	g_ril_reader_free(NULL);
+}
+
+#define TEST_(name) "/gril-reader/" name
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func(TEST_("null"), test_null);
+	g_test_add_func(TEST_("split"), test_split);
+	g_test_add_func(TEST_("split3"), test_split3);
+	g_test_add_func(TEST_("bytewise"), test_bytewise);
+	g_test_add_func(TEST_("large"), test_large);
+	g_test_add_func(TEST_("reset"), test_reset);
+
+	return g_test_run();
+}
@@ -0,0 +1,175 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <string.h>
+
+#include <ofono/types.h>
+#include <gril.h>
+
+#include "ril_constants.h"
+#include "rilmodem-test-server.h"
+
+#define TEST_TIMEOUT_SEC 30
+
+struct test_load_data {
+	GRil *ril;
+	GMainLoop *loop;
+	struct server_data *serverd;
+	guint count;
+	guint received;
+	guint destroyed;
+	gint next_id;
+	gboolean in_order;
+	gint64 first;
+	gint64 last;
+};
+
+static gboolean test_timeout(gpointer data)
+{
+	g_assert(FALSE);
+	return G_SOURCE_REMOVE;
+}
+
+static void test_load_response(struct ril_msg *message, gpointer user_data)
+{
+	struct test_load_data *td = user_data;
+
+	g_assert(message->error == RIL_E_SUCCESS);
+	g_assert(message->req == RIL_REQUEST_BASEBAND_VERSION);
+
+	if (message->serial_no != td->next_id)
+		td->in_order = FALSE;
+
+	td->next_id = message->serial_no + 1;
+
+	if (!td->received)
+		td->first = g_get_monotonic_time();
+
+	if (++td->received == td->count) {
+		td->last = g_get_monotonic_time();
+		g_main_loop_quit(td->loop);
+	}
+}
+
+static void test_load_destroy(gpointer user_data)
+{
+	struct test_load_data *td = user_data;
+
+	td->destroyed++;
+}
+
+static void test_load_run(guint count)
+{
+	struct test_load_data td;
+	guint timeout;
+	guint i;
+
+	memset(&td, 0, sizeof(td));
+	td.count = count;
+	td.in_order = TRUE;
+	td.serverd = rilmodem_test_server_create_echo(NULL, NULL);
+	td.ril = g_ril_new(RIL_SERVER_SOCK_PATH, OFONO_RIL_VENDOR_AOSP);
+	g_assert(td.ril);
+
+	/* All requests are queued before the first response arrives */
+	for (i = 0; i < count; i++) {
+		gint id = g_ril_send(td.ril, RIL_REQUEST_BASEBAND_VERSION,
+					NULL, test_load_response, &td,
+					test_load_destroy);
+
+		g_assert(id > 0);
+
+		if (!i)
+			td.next_id = id;
+	}
+
+	td.loop = g_main_loop_new(NULL, FALSE);
+	timeout = g_timeout_add_seconds(TEST_TIMEOUT_SEC, test_timeout, NULL);
+	g_main_loop_run(td.loop);
+	g_source_remove(timeout);
+	g_main_loop_unref(td.loop);
+
+	g_assert(td.received == count);
+	g_assert(td.destroyed == count);
+	g_assert(td.in_order);
+
+	g_test_message("%u outstanding requests: %.2f us per response", count,
+			(double) (td.last - td.first) / count);
+
+	g_ril_unref(td.ril);
+	rilmodem_test_server_close(td.serverd);
+}
+
+static void test_load(gconstpointer data)
+{
+	test_load_run(GPOINTER_TO_UINT(data));
+}
+
+static void test_cancel(void)
+{
+	struct test_load_data td;
+	GRil *clone;
+	guint i;
+
+	memset(&td, 0, sizeof(td));
+	td.serverd = rilmodem_test_server_create_echo(NULL, NULL);
+	td.ril = g_ril_new(RIL_SERVER_SOCK_PATH, OFONO_RIL_VENDOR_AOSP);
+	g_assert(td.ril);
+
+	/* Requests queued through the clone are dropped with it */
+	clone = g_ril_clone(td.ril);
+
+	for (i = 0; i < 100; i++)
+		g_assert(g_ril_send(clone, RIL_REQUEST_BASEBAND_VERSION,
+				NULL, test_load_response, &td,
+				test_load_destroy) > 0);
+
+	g_ril_unref(clone);
+	g_assert(td.destroyed == 100);
+	g_assert(!td.received);
+
+	g_ril_unref(td.ril);
+	rilmodem_test_server_close(td.serverd);
+}
+
+#define TEST_(name) "/gril/" name
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func(TEST_("cancel"), test_cancel);
+	g_test_add_data_func(TEST_("load/10"), GUINT_TO_POINTER(10),
+								test_load);
+	g_test_add_data_func(TEST_("load/100"), GUINT_TO_POINTER(100),
+								test_load);
+	g_test_add_data_func(TEST_("load/500"), GUINT_TO_POINTER(500),
+								test_load);
+	g_test_add_data_func(TEST_("load/2000"), GUINT_TO_POINTER(2000),
+								test_load);
+
+	return g_test_run();
+}
@@ -24,8 +24,13 @@
 #endif
 
 #include <sys/uio.h>
+#include <sys/socket.h>
 #include <linux/types.h>
 #include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <ell/ell.h>
 
@@ -718,6 +723,278 @@ static void parse_ip_configuration_query(const void *data)
 	mbim_message_unref(msg);
 }
 
+/*
+ * Fake MBIM function on the other end of a socket pair.  It completes
+ * the MBIM_OPEN handshake and answers every command with a COMMAND_DONE
+ * echoing the information buffer, fragmenting the response according
+ * to the max control transfer size requested by the host.
+ */
+#define FAKE_SEGMENT_SIZE	512
+#define FAKE_ROUNDS		1000
+#define FAKE_LARGE_ROUNDS	20
+#define FAKE_LARGE_PDU		2000
+
+struct fake_device {
+	struct l_io *io;
+	uint32_t max_segment_size;
+	uint8_t buf[2 * 4096];
+	size_t buf_len;
+	uint8_t *command;
+	size_t command_len;
+	unsigned int n_commands;
+	unsigned int n_fragments;
+};
+
+static void fake_device_write(struct fake_device *fake, uint32_t type,
+					uint32_t tid, const void *payload,
+					size_t len)
+{
+	size_t frag_size = fake->max_segment_size - 20;
+	uint32_t n_frags = len ? (len + frag_size - 1) / frag_size : 1;
+	uint8_t frag[4096];
+	uint32_t i;
+	int fd = l_io_get_fd(fake->io);
+
+	for (i = 0; i < n_frags; i++) {
+		size_t frag_len = len - i * frag_size;
+
+		if (frag_len > frag_size)
+			frag_len = frag_size;
+
+		l_put_le32(type, frag);
+		l_put_le32(20 + frag_len, frag + 4);
+		l_put_le32(tid, frag + 8);
+		l_put_le32(n_frags, frag + 12);
+		l_put_le32(i, frag + 16);
+		memcpy(frag + 20, payload + i * frag_size, frag_len);
+
+		assert(write(fd, frag, 20 + frag_len) ==
+					(ssize_t) (20 + frag_len));
+	}
+}
+
+static void fake_device_process(struct fake_device *fake, const uint8_t *pdu)
+{
+	uint32_t type = l_get_le32(pdu);
+	uint32_t len = l_get_le32(pdu + 4);
+	uint32_t tid = l_get_le32(pdu + 8);
+	uint32_t reply[4];
+	uint32_t n_frags;
+	uint32_t cur_frag;
+
+	switch (type) {
+	case MBIM_OPEN_MSG:
+		fake->max_segment_size = l_get_le32(pdu + 12);
+		reply[0] = L_CPU_TO_LE32(MBIM_OPEN_DONE);
+		reply[1] = L_CPU_TO_LE32(sizeof(reply));
+		reply[2] = L_CPU_TO_LE32(tid);
+		reply[3] = 0;
+		assert(write(l_io_get_fd(fake->io), reply, sizeof(reply)) ==
+						(ssize_t) sizeof(reply));
+		break;
+	case MBIM_COMMAND_MSG:
+		n_frags = l_get_le32(pdu + 12);
+		cur_frag = l_get_le32(pdu + 16);
+		assert(len <= fake->max_segment_size);
+		assert(cur_frag < n_frags);
+
+		if (cur_frag == 0)
+			fake->command_len = 0;
+
+		fake->command = l_realloc(fake->command,
+						fake->command_len + len - 20);
+		memcpy(fake->command + fake->command_len, pdu + 20, len - 20);
+		fake->command_len += len - 20;
+		fake->n_fragments++;
+
+		if (cur_frag + 1 < n_frags)
+			break;
+
+		/* Status goes where the command type was */
+		l_put_le32(0, fake->command + 20);
+		fake_device_write(fake, MBIM_COMMAND_DONE, tid,
+					fake->command, fake->command_len);
+		fake->n_commands++;
+		break;
+	default:
+		break;
+	}
+}
+
+static bool fake_device_read(struct l_io *io, void *user_data)
+{
+	struct fake_device *fake = user_data;
+	ssize_t len;
+	uint32_t pdu_len;
+
+	len = read(l_io_get_fd(io), fake->buf + fake->buf_len,
+					sizeof(fake->buf) - fake->buf_len);
+	if (len < 0)
+		return errno == EAGAIN;
+
+	if (len == 0)
+		return false;
+
+	fake->buf_len += len;
+
+	while (fake->buf_len >= 12) {
+		pdu_len = l_get_le32(fake->buf + 4);
+		assert(pdu_len >= 12 && pdu_len <= 4096);
+
+		if (fake->buf_len < pdu_len)
+			break;
+
+		fake_device_process(fake, fake->buf);
+		fake->buf_len -= pdu_len;
+		memmove(fake->buf, fake->buf + pdu_len, fake->buf_len);
+	}
+
+	return true;
+}
+
+struct fake_test {
+	struct mbim_device *device;
+	struct fake_device fake;
+	uint8_t pdu[FAKE_LARGE_PDU];
+	unsigned int n_sent;
+	unsigned int n_large_sent;
+	unsigned int n_replies;
+	struct timespec start;
+};
+
+static void fake_test_send(struct fake_test *test);
+
+static void fake_test_reply(struct mbim_message *message, void *user_data)
+{
+	struct fake_test *test = user_data;
+
+	assert(mbim_message_get_error(message) == 0);
+	assert(mbim_message_get_cid(message) == MBIM_CID_DEVICE_CAPS);
+
+	test->n_replies++;
+	fake_test_send(test);
+}
+
+static void fake_test_large_reply(struct mbim_message *message,
+							void *user_data)
+{
+	struct fake_test *test = user_data;
+	struct mbim_message_iter databuf;
+	struct mbim_message_iter pdu;
+	uint32_t format;
+	uint32_t pdu_len;
+	uint8_t b;
+	int i = 0;
+
+	assert(mbim_message_get_error(message) == 0);
+	assert(mbim_message_get_cid(message) == MBIM_CID_SMS_SEND);
+
+	/* The response is parsed in place, spread over several fragments */
+	assert(mbim_message_get_arguments(message, "ud", &format,
+							"ay", &databuf));
+	assert(format == 0);
+	assert(mbim_message_iter_next_entry(&databuf, &pdu_len, &pdu));
+	assert(pdu_len == sizeof(test->pdu));
+
+	while (mbim_message_iter_next_entry(&pdu, &b))
+		assert(b == test->pdu[i++]);
+
+	assert(i == sizeof(test->pdu));
+
+	test->n_replies++;
+	fake_test_send(test);
+}
+
+static void fake_test_send(struct fake_test *test)
+{
+	struct mbim_message *message;
+	struct timespec now;
+
+	if (test->n_sent < FAKE_ROUNDS) {
+		message = mbim_message_new(mbim_uuid_basic_connect,
+						MBIM_CID_DEVICE_CAPS,
+						MBIM_COMMAND_TYPE_QUERY);
+		assert(mbim_message_set_arguments(message, ""));
+		assert(mbim_device_send(test->device, 0, message,
+					fake_test_reply, test, NULL));
+		test->n_sent++;
+		return;
+	}
+
+	if (test->n_large_sent < FAKE_LARGE_ROUNDS) {
+		message = mbim_message_new(mbim_uuid_sms, MBIM_CID_SMS_SEND,
+						MBIM_COMMAND_TYPE_SET);
+		assert(mbim_message_set_arguments(message, "ud", 0, "ay",
+						sizeof(test->pdu), test->pdu));
+		assert(mbim_device_send(test->device, 0, message,
+					fake_test_large_reply, test, NULL));
+		test->n_large_sent++;
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	printf("%u round trips in %ld us\n", test->n_replies,
+			(now.tv_sec - test->start.tv_sec) * 1000000L +
+			(now.tv_nsec - test->start.tv_nsec) / 1000L);
+
+	l_main_quit();
+}
+
+static void fake_test_ready(void *user_data)
+{
+	struct fake_test *test = user_data;
+
+	clock_gettime(CLOCK_MONOTONIC, &test->start);
+	fake_test_send(test);
+}
+
+static void fake_test_timeout(struct l_timeout *timeout, void *user_data)
+{
+	assert(false);
+}
+
+static void fake_device_round_trip(const void *data)
+{
+	struct fake_test *test = l_new(struct fake_test, 1);
+	struct l_timeout *timeout;
+	int fds[2];
+	unsigned int i;
+
+	assert(l_main_init());
+	assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+	for (i = 0; i < sizeof(test->pdu); i++)
+		test->pdu[i] = i;
+
+	test->fake.io = l_io_new(fds[1]);
+	l_io_set_close_on_destroy(test->fake.io, true);
+	l_io_set_read_handler(test->fake.io, fake_device_read,
+						&test->fake, NULL);
+
+	test->device = mbim_device_new(fds[0], FAKE_SEGMENT_SIZE);
+	assert(test->device);
+	mbim_device_set_close_on_unref(test->device, true);
+	mbim_device_set_ready_handler(test->device, fake_test_ready,
+								test, NULL);
+
+	timeout = l_timeout_create(30, fake_test_timeout, NULL, NULL);
+	l_main_run();
+	l_timeout_remove(timeout);
+
+	assert(test->n_replies == FAKE_ROUNDS + FAKE_LARGE_ROUNDS);
+	assert(test->fake.n_commands == test->n_replies);
+
+	/* Large commands went out in fragments */
+	assert(test->fake.n_fragments > test->fake.n_commands);
+
+	mbim_device_unref(test->device);
+	l_io_destroy(test->fake.io);
+	l_free(test->fake.command);
+	l_free(test);
+
+	l_main_exit();
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -762,5 +1039,7 @@ int main(int argc, char *argv[])
 				parse_ip_configuration_query,
 				&message_data_ip_configuration_query);
 
+	l_test_add("Fake Device (round trip)", fake_device_round_trip, NULL);
+
 	return l_test_run();
 }
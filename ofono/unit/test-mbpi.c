@@ -0,0 +1,439 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include <glib.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+
+#define OFONO_API_SUBJECT_TO_CHANGE
+#include <ofono/modem.h>
+#include <ofono/gprs-provision.h>
+
+#include "plugins/mbpi.h"
+
+#define TEST_SUITE "/mbpi/"
+#define TEST_BENCH_PROVIDERS	2000
+#define TEST_BENCH_LOOKUPS	100
+
+static const char test_xml[] =
+	"<?xml version=\"1.0\"?>\n"
+	"<serviceproviders format=\"2.0\">\n"
+	"<country code=\"fi\">\n"
+	"  <provider primary=\"true\">\n"
+	"    <name>Telia FI</name>\n"
+	"    <gsm>\n"
+	"      <network-id mcc=\"244\" mnc=\"91\"/>\n"
+	"      <network-id mcc=\"244\" mnc=\"91\"/>\n"
+	"      <network-id mcc=\"244\" mnc=\"36\"/>\n"
+	"      <apn value=\"internet\">\n"
+	"        <usage type=\"internet\"/>\n"
+	"        <name>Telia Internet</name>\n"
+	"      </apn>\n"
+	"      <apn value=\"mms\">\n"
+	"        <usage type=\"mms\"/>\n"
+	"        <name>Telia MMS</name>\n"
+	"        <mmsc>http://mms/</mmsc>\n"
+	"        <mmsproxy>195.156.25.33:8080</mmsproxy>\n"
+	"      </apn>\n"
+	"      <apn value=\"ims\">\n"
+	"        <protocol type=\"ipv6\"/>\n"
+	"        <usage type=\"ims\"/>\n"
+	"      </apn>\n"
+	"      <apn value=\"wap\">\n"
+	"        <usage type=\"wap\"/>\n"
+	"        <protocol type=\"ipv4v6\"/>\n"
+	"        <username>user</username>\n"
+	"        <password>pass</password>\n"
+	"      </apn>\n"
+	"    </gsm>\n"
+	"  </provider>\n"
+	"  <provider>\n"
+	"    <gsm>\n"
+	"      <network-id mcc=\"244\" mnc=\"37\"/>\n"
+	"      <apn value=\"unnamed\">\n"
+	"        <authentication method=\"chap\"/>\n"
+	"      </apn>\n"
+	"    </gsm>\n"
+	"  </provider>\n"
+	"  <provider>\n"
+	"    <name>DNA</name>\n"
+	"    <gsm>\n"
+	"      <apn value=\"ignored\"/>\n"
+	"      <network-id mcc=\"244\" mnc=\"12\"/>\n"
+	"      <apn value=\"internet\">\n"
+	"        <username>dna</username>\n"
+	"      </apn>\n"
+	"      <apn value=\"internet2\"/>\n"
+	"    </gsm>\n"
+	"  </provider>\n"
+	"  <provider>\n"
+	"    <cdma>\n"
+	"      <sid value=\"100\"/>\n"
+	"    </cdma>\n"
+	"  </provider>\n"
+	"  <provider>\n"
+	"    <name>Second</name>\n"
+	"    <cdma>\n"
+	"      <sid value=\"100\"/>\n"
+	"      <sid value=\"200\"/>\n"
+	"    </cdma>\n"
+	"    <gsm>\n"
+	"      <network-id mcc=\"244\" mnc=\"91\"/>\n"
+	"      <apn value=\"second\"/>\n"
+	"    </gsm>\n"
+	"  </provider>\n"
+	"</country>\n"
+	"</serviceproviders>\n";
+
+static const char test_broken_xml[] =
+	"<serviceproviders format=\"2.0\">\n"
+	"  <provider>\n"
+	"    <name>Broken</name>\n"
+	"    <gsm>\n"
+	"      <network-id mcc=\"244\"/>\n"
+	"    </gsm>\n"
+	"  </provider>\n"
+	"</serviceproviders>\n";
+
+static const char *test_networks[][2] = {
+	{ "244", "91" }, { "244", "36" }, { "244", "37" },
+	{ "244", "12" }, { "244", "99" }, { "24", "491" }
+};
+
+static const char *test_sids[] = { "100", "200", "300", "" };
+
+static char *test_dir;
+static char *test_db;
+static char *test_index;
+
+static void test_setup(const char *xml)
+{
+	test_dir = g_dir_make_tmp("test-mbpi-XXXXXX", NULL);
+	g_assert(test_dir);
+	test_db = g_build_filename(test_dir, "serviceproviders.xml", NULL);
+	test_index = g_strconcat(test_db, ".idx", NULL);
+	g_assert(g_file_set_contents(test_db, xml, -1, NULL));
+	mbpi_database = test_db;
+	mbpi_use_index = TRUE;
+}
+
+static void test_teardown(void)
+{
+	unlink(test_index);
+	unlink(test_db);
+	rmdir(test_dir);
+	g_free(test_index);
+	g_free(test_db);
+	g_free(test_dir);
+	test_index = test_db = test_dir = NULL;
+}
+
+static void test_rewrite(const char *xml, time_t mtime)
+{
+	struct utimbuf times;
+
+	g_assert(g_file_set_contents(test_db, xml, -1, NULL));
+	times.actime = times.modtime = mtime;
+	g_assert(!utime(test_db, &times));
+}
+
+static void test_free_apns(GSList *apns)
+{
+	g_slist_free_full(apns, (GDestroyNotify) mbpi_ap_free);
+}
+
+static GSList *test_lookup_apn(gboolean use_index, const char *mcc,
+				const char *mnc, gboolean allow_duplicates,
+				gboolean *failed)
+{
+	GError *error = NULL;
+	GSList *apns;
+
+	mbpi_use_index = use_index;
+	apns = mbpi_lookup_apn(mcc, mnc, allow_duplicates, &error);
+	mbpi_use_index = TRUE;
+
+	*failed = (error != NULL);
+	if (error)
+		g_error_free(error);
+
+	return apns;
+}
+
+/* The index must give exactly what the parser gives */
+static void test_compare_apn(const char *mcc, const char *mnc,
+						gboolean allow_duplicates)
+{
+	gboolean failed1, failed2;
+	GSList *apns1 = test_lookup_apn(FALSE, mcc, mnc, allow_duplicates,
+								&failed1);
+	GSList *apns2 = test_lookup_apn(TRUE, mcc, mnc, allow_duplicates,
+								&failed2);
+	GSList *l1, *l2;
+
+	g_assert(failed1 == failed2);
+	g_assert_cmpuint(g_slist_length(apns1), == ,g_slist_length(apns2));
+
+	for (l1 = apns1, l2 = apns2; l1; l1 = l1->next, l2 = l2->next) {
+		const struct ofono_gprs_provision_data *ap1 = l1->data;
+		const struct ofono_gprs_provision_data *ap2 = l2->data;
+
+		g_assert(ap1->type == ap2->type);
+		g_assert(ap1->proto == ap2->proto);
+		g_assert_cmpstr(ap1->provider_name, == ,ap2->provider_name);
+		g_assert(ap1->provider_primary == ap2->provider_primary);
+		g_assert_cmpstr(ap1->name, == ,ap2->name);
+		g_assert_cmpstr(ap1->apn, == ,ap2->apn);
+		g_assert_cmpstr(ap1->username, == ,ap2->username);
+		g_assert_cmpstr(ap1->password, == ,ap2->password);
+		g_assert(ap1->auth_method == ap2->auth_method);
+		g_assert_cmpstr(ap1->message_proxy, == ,ap2->message_proxy);
+		g_assert_cmpstr(ap1->message_center, == ,ap2->message_center);
+	}
+
+	test_free_apns(apns1);
+	test_free_apns(apns2);
+}
+
+static void test_compare_cdma(const char *sid)
+{
+	char *name1, *name2;
+
+	mbpi_use_index = FALSE;
+	name1 = mbpi_lookup_cdma_provider_name(sid, NULL);
+	mbpi_use_index = TRUE;
+	name2 = mbpi_lookup_cdma_provider_name(sid, NULL);
+
+	g_assert_cmpstr(name1, == ,name2);
+	g_free(name1);
+	g_free(name2);
+}
+
+static void test_compare_all(void)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(test_networks); i++) {
+		test_compare_apn(test_networks[i][0], test_networks[i][1],
+									FALSE);
+		test_compare_apn(test_networks[i][0], test_networks[i][1],
+									TRUE);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS(test_sids); i++)
+		test_compare_cdma(test_sids[i]);
+}
+
+static void test_lookup(void)
+{
+	struct ofono_gprs_provision_data *ap;
+	gboolean failed;
+	GSList *apns;
+	char *name;
+
+	test_setup(test_xml);
+
+	apns = test_lookup_apn(TRUE, "244", "36", FALSE, &failed);
+	g_assert(!failed);
+	g_assert(g_file_test(test_index, G_FILE_TEST_IS_REGULAR));
+	g_assert_cmpuint(g_slist_length(apns), == ,4);
+
+	ap = apns->data;
+	g_assert(ap->type == OFONO_GPRS_CONTEXT_TYPE_INTERNET);
+	g_assert(ap->proto == mbpi_default_internet_proto);
+	g_assert(ap->auth_method == OFONO_GPRS_AUTH_METHOD_NONE);
+	g_assert(ap->provider_primary);
+	g_assert_cmpstr(ap->provider_name, == ,"Telia FI");
+	g_assert_cmpstr(ap->name, == ,"Telia Internet");
+
+	ap = apns->next->data;
+	g_assert(ap->type == OFONO_GPRS_CONTEXT_TYPE_MMS);
+	g_assert(ap->proto == mbpi_default_mms_proto);
+	g_assert_cmpstr(ap->message_center, == ,"http://mms/");
+
+	ap = apns->next->next->data;
+	g_assert(ap->type == OFONO_GPRS_CONTEXT_TYPE_IMS);
+	g_assert(ap->proto == mbpi_default_ims_proto);
+
+	ap = apns->next->next->next->data;
+	g_assert(ap->type == OFONO_GPRS_CONTEXT_TYPE_WAP);
+	g_assert(ap->proto == OFONO_GPRS_PROTO_IPV4V6);
+	g_assert(ap->auth_method == mbpi_default_auth_method);
+	test_free_apns(apns);
+
+	/* Two internet APNs for the same network */
+	g_assert(!test_lookup_apn(TRUE, "244", "12", FALSE, &failed));
+	g_assert(failed);
+	apns = test_lookup_apn(TRUE, "244", "12", TRUE, &failed);
+	g_assert(!failed);
+	g_assert_cmpuint(g_slist_length(apns), == ,2);
+	test_free_apns(apns);
+
+	/* Unknown network */
+	g_assert(!test_lookup_apn(TRUE, "244", "99", FALSE, &failed));
+	g_assert(!failed);
+
+	/* The first provider listing the SID wins, unknown SIDs have none */
+	name = mbpi_lookup_cdma_provider_name("200", NULL);
+	g_assert_cmpstr(name, == ,"Second");
+	g_free(name);
+	g_assert(!mbpi_lookup_cdma_provider_name("300", NULL));
+
+	test_compare_all();
+	test_teardown();
+}
+
+static void test_changed(void)
+{
+	static const char old_xml[] =
+		"<serviceproviders format=\"2.0\"><provider><name>Old</name>"
+		"<gsm><network-id mcc=\"1\" mnc=\"1\"/><apn value=\"apn\"/>"
+		"</gsm></provider></serviceproviders>";
+	static const char new_xml[] =
+		"<serviceproviders format=\"2.0\"><provider><name>New</name>"
+		"<gsm><network-id mcc=\"1\" mnc=\"1\"/><apn value=\"apn\"/>"
+		"</gsm></provider></serviceproviders>";
+	struct ofono_gprs_provision_data *ap;
+	time_t now = time(NULL);
+	gboolean failed;
+	GSList *apns;
+
+	test_setup(old_xml);
+	test_rewrite(old_xml, now - 20);
+
+	apns = test_lookup_apn(TRUE, "1", "1", FALSE, &failed);
+	g_assert_cmpuint(g_slist_length(apns), == ,1);
+	ap = apns->data;
+	g_assert_cmpstr(ap->provider_name, == ,"Old");
+	test_free_apns(apns);
+
+	/* Same size, only the mtime tells that it has changed */
+	test_rewrite(new_xml, now - 10);
+	apns = test_lookup_apn(TRUE, "1", "1", FALSE, &failed);
+	g_assert_cmpuint(g_slist_length(apns), == ,1);
+	ap = apns->data;
+	g_assert_cmpstr(ap->provider_name, == ,"New");
+	test_free_apns(apns);
+
+	/* Garbage in the index file gets replaced */
+	test_rewrite(old_xml, now);
+	g_assert(g_file_set_contents(test_index, "MBPI garbage", -1, NULL));
+	apns = test_lookup_apn(TRUE, "1", "1", FALSE, &failed);
+	g_assert_cmpuint(g_slist_length(apns), == ,1);
+	ap = apns->data;
+	g_assert_cmpstr(ap->provider_name, == ,"Old");
+	test_free_apns(apns);
+
+	test_teardown();
+}
+
+static void test_broken(void)
+{
+	gboolean failed;
+
+	/* The parser still reports the errors */
+	test_setup(test_broken_xml);
+	g_assert(!test_lookup_apn(TRUE, "244", "1", FALSE, &failed));
+	g_assert(failed);
+	g_assert(!g_file_test(test_index, G_FILE_TEST_EXISTS));
+	test_teardown();
+
+	/* And so it does when there's no database at all */
+	test_setup(test_xml);
+	unlink(test_db);
+	g_assert(!test_lookup_apn(TRUE, "244", "91", FALSE, &failed));
+	g_assert(failed);
+	test_teardown();
+}
+
+static void test_bench(void)
+{
+	GString *xml = g_string_new("<serviceproviders format=\"2.0\">\n");
+	gboolean failed;
+	GSList *apns;
+	gdouble elapsed;
+	char mcc[8], mnc[8];
+	int i, pass;
+
+	for (i = 0; i < TEST_BENCH_PROVIDERS; i++)
+		g_string_append_printf(xml, "<provider><name>Provider %d</name>"
+			"<gsm><network-id mcc=\"%d\" mnc=\"%02d\"/>"
+			"<apn value=\"internet\"><usage type=\"internet\"/>"
+			"<name>Internet</name><username>user</username>"
+			"<password>pass</password></apn>"
+			"<apn value=\"mms\"><usage type=\"mms\"/>"
+			"<mmsc>http://mms.example.com/</mmsc>"
+			"<mmsproxy>10.0.0.1:8080</mmsproxy></apn></gsm>"
+			"<cdma><sid value=\"%d\"/></cdma></provider>\n",
+			i, 200 + i / 100, i % 100, i);
+
+	g_string_append(xml, "</serviceproviders>\n");
+	test_setup(xml->str);
+
+	for (pass = 0; pass < 2; pass++) {
+		gboolean use_index = (pass == 1);
+
+		if (use_index) {
+			g_test_timer_start();
+			apns = test_lookup_apn(TRUE, "200", "00", FALSE,
+								&failed);
+			elapsed = g_test_timer_elapsed();
+			g_assert_cmpuint(g_slist_length(apns), == ,2);
+			test_free_apns(apns);
+			g_test_message("%u bytes compiled in %.3f ms",
+					(guint) xml->len, elapsed * 1000);
+		}
+
+		g_test_timer_start();
+
+		for (i = 0; i < TEST_BENCH_LOOKUPS; i++) {
+			int n = (i * 7919) % TEST_BENCH_PROVIDERS;
+
+			snprintf(mcc, sizeof(mcc), "%d", 200 + n / 100);
+			snprintf(mnc, sizeof(mnc), "%02d", n % 100);
+			apns = test_lookup_apn(use_index, mcc, mnc, FALSE,
+								&failed);
+			g_assert_cmpuint(g_slist_length(apns), == ,2);
+			test_free_apns(apns);
+		}
+
+		elapsed = g_test_timer_elapsed();
+		g_test_message("%s: %.3f ms per lookup",
+				use_index ? "index" : "parser",
+				elapsed * 1000 / TEST_BENCH_LOOKUPS);
+	}
+
+	test_teardown();
+	g_string_free(xml, TRUE);
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+	g_test_add_func(TEST_SUITE "lookup", test_lookup);
+	g_test_add_func(TEST_SUITE "changed", test_changed);
+	g_test_add_func(TEST_SUITE "broken", test_broken);
+	g_test_add_func(TEST_SUITE "bench", test_bench);
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -0,0 +1,269 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "parcel.h"
+
+#define BENCH_ROUNDS 100000
+
+/*
+ * RIL_REQUEST_GET_SMSC_ADDRESS response captured from rild. Note that
+ * the string length doesn't cover the closing quote.
+ */
+static const guchar rsp_get_smsc_address[] = {
+	0x0d, 0x00, 0x00, 0x00, 0x22, 0x00, 0x2b, 0x00, 0x33, 0x00, 0x34, 0x00,
+	0x36, 0x00, 0x30, 0x00, 0x37, 0x00, 0x30, 0x00, 0x30, 0x00, 0x33, 0x00,
+	0x31, 0x00, 0x31, 0x00, 0x30, 0x00, 0x22, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+/* RIL_REQUEST_DATA_REGISTRATION_STATE response, without the header */
+static const guchar rsp_data_registration_state[] = {
+	0x06, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+	0x30, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x30, 0x00, 0x62, 0x00,
+	0x30, 0x00, 0x38, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00,
+	0x30, 0x00, 0x30, 0x00, 0x30, 0x00, 0x30, 0x00, 0x31, 0x00, 0x30, 0x00,
+	0x65, 0x00, 0x31, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+	0x31, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff, 0x01, 0x00, 0x00, 0x00,
+	0x34, 0x00, 0x00, 0x00
+};
+
+static void test_parcel_wrap(struct parcel *p, const void *data, gsize len)
+{
+	/* Copy the data, the parcel code assumes aligned buffer */
+	p->data = g_memdup(data, len);
+	p->size = len;
+	p->capacity = len;
+	p->offset = 0;
+	p->malformed = 0;
+}
+
+static void test_string_roundtrip(const char *str)
+{
+	struct parcel p;
+	char *out;
+
+	parcel_init(&p);
+	parcel_w_string(&p, str);
+	p.offset = 0;
+
+	out = parcel_r_string(&p);
+	g_assert(!p.malformed);
+	g_assert_cmpstr(out, ==, str);
+	g_assert(p.offset == p.size);
+
+	g_free(out);
+	parcel_free(&p);
+}
+
+static void test_string(void)
+{
+	static const char ascii[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+	static const char *utf8[] = {
+		"\xc3\xa4", "a\xc3\xa4", "abc\xc3\xa4", "abcd\xc3\xa4",
+		"abcde\xc3\xa4", "\xc3\xa4" "abcdefgh",
+		"internet.\xe2\x82\xac", "\xf0\x9f\x98\x80 smiley",
+		"\x7f\xc2\x80"
+	};
+	char buf[sizeof(ascii)];
+	gsize i;
+
+	/* Every length exercises both the 4-character and the tail loop */
+	for (i = 0; i < sizeof(ascii); i++) {
+		memcpy(buf, ascii, i);
+		buf[i] = 0;
+		test_string_roundtrip(buf);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS(utf8); i++)
+		test_string_roundtrip(utf8[i]);
+}
+
+static void test_string_null(void)
+{
+	struct parcel p;
+
+	parcel_init(&p);
+	parcel_w_string(&p, NULL);
+	p.offset = 0;
+	g_assert(!parcel_r_string(&p));
+	g_assert(!p.malformed);
+	parcel_free(&p);
+}
+
+static void test_string_invalid(void)
+{
+	/* Unpaired surrogate must still be rejected */
+	static const guchar data[] = {
+		0x05, 0x00, 0x00, 0x00, 0x61, 0x00, 0x62, 0x00,
+		0x63, 0x00, 0x00, 0xd8, 0x64, 0x00, 0x00, 0x00
+	};
+	/* Length doesn't fit */
+	static const guchar data2[] = {
+		0x04, 0x00, 0x00, 0x00, 0x61, 0x00, 0x62, 0x00
+	};
+	struct parcel p;
+
+	test_parcel_wrap(&p, data, sizeof(data));
+	g_assert(!parcel_r_string(&p));
+	g_assert(p.malformed);
+	parcel_free(&p);
+
+	test_parcel_wrap(&p, data2, sizeof(data2));
+	g_assert(!parcel_r_string(&p));
+	g_assert(p.malformed);
+	parcel_free(&p);
+}
+
+static void test_grow(void)
+{
+	struct parcel p;
+	size_t capacity;
+	int reallocs = 0;
+	int i;
+
+	parcel_init(&p);
+	capacity = p.capacity;
+
+	for (i = 0; i < 1024; i++) {
+		parcel_w_int32(&p, i);
+		if (p.capacity != capacity) {
+			capacity = p.capacity;
+			reallocs++;
+		}
+	}
+
+	g_assert(p.size == 1024 * sizeof(int32_t));
+	g_assert(p.capacity > p.size);
+
+	/* Linear growth would have reallocated on every write */
+	g_assert(reallocs <= 12);
+
+	p.offset = 0;
+	for (i = 0; i < 1024; i++)
+		g_assert(parcel_r_int32(&p) == i);
+
+	parcel_free(&p);
+}
+
+static void test_captured(void)
+{
+	static const char *reg[] = {
+		"0", "0b08", "000010e1", "1", NULL, "4"
+	};
+	struct parcel p;
+	char *str;
+	int i;
+
+	test_parcel_wrap(&p, rsp_get_smsc_address,
+				sizeof(rsp_get_smsc_address));
+	str = parcel_r_string(&p);
+	g_assert_cmpstr(str, ==, "\"+34607003110");
+	g_free(str);
+	parcel_free(&p);
+
+	test_parcel_wrap(&p, rsp_data_registration_state,
+				sizeof(rsp_data_registration_state));
+	g_assert(parcel_r_int32(&p) == G_N_ELEMENTS(reg));
+
+	for (i = 0; i < (int) G_N_ELEMENTS(reg); i++) {
+		str = parcel_r_string(&p);
+		g_assert_cmpstr(str, ==, reg[i]);
+		g_free(str);
+	}
+
+	g_assert(!p.malformed);
+	g_assert(!parcel_data_avail(&p));
+	parcel_free(&p);
+}
+
+static void test_bench(void)
+{
+	struct parcel p;
+	gdouble elapsed;
+	int i, j, n;
+
+	if (!g_test_perf())
+		return;
+
+	g_test_timer_start();
+
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		test_parcel_wrap(&p, rsp_data_registration_state,
+				sizeof(rsp_data_registration_state));
+
+		n = parcel_r_int32(&p);
+		for (j = 0; j < n; j++)
+			g_free(parcel_r_string(&p));
+
+		parcel_free(&p);
+
+		test_parcel_wrap(&p, rsp_get_smsc_address,
+				sizeof(rsp_get_smsc_address));
+		g_free(parcel_r_string(&p));
+		parcel_free(&p);
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed, "parsed %d parcels in %.3f sec",
+						BENCH_ROUNDS * 2, elapsed);
+
+	g_test_timer_start();
+
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		parcel_init(&p);
+		parcel_w_int32(&p, 5);
+		parcel_w_string(&p, "1");
+		parcel_w_string(&p, "1");
+		parcel_w_string(&p, "internet");
+		parcel_w_string(&p, "username");
+		parcel_w_string(&p, "password");
+		parcel_w_string(&p, "0");
+		parcel_w_string(&p, "IPV4V6");
+		parcel_free(&p);
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed, "built %d parcels in %.3f sec",
+						BENCH_ROUNDS, elapsed);
+}
+
+#define TEST_(name) "/parcel/" name
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func(TEST_("string"), test_string);
+	g_test_add_func(TEST_("string_null"), test_string_null);
+	g_test_add_func(TEST_("string_invalid"), test_string_invalid);
+	g_test_add_func(TEST_("grow"), test_grow);
+	g_test_add_func(TEST_("captured"), test_captured);
+	g_test_add_func(TEST_("bench"), test_bench);
+
+	return g_test_run();
+}
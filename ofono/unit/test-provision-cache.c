@@ -0,0 +1,390 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "ofono.h"
+#include "storage.h"
+#include "plugins/mbpi.h"
+#include "plugins/provision.h"
+#include "plugins/provision-cache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+
+#define TEST_SUITE		"/provision-cache/"
+#define TEST_DB			STORAGEDIR "/serviceproviders.xml"
+#define TEST_CACHE		STORAGEDIR "/provision_cache"
+#define TEST_MCC		"244"
+#define TEST_MNC		"91"
+#define TEST_SPN		"Telia"
+#define TEST_CACHE_MAX		32	/* PROVISION_CACHE_MAX */
+#define TEST_BENCH_PROVIDERS	2000
+#define TEST_BENCH_LOOKUPS	1000
+
+static const char test_xml_fmt[] =
+	"<serviceproviders format=\"2.0\">\n"
+	"  <provider primary=\"true\">\n"
+	"    <name>Telia FI</name>\n"
+	"    <gsm>\n"
+	"      <network-id mcc=\"244\" mnc=\"91\"/>\n"
+	"      <apn value=\"%s\">\n"
+	"        <usage type=\"internet\"/>\n"
+	"        <name>Telia Internet</name>\n"
+	"        <username>user</username>\n"
+	"        <password>pass</password>\n"
+	"      </apn>\n"
+	"      <apn value=\"mms\">\n"
+	"        <usage type=\"mms\"/>\n"
+	"        <mmsc>http://mms/</mmsc>\n"
+	"        <mmsproxy>195.156.25.33:8080</mmsproxy>\n"
+	"      </apn>\n"
+	"    </gsm>\n"
+	"  </provider>\n"
+	"  <provider>\n"
+	"    <name>Other</name>\n"
+	"    <gsm>\n"
+	"      <network-id mcc=\"244\" mnc=\"91\"/>\n"
+	"      <apn value=\"other\"/>\n"
+	"    </gsm>\n"
+	"  </provider>\n"
+	"</serviceproviders>\n";
+
+static void test_cleanup(void)
+{
+	provision_cache_cleanup();
+	remove(TEST_CACHE);
+	remove(TEST_DB ".idx");
+	remove(TEST_DB);
+	rmdir(STORAGEDIR);
+}
+
+static void test_write_db(const char *apn, time_t mtime)
+{
+	char *xml = g_strdup_printf(test_xml_fmt, apn);
+	struct utimbuf times;
+
+	g_assert(!create_dirs(TEST_DB, 0700));
+	g_assert(g_file_set_contents(TEST_DB, xml, -1, NULL));
+	times.actime = times.modtime = mtime;
+	g_assert(!utime(TEST_DB, &times));
+	mbpi_database = TEST_DB;
+	g_free(xml);
+}
+
+static void test_assert_equal(const struct ofono_gprs_provision_data *s1,
+			const struct ofono_gprs_provision_data *s2, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		const struct ofono_gprs_provision_data *ap1 = s1 + i;
+		const struct ofono_gprs_provision_data *ap2 = s2 + i;
+
+		g_assert(ap1->type == ap2->type);
+		g_assert(ap1->proto == ap2->proto);
+		g_assert_cmpstr(ap1->provider_name, == ,ap2->provider_name);
+		g_assert(ap1->provider_primary == ap2->provider_primary);
+		g_assert_cmpstr(ap1->name, == ,ap2->name);
+		g_assert_cmpstr(ap1->apn, == ,ap2->apn);
+		g_assert_cmpstr(ap1->username, == ,ap2->username);
+		g_assert_cmpstr(ap1->password, == ,ap2->password);
+		g_assert(ap1->auth_method == ap2->auth_method);
+		g_assert_cmpstr(ap1->message_proxy, == ,ap2->message_proxy);
+		g_assert_cmpstr(ap1->message_center, == ,ap2->message_center);
+	}
+}
+
+static struct ofono_gprs_provision_data *test_get(const char *spn,
+								int *count)
+{
+	struct ofono_gprs_provision_data *settings = NULL;
+
+	g_assert(!provision_get_settings(TEST_MCC, TEST_MNC, spn,
+							&settings, count));
+	g_assert_cmpint(*count, == ,3);
+	return settings;
+}
+
+static void test_hit(void)
+{
+	const struct provision_cache_stats *stats = provision_cache_get_stats();
+	struct ofono_gprs_provision_data *s1, *s2;
+	unsigned int hits = stats->hits;
+	unsigned int misses = stats->misses;
+	int n1, n2;
+
+	test_cleanup();
+	test_write_db("internet", time(NULL));
+
+	s1 = test_get(TEST_SPN, &n1);
+	g_assert_cmpuint(stats->misses, == ,misses + 1);
+	g_assert_cmpstr(s1->apn, == ,"internet");
+	g_assert_cmpstr(s1->username, == ,"user");
+	g_assert_cmpstr(s1[1].message_center, == ,"http://mms/");
+	g_assert_cmpstr(s1[2].apn, == ,"ims");
+
+	s2 = test_get(TEST_SPN, &n2);
+	g_assert_cmpuint(stats->hits, == ,hits + 1);
+	g_assert_cmpint(n1, == ,n2);
+	test_assert_equal(s1, s2, n1);
+	ofono_gprs_provision_free_settings(s2, n2);
+
+	/* The SPN is a part of the key, a missing SPN is not an empty one */
+	s2 = test_get("Other", &n2);
+	g_assert_cmpuint(stats->misses, == ,misses + 2);
+	g_assert_cmpstr(s2->apn, == ,"other");
+	ofono_gprs_provision_free_settings(s2, n2);
+
+	s2 = test_get(NULL, &n2);
+	ofono_gprs_provision_free_settings(s2, n2);
+	s2 = test_get("", &n2);
+	ofono_gprs_provision_free_settings(s2, n2);
+	g_assert_cmpuint(stats->misses, == ,misses + 4);
+
+	ofono_gprs_provision_free_settings(s1, n1);
+	test_cleanup();
+}
+
+static void test_persist(void)
+{
+	const struct provision_cache_stats *stats = provision_cache_get_stats();
+	struct ofono_gprs_provision_data *s1, *s2;
+	unsigned int hits;
+	int n1, n2;
+
+	test_cleanup();
+	test_write_db("internet", time(NULL));
+	s1 = test_get(TEST_SPN, &n1);
+	s2 = test_get(NULL, &n2);
+	ofono_gprs_provision_free_settings(s2, n2);
+	g_assert(g_file_test(TEST_CACHE, G_FILE_TEST_IS_REGULAR));
+
+	/* As if ofono has been restarted */
+	provision_cache_cleanup();
+	hits = stats->hits;
+
+	s2 = test_get(TEST_SPN, &n2);
+	g_assert_cmpuint(stats->hits, == ,hits + 1);
+	g_assert_cmpint(n1, == ,n2);
+	test_assert_equal(s1, s2, n1);
+	ofono_gprs_provision_free_settings(s2, n2);
+
+	s2 = test_get(NULL, &n2);
+	g_assert_cmpuint(stats->hits, == ,hits + 2);
+	ofono_gprs_provision_free_settings(s2, n2);
+
+	ofono_gprs_provision_free_settings(s1, n1);
+	test_cleanup();
+}
+
+static void test_invalidate(void)
+{
+	const struct provision_cache_stats *stats = provision_cache_get_stats();
+	enum ofono_gprs_proto mms_proto = mbpi_default_mms_proto;
+	struct ofono_gprs_provision_data *settings;
+	time_t now = time(NULL);
+	unsigned int misses;
+	int count;
+
+	test_cleanup();
+	test_write_db("internet", now - 20);
+	settings = test_get(TEST_SPN, &count);
+	ofono_gprs_provision_free_settings(settings, count);
+
+	/* Same size, different mtime */
+	test_write_db("internex", now - 10);
+	misses = stats->misses;
+	settings = test_get(TEST_SPN, &count);
+	g_assert_cmpuint(stats->misses, == ,misses + 1);
+	g_assert_cmpstr(settings->apn, == ,"internex");
+	ofono_gprs_provision_free_settings(settings, count);
+
+	/* The database has changed while ofono wasn't running */
+	provision_cache_cleanup();
+	test_write_db("internet", now);
+	misses = stats->misses;
+	settings = test_get(TEST_SPN, &count);
+	g_assert_cmpuint(stats->misses, == ,misses + 1);
+	g_assert_cmpstr(settings->apn, == ,"internet");
+	ofono_gprs_provision_free_settings(settings, count);
+
+	/* So do the defaults */
+	mbpi_default_mms_proto = OFONO_GPRS_PROTO_IPV6;
+	misses = stats->misses;
+	settings = test_get(TEST_SPN, &count);
+	g_assert_cmpuint(stats->misses, == ,misses + 1);
+	g_assert(settings[1].proto == OFONO_GPRS_PROTO_IPV6);
+	ofono_gprs_provision_free_settings(settings, count);
+
+	mbpi_default_mms_proto = mms_proto;
+	test_cleanup();
+}
+
+static void test_put_mnc(int mnc, const char *apn)
+{
+	struct ofono_gprs_provision_data ap;
+	char *mnc_str = g_strdup_printf("%02d", mnc);
+
+	memset(&ap, 0, sizeof(ap));
+	ap.type = OFONO_GPRS_CONTEXT_TYPE_INTERNET;
+	ap.apn = (char *) apn;
+	provision_cache_put(TEST_MCC, mnc_str, NULL, &ap, 1);
+	g_free(mnc_str);
+}
+
+static gboolean test_has_mnc(int mnc)
+{
+	struct ofono_gprs_provision_data *settings;
+	char *mnc_str = g_strdup_printf("%02d", mnc);
+	int count;
+	gboolean found = provision_cache_get(TEST_MCC, mnc_str, NULL,
+							&settings, &count);
+
+	if (found)
+		ofono_gprs_provision_free_settings(settings, count);
+
+	g_free(mnc_str);
+	return found;
+}
+
+static void test_evict(void)
+{
+	int i;
+
+	test_cleanup();
+	test_write_db("internet", time(NULL));
+
+	for (i = 0; i < TEST_CACHE_MAX; i++)
+		test_put_mnc(i, "internet");
+
+	/* Replacing an entry pushes nothing out, but makes it the newest */
+	test_put_mnc(0, "internex");
+	for (i = 0; i < TEST_CACHE_MAX; i++)
+		g_assert(test_has_mnc(i));
+
+	/* A new one only pushes out the oldest */
+	test_put_mnc(TEST_CACHE_MAX, "internet");
+	g_assert(!test_has_mnc(1));
+	g_assert(test_has_mnc(0));
+	for (i = 2; i <= TEST_CACHE_MAX; i++)
+		g_assert(test_has_mnc(i));
+
+	/* The order survives a restart */
+	provision_cache_cleanup();
+	test_put_mnc(TEST_CACHE_MAX + 1, "internet");
+	g_assert(!test_has_mnc(2));
+	g_assert(test_has_mnc(0));
+	for (i = 3; i <= TEST_CACHE_MAX + 1; i++)
+		g_assert(test_has_mnc(i));
+
+	test_cleanup();
+}
+
+static void test_unchanged(void)
+{
+	test_cleanup();
+	test_write_db("internet", time(NULL));
+
+	test_put_mnc(1, "internet");
+	g_assert(g_file_test(TEST_CACHE, G_FILE_TEST_IS_REGULAR));
+
+	/* The same settings again aren't written */
+	remove(TEST_CACHE);
+	test_put_mnc(1, "internet");
+	g_assert(!g_file_test(TEST_CACHE, G_FILE_TEST_EXISTS));
+
+	/* Different ones are */
+	test_put_mnc(1, "internex");
+	g_assert(g_file_test(TEST_CACHE, G_FILE_TEST_IS_REGULAR));
+
+	test_cleanup();
+}
+
+static void test_bench(void)
+{
+	GString *xml = g_string_new("<serviceproviders format=\"2.0\">\n");
+	struct ofono_gprs_provision_data *settings;
+	gdouble elapsed;
+	int count, i, pass;
+
+	test_cleanup();
+
+	for (i = 0; i < TEST_BENCH_PROVIDERS; i++)
+		g_string_append_printf(xml, "<provider><name>Provider %d</name>"
+			"<gsm><network-id mcc=\"%d\" mnc=\"%02d\"/>"
+			"<apn value=\"internet\"><usage type=\"internet\"/>"
+			"</apn></gsm></provider>\n",
+			i, 300 + i / 100, i % 100);
+
+	g_string_append_printf(xml, "<provider><name>Telia</name><gsm>"
+			"<network-id mcc=\"%s\" mnc=\"%s\"/>"
+			"<apn value=\"internet\"><usage type=\"internet\"/>"
+			"</apn></gsm></provider>\n", TEST_MCC, TEST_MNC);
+	g_string_append(xml, "</serviceproviders>\n");
+
+	g_assert(!create_dirs(TEST_DB, 0700));
+	g_assert(g_file_set_contents(TEST_DB, xml->str, -1, NULL));
+	mbpi_database = TEST_DB;
+
+	/* The first pass throws the cache away every time */
+	for (pass = 0; pass < 2; pass++) {
+		g_test_timer_start();
+
+		for (i = 0; i < TEST_BENCH_LOOKUPS; i++) {
+			if (!pass) {
+				provision_cache_cleanup();
+				remove(TEST_CACHE);
+			}
+
+			settings = test_get(TEST_SPN, &count);
+			ofono_gprs_provision_free_settings(settings, count);
+		}
+
+		elapsed = g_test_timer_elapsed();
+		g_test_message("%s: %.3f ms per provisioning",
+				pass ? "cached" : "uncached",
+				elapsed * 1000 / TEST_BENCH_LOOKUPS);
+	}
+
+	g_string_free(xml, TRUE);
+	test_cleanup();
+}
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	__ofono_log_init("test-provision-cache",
+				g_test_verbose() ? "*" : NULL,
+				FALSE, FALSE);
+
+	g_test_add_func(TEST_SUITE "hit", test_hit);
+	g_test_add_func(TEST_SUITE "persist", test_persist);
+	g_test_add_func(TEST_SUITE "invalidate", test_invalidate);
+	g_test_add_func(TEST_SUITE "evict", test_evict);
+	g_test_add_func(TEST_SUITE "unchanged", test_unchanged);
+	g_test_add_func(TEST_SUITE "bench", test_bench);
+
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
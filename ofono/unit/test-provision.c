@@ -25,9 +25,12 @@
 #include "plugins/mbpi.h"
 #include "plugins/provision.h"
 
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #define TEST_SUITE "/provision/"
+#define TEST_CACHE STORAGEDIR "/provision_cache"
 
 extern struct ofono_plugin_desc __ofono_builtin_provision;
 
@@ -128,7 +131,17 @@ static void test_provision(gconstpointer test_data)
 
 	ofono_gprs_provision_free_settings(settings, count);
 	__ofono_builtin_provision.exit();
+
+	/* Don't let the next case hit the cache */
+	remove(TEST_CACHE);
+	rmdir(STORAGEDIR);
+
 	if (file) {
+		char *index = g_strconcat(path, ".idx", NULL);
+
+		/* mbpi compiles the database next to it */
+		remove(index);
+		g_free(index);
 		g_file_delete(file, NULL, NULL);
 		g_object_unref(file);
 	}
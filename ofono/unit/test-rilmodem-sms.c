@@ -456,6 +456,10 @@ void *ofono_sms_get_data(struct ofono_sms *sms)
 	return sms->driver_data;
 }
 
+void ofono_sms_set_submit_window(struct ofono_sms *sms, unsigned int window)
+{
+}
+
 void ofono_sms_register(struct ofono_sms *sms)
 {
 }
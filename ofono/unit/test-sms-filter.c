@@ -1085,6 +1085,36 @@ static void test_recv_message_drop(void)
 
 /* ==== early_free ==== */
 
+static unsigned int test_recv_datagram_pending_filter
+		(struct ofono_modem *modem,
+		const struct ofono_uuid *uuid, int dst_port, int src_port,
+		const unsigned char *buf, unsigned int len,
+		const struct ofono_sms_address *addr,
+		const struct ofono_sms_scts *scts,
+		ofono_sms_filter_recv_datagram_cb_t cb, void *data)
+{
+	test_recv_datagram_filter_count++;
+	return g_timeout_add_seconds(2*TEST_TIMEOUT_SEC,
+					test_no_timeout_cb, NULL);
+}
+
+static unsigned int test_recv_message_pending_filter
+		(struct ofono_modem *modem,
+		const struct ofono_uuid *uuid, const char *message,
+		enum ofono_sms_class cls, const struct ofono_sms_address *addr,
+		const struct ofono_sms_scts *scts,
+		ofono_sms_filter_recv_text_cb_t cb, void *data)
+{
+	test_recv_message_filter_count++;
+	return g_timeout_add_seconds(2*TEST_TIMEOUT_SEC,
+					test_no_timeout_cb, NULL);
+}
+
+static void test_pending_cancel(unsigned int id)
+{
+	g_source_remove(id);
+}
+
 static void test_early_free(void)
 {
 	/* First driver has no callbacks */
@@ -1096,8 +1126,9 @@ static void test_early_free(void)
 	static struct ofono_sms_filter early_free = {
 		.name = "early_free",
 		.priority = 1,
-		.filter_recv_datagram = test_recv_datagram_filter,
-		.filter_recv_text = test_recv_message_filter
+		.filter_recv_datagram = test_recv_datagram_pending_filter,
+		.filter_recv_text = test_recv_message_pending_filter,
+		.cancel = test_pending_cancel
 	};
 
 	struct sms_filter_chain *chain;
@@ -1120,7 +1151,7 @@ static void test_early_free(void)
 	g_assert(ofono_sms_filter_register(&early_free2) == 0);
 	chain = __ofono_sms_filter_chain_new(&sms, &modem);
 
-	/* Submit the datagrams and immediately free the filter */
+	/* Submit the datagrams and free the chain while they are pending */
 	__ofono_sms_filter_chain_recv_text(chain, &uuid, NULL, 0, &addr, &scts,
 				test_default_dispatch_recv_message);
 	__ofono_sms_filter_chain_recv_datagram(chain, &uuid, 0, 0, NULL, 0,
@@ -1138,6 +1169,72 @@ static void test_early_free(void)
 	test_common_deinit();
 }
 
+/* ==== sync ==== */
+
+#define TEST_SYNC_FILTERS (1000)
+#define TEST_SYNC_MESSAGES (100)
+
+static void test_sync(void)
+{
+	struct ofono_sms_filter *filters =
+		g_new0(struct ofono_sms_filter, TEST_SYNC_FILTERS);
+	const struct ofono_filter_chain_stats *stats;
+	struct sms_filter_chain *chain;
+	struct ofono_modem modem;
+	struct ofono_sms sms;
+	struct ofono_uuid uuid;
+	struct sms_address addr;
+	struct sms_scts scts;
+	gdouble elapsed;
+	int i;
+
+	test_common_init();
+	test_recv_message_filter_count = 0;
+	memset(&modem, 0, sizeof(modem));
+	memset(&sms, 0, sizeof(sms));
+	memset(&uuid, 0, sizeof(uuid));
+	memset(&addr, 0, sizeof(addr));
+	memset(&scts, 0, sizeof(scts));
+
+	for (i = 0; i < TEST_SYNC_FILTERS; i++) {
+		filters[i].name = "sync";
+		filters[i].filter_recv_text = test_recv_message_filter;
+		g_assert(ofono_sms_filter_register(filters + i) == 0);
+	}
+
+	chain = __ofono_sms_filter_chain_new(&sms, &modem);
+	stats = __ofono_sms_filter_chain_get_stats(chain);
+	g_assert(!__ofono_sms_filter_chain_get_stats(NULL));
+
+	/* All filters reply inline, nothing is left for the main loop */
+	g_test_timer_start();
+	for (i = 0; i < TEST_SYNC_MESSAGES; i++) {
+		__ofono_sms_filter_chain_recv_text(chain, &uuid,
+				g_strdup("sync"), 0, &addr, &scts,
+				test_default_dispatch_recv_message);
+	}
+	elapsed = g_test_timer_elapsed();
+
+	g_assert(sms.msg_count == TEST_SYNC_MESSAGES);
+	g_assert(test_recv_message_filter_count ==
+				TEST_SYNC_FILTERS * TEST_SYNC_MESSAGES);
+	g_assert(stats->requests == TEST_SYNC_MESSAGES);
+	g_assert(stats->inline_steps ==
+				TEST_SYNC_FILTERS * TEST_SYNC_MESSAGES);
+	g_assert(!stats->async_steps);
+	g_assert(stats->latency_max_us <= stats->latency_total_us);
+	g_test_message("%d messages through %d filters in %.3f sec, "
+			"%u us max", TEST_SYNC_MESSAGES, TEST_SYNC_FILTERS,
+			elapsed, stats->latency_max_us);
+
+	__ofono_sms_filter_chain_free(chain);
+	for (i = 0; i < TEST_SYNC_FILTERS; i++) {
+		ofono_sms_filter_unregister(filters + i);
+	}
+	g_free(filters);
+	test_common_deinit();
+}
+
 #define TEST_(name) "/smsfilter/" name
 
 int main(int argc, char *argv[])
@@ -1169,6 +1266,7 @@ int main(int argc, char *argv[])
 	g_test_add_func(TEST_("recv_message3"), test_recv_message3);
 	g_test_add_func(TEST_("recv_message_drop"), test_recv_message_drop);
 	g_test_add_func(TEST_("early_free"), test_early_free);
+	g_test_add_func(TEST_("sync"), test_sync);
 
 	return g_test_run();
 }
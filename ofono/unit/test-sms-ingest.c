@@ -0,0 +1,661 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "ofono.h"
+#include "common.h"
+#include "smsutil.h"
+#include "message.h"
+
+#include <gdbus.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define TEST_DRIVER		"test"
+#define TEST_IMSI		"244120000000000"
+#define TEST_SC			"358401234567"
+#define TEST_FROM		"358501234567"
+#define TEST_BENCH_SHORT	250
+#define TEST_BENCH_LONG		250
+#define TEST_BENCH_PARTS	3
+
+struct ofono_atom {
+	void (*destruct)(struct ofono_atom *atom);
+	void (*unregister)(struct ofono_atom *atom);
+	void *data;
+};
+
+static struct ofono_atom test_sim_atom = { .data = &test_sim_atom };
+
+static struct test_data {
+	GString *received;
+	unsigned int count;
+} test;
+
+/* ==== Stubs ==== */
+
+struct ofono_atom *__ofono_modem_add_atom(struct ofono_modem *modem,
+					enum ofono_atom_type type,
+					void (*destruct)(struct ofono_atom *),
+					void *data)
+{
+	struct ofono_atom *atom = g_new0(struct ofono_atom, 1);
+
+	atom->destruct = destruct;
+	atom->data = data;
+	return atom;
+}
+
+void __ofono_atom_register(struct ofono_atom *atom,
+				void (*unregister)(struct ofono_atom *))
+{
+	atom->unregister = unregister;
+}
+
+void __ofono_atom_free(struct ofono_atom *atom)
+{
+	if (atom->unregister)
+		atom->unregister(atom);
+
+	atom->destruct(atom);
+	g_free(atom);
+}
+
+void *__ofono_atom_get_data(struct ofono_atom *atom)
+{
+	return atom->data;
+}
+
+struct ofono_modem *__ofono_atom_get_modem(struct ofono_atom *atom)
+{
+	return NULL;
+}
+
+const char *__ofono_atom_get_path(struct ofono_atom *atom)
+{
+	return "/test";
+}
+
+unsigned int __ofono_modem_add_atom_watch(struct ofono_modem *modem,
+					enum ofono_atom_type type,
+					ofono_atom_watch_func notify,
+					void *data, ofono_destroy_func destroy)
+{
+	return type + 1;
+}
+
+gboolean __ofono_modem_remove_atom_watch(struct ofono_modem *modem,
+						unsigned int id)
+{
+	return TRUE;
+}
+
+struct ofono_atom *__ofono_modem_find_atom(struct ofono_modem *modem,
+						enum ofono_atom_type type)
+{
+	return type == OFONO_ATOM_TYPE_SIM ? &test_sim_atom : NULL;
+}
+
+void ofono_modem_add_interface(struct ofono_modem *modem,
+				const char *interface)
+{
+}
+
+void ofono_modem_remove_interface(struct ofono_modem *modem,
+					const char *interface)
+{
+}
+
+unsigned int __ofono_netreg_add_status_watch(struct ofono_netreg *netreg,
+				ofono_netreg_status_notify_cb_t cb,
+				void *data, ofono_destroy_func destroy)
+{
+	return 1;
+}
+
+gboolean __ofono_netreg_remove_status_watch(struct ofono_netreg *netreg,
+						unsigned int id)
+{
+	return TRUE;
+}
+
+enum ofono_netreg_status ofono_netreg_get_status(struct ofono_netreg *netreg)
+{
+	return OFONO_NETREG_STATUS_REGISTERED;
+}
+
+const char *ofono_sim_get_imsi(struct ofono_sim *sim)
+{
+	return TEST_IMSI;
+}
+
+ofono_bool_t __ofono_sim_service_available(struct ofono_sim *sim,
+						int ust_service,
+						int sst_service)
+{
+	return FALSE;
+}
+
+int __ofono_sms_sim_download(struct ofono_stk *stk, const struct sms *msg,
+				__ofono_sms_sim_download_cb_t cb, void *data)
+{
+	return -ENOSYS;
+}
+
+void __ofono_message_waiting_mwi(struct ofono_message_waiting *mw,
+				struct sms *sms, gboolean *out_discard)
+{
+}
+
+void __ofono_history_sms_received(struct ofono_modem *modem,
+					const struct ofono_uuid *uuid,
+					const char *from,
+					const struct tm *remote,
+					const struct tm *local,
+					const char *text)
+{
+}
+
+void __ofono_history_sms_send_pending(struct ofono_modem *modem,
+					const struct ofono_uuid *uuid,
+					const char *to,
+					time_t when, const char *text)
+{
+}
+
+void __ofono_history_sms_send_status(struct ofono_modem *modem,
+					const struct ofono_uuid *uuid,
+					time_t when,
+					enum ofono_history_sms_status status)
+{
+}
+
+struct sms_filter_chain *__ofono_sms_filter_chain_new(struct ofono_sms *sms,
+						struct ofono_modem *modem)
+{
+	return NULL;
+}
+
+void __ofono_sms_filter_chain_free(struct sms_filter_chain *chain)
+{
+}
+
+void __ofono_sms_filter_chain_send_text(struct sms_filter_chain *chain,
+		const struct sms_address *addr, const char *text,
+		sms_send_text_cb_t sender, ofono_destroy_func destroy,
+		void *data)
+{
+	g_assert_not_reached();
+}
+
+void __ofono_sms_filter_chain_send_datagram(struct sms_filter_chain *chain,
+		const struct sms_address *addr, int dstport, int srcport,
+		unsigned char *bytes, int len, int flags,
+		sms_send_datagram_cb_t sender, ofono_destroy_func destroy,
+		void *data)
+{
+	g_assert_not_reached();
+}
+
+void __ofono_sms_filter_chain_recv_text(struct sms_filter_chain *chain,
+		const struct ofono_uuid *uuid, char *message,
+		enum sms_class cls, const struct sms_address *addr,
+		const struct sms_scts *scts,
+		sms_dispatch_recv_text_cb_t default_handler)
+{
+	if (test.received)
+		g_string_append_printf(test.received, "%s;", message);
+
+	test.count++;
+	g_free(message);
+}
+
+void __ofono_sms_filter_chain_recv_datagram(struct sms_filter_chain *chain,
+		const struct ofono_uuid *uuid, int dst_port, int src_port,
+		unsigned char *buf, unsigned int len,
+		const struct sms_address *addr, const struct sms_scts *scts,
+		sms_dispatch_recv_datagram_cb_t default_handler)
+{
+	g_assert_not_reached();
+}
+
+struct ofono_watchlist *__ofono_watchlist_new(ofono_destroy_func destroy)
+{
+	return NULL;
+}
+
+unsigned int __ofono_watchlist_add_item(struct ofono_watchlist *watchlist,
+					struct ofono_watchlist_item *item)
+{
+	return 0;
+}
+
+gboolean __ofono_watchlist_remove_item(struct ofono_watchlist *watchlist,
+					unsigned int id)
+{
+	return FALSE;
+}
+
+void __ofono_watchlist_free(struct ofono_watchlist *watchlist)
+{
+}
+
+struct message *message_create(const struct ofono_uuid *uuid,
+						struct ofono_atom *atom)
+{
+	return NULL;
+}
+
+gboolean message_dbus_register(struct message *m)
+{
+	return FALSE;
+}
+
+void message_dbus_unregister(struct message *m)
+{
+}
+
+const struct ofono_uuid *message_get_uuid(const struct message *m)
+{
+	return NULL;
+}
+
+void message_set_state(struct message *m, enum message_state new_state)
+{
+}
+
+void message_append_properties(struct message *m, DBusMessageIter *dict)
+{
+}
+
+void message_emit_added(struct message *m, const char *interface)
+{
+}
+
+void message_emit_removed(struct message *m, const char *interface)
+{
+}
+
+void message_set_data(struct message *m, void *data)
+{
+}
+
+const char *message_path_from_uuid(struct ofono_atom *atom,
+						const struct ofono_uuid *uuid)
+{
+	return NULL;
+}
+
+DBusConnection *ofono_dbus_get_connection(void)
+{
+	return NULL;
+}
+
+void ofono_dbus_dict_append(DBusMessageIter *dict, const char *key, int type,
+				const void *value)
+{
+}
+
+int ofono_dbus_signal_property_changed(DBusConnection *conn, const char *path,
+					const char *interface, const char *name,
+					int type, const void *value)
+{
+	return 0;
+}
+
+void __ofono_dbus_pending_reply(DBusMessage **msg, DBusMessage *reply)
+{
+}
+
+ofono_bool_t ofono_dbus_access_method_allowed(const char *sender,
+	enum ofono_dbus_access_intf iface, int method, const char *arg)
+{
+	return TRUE;
+}
+
+DBusMessage *ofono_dbus_error_access_denied(DBusMessage *msg)
+{
+	return NULL;
+}
+
+DBusMessage *ofono_dbus_error_busy(DBusMessage *msg)
+{
+	return NULL;
+}
+
+DBusMessage *ofono_dbus_error_canceled(DBusMessage *msg)
+{
+	return NULL;
+}
+
+DBusMessage *ofono_dbus_error_failed(DBusMessage *msg)
+{
+	return NULL;
+}
+
+DBusMessage *ofono_dbus_error_invalid_args(DBusMessage *msg)
+{
+	return NULL;
+}
+
+DBusMessage *ofono_dbus_error_invalid_format(DBusMessage *msg)
+{
+	return NULL;
+}
+
+DBusMessage *ofono_dbus_error_not_implemented(DBusMessage *msg)
+{
+	return NULL;
+}
+
+gboolean g_dbus_register_interface(DBusConnection *connection,
+					const char *path, const char *name,
+					const GDBusMethodTable *methods,
+					const GDBusSignalTable *signals,
+					const GDBusPropertyTable *properties,
+					void *user_data,
+					GDBusDestroyFunction destroy)
+{
+	return TRUE;
+}
+
+gboolean g_dbus_unregister_interface(DBusConnection *connection,
+					const char *path, const char *name)
+{
+	return TRUE;
+}
+
+gboolean g_dbus_send_message(DBusConnection *connection, DBusMessage *message)
+{
+	return FALSE;
+}
+
+gboolean g_dbus_send_reply(DBusConnection *connection,
+				DBusMessage *message, int type, ...)
+{
+	return FALSE;
+}
+
+
+/* ==== Fake driver ==== */
+
+static int test_probe(struct ofono_sms *sms, unsigned int vendor, void *data)
+{
+	return 0;
+}
+
+static void test_remove(struct ofono_sms *sms)
+{
+}
+
+static const struct ofono_sms_driver test_driver = {
+	.name		= TEST_DRIVER,
+	.probe		= test_probe,
+	.remove		= test_remove,
+};
+
+/* ==== Common ==== */
+
+static void test_rmdir_r(const char *path)
+{
+	GDir *dir = g_dir_open(path, 0, NULL);
+	const char *name;
+
+	if (dir == NULL) {
+		unlink(path);
+		return;
+	}
+
+	while ((name = g_dir_read_name(dir))) {
+		char *file = g_build_filename(path, name, NULL);
+
+		test_rmdir_r(file);
+		g_free(file);
+	}
+
+	g_dir_close(dir);
+	rmdir(path);
+}
+
+static struct ofono_sms *test_init(void)
+{
+	struct ofono_sms *sms;
+
+	memset(&test, 0, sizeof(test));
+	test.received = g_string_new(NULL);
+
+	g_assert(!ofono_sms_driver_register(&test_driver));
+	sms = ofono_sms_create(NULL, 0, TEST_DRIVER, NULL);
+	g_assert(sms);
+	ofono_sms_register(sms);
+	return sms;
+}
+
+static void test_cleanup(struct ofono_sms *sms)
+{
+	ofono_sms_remove(sms);
+	ofono_sms_driver_unregister(&test_driver);
+	g_string_free(test.received, TRUE);
+}
+
+/* UCS2 SMS-DELIVER, with a concatenation header if max > 1 */
+static void test_pdu(struct ofono_sms_pdu *out, unsigned char *buf,
+				const char *text, guint8 ref, guint8 max,
+				guint8 seq)
+{
+	struct sms s;
+	int len, tpdu_len;
+	guint8 *ud;
+	size_t i;
+
+	memset(&s, 0, sizeof(s));
+	s.type = SMS_TYPE_DELIVER;
+	s.sc_addr.number_type = SMS_NUMBER_TYPE_INTERNATIONAL;
+	s.sc_addr.numbering_plan = SMS_NUMBERING_PLAN_ISDN;
+	strcpy(s.sc_addr.address, TEST_SC);
+	s.deliver.oaddr.number_type = SMS_NUMBER_TYPE_INTERNATIONAL;
+	s.deliver.oaddr.numbering_plan = SMS_NUMBERING_PLAN_ISDN;
+	strcpy(s.deliver.oaddr.address, TEST_FROM);
+	s.deliver.dcs = 0x08;
+	s.deliver.scts.year = 26;
+	s.deliver.scts.month = 10;
+	s.deliver.scts.day = 19;
+	s.deliver.scts.hour = 12;
+	s.deliver.scts.has_timezone = TRUE;
+
+	ud = s.deliver.ud;
+
+	if (max > 1) {
+		s.deliver.udhi = TRUE;
+		*ud++ = 5;
+		*ud++ = SMS_IEI_CONCATENATED_8BIT;
+		*ud++ = 3;
+		*ud++ = ref;
+		*ud++ = max;
+		*ud++ = seq;
+	}
+
+	for (i = 0; text[i]; i++) {
+		*ud++ = 0;
+		*ud++ = text[i];
+	}
+
+	s.deliver.udl = ud - s.deliver.ud;
+	g_assert(sms_encode(&s, &len, &tpdu_len, buf));
+
+	out->pdu = buf;
+	out->len = len;
+	out->tpdu_len = tpdu_len;
+}
+
+/* ==== Tests ==== */
+
+static void test_batch(void)
+{
+	static const unsigned char garbage[] = { 0xff, 0xff, 0xff, 0xff };
+	unsigned char buf[7][176];
+	struct ofono_sms_pdu pdus[7];
+	struct ofono_sms *sms;
+	int n = 0;
+
+	test_rmdir_r(STORAGEDIR);
+	sms = test_init();
+
+	test_pdu(pdus + n, buf[n], "one", 0, 1, 1); n++;
+	test_pdu(pdus + n, buf[n], "-b", 1, 2, 2); n++;
+	test_pdu(pdus + n, buf[n], "two", 1, 2, 1); n++;
+	pdus[n].pdu = garbage;
+	pdus[n].len = sizeof(garbage);
+	pdus[n].tpdu_len = sizeof(garbage);
+	n++;
+	test_pdu(pdus + n, buf[n], "three", 0, 1, 1); n++;
+	test_pdu(pdus + n, buf[n], "four", 2, 3, 1); n++;
+	test_pdu(pdus + n, buf[n], "-b", 2, 3, 2); n++;
+
+	/* Messages come out in the order they were completed */
+	g_assert(ofono_sms_deliver_notify_batch(sms, pdus, n));
+	g_assert_cmpstr(test.received->str, == ,"one;two-b;three;");
+	g_assert_cmpuint(test.count, == ,3);
+
+	/* An empty batch is fine too */
+	g_assert(ofono_sms_deliver_notify_batch(sms, NULL, 0));
+	g_assert_cmpuint(test.count, == ,3);
+	test_cleanup(sms);
+
+	/* The fragments of the incomplete message made it to the disk */
+	sms = test_init();
+	test_pdu(pdus, buf[0], "-c", 2, 3, 3);
+	ofono_sms_deliver_notify(sms, pdus[0].pdu, pdus[0].len,
+							pdus[0].tpdu_len);
+	g_assert_cmpstr(test.received->str, == ,"four-b-c;");
+	test_cleanup(sms);
+
+	test_rmdir_r(STORAGEDIR);
+}
+
+static void test_batch_failed(void)
+{
+	unsigned char buf[3][176];
+	struct ofono_sms_pdu pdus[3];
+	struct ofono_sms *sms;
+	int n = 0;
+
+	/* A directory in the way of the journal fails the backup */
+	test_rmdir_r(STORAGEDIR);
+	g_assert(!g_mkdir_with_parents(STORAGEDIR "/" TEST_IMSI
+						"/sms_journal", 0700));
+	sms = test_init();
+
+	test_pdu(pdus + n, buf[n], "one", 0, 1, 1); n++;
+	test_pdu(pdus + n, buf[n], "-b", 1, 2, 2); n++;
+	test_pdu(pdus + n, buf[n], "two", 1, 2, 1); n++;
+
+	/* Nothing goes out, the PDUs have to stay on the modem */
+	g_assert(!ofono_sms_deliver_notify_batch(sms, pdus, n));
+	g_assert_cmpstr(test.received->str, == ,"");
+	g_assert_cmpuint(test.count, == ,0);
+	test_cleanup(sms);
+
+	test_rmdir_r(STORAGEDIR);
+}
+
+static struct ofono_sms_pdu *test_bench_pdus(unsigned int *count)
+{
+	const unsigned int n = TEST_BENCH_SHORT +
+				TEST_BENCH_LONG * TEST_BENCH_PARTS;
+	struct ofono_sms_pdu *pdus = g_new(struct ofono_sms_pdu, n);
+	unsigned char *buf = g_malloc(n * 176);
+	unsigned int i, j, k = 0;
+	char text[32];
+
+	for (i = 0; i < TEST_BENCH_SHORT; i++, k++) {
+		snprintf(text, sizeof(text), "Message %u", i);
+		test_pdu(pdus + k, buf + k * 176, text, 0, 1, 1);
+	}
+
+	for (i = 0; i < TEST_BENCH_LONG; i++)
+		for (j = 1; j <= TEST_BENCH_PARTS; j++, k++) {
+			snprintf(text, sizeof(text), "Part %u of %u", j, i);
+			test_pdu(pdus + k, buf + k * 176, text, i,
+						TEST_BENCH_PARTS, j);
+		}
+
+	*count = n;
+	return pdus;
+}
+
+static void test_bench(void)
+{
+	struct ofono_sms_pdu *pdus;
+	struct ofono_sms *sms;
+	unsigned int count, i;
+	gdouble elapsed;
+
+	pdus = test_bench_pdus(&count);
+
+	test_rmdir_r(STORAGEDIR);
+	sms = test_init();
+
+	g_test_timer_start();
+	for (i = 0; i < count; i++)
+		ofono_sms_deliver_notify(sms, pdus[i].pdu, pdus[i].len,
+							pdus[i].tpdu_len);
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpuint(test.count, == ,TEST_BENCH_SHORT + TEST_BENCH_LONG);
+	g_test_message("%u stored PDUs one at a time in %.3f sec", count,
+								elapsed);
+	test_cleanup(sms);
+
+	test_rmdir_r(STORAGEDIR);
+	sms = test_init();
+
+	g_test_timer_start();
+	g_assert(ofono_sms_deliver_notify_batch(sms, pdus, count));
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpuint(test.count, == ,TEST_BENCH_SHORT + TEST_BENCH_LONG);
+	g_test_message("%u stored PDUs in one batch in %.3f sec", count,
+								elapsed);
+	test_cleanup(sms);
+
+	test_rmdir_r(STORAGEDIR);
+	g_free((void *) pdus[0].pdu);
+	g_free(pdus);
+}
+
+#define TEST_(name) "/sms-ingest/" name
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	__ofono_log_init("test-sms-ingest",
+				g_test_verbose() ? "*" : NULL,
+				FALSE, FALSE);
+
+	g_test_add_func(TEST_("batch"), test_batch);
+	g_test_add_func(TEST_("batch_failed"), test_batch_failed);
+	g_test_add_func(TEST_("bench"), test_bench);
+
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -0,0 +1,369 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "storage.h"
+#include "sms-journal.h"
+
+#define TEST_IMSI	"244120000000000"
+#define TEST_DIR	STORAGEDIR "/" TEST_IMSI
+#define TEST_JOURNAL	TEST_DIR "/sms_journal"
+#define TEST_ASSEMBLY	TEST_DIR "/sms_assembly"
+#define TEST_TX_QUEUE	TEST_DIR "/tx_queue"
+#define TEST_MODE	0600
+#define TEST_BENCH_DIRS	1000
+#define TEST_BENCH_SEQS	10
+
+static void test_rmdir_r(const char *path)
+{
+	GDir *dir = g_dir_open(path, 0, NULL);
+	const char *name;
+
+	if (dir == NULL) {
+		unlink(path);
+		return;
+	}
+
+	while ((name = g_dir_read_name(dir))) {
+		char *file = g_build_filename(path, name, NULL);
+
+		test_rmdir_r(file);
+		g_free(file);
+	}
+
+	g_dir_close(dir);
+	rmdir(path);
+}
+
+static off_t test_journal_size(void)
+{
+	struct stat st;
+
+	return stat(TEST_JOURNAL, &st) == 0 ? st.st_size : -1;
+}
+
+static void test_collect(const char *key, const void *data, unsigned int len,
+				time_t ts, void *user_data)
+{
+	GString *keys = user_data;
+
+	g_string_append_printf(keys, "%s=%.*s@%ld;", key, (int) len,
+						(const char *) data, (long) ts);
+}
+
+static char *test_dump(struct sms_journal *journal, const char *prefix)
+{
+	GString *keys = g_string_new(NULL);
+
+	sms_journal_foreach(journal, prefix, test_collect, keys);
+	return g_string_free(keys, FALSE);
+}
+
+static void test_basic(void)
+{
+	struct sms_journal *journal;
+	struct sms_journal *ref;
+	char *dump;
+
+	test_rmdir_r(STORAGEDIR);
+	g_assert(!sms_journal_open(NULL));
+
+	journal = sms_journal_open(TEST_IMSI);
+	g_assert(journal);
+	g_assert_cmpuint(sms_journal_count(journal), == ,0);
+
+	/* Nothing is written until there is something to write */
+	g_assert_cmpint(test_journal_size(), == ,-1);
+
+	g_assert(sms_journal_put(journal, "a/10", "ten", 3, 10));
+	g_assert(sms_journal_put(journal, "a/2", "two", 3, 2));
+	g_assert(sms_journal_put(journal, "a/1", "one", 3, 1));
+	g_assert(sms_journal_put(journal, "b/1", "bee", 3, 1));
+	g_assert(sms_journal_put(journal, "a/1", "uno", 3, 11));
+	g_assert(sms_journal_remove(journal, "a/2"));
+	g_assert(!sms_journal_remove(journal, "a/2"));
+	g_assert(!sms_journal_put(journal, "", "x", 1, 0));
+
+	/* The same IMSI gets the same journal */
+	ref = sms_journal_open(TEST_IMSI);
+	g_assert(ref == journal);
+	sms_journal_close(ref);
+
+	dump = test_dump(journal, "a/");
+	g_assert_cmpstr(dump, == ,"a/1=uno@11;a/10=ten@10;");
+	g_free(dump);
+	sms_journal_close(journal);
+
+	/* Everything survives a restart */
+	journal = sms_journal_open(TEST_IMSI);
+	g_assert_cmpuint(sms_journal_count(journal), == ,3);
+	dump = test_dump(journal, NULL);
+	g_assert_cmpstr(dump, == ,"a/1=uno@11;a/10=ten@10;b/1=bee@1;");
+	g_free(dump);
+
+	g_assert_cmpuint(sms_journal_remove_prefix(journal, "a/"), == ,2);
+	sms_journal_close(journal);
+
+	journal = sms_journal_open(TEST_IMSI);
+	dump = test_dump(journal, NULL);
+	g_assert_cmpstr(dump, == ,"b/1=bee@1;");
+	g_free(dump);
+	sms_journal_close(journal);
+
+	test_rmdir_r(STORAGEDIR);
+}
+
+static void test_torn(void)
+{
+	static const char garbage[] = "\x01\x02\x03\x04\x01\x00\x05\x00";
+	struct sms_journal *journal;
+	off_t size;
+	FILE *f;
+	char *dump;
+
+	test_rmdir_r(STORAGEDIR);
+
+	journal = sms_journal_open(TEST_IMSI);
+	g_assert(sms_journal_put(journal, "a/1", "one", 3, 1));
+	g_assert(sms_journal_put(journal, "a/2", "two", 3, 2));
+	sms_journal_close(journal);
+	size = test_journal_size();
+
+	/* What a write cut short by a crash could leave behind */
+	f = fopen(TEST_JOURNAL, "ab");
+	g_assert(f);
+	g_assert(fwrite(garbage, sizeof(garbage), 1, f) == 1);
+	fclose(f);
+	g_assert_cmpint(test_journal_size(), > ,size);
+
+	journal = sms_journal_open(TEST_IMSI);
+	dump = test_dump(journal, NULL);
+	g_assert_cmpstr(dump, == ,"a/1=one@1;a/2=two@2;");
+	g_free(dump);
+	g_assert_cmpint(test_journal_size(), == ,size);
+
+	/* And appending carries on from where the good records end */
+	g_assert(sms_journal_put(journal, "a/3", "three", 5, 3));
+	sms_journal_close(journal);
+
+	journal = sms_journal_open(TEST_IMSI);
+	g_assert_cmpuint(sms_journal_count(journal), == ,3);
+	sms_journal_close(journal);
+
+	test_rmdir_r(STORAGEDIR);
+}
+
+static void test_compact(void)
+{
+	struct sms_journal *journal;
+	off_t size;
+	int i;
+
+	test_rmdir_r(STORAGEDIR);
+
+	journal = sms_journal_open(TEST_IMSI);
+	g_assert(sms_journal_put(journal, "a/1", "one", 3, 1));
+	size = test_journal_size();
+
+	for (i = 0; i < 1000; i++) {
+		g_assert(sms_journal_put(journal, "a/2", "two", 3, 2));
+		g_assert(sms_journal_remove(journal, "a/2"));
+	}
+
+	/* The journal doesn't grow without bounds */
+	g_assert_cmpint(test_journal_size(), < ,size * 600);
+	sms_journal_close(journal);
+
+	journal = sms_journal_open(TEST_IMSI);
+	g_assert_cmpuint(sms_journal_count(journal), == ,1);
+	g_assert(sms_journal_compact(journal));
+	g_assert_cmpint(test_journal_size(), == ,size);
+
+	/* An empty journal doesn't take any space */
+	g_assert(sms_journal_remove(journal, "a/1"));
+	g_assert(sms_journal_compact(journal));
+	g_assert_cmpint(test_journal_size(), == ,-1);
+	sms_journal_close(journal);
+
+	test_rmdir_r(STORAGEDIR);
+}
+
+static void test_migrate(void)
+{
+	struct sms_journal *journal;
+	char *dump;
+
+	test_rmdir_r(STORAGEDIR);
+
+	g_assert(write_file((const unsigned char *) "one", 3, TEST_MODE,
+				TEST_ASSEMBLY "/1234-1-2/000") == 3);
+	g_assert(write_file((const unsigned char *) "two", 3, TEST_MODE,
+				TEST_ASSEMBLY "/1234-1-2/001") == 3);
+	g_assert(write_file((const unsigned char *) "pdu", 3, TEST_MODE,
+				TEST_TX_QUEUE "/0-0-ABCD/000") == 3);
+	g_assert(write_file((const unsigned char *) "tmp", 3, TEST_MODE,
+				TEST_TX_QUEUE "/0-0-ABCD/001.XXXXXX.tmp") == 3);
+
+	journal = sms_journal_open(TEST_IMSI);
+	g_assert_cmpuint(sms_journal_count(journal), == ,3);
+
+	dump = test_dump(journal, "sms_assembly/1234-1-2/");
+	g_assert(strstr(dump, "sms_assembly/1234-1-2/000=one@"));
+	g_assert(strstr(dump, "sms_assembly/1234-1-2/001=two@"));
+	g_free(dump);
+
+	dump = test_dump(journal, "tx_queue/");
+	g_assert(g_str_has_prefix(dump, "tx_queue/0-0-ABCD/000=pdu@"));
+	g_free(dump);
+
+	/* The old files are gone */
+	g_assert(!g_file_test(TEST_ASSEMBLY, G_FILE_TEST_EXISTS));
+	g_assert(!g_file_test(TEST_TX_QUEUE, G_FILE_TEST_EXISTS));
+	sms_journal_close(journal);
+
+	journal = sms_journal_open(TEST_IMSI);
+	g_assert_cmpuint(sms_journal_count(journal), == ,3);
+	sms_journal_close(journal);
+
+	test_rmdir_r(STORAGEDIR);
+}
+
+static void test_batch(void)
+{
+	struct sms_journal *journal;
+	off_t size;
+	char *dump;
+
+	test_rmdir_r(STORAGEDIR);
+
+	journal = sms_journal_open(TEST_IMSI);
+	g_assert(sms_journal_put(journal, "a/1", "one", 3, 1));
+	size = test_journal_size();
+
+	sms_journal_begin(journal);
+	g_assert(sms_journal_put(journal, "a/2", "two", 3, 2));
+	sms_journal_begin(journal);
+	g_assert(sms_journal_put(journal, "a/3", "three", 5, 3));
+	g_assert(sms_journal_remove(journal, "a/1"));
+	g_assert(sms_journal_commit(journal));
+
+	/* Nothing hits the disk until the outermost commit */
+	g_assert_cmpint(test_journal_size(), == ,size);
+	dump = test_dump(journal, NULL);
+	g_assert_cmpstr(dump, == ,"a/2=two@2;a/3=three@3;");
+	g_free(dump);
+
+	g_assert(sms_journal_commit(journal));
+	g_assert_cmpint(test_journal_size(), > ,size);
+
+	/* Unbalanced commits are harmless */
+	g_assert(sms_journal_commit(journal));
+
+	/* A batch left open is written out on close */
+	sms_journal_begin(journal);
+	g_assert(sms_journal_put(journal, "a/4", "four", 4, 4));
+	sms_journal_close(journal);
+
+	journal = sms_journal_open(TEST_IMSI);
+	dump = test_dump(journal, NULL);
+	g_assert_cmpstr(dump, == ,"a/2=two@2;a/3=three@3;a/4=four@4;");
+	g_free(dump);
+	sms_journal_close(journal);
+
+	test_rmdir_r(STORAGEDIR);
+}
+
+static void test_count(const char *key, const void *data, unsigned int len,
+				time_t ts, void *user_data)
+{
+	unsigned int *count = user_data;
+
+	(*count)++;
+}
+
+static void test_bench(void)
+{
+	unsigned char pdu[176];
+	struct sms_journal *journal;
+	unsigned int count = 0;
+	gdouble elapsed;
+	int i, j;
+
+	test_rmdir_r(STORAGEDIR);
+	memset(pdu, 0x55, sizeof(pdu));
+
+	for (i = 0; i < TEST_BENCH_DIRS; i++)
+		for (j = 0; j < TEST_BENCH_SEQS; j++)
+			write_file(pdu, sizeof(pdu), TEST_MODE,
+					TEST_ASSEMBLY "/%04X-%d-%d/%03d",
+					i, i % 256, TEST_BENCH_SEQS, j);
+
+	/* The first open reads the same files the old backup code did */
+	g_test_timer_start();
+	journal = sms_journal_open(TEST_IMSI);
+	sms_journal_foreach(journal, "sms_assembly/", test_count, &count);
+	sms_journal_close(journal);
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpuint(count, == ,TEST_BENCH_DIRS * TEST_BENCH_SEQS);
+	g_test_message("%u fragments from files in %.3f sec", count, elapsed);
+
+	count = 0;
+	g_test_timer_start();
+	journal = sms_journal_open(TEST_IMSI);
+	sms_journal_foreach(journal, "sms_assembly/", test_count, &count);
+	sms_journal_close(journal);
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpuint(count, == ,TEST_BENCH_DIRS * TEST_BENCH_SEQS);
+	g_test_message("%u fragments from the journal in %.3f sec", count,
+								elapsed);
+
+	test_rmdir_r(STORAGEDIR);
+}
+
+#define TEST_(name) "/sms-journal/" name
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func(TEST_("basic"), test_basic);
+	g_test_add_func(TEST_("torn"), test_torn);
+	g_test_add_func(TEST_("compact"), test_compact);
+	g_test_add_func(TEST_("migrate"), test_migrate);
+	g_test_add_func(TEST_("batch"), test_batch);
+	g_test_add_func(TEST_("bench"), test_bench);
+
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
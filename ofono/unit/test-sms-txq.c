@@ -0,0 +1,740 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "ofono.h"
+#include "common.h"
+#include "smsutil.h"
+#include "message.h"
+
+#include <gdbus.h>
+#include <errno.h>
+
+#define TEST_DRIVER		"test"
+#define TEST_TO			"+358501234567"
+#define TEST_LONG_PARTS		3
+#define TEST_TIMEOUT_SEC	20
+#define TEST_BENCH_MSGS		100
+#define TEST_BENCH_LATENCY	5
+#define TEST_CMS_FAILURE	500
+
+struct ofono_atom {
+	void (*destruct)(struct ofono_atom *atom);
+	void (*unregister)(struct ofono_atom *atom);
+	void *data;
+};
+
+struct test_submit {
+	ofono_sms_submit_cb_t cb;
+	void *data;
+	int ref;
+	gboolean fail;
+};
+
+static struct ofono_atom test_netreg_atom;
+static ofono_netreg_status_notify_cb_t test_netreg_cb;
+static void *test_netreg_data;
+
+static struct test_driver_data {
+	GMainLoop *loop;
+	GHashTable *last_seq;
+	GHashTable *busy;
+	guint latency;
+	unsigned int pending;
+	unsigned int max_pending;
+	unsigned int submitted;
+	unsigned int sent;
+	unsigned int failed;
+	unsigned int expected;
+	int fail_ref;
+	void (*submit_hook)(struct ofono_sms *sms);
+} test;
+
+/* ==== Stubs ==== */
+
+struct ofono_atom *__ofono_modem_add_atom(struct ofono_modem *modem,
+					enum ofono_atom_type type,
+					void (*destruct)(struct ofono_atom *),
+					void *data)
+{
+	struct ofono_atom *atom = g_new0(struct ofono_atom, 1);
+
+	atom->destruct = destruct;
+	atom->data = data;
+	return atom;
+}
+
+void __ofono_atom_register(struct ofono_atom *atom,
+				void (*unregister)(struct ofono_atom *))
+{
+	atom->unregister = unregister;
+}
+
+void __ofono_atom_free(struct ofono_atom *atom)
+{
+	if (atom->unregister)
+		atom->unregister(atom);
+
+	atom->destruct(atom);
+	g_free(atom);
+}
+
+void *__ofono_atom_get_data(struct ofono_atom *atom)
+{
+	return atom->data;
+}
+
+struct ofono_modem *__ofono_atom_get_modem(struct ofono_atom *atom)
+{
+	return NULL;
+}
+
+const char *__ofono_atom_get_path(struct ofono_atom *atom)
+{
+	return "/test";
+}
+
+unsigned int __ofono_modem_add_atom_watch(struct ofono_modem *modem,
+					enum ofono_atom_type type,
+					ofono_atom_watch_func notify,
+					void *data, ofono_destroy_func destroy)
+{
+	if (type == OFONO_ATOM_TYPE_NETREG)
+		notify(&test_netreg_atom, OFONO_ATOM_WATCH_CONDITION_REGISTERED,
+									data);
+
+	return type + 1;
+}
+
+gboolean __ofono_modem_remove_atom_watch(struct ofono_modem *modem,
+						unsigned int id)
+{
+	return TRUE;
+}
+
+struct ofono_atom *__ofono_modem_find_atom(struct ofono_modem *modem,
+						enum ofono_atom_type type)
+{
+	return NULL;
+}
+
+void ofono_modem_add_interface(struct ofono_modem *modem,
+				const char *interface)
+{
+}
+
+void ofono_modem_remove_interface(struct ofono_modem *modem,
+					const char *interface)
+{
+}
+
+unsigned int __ofono_netreg_add_status_watch(struct ofono_netreg *netreg,
+				ofono_netreg_status_notify_cb_t cb,
+				void *data, ofono_destroy_func destroy)
+{
+	test_netreg_cb = cb;
+	test_netreg_data = data;
+	return 1;
+}
+
+gboolean __ofono_netreg_remove_status_watch(struct ofono_netreg *netreg,
+						unsigned int id)
+{
+	test_netreg_cb = NULL;
+	test_netreg_data = NULL;
+	return TRUE;
+}
+
+enum ofono_netreg_status ofono_netreg_get_status(struct ofono_netreg *netreg)
+{
+	return OFONO_NETREG_STATUS_REGISTERED;
+}
+
+const char *ofono_sim_get_imsi(struct ofono_sim *sim)
+{
+	return NULL;
+}
+
+ofono_bool_t __ofono_sim_service_available(struct ofono_sim *sim,
+						int ust_service,
+						int sst_service)
+{
+	return FALSE;
+}
+
+int __ofono_sms_sim_download(struct ofono_stk *stk, const struct sms *msg,
+				__ofono_sms_sim_download_cb_t cb, void *data)
+{
+	return -ENOSYS;
+}
+
+void __ofono_message_waiting_mwi(struct ofono_message_waiting *mw,
+				struct sms *sms, gboolean *out_discard)
+{
+}
+
+void __ofono_history_sms_received(struct ofono_modem *modem,
+					const struct ofono_uuid *uuid,
+					const char *from,
+					const struct tm *remote,
+					const struct tm *local,
+					const char *text)
+{
+}
+
+void __ofono_history_sms_send_pending(struct ofono_modem *modem,
+					const struct ofono_uuid *uuid,
+					const char *to,
+					time_t when, const char *text)
+{
+}
+
+void __ofono_history_sms_send_status(struct ofono_modem *modem,
+					const struct ofono_uuid *uuid,
+					time_t when,
+					enum ofono_history_sms_status status)
+{
+}
+
+struct sms_filter_chain *__ofono_sms_filter_chain_new(struct ofono_sms *sms,
+						struct ofono_modem *modem)
+{
+	return NULL;
+}
+
+void __ofono_sms_filter_chain_free(struct sms_filter_chain *chain)
+{
+}
+
+void __ofono_sms_filter_chain_send_text(struct sms_filter_chain *chain,
+		const struct sms_address *addr, const char *text,
+		sms_send_text_cb_t sender, ofono_destroy_func destroy,
+		void *data)
+{
+	g_assert_not_reached();
+}
+
+void __ofono_sms_filter_chain_send_datagram(struct sms_filter_chain *chain,
+		const struct sms_address *addr, int dstport, int srcport,
+		unsigned char *bytes, int len, int flags,
+		sms_send_datagram_cb_t sender, ofono_destroy_func destroy,
+		void *data)
+{
+	g_assert_not_reached();
+}
+
+void __ofono_sms_filter_chain_recv_text(struct sms_filter_chain *chain,
+		const struct ofono_uuid *uuid, char *message,
+		enum sms_class cls, const struct sms_address *addr,
+		const struct sms_scts *scts,
+		sms_dispatch_recv_text_cb_t default_handler)
+{
+	g_assert_not_reached();
+}
+
+void __ofono_sms_filter_chain_recv_datagram(struct sms_filter_chain *chain,
+		const struct ofono_uuid *uuid, int dst_port, int src_port,
+		unsigned char *buf, unsigned int len,
+		const struct sms_address *addr, const struct sms_scts *scts,
+		sms_dispatch_recv_datagram_cb_t default_handler)
+{
+	g_assert_not_reached();
+}
+
+struct ofono_watchlist *__ofono_watchlist_new(ofono_destroy_func destroy)
+{
+	return NULL;
+}
+
+unsigned int __ofono_watchlist_add_item(struct ofono_watchlist *watchlist,
+					struct ofono_watchlist_item *item)
+{
+	return 0;
+}
+
+gboolean __ofono_watchlist_remove_item(struct ofono_watchlist *watchlist,
+					unsigned int id)
+{
+	return FALSE;
+}
+
+void __ofono_watchlist_free(struct ofono_watchlist *watchlist)
+{
+}
+
+struct message *message_create(const struct ofono_uuid *uuid,
+						struct ofono_atom *atom)
+{
+	return NULL;
+}
+
+gboolean message_dbus_register(struct message *m)
+{
+	return FALSE;
+}
+
+void message_dbus_unregister(struct message *m)
+{
+}
+
+const struct ofono_uuid *message_get_uuid(const struct message *m)
+{
+	return NULL;
+}
+
+void message_set_state(struct message *m, enum message_state new_state)
+{
+}
+
+void message_append_properties(struct message *m, DBusMessageIter *dict)
+{
+}
+
+void message_emit_added(struct message *m, const char *interface)
+{
+}
+
+void message_emit_removed(struct message *m, const char *interface)
+{
+}
+
+void message_set_data(struct message *m, void *data)
+{
+}
+
+const char *message_path_from_uuid(struct ofono_atom *atom,
+						const struct ofono_uuid *uuid)
+{
+	return NULL;
+}
+
+DBusConnection *ofono_dbus_get_connection(void)
+{
+	return NULL;
+}
+
+void ofono_dbus_dict_append(DBusMessageIter *dict, const char *key, int type,
+				const void *value)
+{
+}
+
+int ofono_dbus_signal_property_changed(DBusConnection *conn, const char *path,
+					const char *interface, const char *name,
+					int type, const void *value)
+{
+	return 0;
+}
+
+void __ofono_dbus_pending_reply(DBusMessage **msg, DBusMessage *reply)
+{
+}
+
+ofono_bool_t ofono_dbus_access_method_allowed(const char *sender,
+	enum ofono_dbus_access_intf iface, int method, const char *arg)
+{
+	return TRUE;
+}
+
+DBusMessage *ofono_dbus_error_access_denied(DBusMessage *msg)
+{
+	return NULL;
+}
+
+DBusMessage *ofono_dbus_error_busy(DBusMessage *msg)
+{
+	return NULL;
+}
+
+DBusMessage *ofono_dbus_error_canceled(DBusMessage *msg)
+{
+	return NULL;
+}
+
+DBusMessage *ofono_dbus_error_failed(DBusMessage *msg)
+{
+	return NULL;
+}
+
+DBusMessage *ofono_dbus_error_invalid_args(DBusMessage *msg)
+{
+	return NULL;
+}
+
+DBusMessage *ofono_dbus_error_invalid_format(DBusMessage *msg)
+{
+	return NULL;
+}
+
+DBusMessage *ofono_dbus_error_not_implemented(DBusMessage *msg)
+{
+	return NULL;
+}
+
+gboolean g_dbus_register_interface(DBusConnection *connection,
+					const char *path, const char *name,
+					const GDBusMethodTable *methods,
+					const GDBusSignalTable *signals,
+					const GDBusPropertyTable *properties,
+					void *user_data,
+					GDBusDestroyFunction destroy)
+{
+	return TRUE;
+}
+
+gboolean g_dbus_unregister_interface(DBusConnection *connection,
+					const char *path, const char *name)
+{
+	return TRUE;
+}
+
+gboolean g_dbus_send_message(DBusConnection *connection, DBusMessage *message)
+{
+	return FALSE;
+}
+
+gboolean g_dbus_send_reply(DBusConnection *connection,
+				DBusMessage *message, int type, ...)
+{
+	return FALSE;
+}
+
+/* ==== Fake driver ==== */
+
+static gboolean test_submit_done(gpointer user_data)
+{
+	struct test_submit *req = user_data;
+	struct ofono_error error;
+
+	test.pending--;
+
+	if (req->ref >= 0)
+		g_hash_table_remove(test.busy, GINT_TO_POINTER(req->ref));
+
+	error.type = req->fail ? OFONO_ERROR_TYPE_CMS :
+						OFONO_ERROR_TYPE_NO_ERROR;
+	error.error = req->fail ? TEST_CMS_FAILURE : 0;
+	req->cb(&error, test.submitted & 0xff, req->data);
+
+	g_free(req);
+	return G_SOURCE_REMOVE;
+}
+
+static void test_submit(struct ofono_sms *sms, const unsigned char *pdu,
+			int pdu_len, int tpdu_len, int mms,
+			ofono_sms_submit_cb_t cb, void *data)
+{
+	struct test_submit *req = g_new0(struct test_submit, 1);
+	struct sms s;
+	guint16 ref;
+	guint8 max, seq;
+
+	g_assert(sms_decode(pdu, pdu_len, TRUE, tpdu_len, &s));
+
+	req->cb = cb;
+	req->data = data;
+	req->ref = -1;
+
+	if (sms_extract_concatenation(&s, &ref, &max, &seq)) {
+		gpointer key = GINT_TO_POINTER(ref);
+		guint last = GPOINTER_TO_UINT(g_hash_table_lookup(
+						test.last_seq, key));
+
+		/* The parts of a message go one at a time and in order */
+		g_assert(!g_hash_table_contains(test.busy, key));
+		g_assert_cmpuint(seq, == ,last + 1);
+		g_hash_table_insert(test.last_seq, key, GUINT_TO_POINTER(seq));
+		g_hash_table_add(test.busy, key);
+		req->ref = ref;
+		req->fail = (ref == test.fail_ref);
+	}
+
+	test.submitted++;
+	test.pending++;
+
+	if (test.pending > test.max_pending)
+		test.max_pending = test.pending;
+
+	g_timeout_add(test.latency, test_submit_done, req);
+
+	if (test.submit_hook)
+		test.submit_hook(sms);
+}
+
+static int test_probe(struct ofono_sms *sms, unsigned int vendor, void *data)
+{
+	ofono_sms_set_submit_window(sms, GPOINTER_TO_UINT(data));
+	return 0;
+}
+
+static void test_remove(struct ofono_sms *sms)
+{
+}
+
+static const struct ofono_sms_driver test_driver = {
+	.name		= TEST_DRIVER,
+	.probe		= test_probe,
+	.remove		= test_remove,
+	.submit		= test_submit,
+};
+
+/* ==== Common ==== */
+
+static gboolean test_timeout(gpointer user_data)
+{
+	g_assert_not_reached();
+	return G_SOURCE_REMOVE;
+}
+
+static struct ofono_sms *test_init(unsigned int window, guint latency)
+{
+	struct ofono_sms *sms;
+
+	memset(&test, 0, sizeof(test));
+	test.loop = g_main_loop_new(NULL, FALSE);
+	test.last_seq = g_hash_table_new(g_direct_hash, g_direct_equal);
+	test.busy = g_hash_table_new(g_direct_hash, g_direct_equal);
+	test.latency = latency;
+	test.fail_ref = -1;
+
+	g_assert(!ofono_sms_driver_register(&test_driver));
+	sms = ofono_sms_create(NULL, 0, TEST_DRIVER, GUINT_TO_POINTER(window));
+	g_assert(sms);
+	ofono_sms_register(sms);
+	g_assert(test_netreg_cb);
+
+	return sms;
+}
+
+static void test_cleanup(struct ofono_sms *sms)
+{
+	ofono_sms_remove(sms);
+	ofono_sms_driver_unregister(&test_driver);
+	g_assert(!test_netreg_cb);
+
+	g_hash_table_destroy(test.last_seq);
+	g_hash_table_destroy(test.busy);
+	g_main_loop_unref(test.loop);
+}
+
+static void test_sent(gboolean ok, void *data)
+{
+	if (ok)
+		test.sent++;
+	else
+		test.failed++;
+
+	if (test.sent + test.failed == test.expected)
+		g_main_loop_quit(test.loop);
+}
+
+static void test_queue(struct ofono_sms *sms, guint16 ref,
+				gboolean concat, struct ofono_uuid *uuid)
+{
+	GString *text = g_string_new(NULL);
+	struct ofono_uuid id;
+	GSList *list;
+
+	g_string_printf(text, "Message %u", ref);
+
+	if (concat)
+		while (text->len < 153 * (TEST_LONG_PARTS - 1) + 1)
+			g_string_append_c(text, 'x');
+
+	list = sms_text_prepare(TEST_TO, text->str, ref, FALSE, FALSE);
+	g_assert_cmpuint(g_slist_length(list), == ,
+					concat ? TEST_LONG_PARTS : 1);
+
+	g_assert(!__ofono_sms_txq_submit(sms, list, 0, &id, NULL, NULL));
+	g_assert(!__ofono_sms_txq_set_submit_notify(sms, &id, test_sent,
+								NULL, NULL));
+	test.expected++;
+
+	if (uuid)
+		*uuid = id;
+
+	g_slist_free_full(list, g_free);
+	g_string_free(text, TRUE);
+}
+
+static void test_run(void)
+{
+	guint timeout = g_timeout_add_seconds(TEST_TIMEOUT_SEC,
+							test_timeout, NULL);
+
+	g_main_loop_run(test.loop);
+	g_source_remove(timeout);
+}
+
+/* ==== Tests ==== */
+
+static void test_window(gconstpointer data)
+{
+	unsigned int window = GPOINTER_TO_UINT(data);
+	struct ofono_sms *sms = test_init(window, 1);
+	int i;
+
+	/* Two long messages among the short ones */
+	for (i = 0; i < 10; i++)
+		test_queue(sms, i, i == 1 || i == 2, NULL);
+
+	test_run();
+
+	g_assert_cmpuint(test.sent, == ,10);
+	g_assert_cmpuint(test.failed, == ,0);
+	g_assert_cmpuint(test.submitted, == ,8 + 2 * TEST_LONG_PARTS);
+	g_assert_cmpuint(test.max_pending, == ,window);
+	g_assert_cmpuint(test.pending, == ,0);
+
+	test_cleanup(sms);
+}
+
+static void test_failure(void)
+{
+	struct ofono_sms *sms = test_init(4, 1);
+	int i;
+
+	/* A failed message doesn't hold up the rest */
+	test.fail_ref = 1;
+
+	for (i = 0; i < 6; i++)
+		test_queue(sms, i, TRUE, NULL);
+
+	test_run();
+
+	g_assert_cmpuint(test.sent, == ,5);
+	g_assert_cmpuint(test.failed, == ,1);
+	g_assert_cmpuint(test.submitted, == ,5 * TEST_LONG_PARTS + 1);
+
+	test_cleanup(sms);
+}
+
+static struct ofono_uuid test_cancel_first;
+static struct ofono_uuid test_cancel_last;
+
+static void test_cancel_hook(struct ofono_sms *sms)
+{
+	if (test.submitted > 1)
+		return;
+
+	/* Can't take back what the driver already has */
+	g_assert_cmpint(__ofono_sms_txq_cancel(sms, &test_cancel_first),
+							== ,-EPERM);
+
+	/* But what's still waiting for its turn can go */
+	g_assert_cmpint(__ofono_sms_txq_cancel(sms, &test_cancel_last),
+							== ,0);
+}
+
+static void test_cancel(void)
+{
+	struct ofono_sms *sms = test_init(2, 1);
+	int i;
+
+	test_queue(sms, 0, TRUE, &test_cancel_first);
+
+	for (i = 1; i < 4; i++)
+		test_queue(sms, i, FALSE, &test_cancel_last);
+
+	test.submit_hook = test_cancel_hook;
+	test_run();
+
+	g_assert_cmpuint(test.sent, == ,3);
+	g_assert_cmpuint(test.failed, == ,1);
+	g_assert_cmpuint(test.submitted, == ,TEST_LONG_PARTS + 2);
+
+	test_cleanup(sms);
+}
+
+static void test_unregistered(void)
+{
+	struct ofono_sms *sms = test_init(4, 1);
+	int i;
+
+	test_netreg_cb(NETWORK_REGISTRATION_STATUS_NOT_REGISTERED, 0, 0, 0,
+					NULL, NULL, test_netreg_data);
+
+	for (i = 0; i < 6; i++)
+		test_queue(sms, i, i & 1, NULL);
+
+	/* Nothing goes out until we are back */
+	g_main_context_iteration(NULL, FALSE);
+	g_assert_cmpuint(test.submitted, == ,0);
+
+	test_netreg_cb(NETWORK_REGISTRATION_STATUS_REGISTERED, 0, 0, 0,
+					NULL, NULL, test_netreg_data);
+	test_run();
+
+	g_assert_cmpuint(test.sent, == ,6);
+	g_assert_cmpuint(test.max_pending, == ,4);
+
+	test_cleanup(sms);
+}
+
+static void test_bench(void)
+{
+	static const unsigned int windows[] = { 1, 4, 16 };
+	unsigned int i, j;
+
+	for (i = 0; i < G_N_ELEMENTS(windows); i++) {
+		struct ofono_sms *sms = test_init(windows[i],
+							TEST_BENCH_LATENCY);
+		gdouble elapsed;
+
+		g_test_timer_start();
+
+		for (j = 0; j < TEST_BENCH_MSGS; j++)
+			test_queue(sms, j, FALSE, NULL);
+
+		test_run();
+		elapsed = g_test_timer_elapsed();
+
+		g_assert_cmpuint(test.sent, == ,TEST_BENCH_MSGS);
+		g_test_message("window %u: %u messages in %.3f sec, "
+				"%.0f messages/minute", windows[i],
+				TEST_BENCH_MSGS, elapsed,
+				TEST_BENCH_MSGS * 60 / elapsed);
+
+		test_cleanup(sms);
+	}
+}
+
+#define TEST_(name) "/sms-txq/" name
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	__ofono_log_init("test-sms-txq",
+				g_test_verbose() ? "*" : NULL,
+				FALSE, FALSE);
+
+	g_test_add_data_func(TEST_("window1"), GUINT_TO_POINTER(1),
+							test_window);
+	g_test_add_data_func(TEST_("window4"), GUINT_TO_POINTER(4),
+							test_window);
+	g_test_add_func(TEST_("failure"), test_failure);
+	g_test_add_func(TEST_("cancel"), test_cancel);
+	g_test_add_func(TEST_("unregistered"), test_unregistered);
+	g_test_add_func(TEST_("bench"), test_bench);
+
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
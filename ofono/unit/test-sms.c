@@ -1100,17 +1100,17 @@ static void test_assembly(void)
 				sms_address_to_string(&sms.deliver.oaddr));
 	}
 
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	sms_assembly_expire(assembly, time(NULL) + 40);
 
-	g_assert(g_slist_length(assembly->assembly_list) == 0);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 0);
 
 	sms_extract_concatenation(&sms, &ref, &max, &seq);
 	l = sms_assembly_add_fragment(assembly, &sms, time(NULL),
 					&sms.deliver.oaddr, ref, max, seq);
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	decode_hex_own_buf(assembly_pdu2, -1, &pdu_len, 0, pdu);
@@ -1156,6 +1156,54 @@ static void test_assembly(void)
 	g_free(reencoded);
 }
 
+static void test_assembly_expire(void)
+{
+	unsigned char pdu[176];
+	long pdu_len;
+	struct sms sms;
+	struct sms_assembly *assembly = sms_assembly_new(NULL);
+	guint16 ref;
+	guint8 max;
+	guint8 seq;
+	GSList *l;
+	int i;
+
+	decode_hex_own_buf(assembly_pdu1, -1, &pdu_len, 0, pdu);
+	sms_decode(pdu, pdu_len, FALSE, assembly_pdu_len1, &sms);
+	sms_extract_concatenation(&sms, &ref, &max, &seq);
+
+	/* Add them out of order, expiry goes by the time stamp */
+	for (i = 0; i < 100; i++) {
+		int n = (i * 37) % 100;
+
+		l = sms_assembly_add_fragment(assembly, &sms, 1000 + n,
+					&sms.deliver.oaddr, n, max, seq);
+		g_assert(l == NULL);
+	}
+
+	g_assert(g_hash_table_size(assembly->assembly_table) == 100);
+
+	/* Same address and reference with a different max is dropped */
+	l = sms_assembly_add_fragment(assembly, &sms, 2000,
+					&sms.deliver.oaddr, 0, max + 1, seq);
+	g_assert(l == NULL);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 100);
+
+	sms_assembly_expire(assembly, 1049);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 50);
+
+	/* The expired references are free to start over */
+	l = sms_assembly_add_fragment(assembly, &sms, 2000,
+					&sms.deliver.oaddr, 0, max, seq);
+	g_assert(l == NULL);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 51);
+
+	sms_assembly_expire(assembly, 1999);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
+
+	sms_assembly_free(assembly);
+}
+
 static const char *test_no_fragmentation_7bit = "This is testing !";
 static const char *expected_no_fragmentation_7bit = "079153485002020911000C915"
 			"348870420140000A71154747A0E4ACF41F4F29C9E769F4121";
@@ -1372,6 +1420,76 @@ static void test_prepare_limits(void)
 	test_limit(ucs2, target_size, FALSE);
 }
 
+static void test_prepare_dialect(void)
+{
+	GString *text = g_string_new(NULL);
+	GSList *r;
+	struct sms *sms;
+	int i;
+
+	/* "ş" only has a single shift code in the default locking table */
+	for (i = 0; i < 150; i++)
+		g_string_append_unichar(text, 0x15f);
+
+	/* Both Turkish tables take one SMS, the single shift only three */
+	r = sms_text_prepare_with_alphabet("555", text->str, 0, FALSE, FALSE,
+						SMS_ALPHABET_TURKISH);
+	g_assert(r);
+	g_assert(g_slist_length(r) == 1);
+
+	sms = r->data;
+	g_assert(sms->submit.udhi);
+	g_assert(sms->submit.ud[0] == 6);
+	g_assert(sms->submit.ud[1] == SMS_IEI_NATIONAL_LANGUAGE_SINGLE_SHIFT);
+	g_assert(sms->submit.ud[3] == GSM_DIALECT_TURKISH);
+	g_assert(sms->submit.ud[4] == SMS_IEI_NATIONAL_LANGUAGE_LOCKING_SHIFT);
+	g_assert(sms->submit.ud[6] == GSM_DIALECT_TURKISH);
+	g_slist_free_full(r, g_free);
+
+	/* A short text sticks to the single shift table */
+	r = sms_text_prepare_with_alphabet("555", "\xc5\x9f", 0, FALSE, FALSE,
+						SMS_ALPHABET_TURKISH);
+	g_assert(r);
+	g_assert(g_slist_length(r) == 1);
+
+	sms = r->data;
+	g_assert(sms->submit.ud[0] == 3);
+	g_assert(sms->submit.ud[1] == SMS_IEI_NATIONAL_LANGUAGE_SINGLE_SHIFT);
+	g_slist_free_full(r, g_free);
+
+	/*
+	 * 298 septets look like two segments with the single shift table,
+	 * but the escape pair ending the first one can't be split and
+	 * pushes the text into a third. Both tables fit it into two.
+	 */
+	g_string_truncate(text, 0);
+
+	for (i = 0; i < 5; i++)
+		g_string_append_unichar(text, 0x15f);
+
+	for (i = 0; i < 138; i++)
+		g_string_append_c(text, 'a');
+
+	g_string_append_unichar(text, 0x15f);
+
+	for (i = 0; i < 148; i++)
+		g_string_append_c(text, 'a');
+
+	r = sms_text_prepare_with_alphabet("555", text->str, 0, FALSE, FALSE,
+						SMS_ALPHABET_TURKISH);
+	g_assert(r);
+	g_assert(g_slist_length(r) == 2);
+
+	sms = r->data;
+	g_assert(sms->submit.ud[0] == 11);
+	g_assert(sms->submit.ud[1] == SMS_IEI_NATIONAL_LANGUAGE_SINGLE_SHIFT);
+	g_assert(sms->submit.ud[4] == SMS_IEI_NATIONAL_LANGUAGE_LOCKING_SHIFT);
+	g_assert(sms->submit.ud[7] == SMS_IEI_CONCATENATED_8BIT);
+	g_slist_free_full(r, g_free);
+
+	g_string_free(text, TRUE);
+}
+
 static const char *cbs1 = "011000320111C2327BFC76BBCBEE46A3D168341A8D46A3D1683"
 	"41A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D168"
 	"341A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D100";
@@ -1475,14 +1593,14 @@ static void test_cbs_assembly(void)
 	/* Add an initial page to the assembly */
 	l = cbs_assembly_add_page(assembly, &dec1);
 	g_assert(l);
-	g_assert(g_slist_length(assembly->recv_cell) == 1);
+	g_assert(g_hash_table_size(assembly->recv_cell) == 1);
 	g_slist_free_full(l, g_free);
 
 	/* Can we receive new updates ? */
 	dec1.update_number = 8;
 	l = cbs_assembly_add_page(assembly, &dec1);
 	g_assert(l);
-	g_assert(g_slist_length(assembly->recv_cell) == 1);
+	g_assert(g_hash_table_size(assembly->recv_cell) == 1);
 	g_slist_free_full(l, g_free);
 
 	/* Do we ignore old pages ? */
@@ -1495,7 +1613,7 @@ static void test_cbs_assembly(void)
 	g_assert(l == NULL);
 
 	cbs_assembly_location_changed(assembly, TRUE, TRUE, TRUE);
-	g_assert(assembly->recv_cell == NULL);
+	g_assert(g_hash_table_size(assembly->recv_cell) == 0);
 
 	dec1.update_number = 9;
 	dec1.page = 3;
@@ -1624,6 +1742,137 @@ static void test_range_minimizer(void)
 	}
 }
 
+static void test_topic_bitmap(void)
+{
+	struct cbs_topic_range edges[] = {
+		{ 0, 0 }, { 31, 32 }, { 63, 64 }, { 100, 227 },
+		{ 4352, 4356 }, { 65535, 65535 },
+	};
+	GSList *extracted = NULL;
+	GSList *r = NULL;
+	guint32 *bitmap;
+	unsigned int topic;
+	unsigned int i;
+
+	g_assert(cbs_topic_ranges_to_bitmap(NULL) == NULL);
+	g_assert(!cbs_topic_in_bitmap(0, NULL));
+
+	for (i = 0; i < G_N_ELEMENTS(edges); i++)
+		r = g_slist_append(r, &edges[i]);
+
+	for (i = 0; ranges[i]; i++)
+		extracted = g_slist_concat(extracted,
+					cbs_extract_topic_ranges(ranges[i]));
+
+	r = g_slist_concat(r, g_slist_copy(extracted));
+	bitmap = cbs_topic_ranges_to_bitmap(r);
+
+	for (topic = 0; topic < 65536; topic++)
+		g_assert(cbs_topic_in_bitmap(topic, bitmap) ==
+				cbs_topic_in_range(topic, r));
+
+	g_assert(cbs_topic_in_bitmap(65535, bitmap));
+	g_assert(!cbs_topic_in_bitmap(65536, bitmap));
+
+	g_free(bitmap);
+	g_slist_free(r);
+	g_slist_free_full(extracted, g_free);
+}
+
+#define CBS_FLOOD_MESSAGES 20000
+#define CBS_FLOOD_BATCH 16
+
+/* Takes the page the way ofono_cbs_notify() does, TRUE if it completes */
+static gboolean cbs_flood_page(struct cbs_assembly *assembly,
+				const guint32 *sim_topics,
+				const struct cbs *cbs)
+{
+	unsigned char pdu[88];
+	struct cbs decoded;
+	int pdu_len;
+	GSList *l;
+
+	g_assert(cbs_encode(cbs, &pdu_len, pdu));
+	g_assert(cbs_decode(pdu, pdu_len, &decoded));
+
+	if (cbs_topic_in_bitmap(decoded.message_identifier, sim_topics))
+		return FALSE;
+
+	l = cbs_assembly_add_page(assembly, &decoded);
+	if (l == NULL)
+		return FALSE;
+
+	g_assert(g_slist_length(l) == decoded.max_pages);
+	g_slist_free_full(l, g_free);
+
+	return TRUE;
+}
+
+static void test_cbs_flood(void)
+{
+	struct cbs_topic_range sim_range = { 1000, 1099 };
+	GSList *sim_ranges = g_slist_append(NULL, &sim_range);
+	guint32 *sim_topics = cbs_topic_ranges_to_bitmap(sim_ranges);
+	struct cbs_assembly *assembly = cbs_assembly_new();
+	unsigned int completed = 0;
+	unsigned int expected = 0;
+	unsigned int pages = 0;
+	gdouble elapsed;
+	struct cbs cbs;
+	int batch, repeat, id;
+
+	memset(&cbs, 0, sizeof(cbs));
+	cbs.gs = CBS_GEO_SCOPE_PLMN;
+	cbs.dcs = 0x0f;
+	cbs.udlen = 82;
+	memset(cbs.ud, 0x55, sizeof(cbs.ud));
+
+	for (id = 0; id < CBS_FLOOD_MESSAGES; id++)
+		if (id % 4096 < sim_range.min || id % 4096 > sim_range.max)
+			expected += 1;
+
+	g_test_timer_start();
+
+	/*
+	 * Multi page messages a batch at a time, with the pages of the
+	 * batch interleaved and the whole batch repeated, as an alert
+	 * network would.
+	 */
+	for (batch = 0; batch < CBS_FLOOD_MESSAGES; batch += CBS_FLOOD_BATCH) {
+		for (repeat = 0; repeat < 2; repeat++) {
+			for (cbs.page = 4; cbs.page > 0; cbs.page--) {
+				for (id = batch; id < batch + CBS_FLOOD_BATCH;
+									id++) {
+					cbs.message_identifier = id % 4096;
+					cbs.message_code = id / 4096;
+					cbs.max_pages = 1 + id % 4;
+
+					if (cbs.page > cbs.max_pages)
+						continue;
+
+					pages += 1;
+					completed += cbs_flood_page(assembly,
+								sim_topics,
+								&cbs);
+				}
+			}
+		}
+	}
+
+	elapsed = g_test_timer_elapsed();
+
+	if (g_test_verbose())
+		g_print("%u CBS pages in %.3f sec\n", pages, elapsed);
+
+	/* Every message once, except those for the SIM */
+	g_assert(completed == expected);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 0);
+
+	cbs_assembly_free(assembly);
+	g_free(sim_topics);
+	g_slist_free(sim_ranges);
+}
+
 static void test_sr_assembly(void)
 {
 	const char *sr_pdu1 = "06040D91945152991136F00160124130340A0160124130"
@@ -1722,6 +1971,86 @@ static void test_sr_assembly(void)
 	status_report_assembly_free(sra);
 }
 
+#define SR_BULK_SENDS 5000
+
+static void sr_bulk_report(struct sms *sr, const char *raddr, unsigned char mr)
+{
+	memset(sr, 0, sizeof(*sr));
+	sr->type = SMS_TYPE_STATUS_REPORT;
+	sr->status_report.mr = mr;
+	sr->status_report.st = SMS_ST_COMPLETED_RECEIVED;
+	sms_address_from_string(&sr->status_report.raddr, raddr);
+}
+
+static void test_sr_assembly_bulk(void)
+{
+	struct status_report_assembly *sra = status_report_assembly_new(NULL);
+	unsigned char msgid[SMS_MSGID_LEN];
+	unsigned char id[SMS_MSGID_LEN];
+	struct sms_address addr;
+	gboolean delivered;
+	struct sms sr;
+	char straddr[32];
+	gdouble elapsed;
+	int i;
+
+	memset(msgid, 0, sizeof(msgid));
+
+	/* A bulk sender, every message waits for its report */
+	for (i = 0; i < SR_BULK_SENDS; i++) {
+		memcpy(msgid, &i, sizeof(i));
+		sprintf(straddr, "+3584%08d", i);
+		sms_address_from_string(&addr, straddr);
+		status_report_assembly_add_fragment(sra, msgid, &addr, i % 256,
+							1000 + i, 1);
+	}
+
+	g_assert(g_hash_table_size(sra->assembly_table) == SR_BULK_SENDS);
+
+	/* Nothing for an MR that wasn't sent to the address */
+	sr_bulk_report(&sr, "+358400000000", 1);
+	g_assert(!status_report_assembly_report(sra, &sr, id, &delivered));
+
+	g_test_timer_start();
+
+	/* Reports for the first half in the national format */
+	for (i = 0; i < SR_BULK_SENDS / 2; i++) {
+		sprintf(straddr, "04%08d", i);
+		sr_bulk_report(&sr, straddr, i % 256);
+		g_assert(status_report_assembly_report(sra, &sr, id,
+							&delivered));
+		g_assert(memcmp(id, &i, sizeof(i)) == 0);
+		g_assert(delivered == TRUE);
+	}
+
+	elapsed = g_test_timer_elapsed();
+
+	if (g_test_verbose())
+		g_print("%d status reports in %.3f sec\n", SR_BULK_SENDS / 2,
+								elapsed);
+
+	g_assert(g_hash_table_size(sra->assembly_table) == SR_BULK_SENDS / 2);
+
+	/* Only the messages that have expired go */
+	status_report_assembly_expire(sra, 1000 + SR_BULK_SENDS * 3 / 4 - 1);
+	g_assert(g_hash_table_size(sra->assembly_table) == SR_BULK_SENDS / 4);
+
+	/* Sending again pushes the expiration back */
+	i = SR_BULK_SENDS - 1;
+	memcpy(msgid, &i, sizeof(i));
+	sprintf(straddr, "+3584%08d", i);
+	sms_address_from_string(&addr, straddr);
+	status_report_assembly_add_fragment(sra, msgid, &addr, 1, 100000, 2);
+
+	status_report_assembly_expire(sra, 1000 + SR_BULK_SENDS);
+	g_assert(g_hash_table_size(sra->assembly_table) == 1);
+
+	status_report_assembly_expire(sra, 100000);
+	g_assert(g_hash_table_size(sra->assembly_table) == 0);
+
+	status_report_assembly_free(sra);
+}
+
 struct wap_push_data {
 	const char *pdu;
 	int len;
@@ -1914,6 +2243,8 @@ int main(int argc, char **argv)
 			&ems_udh_test_2, test_ems_udh);
 
 	g_test_add_func("/testsms/Test Assembly", test_assembly);
+	g_test_add_func("/testsms/Test Assembly Expire",
+					test_assembly_expire);
 	g_test_add_func("/testsms/Test Prepare 7Bit", test_prepare_7bit);
 
 	g_test_add_data_func("/testsms/Test Prepare Concat",
@@ -1932,6 +2263,7 @@ int main(int argc, char **argv)
 			&long_string_test, test_prepare_concat);
 
 	g_test_add_func("/testsms/Test Prepare Limits", test_prepare_limits);
+	g_test_add_func("/testsms/Test Prepare Dialect", test_prepare_dialect);
 
 	g_test_add_func("/testsms/Test CBS Encode / Decode",
 			test_cbs_encode_decode);
@@ -1941,8 +2273,12 @@ int main(int argc, char **argv)
 			test_cbs_padding_character);
 
 	g_test_add_func("/testsms/Range minimizer", test_range_minimizer);
+	g_test_add_func("/testsms/Topic bitmap", test_topic_bitmap);
+	g_test_add_func("/testsms/Test CBS Flood", test_cbs_flood);
 
 	g_test_add_func("/testsms/Status Report Assembly", test_sr_assembly);
+	g_test_add_func("/testsms/Status Report Assembly Bulk",
+					test_sr_assembly_bulk);
 
 	g_test_add_data_func("/testsms/Test WAP Push 1", &wap_push_1,
 				test_wap_push);
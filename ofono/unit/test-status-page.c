@@ -0,0 +1,182 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "ofono.h"
+#include "common.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define TEST_UPDATES 1000000
+
+static const volatile struct ofono_status_page *test_map(int fd)
+{
+	void *map = mmap(NULL, sizeof(struct ofono_status_page), PROT_READ,
+							MAP_SHARED, fd, 0);
+
+	g_assert(map != MAP_FAILED);
+	return map;
+}
+
+static void test_unmap(const volatile struct ofono_status_page *map)
+{
+	munmap((void *) map, sizeof(struct ofono_status_page));
+}
+
+static void test_disabled(void)
+{
+	__ofono_status_page_set_enabled(FALSE);
+	g_assert(!__ofono_status_page_new("test"));
+	g_assert_cmpint(__ofono_status_page_get_fd(NULL), == ,-1);
+
+	/* These are all NULL-safe */
+	__ofono_status_page_update_netreg(NULL, 0, 0, 0);
+	__ofono_status_page_update_gprs(NULL, FALSE, 0, 0);
+	__ofono_status_page_free(NULL);
+}
+
+static void test_basic(void)
+{
+	const volatile struct ofono_status_page *map;
+	struct ofono_status_page copy;
+	struct status_page *page;
+	char *path;
+	int fd, rw_fd;
+
+	__ofono_status_page_set_enabled(TRUE);
+	page = __ofono_status_page_new("test");
+	g_assert(page);
+
+	fd = __ofono_status_page_get_fd(page);
+	g_assert_cmpint(fd, >= ,0);
+
+	/* Clients can't scribble on it, not even after reopening it */
+	g_assert(mmap(NULL, sizeof(copy), PROT_READ | PROT_WRITE,
+					MAP_SHARED, fd, 0) == MAP_FAILED);
+	path = g_strdup_printf("/proc/self/fd/%d", fd);
+	rw_fd = open(path, O_RDWR);
+	g_free(path);
+	if (rw_fd >= 0) {
+		g_assert(mmap(NULL, sizeof(copy), PROT_READ | PROT_WRITE,
+					MAP_SHARED, rw_fd, 0) == MAP_FAILED);
+		g_assert(write(rw_fd, &copy, sizeof(copy)) < 0);
+		g_assert(ftruncate(rw_fd, 0) < 0);
+		close(rw_fd);
+	}
+
+	map = test_map(fd);
+	ofono_status_page_read(map, &copy);
+	g_assert_cmpuint(copy.magic, == ,OFONO_STATUS_PAGE_MAGIC);
+	g_assert_cmpuint(copy.version, == ,OFONO_STATUS_PAGE_VERSION);
+	g_assert_cmpuint(copy.size, == ,sizeof(copy));
+	g_assert_cmpuint(copy.seq, == ,0);
+	g_assert_cmpint(copy.strength, == ,-1);
+	g_assert_cmpint(copy.registration, == ,
+				NETWORK_REGISTRATION_STATUS_UNKNOWN);
+	g_assert_cmpint(copy.technology, == ,-1);
+	g_assert(!copy.attached);
+	g_assert(!copy.active_contexts);
+
+	__ofono_status_page_update_netreg(page,
+				NETWORK_REGISTRATION_STATUS_REGISTERED,
+				ACCESS_TECHNOLOGY_EUTRAN, 60);
+	__ofono_status_page_update_gprs(page, 42, 2,
+				(1 << OFONO_GPRS_CONTEXT_TYPE_INTERNET) |
+				(1 << OFONO_GPRS_CONTEXT_TYPE_MMS));
+	ofono_status_page_read(map, &copy);
+	g_assert_cmpuint(copy.seq, == ,4);
+	g_assert_cmpint(copy.strength, == ,60);
+	g_assert_cmpint(copy.registration, == ,
+				NETWORK_REGISTRATION_STATUS_REGISTERED);
+	g_assert_cmpint(copy.technology, == ,ACCESS_TECHNOLOGY_EUTRAN);
+	g_assert_cmpuint(copy.attached, == ,1);
+	g_assert_cmpuint(copy.active_contexts, == ,2);
+	g_assert_cmpuint(copy.active_types, == ,
+				(1 << OFONO_GPRS_CONTEXT_TYPE_INTERNET) |
+				(1 << OFONO_GPRS_CONTEXT_TYPE_MMS));
+
+	/* Nothing changes, nothing is written */
+	__ofono_status_page_update_netreg(page,
+				NETWORK_REGISTRATION_STATUS_REGISTERED,
+				ACCESS_TECHNOLOGY_EUTRAN, 60);
+	__ofono_status_page_update_gprs(page, TRUE, 2,
+				(1 << OFONO_GPRS_CONTEXT_TYPE_INTERNET) |
+				(1 << OFONO_GPRS_CONTEXT_TYPE_MMS));
+	ofono_status_page_read(map, &copy);
+	g_assert_cmpuint(copy.seq, == ,4);
+
+	/* The mapping outlives the page */
+	__ofono_status_page_free(page);
+	ofono_status_page_read(map, &copy);
+	g_assert_cmpint(copy.strength, == ,60);
+	test_unmap(map);
+}
+
+static void test_bench(void)
+{
+	const volatile struct ofono_status_page *map;
+	struct ofono_status_page copy;
+	struct status_page *page;
+	gdouble elapsed;
+	int i;
+
+	__ofono_status_page_set_enabled(TRUE);
+	page = __ofono_status_page_new("test");
+	g_assert(page);
+	map = test_map(__ofono_status_page_get_fd(page));
+
+	g_test_timer_start();
+
+	for (i = 0; i < TEST_UPDATES; i++) {
+		__ofono_status_page_update_netreg(page,
+				NETWORK_REGISTRATION_STATUS_REGISTERED,
+				ACCESS_TECHNOLOGY_EUTRAN, i % 101);
+		ofono_status_page_read(map, &copy);
+		g_assert_cmpint(copy.strength, == ,i % 101);
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_message("%d updates and reads in %.3f sec", TEST_UPDATES,
+								elapsed);
+
+	test_unmap(map);
+	__ofono_status_page_free(page);
+}
+
+#define TEST_(name) "/status-page/" name
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	__ofono_log_init("test-status-page",
+				g_test_verbose() ? "*" : NULL,
+				FALSE, FALSE);
+
+	g_test_add_func(TEST_("disabled"), test_disabled);
+	g_test_add_func(TEST_("basic"), test_basic);
+	g_test_add_func(TEST_("bench"), test_bench);
+
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -0,0 +1,220 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "ofono.h"
+#include "storage.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#define TEST_IMSI	"244120000000000"
+#define TEST_STORE	"test"
+#define TEST_GROUP	"Settings"
+#define TEST_KEY	"Value"
+#define TEST_PATH	STORAGEDIR "/" TEST_IMSI "/" TEST_STORE
+#define TEST_SYNCS	100
+
+static void test_cleanup(void)
+{
+	remove(TEST_PATH);
+	rmdir(STORAGEDIR "/" TEST_IMSI);
+	rmdir(STORAGEDIR);
+}
+
+static int test_file_value(void)
+{
+	GKeyFile *k = g_key_file_new();
+	int value = -1;
+
+	if (g_key_file_load_from_file(k, TEST_PATH, 0, NULL))
+		value = g_key_file_get_integer(k, TEST_GROUP, TEST_KEY, NULL);
+
+	g_key_file_free(k);
+	return value;
+}
+
+static int test_open_value(void)
+{
+	GKeyFile *k = storage_open(TEST_IMSI, TEST_STORE);
+	int value = g_key_file_get_integer(k, TEST_GROUP, TEST_KEY, NULL);
+
+	g_key_file_free(k);
+	return value;
+}
+
+static gboolean test_quit(gpointer loop)
+{
+	g_main_loop_quit(loop);
+	return G_SOURCE_REMOVE;
+}
+
+static void test_run_loop(guint ms)
+{
+	GMainLoop *loop = g_main_loop_new(NULL, FALSE);
+
+	g_timeout_add(ms, test_quit, loop);
+	g_main_loop_run(loop);
+	g_main_loop_unref(loop);
+}
+
+static void test_sync(void)
+{
+	const struct ofono_storage_stats *stats = __ofono_storage_get_stats();
+	GKeyFile *k = g_key_file_new();
+	unsigned int writes = stats->writes;
+
+	test_cleanup();
+	g_key_file_set_integer(k, TEST_GROUP, TEST_KEY, 1);
+	storage_sync(TEST_IMSI, TEST_STORE, k);
+	g_assert_cmpuint(stats->writes, == ,writes + 1);
+	g_assert_cmpint(test_file_value(), == ,1);
+	g_assert_cmpint(test_open_value(), == ,1);
+
+	g_key_file_free(k);
+	__ofono_storage_cleanup();
+	test_cleanup();
+}
+
+static void test_coalesce(void)
+{
+	const struct ofono_storage_stats *stats = __ofono_storage_get_stats();
+	GKeyFile *k = g_key_file_new();
+	unsigned int writes = stats->writes;
+	int i;
+
+	test_cleanup();
+	__ofono_storage_set_delay(10);
+
+	for (i = 1; i <= TEST_SYNCS; i++) {
+		g_key_file_set_integer(k, TEST_GROUP, TEST_KEY, i);
+		storage_sync(TEST_IMSI, TEST_STORE, k);
+	}
+
+	/* Nothing is on the disk yet but the store reads back fine */
+	g_assert_cmpint(test_file_value(), == ,-1);
+	g_assert_cmpint(test_open_value(), == ,TEST_SYNCS);
+
+	test_run_loop(100);
+	__ofono_storage_flush();
+	g_assert_cmpint(test_file_value(), == ,TEST_SYNCS);
+	g_assert_cmpuint(stats->writes, == ,writes + 1);
+
+	g_key_file_free(k);
+	__ofono_storage_cleanup();
+	test_cleanup();
+}
+
+/*
+ * The window is shorter than the write. The second sync closes its
+ * window while the first write is still in flight and must not get
+ * stuck in memory once the first write is done.
+ */
+static void test_slow_write(void)
+{
+	GKeyFile *k = g_key_file_new();
+
+	test_cleanup();
+	__ofono_storage_set_delay(1);
+
+	g_key_file_set_integer(k, TEST_GROUP, TEST_KEY, 1);
+	storage_sync(TEST_IMSI, TEST_STORE, k);
+	g_usleep(10000);
+	g_main_context_iteration(NULL, FALSE);
+
+	/* The first write is in flight until the main loop reaps it */
+	g_key_file_set_integer(k, TEST_GROUP, TEST_KEY, 2);
+	storage_sync(TEST_IMSI, TEST_STORE, k);
+	g_usleep(10000);
+
+	test_run_loop(100);
+	g_assert_cmpint(test_file_value(), == ,2);
+
+	g_key_file_free(k);
+	__ofono_storage_cleanup();
+	test_cleanup();
+}
+
+static void test_flush(void)
+{
+	GKeyFile *k = g_key_file_new();
+
+	test_cleanup();
+	__ofono_storage_set_delay(60000);
+
+	g_key_file_set_integer(k, TEST_GROUP, TEST_KEY, 42);
+	storage_close(TEST_IMSI, TEST_STORE, k, TRUE);
+	g_assert_cmpint(test_file_value(), == ,-1);
+
+	/* Shutdown doesn't wait for the window to close */
+	__ofono_storage_cleanup();
+	g_assert_cmpint(test_file_value(), == ,42);
+	test_cleanup();
+}
+
+static void test_bench(void)
+{
+	const struct ofono_storage_stats *stats = __ofono_storage_get_stats();
+	GKeyFile *k = g_key_file_new();
+	guint delay;
+	int i;
+
+	for (delay = 0; delay <= 10; delay += 10) {
+		unsigned int total = stats->stall_total_us;
+
+		test_cleanup();
+		if (delay)
+			__ofono_storage_set_delay(delay);
+
+		for (i = 0; i < TEST_SYNCS; i++) {
+			g_key_file_set_integer(k, TEST_GROUP, TEST_KEY, i);
+			storage_sync(TEST_IMSI, TEST_STORE, k);
+		}
+
+		g_test_message("delay %u ms: %u syncs stalled the main loop "
+				"for %u us", delay, TEST_SYNCS,
+				stats->stall_total_us - total);
+		__ofono_storage_cleanup();
+	}
+
+	g_key_file_free(k);
+	test_cleanup();
+}
+
+#define TEST_(name) "/storage/" name
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	__ofono_log_init("test-storage",
+				g_test_verbose() ? "*" : NULL,
+				FALSE, FALSE);
+
+	g_test_add_func(TEST_("sync"), test_sync);
+	g_test_add_func(TEST_("coalesce"), test_coalesce);
+	g_test_add_func(TEST_("slow_write"), test_slow_write);
+	g_test_add_func(TEST_("flush"), test_flush);
+	g_test_add_func(TEST_("bench"), test_bench);
+
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -30,6 +30,8 @@
 
 #include "util.h"
 
+#define CBS_PAGES 8
+
 const unsigned char invalid_gsm_extended[] = {
 	0x1b, 0x15
 };
@@ -1012,6 +1014,456 @@ static void test_unicode_to_gsm(void)
 	}
 }
 
+/*
+ * Every septet of every dialect, with and without the escape, decoded,
+ * encoded back and decoded again. Also times the conversions.
+ */
+#define DIALECT_ROUNDS 1000
+
+static void test_dialects(void)
+{
+	enum gsm_dialect lang;
+	unsigned char gsm[128 * 3];
+	long gsm_len = 0;
+	gdouble decode_time = 0;
+	gdouble encode_time = 0;
+	int i;
+
+	for (i = 0; i < 128; i++)
+		if (i != 0x1b)
+			gsm[gsm_len++] = i;
+
+	for (i = 0; i < 128; i++) {
+		if (i == 0x1b)
+			continue;
+
+		gsm[gsm_len++] = 0x1b;
+		gsm[gsm_len++] = i;
+	}
+
+	for (lang = GSM_DIALECT_DEFAULT; lang <= GSM_DIALECT_URDU; lang++) {
+		long nread, nwritten;
+		unsigned char *encoded;
+		char *utf8;
+		char *decoded;
+
+		utf8 = convert_gsm_to_utf8_with_lang(gsm, gsm_len, &nread,
+							&nwritten, 0,
+							lang, lang);
+		g_assert(utf8);
+		g_assert(nread == gsm_len);
+		g_assert(nwritten == (long) strlen(utf8));
+
+		encoded = convert_utf8_to_gsm_with_lang(utf8, -1, &nread,
+							&nwritten, 0,
+							lang, lang);
+		g_assert(encoded);
+		g_assert(nread == (long) strlen(utf8));
+
+		decoded = convert_gsm_to_utf8_with_lang(encoded, nwritten,
+							NULL, NULL, 0,
+							lang, lang);
+		g_assert(decoded);
+		g_assert_cmpstr(decoded, ==, utf8);
+
+		g_free(decoded);
+		g_free(encoded);
+
+		g_test_timer_start();
+
+		for (i = 0; i < DIALECT_ROUNDS; i++)
+			g_free(convert_gsm_to_utf8_with_lang(gsm, gsm_len,
+							NULL, NULL, 0,
+							lang, lang));
+
+		decode_time += g_test_timer_elapsed();
+		g_test_timer_start();
+
+		for (i = 0; i < DIALECT_ROUNDS; i++)
+			g_free(convert_utf8_to_gsm_with_lang(utf8, -1,
+							NULL, NULL, 0,
+							lang, lang));
+
+		encode_time += g_test_timer_elapsed();
+		g_free(utf8);
+	}
+
+	if (g_test_verbose())
+		g_print("%d rounds over %d dialects: decode %.3f sec, "
+				"encode %.3f sec\n", DIALECT_ROUNDS,
+				GSM_DIALECT_URDU + 1, decode_time,
+				encode_time);
+}
+
+static void test_analyze(void)
+{
+	struct utf8_gsm_analysis analysis;
+	enum gsm_dialect locking, single;
+	unsigned char *gsm;
+	long nwritten;
+
+	/* "ş€" */
+	g_assert(analyze_utf8_for_gsm("\xc5\x9f\xe2\x82\xac", -1,
+					GSM_DIALECT_TURKISH, &analysis));
+	g_assert(analysis.ucs2_len == 4);
+	g_assert(analysis.n_candidates == 3);
+	g_assert(analysis.candidates[0].septets == -1);
+	g_assert(analysis.candidates[1].locking == GSM_DIALECT_DEFAULT);
+	g_assert(analysis.candidates[1].single == GSM_DIALECT_TURKISH);
+	g_assert(analysis.candidates[1].septets == 4);
+	g_assert(analysis.candidates[2].locking == GSM_DIALECT_TURKISH);
+	g_assert(analysis.candidates[2].septets == 2);
+
+	/* Spanish never uses its own locking shift table */
+	g_assert(analyze_utf8_for_gsm("abc", -1, GSM_DIALECT_SPANISH,
+								&analysis));
+	g_assert(analysis.n_candidates == 2);
+	g_assert(analysis.candidates[0].septets == 3);
+	g_assert(analysis.ucs2_len == 6);
+
+	g_assert(!analyze_utf8_for_gsm("\xc5", -1, GSM_DIALECT_DEFAULT,
+								&analysis));
+
+	/* The first dialects that do the job are still the ones used */
+	gsm = convert_utf8_to_gsm_best_lang("\xc5\x9f", -1, NULL, &nwritten,
+						0, GSM_DIALECT_TURKISH,
+						&locking, &single);
+	g_assert(gsm);
+	g_assert(nwritten == 2);
+	g_assert(locking == GSM_DIALECT_DEFAULT);
+	g_assert(single == GSM_DIALECT_TURKISH);
+	g_free(gsm);
+}
+
+/*
+ * The octet at a time codecs util.c used to have, the word at a time
+ * ones must give exactly the same results.
+ */
+static unsigned char *ref_unpack_7bit(const unsigned char *in, long len,
+					int byte_offset, bool ussd,
+					long max_to_unpack, long *items_written,
+					unsigned char terminator,
+					unsigned char *buf)
+{
+	unsigned char rest = 0;
+	unsigned char *out = buf;
+	int bits = 7 - (byte_offset % 7);
+	long i;
+
+	if (len <= 0)
+		return NULL;
+
+	if (ussd == true)
+		max_to_unpack = len * 8 / 7;
+
+	for (i = 0; (i < len) && ((out-buf) < max_to_unpack); i++) {
+		*out = (in[i] & ((1 << bits) - 1)) << (7 - bits);
+		*out |= rest;
+		rest = (in[i] >> bits) & ((1 << (8-bits)) - 1);
+
+		if (i != 0 || bits == 7)
+			out++;
+
+		if ((out-buf) == max_to_unpack)
+			break;
+
+		if (bits == 1) {
+			*out = rest;
+			out++;
+			bits = 7;
+			rest = 0;
+		} else {
+			bits = bits - 1;
+		}
+	}
+
+	if (ussd && (((out - buf) % 8) == 0) && (*(out - 1) == '\r'))
+		out = out - 1;
+
+	if (terminator)
+		*out = terminator;
+
+	if (items_written)
+		*items_written = out - buf;
+
+	return buf;
+}
+
+static unsigned char *ref_pack_7bit(const unsigned char *in, long len,
+					int byte_offset, bool ussd,
+					long *items_written,
+					unsigned char *buf)
+{
+	int bits = 7 - (byte_offset % 7);
+	unsigned char *out = buf;
+	long i;
+	long total_bits;
+
+	total_bits = len * 7;
+
+	if (bits != 7) {
+		total_bits += bits;
+		bits = bits - 1;
+		*out = 0;
+	}
+
+	for (i = 0; i < len; i++) {
+		if (bits != 7) {
+			*out |= (in[i] & ((1 << (7 - bits)) - 1)) <<
+					(bits + 1);
+			out++;
+		}
+
+		if (bits != 0)
+			*out = in[i] >> (7 - bits);
+
+		if (bits == 0)
+			bits = 7;
+		else
+			bits = bits - 1;
+	}
+
+	if (ussd && ((total_bits % 8) == 1))
+		*out |= '\r' << 1;
+
+	if (bits != 7)
+		out++;
+
+	if (ussd && ((total_bits % 8) == 0) && (in[len - 1] == '\r')) {
+		*out = '\r';
+		out++;
+	}
+
+	if (items_written)
+		*items_written = out - buf;
+
+	return buf;
+}
+
+static char *ref_encode_hex(const unsigned char *in, long len, char *buf)
+{
+	static const char digits[] = "0123456789ABCDEF";
+	long i;
+
+	for (i = 0; i < len; i++) {
+		buf[i * 2] = digits[in[i] >> 4];
+		buf[i * 2 + 1] = digits[in[i] & 0xf];
+	}
+
+	buf[len * 2] = '\0';
+
+	return buf;
+}
+
+#define CODEC_MAX_LEN 200
+
+static void test_codec_unpack(GRand *rand, const unsigned char *in, long len)
+{
+	unsigned char expected[CODEC_MAX_LEN * 2];
+	unsigned char result[CODEC_MAX_LEN * 2];
+	long expected_len, result_len;
+	int offset;
+	int ussd;
+
+	for (offset = 0; offset < 14; offset++) {
+		for (ussd = 0; ussd < 2; ussd++) {
+			long max = g_rand_int_range(rand, 0, len * 8 / 7 + 2);
+
+			/* The old code looked before the buffer if it was empty */
+			if (ussd && len == 1)
+				continue;
+
+			memset(expected, 0xaa, sizeof(expected));
+			memset(result, 0xaa, sizeof(result));
+
+			ref_unpack_7bit(in, len, offset, ussd, max,
+					&expected_len, 0xff, expected);
+			unpack_7bit_own_buf(in, len, offset, ussd, max,
+					&result_len, 0xff, result);
+
+			g_assert_cmpint(result_len, ==, expected_len);
+			g_assert(!memcmp(result, expected, sizeof(result)));
+		}
+	}
+}
+
+static void test_codec_pack(const unsigned char *in, long len)
+{
+	unsigned char expected[CODEC_MAX_LEN * 2];
+	unsigned char result[CODEC_MAX_LEN * 2];
+	long expected_len, result_len;
+	int offset;
+	int ussd;
+
+	for (offset = 0; offset < 14; offset++) {
+		for (ussd = 0; ussd < 2; ussd++) {
+			memset(expected, 0x55, sizeof(expected));
+			memset(result, 0x55, sizeof(result));
+
+			ref_pack_7bit(in, len, offset, ussd, &expected_len,
+								expected);
+			pack_7bit_own_buf(in, len, offset, ussd, &result_len,
+								0, result);
+
+			g_assert_cmpint(result_len, ==, expected_len);
+			g_assert(!memcmp(result, expected, expected_len));
+		}
+	}
+}
+
+static void test_codec_hex(GRand *rand, const unsigned char *in, long len)
+{
+	char expected[CODEC_MAX_LEN * 2 + 1];
+	char hex[CODEC_MAX_LEN * 2 + 1];
+	unsigned char decoded[CODEC_MAX_LEN + 1];
+	long written;
+	long i;
+
+	ref_encode_hex(in, len, expected);
+	encode_hex_own_buf(in, len, 0, hex);
+	g_assert_cmpstr(hex, ==, expected);
+
+	/* Either case decodes */
+	for (i = 0; i < len * 2; i++)
+		if (g_rand_boolean(rand))
+			hex[i] = g_ascii_tolower(hex[i]);
+
+	g_assert(decode_hex_own_buf(hex, len * 2, &written, 0xff, decoded));
+	g_assert_cmpint(written, ==, len);
+	g_assert(!memcmp(decoded, in, len));
+	g_assert(decoded[len] == 0xff);
+
+	if (len == 0)
+		return;
+
+	/* And a single character that isn't a digit anywhere fails */
+	i = g_rand_int_range(rand, 0, len * 2);
+	hex[i] = "gG:/@`\x80 "[g_rand_int_range(rand, 0, 8)];
+	g_assert(!decode_hex_own_buf(hex, len * 2, &written, 0, decoded));
+	g_assert(!decode_hex(hex, len * 2, &written, 0));
+}
+
+static void test_codecs(void)
+{
+	GRand *rand = g_rand_new_with_seed(7);
+	unsigned char in[CODEC_MAX_LEN];
+	long len;
+	int round;
+	long i;
+
+	for (len = 0; len <= CODEC_MAX_LEN; len++) {
+		for (round = 0; round < 8; round++) {
+			for (i = 0; i < len; i++)
+				in[i] = g_rand_int_range(rand, 0, 256);
+
+			/* Every byte value, at every position */
+			if (round == 0)
+				for (i = 0; i < len; i++)
+					in[i] = i * 7 + len;
+
+			if (len > 0)
+				test_codec_unpack(rand, in, len);
+
+			test_codec_hex(rand, in, len);
+
+			if (len == 0)
+				continue;
+
+			/* Bytes with the 8th bit set take the slow path */
+			if (round < 2)
+				test_codec_pack(in, len);
+
+			for (i = 0; i < len; i++)
+				in[i] &= 0x7f;
+
+			/* Hit the <CR> padding cases */
+			if (round == 3)
+				in[len - 1] = '\r';
+
+			test_codec_pack(in, len);
+		}
+	}
+
+	g_rand_free(rand);
+}
+
+#define CODEC_ROUNDS 100000
+
+static void test_codec_bench(void)
+{
+	unsigned char septets[CBS_PAGES * 93];
+	unsigned char packed[CBS_PAGES * 82];
+	unsigned char unpacked[CBS_PAGES * 93 + 1];
+	char hex[CBS_PAGES * 82 * 2 + 1];
+	long written;
+	gdouble ref_time, time;
+	int i, page;
+
+	for (i = 0; i < (int) sizeof(septets); i++)
+		septets[i] = i % 0x7f;
+
+	/* 160 character SMS: pack and hex encode, decode and unpack */
+	g_test_timer_start();
+
+	for (i = 0; i < CODEC_ROUNDS; i++) {
+		ref_pack_7bit(septets, 160, 0, false, &written, packed);
+		ref_encode_hex(packed, written, hex);
+		decode_hex_own_buf(hex, -1, &written, 0, packed);
+		ref_unpack_7bit(packed, written, 0, false, 160, NULL, 0,
+								unpacked);
+	}
+
+	ref_time = g_test_timer_elapsed();
+	g_test_timer_start();
+
+	for (i = 0; i < CODEC_ROUNDS; i++) {
+		pack_7bit_own_buf(septets, 160, 0, false, &written, 0, packed);
+		encode_hex_own_buf(packed, written, 0, hex);
+		decode_hex_own_buf(hex, -1, &written, 0, packed);
+		unpack_7bit_own_buf(packed, written, 0, false, 160, NULL, 0,
+								unpacked);
+	}
+
+	time = g_test_timer_elapsed();
+
+	if (g_test_verbose())
+		g_print("%d rounds of a 160 character SMS: %.3f sec, "
+			"octet at a time %.3f sec\n", CODEC_ROUNDS, time,
+			ref_time);
+
+	/* 8 page CBS, decode and unpack every page */
+	for (page = 0; page < CBS_PAGES; page++)
+		pack_7bit_own_buf(septets + page * 93, 93, 0, true, NULL, 0,
+							packed + page * 82);
+
+	encode_hex_own_buf(packed, sizeof(packed), 0, hex);
+
+	g_test_timer_start();
+
+	for (i = 0; i < CODEC_ROUNDS / CBS_PAGES; i++)
+		for (page = 0; page < CBS_PAGES; page++)
+			ref_unpack_7bit(packed + page * 82, 82, 0, true, 0,
+						NULL, 0, unpacked);
+
+	ref_time = g_test_timer_elapsed();
+	g_test_timer_start();
+
+	for (i = 0; i < CODEC_ROUNDS / CBS_PAGES; i++) {
+		decode_hex_own_buf(hex, -1, NULL, 0, packed);
+
+		for (page = 0; page < CBS_PAGES; page++)
+			unpack_7bit_own_buf(packed + page * 82, 82, 0, true, 0,
+						NULL, 0, unpacked);
+	}
+
+	time = g_test_timer_elapsed();
+
+	if (g_test_verbose())
+		g_print("%d rounds of an %d page CBS: %.3f sec, "
+			"octet at a time unpacking only %.3f sec\n",
+			CODEC_ROUNDS / CBS_PAGES, CBS_PAGES, time, ref_time);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
@@ -1028,6 +1480,10 @@ int main(int argc, char **argv)
 	g_test_add_func("/testutil/SIM conversions", test_sim);
 	g_test_add_func("/testutil/Valid Unicode to GSM Conversion",
 			test_unicode_to_gsm);
+	g_test_add_func("/testutil/GSM Dialect Conversions", test_dialects);
+	g_test_add_func("/testutil/GSM Dialect Analysis", test_analyze);
+	g_test_add_func("/testutil/7bit and Hex Codecs", test_codecs);
+	g_test_add_func("/testutil/7bit and Hex Codec Bench", test_codec_bench);
 
 	return g_test_run();
 }
@@ -25,6 +25,7 @@
 
 static gboolean test_debug = FALSE;
 static GMainLoop *test_loop = NULL;
+static gboolean test_done = FALSE;
 static int test_filter_dial_count = 0;
 static int test_filter_incoming_count = 0;
 
@@ -36,6 +37,20 @@ struct ofono_voicecall {
 
 /* Code shared by all tests */
 
+static void test_quit(void)
+{
+	test_done = TRUE;
+	g_main_loop_quit(test_loop);
+}
+
+static void test_run(void)
+{
+	/* Synchronous filters may have completed the request already */
+	if (!test_done) {
+		g_main_loop_run(test_loop);
+	}
+}
+
 static gboolean test_timeout_cb(gpointer user_data)
 {
 	g_assert(FALSE);
@@ -44,7 +59,7 @@ static gboolean test_timeout_cb(gpointer user_data)
 
 static gboolean test_quit_cb(gpointer user_data)
 {
-	g_main_loop_quit(test_loop);
+	test_quit();
 	return G_SOURCE_REMOVE;
 }
 
@@ -74,14 +89,14 @@ static void test_dial_expect_continue_and_quit
 		(enum ofono_voicecall_filter_dial_result result, void *data)
 {
 	g_assert(result == OFONO_VOICECALL_FILTER_DIAL_CONTINUE);
-	g_main_loop_quit(test_loop);
+	test_quit();
 }
 
 static void test_dial_expect_block_and_quit
 		(enum ofono_voicecall_filter_dial_result result, void *data)
 {
 	g_assert(result == OFONO_VOICECALL_FILTER_DIAL_BLOCK);
-	g_main_loop_quit(test_loop);
+	test_quit();
 }
 
 static void test_dial_unexpected
@@ -101,21 +116,21 @@ static void test_incoming_expect_continue_and_quit
 	(enum ofono_voicecall_filter_incoming_result result, void *data)
 {
 	g_assert(result == OFONO_VOICECALL_FILTER_INCOMING_CONTINUE);
-	g_main_loop_quit(test_loop);
+	test_quit();
 }
 
 static void test_incoming_expect_hangup_and_quit
 	(enum ofono_voicecall_filter_incoming_result result, void *data)
 {
 	g_assert(result == OFONO_VOICECALL_FILTER_INCOMING_HANGUP);
-	g_main_loop_quit(test_loop);
+	test_quit();
 }
 
 static void test_incoming_expect_ignore_and_quit
 	(enum ofono_voicecall_filter_incoming_result result, void *data)
 {
 	g_assert(result == OFONO_VOICECALL_FILTER_INCOMING_IGNORE);
-	g_main_loop_quit(test_loop);
+	test_quit();
 }
 
 static void test_incoming_unexpected
@@ -134,6 +149,7 @@ static void test_common_init()
 {
 	test_clear_counts();
 	test_loop = g_main_loop_new(NULL, FALSE);
+	test_done = FALSE;
 	if (!test_debug) {
 		g_timeout_add_seconds(TEST_TIMEOUT_SEC, test_timeout_cb, NULL);
 	}
@@ -431,7 +447,7 @@ static void test_dial_allow(void)
 			test_dial_expect_continue_and_quit,
 			test_inc, &count);
 
-	g_main_loop_run(test_loop);
+	test_run();
 	g_assert(test_filter_dial_count == 1);
 
 	/* Count is incremented by the request destructor */
@@ -484,7 +500,7 @@ static void test_dial_allow_async(void)
 			test_dial_expect_continue_and_quit,
 			test_inc, &count);
 
-	g_main_loop_run(test_loop);
+	test_run();
 	g_assert(test_filter_dial_count == 1);
 
 	/* Count is incremented by the request destructor */
@@ -547,7 +563,7 @@ static void test_dial_block(void)
 			test_dial_expect_block_and_quit,
 			test_inc, &count);
 
-	g_main_loop_run(test_loop);
+	test_run();
 	g_assert(test_filter_dial_count == 1);
 
 	/* Count is incremented by the request destructor */
@@ -597,7 +613,7 @@ static void test_dial_block_async(void)
 			test_dial_expect_block_and_quit,
 			test_inc, &count);
 
-	g_main_loop_run(test_loop);
+	test_run();
 	g_assert(test_filter_dial_count == 1);
 
 	/* Count is incremented by the request destructor */
@@ -661,7 +677,7 @@ static void test_dial_check(void)
 			test_dial_expect_continue_and_quit,
 			test_inc, &count);
 
-	g_main_loop_run(test_loop);
+	test_run();
 	g_assert(test_filter_dial_count == 1);
 
 	/* Count is incremented by the request destructor */
@@ -721,7 +737,7 @@ static void test_incoming_allow(void)
 			test_incoming_expect_continue_and_quit,
 			test_inc, &count);
 
-	g_main_loop_run(test_loop);
+	test_run();
 	g_assert(test_filter_incoming_count == 1);
 
 	/* Count is incremented by the request destructor */
@@ -760,7 +776,7 @@ static void test_incoming_hangup(void)
 			test_incoming_expect_hangup_and_quit,
 			test_inc, &count);
 
-	g_main_loop_run(test_loop);
+	test_run();
 	g_assert(test_filter_incoming_count == 1);
 
 	/* Count is incremented by the request destructor */
@@ -799,7 +815,7 @@ static void test_incoming_ignore(void)
 			test_incoming_expect_ignore_and_quit,
 			test_inc, &count);
 
-	g_main_loop_run(test_loop);
+	test_run();
 	g_assert(test_filter_incoming_count == 1);
 
 	/* Count is incremented by the request destructor */
@@ -857,7 +873,7 @@ static void test_restart(void)
 			test_inc, &count);
 
 	g_idle_add(test_restart_cb, &test);
-	g_main_loop_run(test_loop);
+	test_run();
 
 	/* Two times because of the restart */
 	g_assert(test_filter_incoming_count == 2);
@@ -949,7 +965,7 @@ static void test_cancel2(void)
 			test_inc, &count);
 
 	/* It will be cancelled before it's completed */
-	g_main_loop_run(test_loop);
+	test_run();
 	g_assert(!test_filter_dial_count);
 	g_assert(count == 1);
 	count = 0;
@@ -967,8 +983,8 @@ static unsigned int filter_dial_cancel3(struct ofono_voicecall *vc,
 {
 	DBG("");
 	g_idle_add(test_cancel_cb, vc->chain);
-	cb(OFONO_VOICECALL_FILTER_DIAL_CONTINUE, user_data);
-	return 0;
+	return filter_dial_later(cb, OFONO_VOICECALL_FILTER_DIAL_CONTINUE,
+								user_data);
 }
 
 static void test_cancel3(void)
@@ -997,7 +1013,7 @@ static void test_cancel3(void)
 			test_dial_unexpected, test_inc, &count);
 
 	/* It will be cancelled before it's completed */
-	g_main_loop_run(test_loop);
+	test_run();
 	g_assert(!test_filter_dial_count);
 	g_assert(count == 1);
 	count = 0;
@@ -1035,7 +1051,7 @@ static void test_cancel4(void)
 			test_dial_unexpected, test_inc, &count);
 
 	/* It will be cancelled before it's completed */
-	g_main_loop_run(test_loop);
+	test_run();
 	g_assert(!test_filter_dial_count);
 	g_assert(count == 1);
 	count = 0;
@@ -1089,7 +1105,7 @@ static void test_cancel5(void)
 	__ofono_voicecall_filter_chain_cancel(vc.chain, &call1);
 	__ofono_voicecall_filter_chain_cancel(vc.chain, &call1);
 
-	g_main_loop_run(test_loop);
+	test_run();
 	g_assert(test_filter_incoming_count == 2);
 
 	/* Counts are incremented by the request destructors */
@@ -1148,7 +1164,7 @@ static void test_cancel6(void)
 	__ofono_voicecall_filter_chain_cancel(vc.chain, &call2);
 	__ofono_voicecall_filter_chain_cancel(vc.chain, &call2);
 
-	g_main_loop_run(test_loop);
+	test_run();
 	g_assert(test_filter_incoming_count == 2);
 
 	/* Counts are incremented by the request destructors */
@@ -1163,6 +1179,76 @@ static void test_cancel6(void)
 	test_common_deinit();
 }
 
+/* ==== sync ==== */
+
+static void test_sync(void)
+{
+	static struct ofono_voicecall_filter sync1 = {
+		.name = "sync1",
+		.api_version = OFONO_VOICECALL_FILTER_API_VERSION,
+		.priority = OFONO_VOICECALL_FILTER_PRIORITY_HIGH,
+		.filter_dial = filter_dial_continue
+	};
+	static struct ofono_voicecall_filter sync2 = {
+		.name = "sync2",
+		.api_version = OFONO_VOICECALL_FILTER_API_VERSION,
+		.priority = OFONO_VOICECALL_FILTER_PRIORITY_DEFAULT,
+		.filter_dial = filter_dial_continue
+	};
+	static struct ofono_voicecall_filter async = {
+		.name = "async",
+		.api_version = OFONO_VOICECALL_FILTER_API_VERSION,
+		.priority = OFONO_VOICECALL_FILTER_PRIORITY_LOW,
+		.filter_dial = filter_dial_continue_later,
+		.filter_cancel = filter_cancel
+	};
+
+	struct ofono_voicecall vc;
+	struct ofono_phone_number number;
+	const struct ofono_filter_chain_stats *stats;
+	int count = 0;
+
+	test_common_init();
+	test_voicecall_init(&vc);
+	string_to_phone_number("+1234", &number);
+
+	g_assert(ofono_voicecall_filter_register(&sync1) == 0);
+	g_assert(ofono_voicecall_filter_register(&sync2) == 0);
+	g_assert((vc.chain = __ofono_voicecall_filter_chain_new(&vc)) != NULL);
+	stats = __ofono_voicecall_filter_chain_get_stats(vc.chain);
+	g_assert(stats);
+	g_assert(!__ofono_voicecall_filter_chain_get_stats(NULL));
+
+	/* Completes before __ofono_voicecall_filter_chain_dial returns */
+	__ofono_voicecall_filter_chain_dial(vc.chain, &number,
+			OFONO_CLIR_OPTION_DEFAULT,
+			test_dial_expect_continue_inc, test_inc, &count);
+	g_assert(count == 2);
+	g_assert(test_filter_dial_count == 2);
+	g_assert(stats->requests == 1);
+	g_assert(stats->inline_steps == 2);
+	g_assert(!stats->async_steps);
+
+	/* The filter which replies later gets there through the main loop */
+	g_assert(ofono_voicecall_filter_register(&async) == 0);
+	__ofono_voicecall_filter_chain_dial(vc.chain, &number,
+			OFONO_CLIR_OPTION_DEFAULT,
+			test_dial_expect_continue_and_quit, test_inc, &count);
+	g_assert(count == 2);
+	test_run();
+	g_assert(count == 3);
+	g_assert(test_filter_dial_count == 5);
+	g_assert(stats->requests == 2);
+	g_assert(stats->inline_steps == 4);
+	g_assert(stats->async_steps == 1);
+
+	__ofono_voicecall_filter_chain_free(vc.chain);
+	ofono_voicecall_filter_unregister(&sync1);
+	ofono_voicecall_filter_unregister(&sync2);
+	ofono_voicecall_filter_unregister(&async);
+	test_common_deinit();
+}
+
 #define TEST_(name) "/voicecall-filter/" name
 
 int main(int argc, char *argv[])
@@ -1197,6 +1283,7 @@ int main(int argc, char *argv[])
 	g_test_add_func(TEST_("cancel4"), test_cancel4);
 	g_test_add_func(TEST_("cancel5"), test_cancel5);
 	g_test_add_func(TEST_("cancel6"), test_cancel6);
+	g_test_add_func(TEST_("sync"), test_sync);
 
 	return g_test_run();
 }